@@ -24,10 +24,26 @@
 
 #include <cstdint>
 #include <string>
+#include <variant>
 #include <vector>
 
+#ifdef _WIN32
 // Would be nice to avoid this but it's not big like windows.h
 #include <guiddef.h>
+#else
+// Same layout as the Windows definition so records rendered elsewhere 
+// (synthetic, EVTX) carry the same GUID type.
+#ifndef GUID_DEFINED
+#define GUID_DEFINED
+struct GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+#endif
+#endif
 
 namespace Windows
 {
@@ -101,6 +117,139 @@ enum class QueryNextStatus : int
 	Timeout
 };
 
+// Where a subscription starts reading its channel.
+enum class SubscriptionStart
+{
+	// Only records written after subscribing.
+	FutureEvents,
+	// Every record already in the channel, then new ones.
+	Oldest,
+	// Records after the one a bookmark points at.
+	AfterBookmark
+};
+
+// What a subscription does with records that don't fit in its buffer.
+enum class OverflowPolicy
+{
+	// Stops reading the channel until there's room. The channel keeps the 
+	// records, so none are lost unless the log wraps first.
+	Block,
+	// Drops the oldest buffered records to make room.
+	DropOldest,
+	// Drops the records that don't fit.
+	DropNewest
+};
+
+// Fields of an event record, for rendering only the ones needed. These are
+// flags, combine them with |.
+enum class EventField : uint32_t
+{
+	None = 0,
+
+	// System properties
+	ProviderName = 1u << 0,
+	ProviderGuid = 1u << 1,
+	EventId = 1u << 2,
+	Qualifiers = 1u << 3,
+	Level = 1u << 4,
+	Task = 1u << 5,
+	Opcode = 1u << 6,
+	Keywords = 1u << 7,
+	TimeCreated = 1u << 8,
+	RecordId = 1u << 9,
+	ActivityId = 1u << 10,
+	ProcessId = 1u << 11,
+	ThreadId = 1u << 12,
+	Channel = 1u << 13,
+	Computer = 1u << 14,
+	User = 1u << 15,
+	Version = 1u << 16,
+
+	// Display strings, formatted from the publisher's metadata.
+	Message = 1u << 17,
+	LevelDisplay = 1u << 18,
+	TaskDisplay = 1u << 19,
+	OpcodeDisplay = 1u << 20,
+	KeywordsDisplay = 1u << 21,
+	ChannelMessage = 1u << 22,
+	ProviderMessage = 1u << 23,
+
+	// EventData/UserData payload.
+	Properties = 1u << 24,
+
+	System = (1u << 17) - 1,
+	Display = ((1u << 24) - 1) & ~((1u << 17) - 1),
+	All = (1u << 25) - 1
+};
+
+constexpr EventField operator|(EventField a, EventField b)
+{
+	return EventField(uint32_t(a) | uint32_t(b));
+}
+
+constexpr EventField operator&(EventField a, EventField b)
+{
+	return EventField(uint32_t(a) & uint32_t(b));
+}
+
+// True if any of fields is in set.
+constexpr bool hasAnyField(EventField set, EventField fields)
+{
+	return (set & fields) != EventField::None;
+}
+
+// Value of an EventData or UserData property. Integers are widened to 64 
+// bits; SIDs, arrays and anything else without a type here are strings.
+using EventPropertyValue = std::variant<std::monostate, std::string, int64_t, uint64_t, double, bool, GUID, Timestamp, std::vector<uint8_t>>;
+
+// Payload property of an event. The name is empty when nothing names it, 
+// e.g. classic events and UserData rendered without a template.
+struct EventProperty
+{
+	std::string name;
+	EventPropertyValue value;
+};
+
+// Counters of the cache resolving record user SIDs to account names.
+struct AccountCacheStats
+{
+	uint64_t hits = 0;
+	// Hits on SIDs that didn't resolve. Counted in hits too.
+	uint64_t negativeHits = 0;
+	uint64_t misses = 0;
+	uint64_t expirations = 0;
+	uint64_t evictions = 0;
+	size_t size = 0;
+};
+
+// Counters of the publisher metadata cache behind cacheOpenProvider.
+struct MetadataCacheStats
+{
+	uint64_t hits = 0;
+	// Misses that waited for another thread's load of the same publisher.
+	uint64_t waits = 0;
+	// Misses that loaded the publisher.
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	// Time spent loading, summed over all loads.
+	uint64_t loadNanoseconds = 0;
+	size_t size = 0;
+};
+
+// Counters of a subscription's buffer.
+struct SubscriptionStats
+{
+	// Records handed to the caller or the handler.
+	uint64_t delivered = 0;
+	// Records dropped by the overflow policy.
+	uint64_t dropped = 0;
+	// Records waiting in the buffer now, and the most there have been.
+	uint64_t buffered = 0;
+	uint64_t peakBuffered = 0;
+	// Times the reader waited for room under OverflowPolicy::Block.
+	uint64_t blocked = 0;
+};
+
 } // namespace EventLog
 
 std::string to_string(GUID g);
@@ -0,0 +1,385 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventLogQuery.h"
+
+// Coroutines need C++20. The library builds as C++17, so this is only here
+// for callers that build as C++20.
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace Windows::EventLog
+{
+
+// A record of a query batch, read straight from the batch's columns, with
+// no record object or virtual call per record. Only valid until the 
+// generator that yielded it moves on.
+class EventView
+{
+public:
+	// The columns of a batch, looked up once for all its records.
+	struct Columns
+	{
+		Columns(const IQueryBatchResult &result, const IEventBatch &batch)
+			: result(&result)
+			, batch(&batch)
+			, fields(batch.getFields())
+			, eventIds(batch.getEventIds())
+			, levels(batch.getLevels())
+			, timeCreated(batch.getTimeCreated())
+			, recordIds(batch.getRecordIds())
+			, providerNames(batch.getProviderNames())
+			, channels(batch.getChannels())
+			, computers(batch.getComputers())
+		{}
+
+		const IQueryBatchResult *result;
+		const IEventBatch *batch;
+		const EventField *fields;
+		const uint16_t *eventIds;
+		const uint8_t *levels;
+		const uint64_t *timeCreated;
+		const uint64_t *recordIds;
+		const uint32_t *providerNames;
+		const uint32_t *channels;
+		const uint32_t *computers;
+	};
+
+	EventView(const Columns &columns, uint32_t index)
+		: mColumns(&columns)
+		, mIndex(index)
+	{}
+
+	// The fields the record has.
+	EventField getFields() const { return mColumns->fields[mIndex]; }
+	uint16_t getEventId() const { return mColumns->eventIds[mIndex]; }
+	uint8_t getLevel() const { return mColumns->levels[mIndex]; }
+	// 100 nanos since January 1 1601, like Timestamp.
+	uint64_t getTimeCreated() const { return mColumns->timeCreated[mIndex]; }
+	uint64_t getRecordId() const { return mColumns->recordIds[mIndex]; }
+	std::string_view getProviderName() const { return mColumns->batch->getString(mColumns->providerNames[mIndex]); }
+	std::string_view getChannel() const { return mColumns->batch->getString(mColumns->channels[mIndex]); }
+	std::string_view getComputer() const { return mColumns->batch->getString(mColumns->computers[mIndex]); }
+
+	// The whole record, for what isn't in the columns.
+	Ref<IEventRecord> getRecord() const { return mColumns->result->getRecord(mIndex); }
+
+private:
+	const Columns *mColumns;
+	uint32_t mIndex;
+};
+
+// A coroutine yielding values to a range-for on the caller's thread, e.g.
+//     for (const EventView &event : generateEvents(*query, 64, INFINITE)) 
+//         ...
+template<typename T>
+class Generator
+{
+public:
+	struct promise_type
+	{
+		const T *mCurrent = nullptr;
+		std::exception_ptr mException{};
+
+		Generator get_return_object() { return Generator{ Handle::from_promise(*this) }; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(const T &value) noexcept
+		{
+			mCurrent = std::addressof(value);
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() { mException = std::current_exception(); }
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	class Iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+
+		Iterator() = default;
+		explicit Iterator(Handle handle) : mHandle(handle) {}
+
+		const T &operator*() const { return *mHandle.promise().mCurrent; }
+		const T *operator->() const { return mHandle.promise().mCurrent; }
+
+		Iterator &operator++()
+		{
+			resume(mHandle);
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+
+		friend bool operator==(const Iterator &it, std::default_sentinel_t) noexcept 
+		{ 
+			return !it.mHandle || it.mHandle.done(); 
+		}
+
+	private:
+		Handle mHandle{};
+	};
+
+	Generator(Generator &&rhs) noexcept : mHandle(std::exchange(rhs.mHandle, {})) {}
+	Generator &operator=(Generator &&rhs) noexcept
+	{
+		std::swap(mHandle, rhs.mHandle);
+		return *this;
+	}
+
+	~Generator()
+	{
+		if (mHandle)
+			mHandle.destroy();
+	}
+
+	// Runs to the first value. Begin once.
+	Iterator begin()
+	{
+		resume(mHandle);
+		return Iterator{ mHandle };
+	}
+
+	std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+	explicit Generator(Handle handle) : mHandle(handle) {}
+
+	// Runs to the next value, throwing whatever the coroutine threw.
+	static void resume(Handle handle)
+	{
+		handle.resume();
+		if (handle.promise().mException)
+			std::rethrow_exception(std::exchange(handle.promise().mException, nullptr));
+	}
+
+	Handle mHandle{};
+
+	Generator(const Generator &) = delete;
+	Generator &operator=(const Generator &) = delete;
+};
+
+// A coroutine yielding values to another coroutine, which awaits each:
+//     while (const EventView *event = co_await events.next())
+//         ...
+// The generator may suspend in between, e.g. on NextBatch, and whoever 
+// resumes it resumes the caller. Works from any coroutine type.
+template<typename T>
+class AsyncGenerator
+{
+public:
+	struct promise_type;
+	using Handle = std::coroutine_handle<promise_type>;
+
+	struct promise_type
+	{
+		const T *mCurrent = nullptr;
+		std::exception_ptr mException{};
+		std::coroutine_handle<> mCaller{};
+
+		// Hands the value, or the end, to the coroutine awaiting next().
+		struct ResumeCaller
+		{
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(Handle handle) noexcept { return handle.promise().mCaller; }
+			void await_resume() noexcept {}
+		};
+
+		AsyncGenerator get_return_object() { return AsyncGenerator{ Handle::from_promise(*this) }; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		ResumeCaller final_suspend() noexcept
+		{
+			mCurrent = nullptr;
+			return {};
+		}
+		ResumeCaller yield_value(const T &value) noexcept
+		{
+			mCurrent = std::addressof(value);
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() { mException = std::current_exception(); }
+	};
+
+	class Next
+	{
+	public:
+		explicit Next(Handle handle) : mHandle(handle) {}
+
+		bool await_ready() const noexcept { return mHandle.done(); }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+		{
+			mHandle.promise().mCaller = caller;
+			return mHandle;
+		}
+
+		// The next value, null at the end.
+		const T *await_resume()
+		{
+			promise_type &promise = mHandle.promise();
+			if (promise.mException)
+				std::rethrow_exception(std::exchange(promise.mException, nullptr));
+			return mHandle.done() ? nullptr : promise.mCurrent;
+		}
+
+	private:
+		Handle mHandle;
+	};
+
+	AsyncGenerator(AsyncGenerator &&rhs) noexcept : mHandle(std::exchange(rhs.mHandle, {})) {}
+	AsyncGenerator &operator=(AsyncGenerator &&rhs) noexcept
+	{
+		std::swap(mHandle, rhs.mHandle);
+		return *this;
+	}
+
+	~AsyncGenerator()
+	{
+		if (mHandle)
+			mHandle.destroy();
+	}
+
+	// Not to be awaited again until the last one has resumed the caller.
+	Next next() { return Next{ mHandle }; }
+
+private:
+	explicit AsyncGenerator(Handle handle) : mHandle(handle) {}
+
+	Handle mHandle{};
+
+	AsyncGenerator(const AsyncGenerator &) = delete;
+	AsyncGenerator &operator=(const AsyncGenerator &) = delete;
+};
+
+// Hands a coroutine that awaited a query over to the thread it carries on 
+// on, e.g. by queuing it for an event loop. It's called on the query's 
+// worker, with the same limits as a getNextBatchAsync callback.
+using Resumer = std::function<void(std::coroutine_handle<>)>;
+
+// Awaits the query's next batch through getNextBatchAsync, so the 
+// coroutine suspends instead of blocking its thread. 
+//
+// Without a resumer it carries on on the query's worker, with the same 
+// limits as the callback: no blocking calls on the query. The query can't 
+// do anything else, prefetching included, until the coroutine suspends 
+// again.
+class NextBatch
+{
+public:
+	NextBatch(IEventLogQuery &query, uint32_t batchSize, uint32_t timeout, Resumer resume = {})
+		: mQuery(query)
+		, mBatchSize(batchSize)
+		, mTimeout(timeout)
+		, mResume(std::move(resume))
+	{}
+
+	bool await_ready() const noexcept { return false; }
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// The coroutine can be running again before this returns, so 
+		// nothing of it is touched after the call. That includes this, so
+		// the callback has its own resumer.
+		mQuery.getNextBatchAsync(mBatchSize, mTimeout, 
+			[this, handle, resume = mResume](Ref<IQueryBatchResult> batch, std::exception_ptr error)
+			{
+				mResult.emplace(std::move(batch));
+				mException = error;
+				if (resume)
+					resume(handle);
+				else
+					handle.resume();
+			});
+	}
+
+	Ref<IQueryBatchResult> await_resume()
+	{
+		if (mException)
+			std::rethrow_exception(mException);
+		return std::move(*mResult);
+	}
+
+private:
+	IEventLogQuery &mQuery;
+	uint32_t mBatchSize;
+	uint32_t mTimeout;
+	Resumer mResume;
+	std::optional<Ref<IQueryBatchResult>> mResult{};
+	std::exception_ptr mException{};
+};
+
+// Every record of the query, batchSize at a time, until a batch comes back
+// empty: the end of the query or, for a live one, the timeout. Only the 
+// fields the query renders are filled in, see setFields. The query must 
+// outlive the generator.
+inline Generator<EventView> generateEvents(IEventLogQuery &query, uint32_t batchSize, uint32_t timeout)
+{
+	for (;;)
+	{
+		Ref<IQueryBatchResult> result = query.getNextBatch(batchSize, timeout);
+		if (result->getStatus() != QueryNextStatus::Success || result->getCount() == 0)
+			co_return;
+
+		Ref<IEventBatch> batch = result->getEventBatch();
+		EventView::Columns columns(result.get(), batch.get());
+		for (uint32_t i = 0; i < batch->getCount(); ++i)
+			co_yield EventView(columns, i);
+	}
+}
+
+// As above, awaiting each batch with NextBatch. With a resumer that carries
+// the caller on on another thread and prefetching on, the next batch is 
+// read while the caller works through this one.
+inline AsyncGenerator<EventView> generateEventsAsync(IEventLogQuery &query, uint32_t batchSize, uint32_t timeout,
+	Resumer resume = {})
+{
+	for (;;)
+	{
+		Ref<IQueryBatchResult> result = co_await NextBatch(query, batchSize, timeout, resume);
+		if (result->getStatus() != QueryNextStatus::Success || result->getCount() == 0)
+			co_return;
+
+		Ref<IEventBatch> batch = result->getEventBatch();
+		EventView::Columns columns(result.get(), batch.get());
+		for (uint32_t i = 0; i < batch->getCount(); ++i)
+			co_yield EventView(columns, i);
+	}
+}
+
+}
+
+#endif
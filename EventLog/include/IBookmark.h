@@ -0,0 +1,69 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventRecord.h"
+#include "RefObject.h"
+
+#include <optional>
+#include <string>
+
+namespace Windows::EventLog
+{
+
+// Where reading got to in each channel, to carry on from there later, e.g.
+// after a restart. Reads and writes the XML the Event Log uses for 
+// bookmarks, so it goes back and forth with EvtCreateBookmark and 
+// EvtRender:
+//     <BookmarkList>
+//       <Bookmark Channel='System' RecordId='42' IsCurrent='true'/>
+//     </BookmarkList>
+class IBookmark : public IRefObject
+{
+public:
+	// An empty bookmark.
+	static Ref<IBookmark> create();
+
+	// Throws SystemException with ERROR_INVALID_PARAMETER if the text isn't
+	// bookmark XML.
+	static Ref<IBookmark> fromXml(const std::string &xml);
+
+	virtual ~IBookmark() = default;
+
+	// Moves the bookmark to the record, like EvtUpdateBookmark. Throws 
+	// InvalidArgumentException if the record wasn't rendered with its 
+	// Channel and RecordId.
+	virtual void update(const IEventRecord &record) = 0;
+
+	virtual void update(const std::string &channel, uint64_t recordId) = 0;
+
+	// The channel of the last update. Empty if there's none.
+	virtual std::string getCurrentChannel() const = 0;
+
+	// Id of the bookmarked record in the channel, if there is one.
+	virtual std::optional<uint64_t> getRecordId(const std::string &channel) const = 0;
+
+	virtual std::string toXml() const = 0;
+};
+
+}
@@ -0,0 +1,61 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "RefObject.h"
+
+#include <functional>
+
+namespace Windows::EventLog
+{
+
+// Cancels the queries and readers it's set on, e.g. to shut down without
+// waiting out their timeouts. One token can be set on any number of them.
+// Cancelling wakes their callers, who get SystemException with 
+// ERROR_CANCELLED, interrupts fetches in progress and fails every call 
+// after. It can't be undone.
+class ICancellationToken : public IRefObject
+{
+public:
+	static Ref<ICancellationToken> create();
+
+	virtual ~ICancellationToken() = default;
+
+	// Cancels everything the token is set on. Only the first call does 
+	// anything. Called from any thread.
+	virtual void cancel() = 0;
+
+	virtual bool isCancelled() const = 0;
+
+	using Callback = std::function<void()>;
+
+	// Calls the callback on cancel, or now if already cancelled, and 
+	// returns an id to unsubscribe with. Callbacks run with the token 
+	// locked, so they should be quick and mustn't use the token.
+	virtual uint64_t subscribe(Callback callback) = 0;
+
+	// The callback isn't called once this returns.
+	virtual void unsubscribe(uint64_t id) = 0;
+};
+
+}
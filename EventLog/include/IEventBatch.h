@@ -0,0 +1,87 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "RefObject.h"
+
+#include <string_view>
+
+namespace Windows::EventLog
+{
+
+// The system fields of a query batch's records, column by column. Each 
+// field is a contiguous array with one entry per record, so a batch can be
+// scanned or filtered with a loop over the arrays, without a record object
+// per event. Strings are ids into a table of the batch's distinct strings,
+// which are stored together in one buffer. Comparing a string field means 
+// looking the string up once and comparing ids.
+//
+// A field a record doesn't have, or that wasn't rendered, has its bit clear
+// in getFields() and a zero or NoString entry in its column. The columns 
+// live as long as the batch.
+class IEventBatch : public IRefObject
+{
+public:
+	// String id of a field without a value.
+	static constexpr uint32_t NoString = ~0u;
+
+	virtual ~IEventBatch() = default;
+
+	// Returns the number of records, the length of every column.
+	virtual uint32_t getCount() const = 0;
+
+	// The system fields each record has.
+	virtual const EventField *getFields() const = 0;
+
+	virtual const uint32_t *getProviderNames() const = 0;
+	virtual const GUID *getProviderGuids() const = 0;
+	virtual const uint16_t *getEventIds() const = 0;
+	virtual const uint16_t *getQualifiers() const = 0;
+	virtual const uint8_t *getLevels() const = 0;
+	virtual const uint16_t *getTasks() const = 0;
+	virtual const uint8_t *getOpcodes() const = 0;
+	virtual const int64_t *getKeywords() const = 0;
+	// 100 nanos since January 1 1601, like Timestamp.
+	virtual const uint64_t *getTimeCreated() const = 0;
+	virtual const uint64_t *getRecordIds() const = 0;
+	virtual const GUID *getActivityIds() const = 0;
+	virtual const uint32_t *getProcessIds() const = 0;
+	virtual const uint32_t *getThreadIds() const = 0;
+	virtual const uint32_t *getChannels() const = 0;
+	virtual const uint32_t *getComputers() const = 0;
+	virtual const uint32_t *getUsers() const = 0;
+	virtual const uint8_t *getVersions() const = 0;
+
+	// Returns the number of distinct strings. Ids run from zero to this.
+	virtual uint32_t getStringCount() const = 0;
+
+	// Returns the string with the id. Empty for NoString.
+	// Throws IndexOutOfBoundsException if the id is out of range.
+	virtual std::string_view getString(uint32_t id) const = 0;
+
+	// Returns the id of the string, NoString if no record in the batch has it.
+	virtual uint32_t findString(std::string_view s) const = 0;
+};
+
+}
@@ -0,0 +1,77 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventBatch.h"
+#include "IEventRecord.h"
+
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Filter on the system fields of records: a conjunction of conditions, e.g.
+// level at most 3, event id one of a set and created in a time range. It 
+// tests single records, or selects the matching records of a whole batch 
+// at once by running over its columns with vector instructions where the 
+// CPU has them.
+//
+// A record without a field the filter tests doesn't match. Batches are 
+// narrowed down a condition at a time in the order they were added, so 
+// adding the most selective first saves work. Conditions can't be added 
+// while the filter is in use.
+class IEventFilter : public IRefObject
+{
+public:
+	// A filter without conditions, it matches everything.
+	static Ref<IEventFilter> create();
+
+	virtual ~IEventFilter() = default;
+
+	// Level in [min, max].
+	virtual void addLevelRange(uint8_t min, uint8_t max) = 0;
+
+	// Event id one of ids.
+	virtual void addEventIds(const std::vector<uint16_t> &ids) = 0;
+
+	// Created in [from, to).
+	virtual void addTimeRange(Timestamp from, Timestamp to) = 0;
+
+	// Any of the keyword bits in mask.
+	virtual void addKeywords(int64_t mask) = 0;
+
+	// Provider one of names.
+	virtual void addProviderNames(const std::vector<std::string> &names) = 0;
+
+	// Channel one of names.
+	virtual void addChannels(const std::vector<std::string> &names) = 0;
+
+	virtual bool matches(const IEventRecord &record) const = 0;
+
+	// Selects the records of the batch that match. Bit i % 64 of word i / 64
+	// of selection is set if record i matches. Returns the number selected.
+	virtual uint32_t select(const IEventBatch &batch, std::vector<uint64_t> &selection) const = 0;
+};
+
+}
@@ -22,8 +22,14 @@
 
 #pragma once
 
+#include "IBookmark.h"
+#include "ICancellationToken.h"
+#include "IEventBatch.h"
 #include "IEventRecord.h"
 
+#include <exception>
+#include <functional>
+
 namespace Windows::EventLog 
 {
 
@@ -44,6 +50,12 @@ public:
 	// Returns the record handle at the given index.
 	// Throws IndexOutOfBoundsException if index >= size. 
 	virtual Ref<IEventRecord> getRecord(uint32_t index) const = 0;
+
+	// Returns the system fields of every record as columns, for scanning 
+	// or filtering the whole batch. Builds them on each call. Sources that
+	// can fill the columns straight from their records override this, the
+	// default goes through getRecord.
+	virtual Ref<IEventBatch> getEventBatch() const;
 };
 
 // Event log query interface
@@ -66,7 +78,60 @@ public:
 
 	virtual void seek(int64_t position, SeekOption whence) = 0;
 
+	// Seeks to the record after the bookmarked one, to carry on reading 
+	// where the bookmark was last updated.
+	virtual void seek(const IBookmark &bookmark) = 0;
+
+	// Called with the batch, or with an empty batch and the exception the 
+	// call would have thrown.
+	using BatchCallback = std::function<void(Ref<IQueryBatchResult> batch, std::exception_ptr error)>;
+	using SeekCallback = std::function<void(std::exception_ptr error)>;
+
+	// As getNextBatch and seek but return at once and call back when done, 
+	// so one thread can keep calls going on many queries. The callback runs
+	// on the query's worker, in order with the other calls. It should be 
+	// quick and mustn't throw or make blocking calls on this query. Starting
+	// the next async call is fine, and so is dropping the last reference, the
+	// query then goes once the callback returns.
+	// A query holds up to 16 calls, past that other threads wait for room;
+	// calls made from a callback never wait. 
+	// Calls still queued when the query is destroyed get ERROR_CANCELLED.
+	virtual void getNextBatchAsync(uint32_t batchSize, uint32_t timeout, BatchCallback callback) = 0;
+	virtual void seekAsync(int64_t position, SeekOption whence, SeekCallback callback) = 0;
+
 	virtual void close() = 0;
+
+	// Returns the number of batches fetched ahead of the caller. Default is 
+	// zero, i.e. each batch is only fetched when asked for.
+	virtual uint32_t getPrefetchDepth() const = 0;
+
+	// Keeps up to depth batches fetched ahead on the query thread, so the 
+	// source reads while the caller works through the current batch. They 
+	// use the batch size and timeout of the last getNextBatch. Zero turns 
+	// prefetching off.
+	virtual void setPrefetchDepth(uint32_t depth) = 0;
+
+	// Returns the number of threads rendering records. Default is zero, i.e.
+	// each record is rendered by getRecord on the caller's thread.
+	virtual uint32_t getRenderThreads() const = 0;
+
+	// Renders the records of each batch on a pool of threadCount threads 
+	// as soon as it is fetched. getRecord hands them back in order, waiting 
+	// for the record if it isn't ready yet. Zero turns the pool off.
+	virtual void setRenderThreads(uint32_t threadCount) = 0;
+
+	// Returns the fields records are rendered with. Default is all of them.
+	virtual EventField getFields() const = 0;
+
+	// Renders only the given fields of records in batches fetched from now 
+	// on. Other fields may be empty.
+	virtual void setFields(EventField fields) = 0;
+
+	// Cancelling the token wakes callers waiting on the query and stops a 
+	// fetch in progress. They, and every call after, throw SystemException 
+	// with ERROR_CANCELLED, and async calls get it in their callback. 
+	// Without a token, calls wait as long as the source takes.
+	virtual void setCancellationToken(Ref<ICancellationToken> token) = 0;
 };
 
 }
\ No newline at end of file
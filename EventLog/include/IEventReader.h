@@ -23,8 +23,12 @@
 #pragma once
 
 #include "RefObject.h"
+#include "IBookmark.h"
+#include "ICancellationToken.h"
 #include "IEventRecord.h"
 
+#include <functional>
+
 namespace Windows::EventLog
 {
 // TODO: dumb name. Change to IEventLogReader
@@ -43,6 +47,16 @@ public:
 	static Ref<IEventReader> openFile(const std::string &filePath, 
 		const std::string &queryText, Direction direction);
 
+	// Opens the given .evtx file and parses it directly rather than through 
+	// the Event Log service. Works on any platform. Display strings are not 
+	// available since there's no publisher metadata to format them with.
+	static Ref<IEventReader> openEvtxFile(const std::string &filePath, Direction direction);
+
+	// As above, but display strings are formatted with the publisher 
+	// metadata catalog, e.g. one from IPublisherMetadata::saveCatalog on the
+	// machine that wrote the log.
+	static Ref<IEventReader> openEvtxFile(const std::string &filePath, const std::string &catalogPath, Direction direction);
+
 	virtual ~IEventReader() = default;
 	
 	// Returns the timeout in milliseconds for retrieving events. Default is INFINITE.
@@ -51,6 +65,53 @@ public:
 	// Set the timeout in milliseconds for retrieving events. Default is INFINITE.
 	virtual void setTimeout(uint32_t) = 0;
 
+	// Returns the number of records fetched from the query at a time. 
+	// Default is 16.
+	virtual uint32_t getBatchSize() const = 0;
+
+	// Sets a fixed batch size and turns off adaptive batching. Larger batches
+	// mean fewer round trips to the query thread, smaller ones mean records 
+	// arrive sooner. Throws InvalidArgumentException if zero.
+	virtual void setBatchSize(uint32_t) = 0;
+
+	// Lets the batch size adapt between the given limits: it doubles while 
+	// batches come back full and halves when a fetch times out. Starts from 
+	// the current batch size. Throws InvalidArgumentException if 
+	// minBatchSize is zero or greater than maxBatchSize.
+	virtual void setAdaptiveBatchSize(uint32_t minBatchSize, uint32_t maxBatchSize) = 0;
+
+	// Returns true if the batch size is adaptive.
+	virtual bool isAdaptiveBatchSize() const = 0;
+
+	// Returns the number of batches read ahead in the background. Default 
+	// is zero.
+	virtual uint32_t getPrefetchDepth() const = 0;
+
+	// Reads up to depth batches ahead on the query thread while records from
+	// the current batch are being consumed, so reading overlaps with 
+	// whatever the caller does with each record. Zero turns it off.
+	virtual void setPrefetchDepth(uint32_t) = 0;
+
+	// Returns the number of threads rendering records. Default is zero, 
+	// rendering each record on the calling thread.
+	virtual uint32_t getRenderThreads() const = 0;
+
+	// Renders records on a pool of the given number of threads. Records are
+	// still returned in order. Pair it with prefetching so whole batches 
+	// render ahead of the reader. Zero turns it off.
+	virtual void setRenderThreads(uint32_t) = 0;
+
+	// Returns the fields records are rendered with. Default is 
+	// EventField::All.
+	virtual EventField getFields() const = 0;
+
+	// Renders only the given fields of each record, e.g. 
+	//     reader->setFields(EventField::EventId | EventField::TimeCreated);
+	// Other fields may come back empty. Leaving out the display strings 
+	// skips formatting them, which is most of the cost of rendering. Applies
+	// to batches fetched after the call, so set it before reading.
+	virtual void setFields(EventField) = 0;
+
 	// Moves to the next record and returns true if there is a record, or false
 	// if the last record has been reached. e.g: 
 	//     while (reader->next()) { ... }
@@ -60,6 +121,34 @@ public:
 	virtual Ref<IEventRecord> getRecord() const = 0;
 
 	virtual void seek(int64_t position, SeekOption whence) = 0;
+
+	// Carries on from the record after the bookmarked one, e.g. one saved 
+	// by a checkpoint before a restart.
+	virtual void seek(const IBookmark &bookmark) = 0;
+
+	using CheckpointHandler = std::function<void(const IBookmark &)>;
+
+	// Keeps the bookmark at the last record the caller is done with, i.e. 
+	// the one before the current record, and passes it to the handler to 
+	// persist every recordInterval records or timeInterval milliseconds, 
+	// whichever comes first, and when the last record has been read. Zero 
+	// turns either interval off. Updating the bookmark costs next to 
+	// nothing, so the intervals only trade persisting cost against how many
+	// records are read again after a restart. Persist the caller's own 
+	// output in the handler as well for each record to be handled exactly 
+	// once. Channel and RecordId are rendered whatever the fields. A null 
+	// handler turns checkpointing off.
+	virtual void setCheckpoint(Ref<IBookmark> bookmark, uint32_t recordInterval, uint32_t timeInterval, 
+		CheckpointHandler handler) = 0;
+
+	// Marks the current record done and calls the checkpoint handler now, 
+	// e.g. before shutting down.
+	virtual void checkpoint() = 0;
+
+	// Cancelling the token makes next() return at once, throwing 
+	// SystemException with ERROR_CANCELLED, as does every call after that
+	// reads. For shutting down without waiting out the timeout.
+	virtual void setCancellationToken(Ref<ICancellationToken> token) = 0;
 };
 
 }
\ No newline at end of file
@@ -36,6 +36,9 @@ public:
 	// Empty record to avoid RefPtr(nullptr)
 	static Ref<IEventRecord> createEmpty();
 
+	// Counters of the SID to account name cache behind getUser.
+	static AccountCacheStats getAccountCacheStats();
+
 	virtual ~IEventRecord() = default;
 
 	virtual std::optional<std::string> getProviderName() const = 0;
@@ -63,6 +66,12 @@ public:
 	virtual std::vector<std::string> getKeywordsDisplay() const = 0;
 	virtual std::string getChannelMessage() const = 0;
 	virtual std::string getProviderMessage() const = 0;
+
+	// EventData or UserData properties in the order the event defines them.
+	virtual std::vector<EventProperty> getProperties() const = 0;
+
+	// Value of the named property, or nothing if the event doesn't have it.
+	virtual std::optional<EventPropertyValue> getProperty(const std::string &name) const = 0;
 };
 
 }
\ No newline at end of file
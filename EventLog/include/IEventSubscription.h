@@ -0,0 +1,95 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventLogQuery.h"
+
+#include <functional>
+#include <string>
+
+namespace Windows::EventLog
+{
+
+// Live records from a channel as they're written, the EvtSubscribe 
+// counterpart of IEventReader. A reader thread moves records from the 
+// channel into a bounded buffer in batches. They're taken out either by 
+// the caller (pull mode) or by a handler called on a thread of the 
+// subscription (push mode).
+class IEventSubscription : public IRefObject
+{
+public:
+	struct Options
+	{
+		SubscriptionStart start = SubscriptionStart::FutureEvents;
+
+		// Bookmark XML for SubscriptionStart::AfterBookmark, as EvtRender 
+		// writes it for a bookmark.
+		std::string bookmark;
+
+		// Most records read from the channel at a time.
+		uint32_t batchSize = 64;
+
+		// Most records held between the channel and the consumer.
+		uint32_t bufferSize = 4096;
+
+		OverflowPolicy overflow = OverflowPolicy::Block;
+
+		// Fields records are rendered with, see IEventReader::setFields.
+		EventField fields = EventField::All;
+	};
+
+	// Called with each batch in push mode. Batches come one at a time, in 
+	// order. An exception thrown from it ends the subscription.
+	using BatchHandler = std::function<void(Ref<IQueryBatchResult>)>;
+
+	// Subscribes to the channel in pull mode: take batches with 
+	// getNextBatch. Throws SystemException if the channel or query is 
+	// invalid, ERROR_NOT_SUPPORTED off Windows.
+	static Ref<IEventSubscription> subscribe(const std::string &channel, const std::string &query, const Options &options);
+
+	// Subscribes to the channel in push mode: batches go to handler.
+	static Ref<IEventSubscription> subscribe(const std::string &channel, const std::string &query, const Options &options, 
+		BatchHandler handler);
+
+	virtual ~IEventSubscription() = default;
+
+	// Pull mode. Returns the oldest buffered batch, waiting up to timeout 
+	// milliseconds for one. The status is Timeout if none came, NoMoreItems
+	// once closed. Rethrows whatever stopped the reader after the batches
+	// read before it. Throws InvalidStateException in push mode.
+	virtual Ref<IQueryBatchResult> getNextBatch(uint32_t timeout) = 0;
+
+	// Pull mode. Waits up to timeout milliseconds for getNextBatch to have 
+	// something to return and returns true if it has.
+	virtual bool waitForRecords(uint32_t timeout) = 0;
+
+	virtual SubscriptionStats getStats() const = 0;
+
+	// Stops reading the channel and, in push mode, waits for the handler to
+	// return. Called from the handler, it doesn't wait, and the handler 
+	// isn't called again. Buffered records are discarded. Rethrows whatever
+	// stopped the reader or the handler, if anything did.
+	virtual void close() = 0;
+};
+
+}
@@ -344,6 +344,18 @@ public:
 	// does not imply a failure to render the event. 
 	static RefPtr<IPublisherMetadata> cacheOpenProvider(const std::string &provider);
 
+	// Counters of the cache behind cacheOpenProvider.
+	static MetadataCacheStats getCacheStats();
+
+	// Records are formatted with metadata from the catalog file, for the
+	// publishers whose resource files haven't changed since it was saved. 
+	// Saves the cold start cost of reading it from every publisher. A 
+	// missing or unreadable file opens an empty catalog.
+	static void openCatalog(const std::string &path);
+
+	// Writes the opened catalog back with the publishers used since. 
+	static void saveCatalog(const std::string &path);
+
 	virtual ~IPublisherMetadata() = default;
 
 	virtual std::optional<GUID> getPublisherGuid() const = 0;
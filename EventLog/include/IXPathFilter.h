@@ -0,0 +1,70 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventBatch.h"
+#include "IEventRecord.h"
+
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Event Log XPath query evaluated here rather than by the Event Log 
+// service, so the query language works on EVTX files off Windows, on 
+// records in memory and on batches. The expression is compiled once to a
+// short program and each record is tested by running it.
+//
+// Covers what queries on the System and EventData elements use: 
+// *[System[...]] and *[EventData[...]] with and, or, not() and brackets;
+// =, !=, <, <=, > and >= between an element or attribute of System and a
+// literal; band(Keywords, mask); timediff(@SystemTime), measured from the
+// time of the call; and Data or Data[@Name='x'] compared with a value. 
+// Text compares exactly. An element or attribute on its own tests that the
+// record has it, and a comparison with a field the record doesn't have is 
+// false. Keywords are compared without the reserved top bits, like 
+// getKeywords returns them.
+class IXPathFilter : public IRefObject
+{
+public:
+	// Throws SystemException with ERROR_EVT_INVALID_QUERY if the expression
+	// uses something outside the subset.
+	static Ref<IXPathFilter> compile(const std::string &xpath);
+
+	virtual ~IXPathFilter() = default;
+
+	// The record fields the expression reads. Properties if it tests 
+	// EventData.
+	virtual EventField getFields() const = 0;
+
+	virtual bool matches(const IEventRecord &record) const = 0;
+
+	// Selects the records of the batch that match. Bit i % 64 of word i / 64
+	// of selection is set if record i matches. Returns the number selected.
+	// Throws InvalidStateException if the expression tests EventData, which
+	// batches don't have.
+	virtual uint32_t select(const IEventBatch &batch, std::vector<uint64_t> &selection) const = 0;
+};
+
+}
@@ -0,0 +1,134 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "AccountCache.h"
+
+#include "IEventRecord.h"
+
+namespace Windows::EventLog
+{
+
+AccountCache::AccountCache(Options options)
+	: mOptions(options)
+{}
+
+AccountCache &AccountCache::global()
+{
+	static AccountCache cache{};
+	return cache;
+}
+
+std::optional<std::string> AccountCache::lookup(const std::string &sid, const Resolver &resolve)
+{
+	{
+		CriticalSection::Lock lck(mLock);
+
+		auto it = mIndex.find(sid);
+		if (it != mIndex.end())
+		{
+			EntryList::iterator entry = it->second;
+			if (Clock::now() < entry->expires)
+			{
+				++mStats.hits;
+				if (!entry->account)
+					++mStats.negativeHits;
+				mEntries.splice(mEntries.begin(), mEntries, entry);
+				return entry->account;
+			}
+
+			++mStats.expirations;
+			mEntries.erase(entry);
+			mIndex.erase(it);
+		}
+		++mStats.misses;
+	}
+
+	// Don't hold everyone else up while this goes to the domain controller.
+	std::optional<std::string> account = resolve();
+
+	CriticalSection::Lock lck(mLock);
+	insertLocked(sid, account, Clock::now());
+	return account;
+}
+
+void AccountCache::insertLocked(const std::string &sid, std::optional<std::string> account, Clock::time_point now)
+{
+	if (mOptions.capacity == 0)
+		return;
+
+	Clock::time_point expires = now + (account ? mOptions.ttl : mOptions.negativeTtl);
+
+	// Another thread may have resolved it meanwhile.
+	auto it = mIndex.find(sid);
+	if (it != mIndex.end())
+	{
+		it->second->account = std::move(account);
+		it->second->expires = expires;
+		mEntries.splice(mEntries.begin(), mEntries, it->second);
+		return;
+	}
+
+	while (mEntries.size() >= mOptions.capacity)
+	{
+		mIndex.erase(mEntries.back().sid);
+		mEntries.pop_back();
+		++mStats.evictions;
+	}
+
+	mEntries.push_front({ sid, std::move(account), expires });
+	mIndex.emplace(sid, mEntries.begin());
+}
+
+void AccountCache::setOptions(Options options)
+{
+	CriticalSection::Lock lck(mLock);
+	mOptions = options;
+	while (mEntries.size() > mOptions.capacity)
+	{
+		mIndex.erase(mEntries.back().sid);
+		mEntries.pop_back();
+		++mStats.evictions;
+	}
+}
+
+AccountCacheStats AccountCache::getStats() const
+{
+	CriticalSection::Lock lck(mLock);
+	AccountCacheStats stats = mStats;
+	stats.size = mEntries.size();
+	return stats;
+}
+
+void AccountCache::clear()
+{
+	CriticalSection::Lock lck(mLock);
+	mEntries.clear();
+	mIndex.clear();
+	mStats = {};
+}
+
+AccountCacheStats IEventRecord::getAccountCacheStats()
+{
+	return AccountCache::global().getStats();
+}
+
+}
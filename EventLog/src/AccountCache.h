@@ -0,0 +1,104 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+#pragma once
+
+#include "CommonTypes.h"
+#include "SysPlatform.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace Windows::EventLog
+{
+
+// SID to "DOMAIN\user" cache for record user names. Resolving a SID can go
+// to a domain controller, while a log usually carries only a handful of 
+// distinct SIDs. 
+//
+// Bounded, least recently used entries are evicted first. Entries expire so
+// renamed or deleted accounts are eventually noticed. SIDs that don't 
+// resolve are cached too, for a shorter time, so they aren't retried for 
+// every record. Resolution happens outside the lock: two threads missing 
+// on the same SID at once both resolve it.
+class AccountCache
+{
+public:
+	struct Options
+	{
+		size_t capacity = 4096;
+		std::chrono::seconds ttl{ 600 };
+		std::chrono::seconds negativeTtl{ 60 };
+	};
+
+	// Resolves the SID to the account name, nothing if it doesn't resolve.
+	using Resolver = std::function<std::optional<std::string>()>;
+
+	AccountCache() = default;
+	explicit AccountCache(Options options);
+	~AccountCache() = default;
+
+	// The cache behind IEventRecord::getUser.
+	static AccountCache &global();
+
+	// Account name for the SID, from the cache or resolved on a miss. sid is
+	// the binary SID, it's only used as the key.
+	std::optional<std::string> lookup(const std::string &sid, const Resolver &resolve);
+
+	void setOptions(Options options);
+
+	AccountCacheStats getStats() const;
+
+	void clear();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry
+	{
+		std::string sid;
+		std::optional<std::string> account;
+		Clock::time_point expires;
+	};
+
+	using EntryList = std::list<Entry>;
+
+	void insertLocked(const std::string &sid, std::optional<std::string> account, Clock::time_point now);
+
+	mutable CriticalSection mLock{};
+	Options mOptions{};
+
+	// Most recently used first.
+	EntryList mEntries{};
+	std::unordered_map<std::string, EntryList::iterator> mIndex{};
+
+	AccountCacheStats mStats{};
+
+	AccountCache(const AccountCache &) = delete;
+	AccountCache &operator=(const AccountCache &) = delete;
+};
+
+}
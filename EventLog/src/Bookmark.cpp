@@ -0,0 +1,144 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "Bookmark.h"
+
+#include "EvtxParser.h"
+#include "XmlReader.h"
+
+#include <algorithm>
+
+namespace Windows::EventLog
+{
+
+Ref<Bookmark> Bookmark::create()
+{
+	return RefObject<Bookmark>::createRef();
+}
+
+Ref<Bookmark> Bookmark::fromXml(const std::string &xml)
+{
+	Ref<Bookmark> bookmark = create();
+	XmlReader reader(xml, ERROR_INVALID_PARAMETER);
+	XmlReader::Element element;
+	if (!reader.startElement(element) || element.name != "BookmarkList")
+		reader.fail();
+
+	// Without an IsCurrent entry, the first one.
+	size_t current = 0;
+	if (!element.empty)
+	{
+		XmlReader::Element entry;
+		while (reader.startElement(entry))
+		{
+			const std::string *channel = entry.attribute("Channel");
+			const std::string *recordId = entry.attribute("RecordId");
+			std::optional<uint64_t> id = recordId ? Evtx::parseUInt(*recordId) : std::nullopt;
+			if (entry.name != "Bookmark" || !channel || !id)
+				reader.fail();
+
+			bookmark->update(*channel, *id);
+			const std::string *isCurrent = entry.attribute("IsCurrent");
+			if (isCurrent && *isCurrent == "true")
+				current = bookmark->mCurrent;
+			if (!entry.empty)
+				reader.endElement(entry.name);
+		}
+		reader.endElement("BookmarkList");
+	}
+	bookmark->mCurrent = current;
+
+	if (!reader.atEnd())
+		reader.fail();
+	return bookmark;
+}
+
+void Bookmark::update(const IEventRecord &record)
+{
+	std::optional<std::string> channel = record.getChannel();
+	std::optional<uint64_t> recordId = record.getRecordId();
+	if (!channel || !recordId)
+	{
+		THROW(InvalidArgumentException);
+	}
+	update(*channel, *recordId);
+}
+
+void Bookmark::update(const std::string &channel, uint64_t recordId)
+{
+	if (mCurrent < mEntries.size() && mEntries[mCurrent].channel == channel)
+	{
+		mEntries[mCurrent].recordId = recordId;
+		return;
+	}
+
+	auto it = std::find_if(mEntries.begin(), mEntries.end(), [&channel](const Entry &e) { return e.channel == channel; });
+	if (it == mEntries.end())
+		it = mEntries.insert(mEntries.end(), Entry{ channel, recordId });
+	else
+		it->recordId = recordId;
+	mCurrent = size_t(it - mEntries.begin());
+}
+
+std::string Bookmark::getCurrentChannel() const
+{
+	return mCurrent < mEntries.size() ? mEntries[mCurrent].channel : std::string();
+}
+
+std::optional<uint64_t> Bookmark::getRecordId(const std::string &channel) const
+{
+	auto it = std::find_if(mEntries.begin(), mEntries.end(), [&channel](const Entry &e) { return e.channel == channel; });
+	if (it == mEntries.end())
+		return std::nullopt;
+	return it->recordId;
+}
+
+std::string Bookmark::toXml() const
+{
+	std::string xml = "<BookmarkList>\r\n";
+	for (size_t i = 0; i < mEntries.size(); ++i)
+	{
+		xml += "  <Bookmark Channel='";
+		appendEscaped(xml, mEntries[i].channel, '\'');
+		xml += "' RecordId='";
+		xml += std::to_string(mEntries[i].recordId);
+		xml += i == mCurrent ? "' IsCurrent='true'/>\r\n" : "'/>\r\n";
+	}
+	xml += "</BookmarkList>";
+	return xml;
+}
+
+//
+// IBookmark
+//
+
+Ref<IBookmark> IBookmark::create()
+{
+	return Bookmark::create();
+}
+
+Ref<IBookmark> IBookmark::fromXml(const std::string &xml)
+{
+	return Bookmark::fromXml(xml);
+}
+
+}
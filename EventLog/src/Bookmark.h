@@ -0,0 +1,67 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IBookmark.h"
+
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// The bookmark as the record id reached in each channel. Updating is a 
+// compare and a store when the record is in the same channel as the last, 
+// cheap enough to do for every record read.
+class Bookmark : public IBookmark
+{
+public:
+	friend class RefObject<Bookmark>;
+
+	static Ref<Bookmark> create();
+	static Ref<Bookmark> fromXml(const std::string &xml);
+
+	void update(const IEventRecord &record) override;
+
+	void update(const std::string &channel, uint64_t recordId) override;
+
+	std::string getCurrentChannel() const override;
+
+	std::optional<uint64_t> getRecordId(const std::string &channel) const override;
+
+	std::string toXml() const override;
+
+private:
+	Bookmark() = default;
+
+	struct Entry
+	{
+		std::string channel;
+		uint64_t recordId;
+	};
+
+	std::vector<Entry> mEntries{};
+	// Index of the entry last updated.
+	size_t mCurrent = 0;
+};
+
+}
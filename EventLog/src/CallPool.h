@@ -0,0 +1,131 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "RefObject.h"
+#include "SysPlatform.h"
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Windows
+{
+
+// Recycles ref counted call objects, e.g. the method objects posted to a 
+// query's strand. A call goes back to the pool when its last reference 
+// does, and the next acquire() constructs a new one in its memory, so once
+// the pool is warm making a call doesn't touch the heap. The pool does the
+// ref counting for T. It must outlive the calls it hands out.
+template<typename T>
+class CallPool
+{
+public:
+	CallPool() = default;
+
+	~CallPool()
+	{
+		for (void *p : mFree)
+			::operator delete(p);
+	}
+
+	template<typename ... Args>
+	RefPtr<T> acquire(Args && ... args)
+	{
+		void *p = nullptr;
+		{
+			CriticalSection::Lock lck(mLock);
+			if (!mFree.empty())
+			{
+				p = mFree.back();
+				mFree.pop_back();
+			}
+		}
+		if (!p)
+			p = ::operator new(sizeof(Node));
+
+		try
+		{
+			T *call = new (p) Node(*this, std::forward<Args>(args)...);
+			return adopt(call);
+		}
+		catch (...)
+		{
+			recycle(p);
+			throw;
+		}
+	}
+
+private:
+	class Node final : public T
+	{
+	public:
+		template<typename ... Args>
+		explicit Node(CallPool &pool, Args && ... args)
+			: T(std::forward<Args>(args)...)
+			, mPool(pool)
+		{}
+
+		void retain() const override
+		{
+			mRefCount.fetch_add(1u, std::memory_order_relaxed);
+		}
+
+		void release() const override
+		{
+			if (mRefCount.fetch_sub(1u, std::memory_order_acq_rel) == 1)
+			{
+				CallPool &pool = mPool;
+				Node *node = const_cast<Node *>(this);
+				node->~Node();
+				pool.recycle(node);
+			}
+		}
+
+	private:
+		mutable std::atomic<uint32_t> mRefCount{ 1 };
+		CallPool &mPool;
+	};
+
+	void recycle(void *p) noexcept
+	{
+		CriticalSection::Lock lck(mLock);
+		try
+		{
+			mFree.push_back(p);
+		}
+		catch (...) // Out of memory, let it go instead.
+		{
+			::operator delete(p);
+		}
+	}
+
+	CriticalSection mLock{};
+	std::vector<void *> mFree{};
+
+	CallPool(const CallPool &) = delete;
+	CallPool &operator=(const CallPool &) = delete;
+};
+
+}
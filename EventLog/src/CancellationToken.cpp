@@ -0,0 +1,88 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "CancellationToken.h"
+
+#include <algorithm>
+
+namespace Windows::EventLog
+{
+
+Ref<ICancellationToken> ICancellationToken::create()
+{
+	return CancellationToken::create();
+}
+
+Ref<CancellationToken> CancellationToken::create()
+{
+	return RefObject<CancellationToken>::createRef();
+}
+
+void CancellationToken::cancel()
+{
+	CriticalSection::Lock lck(mLock);
+	if (mCancelled.exchange(true))
+		return;
+
+	// Everyone is told, whatever one of them does.
+	for (auto &entry : mCallbacks)
+	{
+		try
+		{
+			entry.second();
+		}
+		catch (...)
+		{
+		}
+	}
+	mCallbacks.clear();
+}
+
+bool CancellationToken::isCancelled() const
+{
+	return mCancelled;
+}
+
+uint64_t CancellationToken::subscribe(Callback callback)
+{
+	CriticalSection::Lock lck(mLock);
+	if (mCancelled)
+	{
+		callback();
+		return 0;
+	}
+
+	uint64_t id = mNextId++;
+	mCallbacks.emplace_back(id, std::move(callback));
+	return id;
+}
+
+void CancellationToken::unsubscribe(uint64_t id)
+{
+	CriticalSection::Lock lck(mLock);
+	auto it = std::find_if(mCallbacks.begin(), mCallbacks.end(), 
+		[id](const auto &entry) { return entry.first == id; });
+	if (it != mCallbacks.end())
+		mCallbacks.erase(it);
+}
+
+}
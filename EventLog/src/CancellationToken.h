@@ -0,0 +1,64 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "ICancellationToken.h"
+#include "SysPlatform.h"
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+class CancellationToken : public ICancellationToken
+{
+public:
+	friend class RefObject<CancellationToken>;
+
+	static Ref<CancellationToken> create();
+
+	~CancellationToken() = default;
+
+	void cancel() override;
+	bool isCancelled() const override;
+
+	uint64_t subscribe(Callback callback) override;
+	void unsubscribe(uint64_t id) override;
+
+private:
+	CancellationToken() = default;
+
+	std::atomic<bool> mCancelled{ false };
+
+	// Held while the callbacks run.
+	CriticalSection mLock{};
+	std::vector<std::pair<uint64_t, Callback>> mCallbacks{};
+	uint64_t mNextId = 1;
+
+	CancellationToken(const CancellationToken &) = delete;
+	CancellationToken &operator=(const CancellationToken &) = delete;
+};
+
+}
@@ -0,0 +1,66 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "IEventRecord.h"
+
+namespace Windows::EventLog
+{
+
+// Null avoidance sentinel.
+class EmptyEventRecord : public IEventRecord
+{
+public:
+	static Ref<EmptyEventRecord> create() { return RefObject<EmptyEventRecord>::createRef(); }
+	std::optional<std::string> getProviderName() const override { return {}; }
+	std::optional<GUID> getProviderGuid() const override { return {}; }
+	std::optional<uint16_t> getEventId() const override { return {}; }
+	std::optional<uint16_t> getQualifers() const override { return {}; }
+	std::optional<uint8_t> getLevel() const override { return {}; }
+	std::optional<uint16_t> getTask() const override { return {}; }
+	std::optional<uint8_t> getOpcode() const override { return {}; }
+	std::optional<int64_t> getKeywords() const override { return {}; }
+	std::optional<Timestamp> getTimeCreated() const override { return {}; }
+	std::optional<uint64_t> getRecordId() const override { return {}; }
+	std::optional<GUID> getActivityId() const override { return {}; }
+	std::optional<uint32_t> getProcessId() const override { return {}; }
+	std::optional<uint32_t> getThreadId() const override { return {}; }
+	std::optional<std::string> getChannel() const override { return {}; }
+	std::optional<std::string> getComputer() const override { return {}; }
+	std::optional<std::string> getUser() const override { return {}; }
+	std::optional<uint8_t> getVersion() const override { return {}; }
+	std::string getMessage() const override { return {}; }
+	std::string getLevelDisplay() const override { return {}; }
+	std::string getTaskDisplay() const override { return {}; }
+	std::string getOpcodeDisplay() const override { return {}; }
+	std::vector<std::string> getKeywordsDisplay() const override { return {}; }
+	std::string getChannelMessage() const override { return {}; }
+	std::string getProviderMessage() const override { return {}; }
+	std::vector<EventProperty> getProperties() const override { return {}; }
+	std::optional<EventPropertyValue> getProperty(const std::string &) const override { return {}; }
+};
+
+Ref<IEventRecord> IEventRecord::createEmpty()
+{
+	return EmptyEventRecord::create();
+}
+
+}
@@ -0,0 +1,201 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EventBatch.h"
+
+#include "SysPlatform.h"
+
+#include <functional>
+
+namespace Windows::EventLog
+{
+
+//
+// IQueryBatchResult
+//
+
+Ref<IEventBatch> IQueryBatchResult::getEventBatch() const
+{
+	return EventBatch::create(*this);
+}
+
+//
+// EventBatch
+//
+
+Ref<EventBatch> EventBatch::create(uint32_t capacity)
+{
+	return RefObject<EventBatch>::createRef(capacity);
+}
+
+Ref<EventBatch> EventBatch::create(const IQueryBatchResult &batch)
+{
+	uint32_t count = batch.getCount();
+	Ref<EventBatch> columns = create(count);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Ref<IEventRecord> r = batch.getRecord(i);
+
+		// Sets the field if the record has it.
+		Record record{};
+		auto set = [&record](EventField field, auto &to, const auto &value)
+		{
+			if (value)
+			{
+				to = *value;
+				record.fields = record.fields | field;
+			}
+		};
+
+		std::optional<std::string> providerName = r->getProviderName();
+		std::optional<std::string> channel = r->getChannel();
+		std::optional<std::string> computer = r->getComputer();
+		std::optional<std::string> user = r->getUser();
+		std::optional<Timestamp> timeCreated = r->getTimeCreated();
+
+		set(EventField::ProviderName, record.providerName, providerName);
+		set(EventField::ProviderGuid, record.providerGuid, r->getProviderGuid());
+		set(EventField::EventId, record.eventId, r->getEventId());
+		set(EventField::Qualifiers, record.qualifiers, r->getQualifers());
+		set(EventField::Level, record.level, r->getLevel());
+		set(EventField::Task, record.task, r->getTask());
+		set(EventField::Opcode, record.opcode, r->getOpcode());
+		set(EventField::Keywords, record.keywords, r->getKeywords());
+		if (timeCreated)
+		{
+			record.timeCreated = timeCreated->timestamp;
+			record.fields = record.fields | EventField::TimeCreated;
+		}
+		set(EventField::RecordId, record.recordId, r->getRecordId());
+		set(EventField::ActivityId, record.activityId, r->getActivityId());
+		set(EventField::ProcessId, record.processId, r->getProcessId());
+		set(EventField::ThreadId, record.threadId, r->getThreadId());
+		set(EventField::Channel, record.channel, channel);
+		set(EventField::Computer, record.computer, computer);
+		set(EventField::User, record.user, user);
+		set(EventField::Version, record.version, r->getVersion());
+
+		columns->append(record);
+	}
+	return columns;
+}
+
+EventBatch::EventBatch(uint32_t capacity)
+{
+	mFields.reserve(capacity);
+	mProviderNames.reserve(capacity);
+	mProviderGuids.reserve(capacity);
+	mEventIds.reserve(capacity);
+	mQualifiers.reserve(capacity);
+	mLevels.reserve(capacity);
+	mTasks.reserve(capacity);
+	mOpcodes.reserve(capacity);
+	mKeywords.reserve(capacity);
+	mTimeCreated.reserve(capacity);
+	mRecordIds.reserve(capacity);
+	mActivityIds.reserve(capacity);
+	mProcessIds.reserve(capacity);
+	mThreadIds.reserve(capacity);
+	mChannels.reserve(capacity);
+	mComputers.reserve(capacity);
+	mUsers.reserve(capacity);
+	mVersions.reserve(capacity);
+}
+
+void EventBatch::append(const Record &record)
+{
+	const EventField fields = record.fields & EventField::System;
+
+	// The value if the field is set, zero otherwise.
+	auto value = [fields](EventField field, auto v) -> decltype(v)
+	{
+		return hasAnyField(fields, field) ? v : decltype(v){};
+	};
+
+	auto string = [this, fields](EventField field, std::string_view s)
+	{
+		return hasAnyField(fields, field) ? intern(s) : NoString;
+	};
+
+	mFields.push_back(fields);
+	mProviderNames.push_back(string(EventField::ProviderName, record.providerName));
+	mProviderGuids.push_back(value(EventField::ProviderGuid, record.providerGuid));
+	mEventIds.push_back(value(EventField::EventId, record.eventId));
+	mQualifiers.push_back(value(EventField::Qualifiers, record.qualifiers));
+	mLevels.push_back(value(EventField::Level, record.level));
+	mTasks.push_back(value(EventField::Task, record.task));
+	mOpcodes.push_back(value(EventField::Opcode, record.opcode));
+	mKeywords.push_back(value(EventField::Keywords, record.keywords));
+	mTimeCreated.push_back(value(EventField::TimeCreated, record.timeCreated));
+	mRecordIds.push_back(value(EventField::RecordId, record.recordId));
+	mActivityIds.push_back(value(EventField::ActivityId, record.activityId));
+	mProcessIds.push_back(value(EventField::ProcessId, record.processId));
+	mThreadIds.push_back(value(EventField::ThreadId, record.threadId));
+	mChannels.push_back(string(EventField::Channel, record.channel));
+	mComputers.push_back(string(EventField::Computer, record.computer));
+	mUsers.push_back(string(EventField::User, record.user));
+	mVersions.push_back(value(EventField::Version, record.version));
+}
+
+std::string_view EventBatch::getString(uint32_t id) const
+{
+	if (id == NoString)
+	{
+		return {};
+	}
+	if (id >= mStrings.size())
+	{
+		THROW(IndexOutOfBoundsException);
+	}
+	return std::string_view(mArena).substr(mStrings[id].first, mStrings[id].second);
+}
+
+uint32_t EventBatch::findString(std::string_view s) const
+{
+	auto range = mStringIds.equal_range(std::hash<std::string_view>{}(s));
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (getString(it->second) == s)
+			return it->second;
+	}
+	return NoString;
+}
+
+uint32_t EventBatch::intern(std::string_view s)
+{
+	size_t hash = std::hash<std::string_view>{}(s);
+	auto range = mStringIds.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (getString(it->second) == s)
+			return it->second;
+	}
+
+	uint32_t id = uint32_t(mStrings.size());
+	mStrings.push_back({ uint32_t(mArena.size()), uint32_t(s.size()) });
+	mArena.append(s);
+	mStringIds.emplace(hash, id);
+	return id;
+}
+
+}
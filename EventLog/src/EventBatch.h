@@ -0,0 +1,140 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventBatch.h"
+#include "IEventLogQuery.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// IEventBatch built a record at a time by the record sources. The columns 
+// are reserved for the batch up front and strings are interned, so 
+// appending doesn't allocate per record.
+class EventBatch : public IEventBatch
+{
+public:
+	friend class RefObject<EventBatch>;
+
+	// The system fields of one record, for append. Strings only need to 
+	// live until append returns.
+	struct Record
+	{
+		EventField fields = EventField::None;
+		std::string_view providerName{};
+		GUID providerGuid{};
+		uint16_t eventId = 0;
+		uint16_t qualifiers = 0;
+		uint8_t level = 0;
+		uint16_t task = 0;
+		uint8_t opcode = 0;
+		int64_t keywords = 0;
+		uint64_t timeCreated = 0;
+		uint64_t recordId = 0;
+		GUID activityId{};
+		uint32_t processId = 0;
+		uint32_t threadId = 0;
+		std::string_view channel{};
+		std::string_view computer{};
+		std::string_view user{};
+		uint8_t version = 0;
+	};
+
+	// An empty batch with room for capacity records.
+	static Ref<EventBatch> create(uint32_t capacity);
+
+	// The batch's records copied in through getRecord. For sources that 
+	// have nothing better.
+	static Ref<EventBatch> create(const IQueryBatchResult &batch);
+
+	~EventBatch() = default;
+
+	// Adds the record's fields. Values of fields that aren't set in 
+	// record.fields are stored as zero.
+	void append(const Record &record);
+
+	uint32_t getCount() const override { return uint32_t(mFields.size()); }
+
+	const EventField *getFields() const override { return mFields.data(); }
+	const uint32_t *getProviderNames() const override { return mProviderNames.data(); }
+	const GUID *getProviderGuids() const override { return mProviderGuids.data(); }
+	const uint16_t *getEventIds() const override { return mEventIds.data(); }
+	const uint16_t *getQualifiers() const override { return mQualifiers.data(); }
+	const uint8_t *getLevels() const override { return mLevels.data(); }
+	const uint16_t *getTasks() const override { return mTasks.data(); }
+	const uint8_t *getOpcodes() const override { return mOpcodes.data(); }
+	const int64_t *getKeywords() const override { return mKeywords.data(); }
+	const uint64_t *getTimeCreated() const override { return mTimeCreated.data(); }
+	const uint64_t *getRecordIds() const override { return mRecordIds.data(); }
+	const GUID *getActivityIds() const override { return mActivityIds.data(); }
+	const uint32_t *getProcessIds() const override { return mProcessIds.data(); }
+	const uint32_t *getThreadIds() const override { return mThreadIds.data(); }
+	const uint32_t *getChannels() const override { return mChannels.data(); }
+	const uint32_t *getComputers() const override { return mComputers.data(); }
+	const uint32_t *getUsers() const override { return mUsers.data(); }
+	const uint8_t *getVersions() const override { return mVersions.data(); }
+
+	uint32_t getStringCount() const override { return uint32_t(mStrings.size()); }
+	std::string_view getString(uint32_t id) const override;
+	uint32_t findString(std::string_view s) const override;
+
+private:
+	explicit EventBatch(uint32_t capacity);
+
+	// Id of the string, adding it if it's new.
+	uint32_t intern(std::string_view s);
+
+	std::vector<EventField> mFields{};
+	std::vector<uint32_t> mProviderNames{};
+	std::vector<GUID> mProviderGuids{};
+	std::vector<uint16_t> mEventIds{};
+	std::vector<uint16_t> mQualifiers{};
+	std::vector<uint8_t> mLevels{};
+	std::vector<uint16_t> mTasks{};
+	std::vector<uint8_t> mOpcodes{};
+	std::vector<int64_t> mKeywords{};
+	std::vector<uint64_t> mTimeCreated{};
+	std::vector<uint64_t> mRecordIds{};
+	std::vector<GUID> mActivityIds{};
+	std::vector<uint32_t> mProcessIds{};
+	std::vector<uint32_t> mThreadIds{};
+	std::vector<uint32_t> mChannels{};
+	std::vector<uint32_t> mComputers{};
+	std::vector<uint32_t> mUsers{};
+	std::vector<uint8_t> mVersions{};
+
+	// Strings by id as offset and length into the arena, and ids by hash.
+	std::string mArena{};
+	std::vector<std::pair<uint32_t, uint32_t>> mStrings{};
+	std::unordered_multimap<size_t, uint32_t> mStringIds{};
+
+	EventBatch(const EventBatch &) = delete;
+	EventBatch &operator=(const EventBatch &) = delete;
+};
+
+}
@@ -0,0 +1,254 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EventFilter.h"
+
+#include <algorithm>
+#include <bitset>
+
+namespace Windows::EventLog
+{
+
+//
+// IEventFilter
+//
+
+Ref<IEventFilter> IEventFilter::create()
+{
+	return EventFilter::create();
+}
+
+//
+// EventFilter
+//
+
+Ref<EventFilter> EventFilter::create()
+{
+	return RefObject<EventFilter>::createRef();
+}
+
+void EventFilter::addLevelRange(uint8_t min, uint8_t max)
+{
+	Condition c(EventField::Level);
+	c.min = min;
+	c.max = max;
+	mEmpty |= min > max;
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::Level;
+}
+
+void EventFilter::addEventIds(const std::vector<uint16_t> &ids)
+{
+	Condition c(EventField::EventId);
+	c.ids = ids;
+	std::sort(c.ids.begin(), c.ids.end());
+	c.ids.erase(std::unique(c.ids.begin(), c.ids.end()), c.ids.end());
+	if (c.ids.size() > FilterKernels::MaxSetSize)
+	{
+		c.idTable.resize(65536 / 64);
+		for (uint16_t id : c.ids)
+			c.idTable[id / 64] |= uint64_t(1) << (id % 64);
+	}
+	mEmpty |= c.ids.empty();
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::EventId;
+}
+
+void EventFilter::addTimeRange(Timestamp from, Timestamp to)
+{
+	// Inclusive, like the kernels.
+	Condition c(EventField::TimeCreated);
+	c.min = from.timestamp;
+	c.max = to.timestamp - 1;
+	mEmpty |= to.timestamp <= from.timestamp;
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::TimeCreated;
+}
+
+void EventFilter::addKeywords(int64_t mask)
+{
+	Condition c(EventField::Keywords);
+	c.min = uint64_t(mask);
+	mEmpty |= mask == 0;
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::Keywords;
+}
+
+void EventFilter::addProviderNames(const std::vector<std::string> &names)
+{
+	Condition c(EventField::ProviderName);
+	c.names = names;
+	mEmpty |= names.empty();
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::ProviderName;
+}
+
+void EventFilter::addChannels(const std::vector<std::string> &names)
+{
+	Condition c(EventField::Channel);
+	c.names = names;
+	mEmpty |= names.empty();
+	mConditions.push_back(std::move(c));
+	mFields = mFields | EventField::Channel;
+}
+
+bool EventFilter::matches(const IEventRecord &record) const
+{
+	if (mEmpty)
+	{
+		return false;
+	}
+
+	auto named = [](const std::optional<std::string> &value, const std::vector<std::string> &names)
+	{
+		return value && std::find(names.begin(), names.end(), *value) != names.end();
+	};
+
+	for (const Condition &c : mConditions)
+	{
+		bool match = false;
+		switch (c.field)
+		{
+		case EventField::Level:
+		{
+			std::optional<uint8_t> level = record.getLevel();
+			match = level && *level >= c.min && *level <= c.max;
+			break;
+		}
+		case EventField::EventId:
+		{
+			std::optional<uint16_t> id = record.getEventId();
+			match = id && std::binary_search(c.ids.begin(), c.ids.end(), *id);
+			break;
+		}
+		case EventField::TimeCreated:
+		{
+			std::optional<Timestamp> time = record.getTimeCreated();
+			match = time && time->timestamp >= c.min && time->timestamp <= c.max;
+			break;
+		}
+		case EventField::Keywords:
+		{
+			std::optional<int64_t> keywords = record.getKeywords();
+			match = keywords && (uint64_t(*keywords) & c.min) != 0;
+			break;
+		}
+		case EventField::ProviderName:
+			match = named(record.getProviderName(), c.names);
+			break;
+		case EventField::Channel:
+			match = named(record.getChannel(), c.names);
+			break;
+		default:
+			break;
+		}
+
+		if (!match)
+			return false;
+	}
+	return true;
+}
+
+uint32_t EventFilter::select(const IEventBatch &batch, std::vector<uint64_t> &selection) const
+{
+	return select(batch, selection, FilterKernels::best());
+}
+
+uint32_t EventFilter::select(const IEventBatch &batch, std::vector<uint64_t> &selection, const FilterKernels &kernels) const
+{
+	const uint32_t count = batch.getCount();
+	const size_t words = (size_t(count) + 63) / 64;
+	if (mEmpty)
+	{
+		selection.assign(words, 0);
+		return 0;
+	}
+
+	selection.assign(words, ~uint64_t(0));
+	if (count % 64 != 0)
+		selection.back() = (uint64_t(1) << (count % 64)) - 1;
+
+	uint64_t *bits = selection.data();
+	if (mFields != EventField::None)
+		kernels.allFields(batch.getFields(), count, mFields, bits);
+
+	std::vector<uint32_t> ids;
+	for (const Condition &c : mConditions)
+	{
+		switch (c.field)
+		{
+		case EventField::Level:
+			kernels.rangeU8(batch.getLevels(), count, uint8_t(c.min), uint8_t(c.max), bits);
+			break;
+		case EventField::EventId:
+			if (c.idTable.empty())
+				kernels.inSetU16(batch.getEventIds(), count, c.ids.data(), c.ids.size(), bits);
+			else
+				kernels.inTableU16(batch.getEventIds(), count, c.idTable.data(), bits);
+			break;
+		case EventField::TimeCreated:
+			kernels.rangeU64(batch.getTimeCreated(), count, c.min, c.max, bits);
+			break;
+		case EventField::Keywords:
+			kernels.anyBits64(batch.getKeywords(), count, int64_t(c.min), bits);
+			break;
+		case EventField::ProviderName:
+		case EventField::Channel:
+		{
+			// The batch's ids of the names, the ones it has.
+			ids.clear();
+			for (const std::string &name : c.names)
+			{
+				uint32_t id = batch.findString(name);
+				if (id != IEventBatch::NoString)
+					ids.push_back(id);
+			}
+
+			const uint32_t *column = c.field == EventField::ProviderName ? batch.getProviderNames() : batch.getChannels();
+			if (ids.size() <= FilterKernels::MaxSetSize)
+			{
+				kernels.inSetU32(column, count, ids.data(), ids.size(), bits);
+			}
+			else
+			{
+				// More than the kernels take, rare enough to go record by record.
+				std::sort(ids.begin(), ids.end());
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					if (!std::binary_search(ids.begin(), ids.end(), column[i]))
+						bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+				}
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	uint32_t selected = 0;
+	for (uint64_t word : selection)
+		selected += uint32_t(std::bitset<64>(word).count());
+	return selected;
+}
+
+}
@@ -0,0 +1,86 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventFilter.h"
+#include "FilterKernels.h"
+
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+class EventFilter : public IEventFilter
+{
+public:
+	friend class RefObject<EventFilter>;
+
+	static Ref<EventFilter> create();
+
+	~EventFilter() = default;
+
+	void addLevelRange(uint8_t min, uint8_t max) override;
+	void addEventIds(const std::vector<uint16_t> &ids) override;
+	void addTimeRange(Timestamp from, Timestamp to) override;
+	void addKeywords(int64_t mask) override;
+	void addProviderNames(const std::vector<std::string> &names) override;
+	void addChannels(const std::vector<std::string> &names) override;
+
+	bool matches(const IEventRecord &record) const override;
+
+	uint32_t select(const IEventBatch &batch, std::vector<uint64_t> &selection) const override;
+
+	// select with the given kernels rather than the best ones.
+	uint32_t select(const IEventBatch &batch, std::vector<uint64_t> &selection, const FilterKernels &kernels) const;
+
+private:
+	EventFilter() = default;
+
+	// One condition. The field says which of the rest apply.
+	struct Condition
+	{
+		explicit Condition(EventField field) : field(field) {}
+
+		EventField field;
+		uint64_t min = 0;
+		uint64_t max = 0;
+		std::vector<uint16_t> ids{};
+		// Bit per event id, for more ids than the kernels compare one by one.
+		std::vector<uint64_t> idTable{};
+		std::vector<std::string> names{};
+	};
+
+	std::vector<Condition> mConditions{};
+
+	// Every field the conditions test.
+	EventField mFields = EventField::None;
+
+	// True once a condition can't match anything.
+	bool mEmpty = false;
+
+	EventFilter(const EventFilter &) = delete;
+	EventFilter &operator=(const EventFilter &) = delete;
+};
+
+}
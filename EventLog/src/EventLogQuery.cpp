@@ -22,12 +22,19 @@ misrepresented as being the original software.
 
 #include "EventLogQuery.h"
 
-#include "EventRecord.h"
-#include "EvtHandle.h"
-#include "WinSys.h"
-#include "Array.h"
+#include "CallPool.h"
+#include "ICancellationToken.h"
+#include "QueryExecutor.h"
 #include "Queues.h"
-#include "StringUtils.h"
+#include "RecordSource.h"
+#include "RenderPool.h"
+#include "SysPlatform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
 
 namespace Windows::EventLog
 { 
@@ -39,7 +46,11 @@ public:
 	~IMethod() = default;
 	virtual void process(T *)  = 0;
 	virtual void complete() = 0;
-	virtual WaitResult wait(uint32_t timeout) = 0;
+	// Returns false if the timeout expires first.
+	virtual bool wait(uint32_t timeout) = 0;
+	// Wakes the caller without the call being done, e.g. on cancel.
+	virtual void cancelWait() noexcept = 0;
+	virtual bool isDone() const noexcept = 0;
 
 	virtual void captureCurrentException() noexcept = 0;		
 	virtual void rethrowCapturedException() = 0;
@@ -48,16 +59,21 @@ public:
 
 class EventLogQueryMethodBase : public IMethod<EventLogQueryImpl>
 {
-	AutoResetEvent mComplete{FALSE};
+	Completion mComplete{};
+	std::atomic<bool> mDone{ false };
 	std::exception_ptr mException{nullptr};
 public:
 	~EventLogQueryMethodBase() = default;
 
-	WaitResult wait(uint32_t timeout) noexcept override;
+	bool wait(uint32_t timeout) noexcept override;
 	void complete() override;
+	void cancelWait() noexcept override;
+	bool isDone() const noexcept override;
 	void captureCurrentException() noexcept override;
 	bool hasCapturedException() noexcept override;
 	void rethrowCapturedException() override;
+protected:
+	std::exception_ptr getCapturedException() const noexcept;
 };
 
 class QueryChannelXPathMethod : public EventLogQueryMethodBase
@@ -68,7 +84,6 @@ class QueryChannelXPathMethod : public EventLogQueryMethodBase
 	Direction mDirection;
 public:
 	QueryChannelXPathMethod() = default;
-	static RefPtr<QueryChannelXPathMethod> create(const std::string &channel, const std::string &xpathQuery, Direction dir);
 	QueryChannelXPathMethod(const std::string &channel, const std::string &xpathQuery, Direction dir);
 	void process(EventLogQueryImpl *r) override;
 };
@@ -79,7 +94,6 @@ class QueryFileXPathMethod : public EventLogQueryMethodBase
 	std::string mXPathQuery;
 	Direction mDirection;
 public:
-	static RefPtr<QueryFileXPathMethod> create(const std::string &filePath, const std::string &xpathQuery, Direction dir);
 	QueryFileXPathMethod(const std::string &filePath, const std::string &xpathQuery, Direction dir);
 	void process(EventLogQueryImpl *r) override;
 };
@@ -89,24 +103,17 @@ class QueryStructuredXMLMethod : public EventLogQueryMethodBase
 	std::string mStructuredXML;
 	Direction mDirection;
 public:
-	static RefPtr<QueryStructuredXMLMethod> create(const std::string &structuredXML, Direction dir);
 	QueryStructuredXMLMethod(const std::string &structuredXML, Direction dir);
 	void process(EventLogQueryImpl *r) override;
 };
 
-using EvtHandleArray = Array<EVT_HANDLE, EvtHandleClose>;
-
 class GetNextBatchMethod : public EventLogQueryMethodBase
 {
+	uint32_t mBatchSize;
 	uint32_t mTimeout;
 public:
-
-	static RefPtr<GetNextBatchMethod> create(uint32_t batchSize, uint32_t timeout);
-
 	// Yes, public. 
-	EvtHandleArray Events{};
-	uint32_t BatchCount{};
-	QueryNextStatus Status{};
+	Ref<IQueryBatchResult> Result;
 
 	GetNextBatchMethod(uint32_t batchSize, uint32_t timeout);
 	void process(EventLogQueryImpl *r) override;
@@ -117,11 +124,35 @@ class SeekMethod : public EventLogQueryMethodBase
 	int64_t mPosition;
 	SeekOption mWhence;
 public:
-	static RefPtr<SeekMethod> create(int64_t position, SeekOption whence);
-
 	SeekMethod(int64_t position, SeekOption whence);
 	void process(EventLogQueryImpl *r) override;
+};
+
+// The async calls are the same calls, with the callback in place of the 
+// caller waiting.
+class GetNextBatchAsyncMethod : public GetNextBatchMethod
+{
+	IEventLogQuery::BatchCallback mCallback;
+public:
+	GetNextBatchAsyncMethod(uint32_t batchSize, uint32_t timeout, IEventLogQuery::BatchCallback callback);
+	void complete() override;
+};
 
+class SeekAsyncMethod : public SeekMethod
+{
+	IEventLogQuery::SeekCallback mCallback;
+public:
+	SeekAsyncMethod(int64_t position, SeekOption whence, IEventLogQuery::SeekCallback callback);
+	void complete() override;
+};
+
+class SeekBookmarkMethod : public EventLogQueryMethodBase
+{
+	// A copy, the caller's bookmark may change once the call returns.
+	Ref<IBookmark> mBookmark;
+public:
+	explicit SeekBookmarkMethod(const IBookmark &bookmark);
+	void process(EventLogQueryImpl *r) override;
 };
 
 class CloseMethod : public EventLogQueryMethodBase
@@ -131,39 +162,20 @@ public:
 	void process(EventLogQueryImpl *r) override;
 };
 
-//
-// QueryBatchResult 
-//
-
-class QueryBatchResult : public IQueryBatchResult
+class SetRenderThreadsMethod : public EventLogQueryMethodBase
 {
+	uint32_t mThreadCount;
 public:
-	friend RefObject<QueryBatchResult>;
-
-	static Ref<QueryBatchResult> createTimeout();
-
-	static Ref<QueryBatchResult> createNoMoreItems();
-
-	static Ref<QueryBatchResult> createSuccess(EvtHandleArray events, uint32_t count);
-
-	~QueryBatchResult();
-
-	QueryNextStatus getStatus() const override;
-	void setStatus(QueryNextStatus status);
-
-	uint32_t getCount() const override;
-
-	Ref<IEventRecord> getRecord(uint32_t index) const override;
-
-private:
-	QueryNextStatus mStatus{QueryNextStatus::Success};
-	EvtHandleArray mEvents{};
-	uint32_t mCount{0};
-
-private:
-	QueryBatchResult(QueryNextStatus status, EvtHandleArray events, uint32_t count);
-	QueryBatchResult(QueryNextStatus status);
+	explicit SetRenderThreadsMethod(uint32_t threadCount);
+	void process(EventLogQueryImpl *r) override;
+};
 
+class SetFieldsMethod : public EventLogQueryMethodBase
+{
+	EventField mFields;
+public:
+	explicit SetFieldsMethod(EventField fields);
+	void process(EventLogQueryImpl *r) override;
 };
 
 // Null avoidance sentinel
@@ -180,60 +192,6 @@ public:
 	Ref<IEventRecord> getRecord(uint32_t /* index */) const override { return IEventRecord::createEmpty(); }
 };
 
-Ref<QueryBatchResult> QueryBatchResult::createTimeout()
-{
-	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::Timeout);
-}
-
-Ref<QueryBatchResult> QueryBatchResult::createNoMoreItems()
-{
-	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::NoMoreItems);
-}
-
-Ref<QueryBatchResult> QueryBatchResult::QueryBatchResult::createSuccess(EvtHandleArray events, uint32_t count)
-{
-	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::Success, std::move(events), count);
-}
-
-QueryBatchResult::QueryBatchResult(QueryNextStatus status, EvtHandleArray events, uint32_t count)
-	: mStatus{ status }
-	, mEvents{ std::move(events) }
-	, mCount(count)
-{
-}
-
-QueryBatchResult::QueryBatchResult(QueryNextStatus status)
-	: mStatus{ status }
-{}
-
-QueryBatchResult::~QueryBatchResult()
-{}
-
-QueryNextStatus QueryBatchResult::getStatus() const 
-{
-	return mStatus;
-}
-
-void QueryBatchResult::setStatus(QueryNextStatus status)
-{
-	mStatus = status;
-}
-
-uint32_t QueryBatchResult::getCount() const 
-{
-	return mCount;
-}
-
-Ref<IEventRecord> QueryBatchResult::getRecord(uint32_t index) const 
-{
-	if (index >= mCount)
-	{
-		THROW(IndexOutOfBoundsException);
-	}
-
-	return EventRecord::create(EventRecordHandle(mEvents[index]));
-}
-
 //
 // EventLogQueryImpl
 //
@@ -246,12 +204,20 @@ public:
 	friend void QueryFileXPathMethod::process(EventLogQueryImpl *);
 	friend void QueryStructuredXMLMethod::process(EventLogQueryImpl *);
 	friend void SeekMethod::process(EventLogQueryImpl *);
+	friend void SeekBookmarkMethod::process(EventLogQueryImpl *);
 	friend void GetNextBatchMethod::process(EventLogQueryImpl *);
 	friend void CloseMethod::process(EventLogQueryImpl *);
+	friend void SetRenderThreadsMethod::process(EventLogQueryImpl *);
+	friend void SetFieldsMethod::process(EventLogQueryImpl *);
 
-	EventLogQueryImpl();
+	EventLogQueryImpl(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor);
 	~EventLogQueryImpl();
 
+	// Deletes the query. On the strand, e.g. from a callback dropping the 
+	// last reference, the strand is still using it, so it's deleted once the
+	// strand's work returns.
+	static void destroy(EventLogQueryImpl *query) noexcept;
+
 	void queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir);
 	void queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir);
 	void queryStructuredXML(const std::string &structuredXML, Direction dir);
@@ -259,35 +225,136 @@ public:
 	Ref<IQueryBatchResult> getNextBatch(uint32_t batchSize, uint32_t timeout);
 
 	void seek(int64_t position, SeekOption whence);
+	void seek(const IBookmark &bookmark);
+
+	void getNextBatchAsync(uint32_t batchSize, uint32_t timeout, IEventLogQuery::BatchCallback callback);
+	void seekAsync(int64_t position, SeekOption whence, IEventLogQuery::SeekCallback callback);
 
 	void close();
 
+	uint32_t getPrefetchDepth() const;
+	void setPrefetchDepth(uint32_t depth);
+
+	uint32_t getRenderThreads() const { return mRenderThreads; }
+	void setRenderThreads(uint32_t threadCount);
+
+	EventField getFields() const { return mFields; }
+	void setFields(EventField fields);
+
+	void setCancellationToken(Ref<ICancellationToken> token);
+
 private:
 
 	void execQueryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir);
 	void execQueryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir);
 	void execQueryStructuredXML(const std::string &structuredXML, Direction dir);
-	QueryNextStatus execGetNextBatch(EvtHandleArray &a, uint32_t timeout, uint32_t *count);
+	Ref<IQueryBatchResult> execGetNextBatch(uint32_t batchSize, uint32_t timeout);
 	void execSeek(int64_t position, SeekOption whence);
+	void execSeekBookmark(const IBookmark &bookmark);
 	SysErr execClose();
+	void execSetRenderThreads(uint32_t threadCount);
+	void execSetFields(EventField fields);
+
+	// Fetches from the source and starts rendering the batch.
+	Ref<IQueryBatchResult> fetch(uint32_t batchSize, uint32_t timeout);
+
+	// Prefetch. Called on the query's strand.
+	bool canPrefetch();
+	void prefetch();
+	void resetPrefetch(bool queryOpen);
+
+	// Caller holds mPrefetchLock.
+	bool canPrefetchLocked() const;
 
 	// Intended to be called from the dtor, so musn't throw. 
-	// Triggers and waits for thread shutdown.
+	// Waits for the strand to finish what it's doing and stops it.
 	void terminate() noexcept;
 
 private:
-	static unsigned objectMain(void *arg);
-	unsigned objectThisMain();
+	// The strand's work: the calls waiting, then a batch ahead if there's 
+	// room. Returns true if there's more to prefetch.
+	bool runStrand();
+
+	// Queues the call for the strand.
+	void post(RefPtr<IMethod<EventLogQueryImpl>> pMethod);
+
+	// Runs the call on the strand and completes it.
+	void runCall(IMethod<EventLogQueryImpl> &call);
+
+	// Waits for the call to be done, throwing what it threw, or 
+	// ERROR_CANCELLED if the token is cancelled first.
+	void waitForCall(IMethod<EventLogQueryImpl> &call);
+
+	// Called by the token, on the cancelling thread.
+	void cancel();
 
 	// All void returns handled the same way.
 
 	void enqueueVoidReturnAndWait(RefPtr<IMethod<EventLogQueryImpl> > pVoidReturnMethod);
 
 private:
-	// Order is important. The queue must exist before the thread.
-	BoundedSynchQueue< RefPtr<IMethod<EventLogQueryImpl> > > mQ;
-	Thread mThread;
-	QueryHandle mQueryHandle;
+	// Calls are recycled rather than allocated each time. The pools go after
+	// the queue, which can still hold calls when it's destroyed.
+	CallPool<QueryChannelXPathMethod> mQueryChannelXPathCalls{};
+	CallPool<QueryFileXPathMethod> mQueryFileXPathCalls{};
+	CallPool<QueryStructuredXMLMethod> mQueryStructuredXMLCalls{};
+	CallPool<GetNextBatchMethod> mGetNextBatchCalls{};
+	CallPool<SeekMethod> mSeekCalls{};
+	CallPool<SeekBookmarkMethod> mSeekBookmarkCalls{};
+	CallPool<CloseMethod> mCloseCalls{};
+	CallPool<SetRenderThreadsMethod> mSetRenderThreadsCalls{};
+	CallPool<SetFieldsMethod> mSetFieldsCalls{};
+	CallPool<GetNextBatchAsyncMethod> mGetNextBatchAsyncCalls{};
+	CallPool<SeekAsyncMethod> mSeekAsyncCalls{};
+
+	// Order is important. The queue and source must exist before the strand.
+	MpmcRingQueue< RefPtr<IMethod<EventLogQueryImpl> > > mQ;
+
+	// Calls posted by callbacks on the strand, which can't wait for room 
+	// in mQ. Only touched on the strand.
+	std::deque<RefPtr<IMethod<EventLogQueryImpl>>> mStrandCalls{};
+	// The thread running the strand, if it's running.
+	std::atomic<std::thread::id> mStrandThread{};
+
+	// Only touched on the query's strand, apart from cancel.
+	Ref<IRecordSource> mSource;
+	std::unique_ptr<RenderPool> mRenderPool{};
+
+	std::atomic<uint32_t> mRenderThreads{ 0 };
+	std::atomic<EventField> mFields{ EventField::All };
+
+	struct PrefetchedBatch
+	{
+		Ref<IQueryBatchResult> result;
+		std::exception_ptr exception;
+	};
+
+	// Batches fetched ahead of the caller, oldest first. Everything below 
+	// is shared by both threads and guarded by mPrefetchLock.
+	mutable CriticalSection mPrefetchLock{};
+	std::deque<PrefetchedBatch> mPrefetched{};
+	uint32_t mPrefetchDepth = 0;
+	// Taken from the caller's last getNextBatch.
+	uint32_t mPrefetchBatchSize = 0;
+	uint32_t mPrefetchTimeout = 0;
+	bool mQueryOpen = false;
+	// A prefetch timed out, so wait for the caller before trying again.
+	bool mPrefetchStalled = false;
+
+	// Set by terminate() so the strand stops after the call it's on.
+	std::atomic<bool> mTerminating{ false };
+	// Destroyed on the strand, which deletes the query when it's done.
+	bool mDestroyed = false;
+
+	// Once cancelled, calls fail without running and nothing is prefetched.
+	std::atomic<bool> mCancelled{ false };
+	// Guards the token and the query's subscription to it.
+	CriticalSection mCancelLock{};
+	RefPtr<ICancellationToken> mCancelToken{};
+	uint64_t mCancelSubscription = 0;
+
+	std::shared_ptr<QueryExecutor> mExecutor;
+	RefPtr<QueryStrand> mStrand;
 
 	EventLogQueryImpl(const EventLogQueryImpl &) = delete;
 	EventLogQueryImpl &operator=(const EventLogQueryImpl &) = delete;
@@ -298,16 +365,27 @@ private:
 // EventLogQueryMethodBase implementation
 //
 
-WaitResult EventLogQueryMethodBase::wait(uint32_t timeout) noexcept 
+bool EventLogQueryMethodBase::wait(uint32_t timeout) noexcept 
 {
 	return mComplete.wait(timeout);
 }
 
 void EventLogQueryMethodBase::complete() 
+{
+	mDone = true;
+	mComplete.set();
+}
+
+void EventLogQueryMethodBase::cancelWait() noexcept
 {
 	mComplete.set();
 }
 
+bool EventLogQueryMethodBase::isDone() const noexcept
+{
+	return mDone;
+}
+
 void EventLogQueryMethodBase::captureCurrentException() noexcept 
 {
 	mException = std::current_exception();
@@ -324,15 +402,15 @@ void EventLogQueryMethodBase::rethrowCapturedException()
 		std::rethrow_exception(mException);
 }
 
+std::exception_ptr EventLogQueryMethodBase::getCapturedException() const noexcept
+{
+	return mException;
+}
+
 //
 // QueryChannelXPathCall
 //
 
-RefPtr<QueryChannelXPathMethod> QueryChannelXPathMethod::create(const std::string &channel, const std::string &xpathQuery, Direction dir)
-{
-	return RefObject<QueryChannelXPathMethod>::create(channel, xpathQuery, dir);
-}
-
 QueryChannelXPathMethod::QueryChannelXPathMethod(const std::string &channel, const std::string &xpathQuery, Direction dir)
 	: mChannel(channel)
 	, mXPathQuery(xpathQuery)
@@ -348,11 +426,6 @@ void QueryChannelXPathMethod::process(EventLogQueryImpl *r)
 // QueryFileXPathCall
 //
 
-RefPtr<QueryFileXPathMethod> QueryFileXPathMethod::create(const std::string &channel, const std::string &xpathQuery, Direction dir)
-{
-	return RefObject<QueryFileXPathMethod>::create(channel, xpathQuery, dir);
-}
-
 QueryFileXPathMethod::QueryFileXPathMethod(const std::string &filePath, const std::string &xpathQuery, Direction dir)
 	: mFilePath(filePath)
 	, mXPathQuery(xpathQuery)
@@ -361,18 +434,13 @@ QueryFileXPathMethod::QueryFileXPathMethod(const std::string &filePath, const st
 
 void QueryFileXPathMethod::process(EventLogQueryImpl *r) 
 {
-	r->execQueryChannelXPath(mFilePath, mXPathQuery, mDirection);
+	r->execQueryFileXPath(mFilePath, mXPathQuery, mDirection);
 }
 
 //
 // QueryStructuredXMLCall
 //
 
-RefPtr<QueryStructuredXMLMethod> QueryStructuredXMLMethod::create(const std::string &structuredXML, Direction dir)
-{
-	return RefObject<QueryStructuredXMLMethod>::create(structuredXML, dir);
-}
-
 
 QueryStructuredXMLMethod::QueryStructuredXMLMethod(const std::string &structuredXML, Direction dir)
 	: mStructuredXML(structuredXML)
@@ -388,21 +456,15 @@ void QueryStructuredXMLMethod::process(EventLogQueryImpl *r)
 // NextCall
 //
 
-RefPtr<GetNextBatchMethod> GetNextBatchMethod::create(uint32_t batchSize, uint32_t timeout)
-{
-	return RefObject<GetNextBatchMethod>::create(batchSize, timeout);
-}
-
 GetNextBatchMethod::GetNextBatchMethod(uint32_t batchSize, uint32_t timeout)
-	: mTimeout(timeout)
-	, Events(batchSize)
-	, BatchCount(0)
-	, Status{}
+	: mBatchSize(batchSize)
+	, mTimeout(timeout)
+	, Result{ IQueryBatchResult::createEmpty() }
 {}
 
 void GetNextBatchMethod::process(EventLogQueryImpl *r) 
 {
-	Status = r->execGetNextBatch(Events, mTimeout, &BatchCount);
+	Result = r->execGetNextBatch(mBatchSize, mTimeout);
 }
 
 //
@@ -415,14 +477,35 @@ void CloseMethod::process(EventLogQueryImpl *r)
 }
 
 //
-// SeekMethod
+// SetRenderThreadsMethod
 //
 
-RefPtr<SeekMethod> SeekMethod::create(int64_t position, SeekOption whence)
+SetRenderThreadsMethod::SetRenderThreadsMethod(uint32_t threadCount)
+	: mThreadCount(threadCount)
+{}
+
+void SetRenderThreadsMethod::process(EventLogQueryImpl *r)
 {
-	return RefObject<SeekMethod>::create(position, whence);
+	r->execSetRenderThreads(mThreadCount);
 }
 
+//
+// SetFieldsMethod
+//
+
+SetFieldsMethod::SetFieldsMethod(EventField fields)
+	: mFields(fields)
+{}
+
+void SetFieldsMethod::process(EventLogQueryImpl *r)
+{
+	r->execSetFields(mFields);
+}
+
+//
+// SeekMethod
+//
+
 SeekMethod::SeekMethod(int64_t position, SeekOption whence)
 	: mPosition(position)
 	, mWhence(whence)
@@ -433,16 +516,76 @@ void SeekMethod::process(EventLogQueryImpl *r)
 	r->execSeek(mPosition, mWhence);
 }
 
+//
+// GetNextBatchAsyncMethod
+//
+
+GetNextBatchAsyncMethod::GetNextBatchAsyncMethod(uint32_t batchSize, uint32_t timeout, IEventLogQuery::BatchCallback callback)
+	: GetNextBatchMethod(batchSize, timeout)
+	, mCallback(std::move(callback))
+{}
+
+void GetNextBatchAsyncMethod::complete()
+{
+	// Moved out so whatever it holds goes now, not when the call is reused.
+	IEventLogQuery::BatchCallback callback = std::move(mCallback);
+	try
+	{
+		callback(std::move(Result), getCapturedException());
+	}
+	catch (...)
+	{
+		// Nowhere to report it on the strand.
+	}
+}
+
+//
+// SeekAsyncMethod
+//
+
+SeekAsyncMethod::SeekAsyncMethod(int64_t position, SeekOption whence, IEventLogQuery::SeekCallback callback)
+	: SeekMethod(position, whence)
+	, mCallback(std::move(callback))
+{}
+
+void SeekAsyncMethod::complete()
+{
+	IEventLogQuery::SeekCallback callback = std::move(mCallback);
+	try
+	{
+		callback(getCapturedException());
+	}
+	catch (...)
+	{
+	}
+}
+
+//
+// SeekBookmarkMethod
+//
+
+SeekBookmarkMethod::SeekBookmarkMethod(const IBookmark &bookmark)
+	: mBookmark(IBookmark::fromXml(bookmark.toXml()))
+{}
+
+void SeekBookmarkMethod::process(EventLogQueryImpl *r)
+{
+	r->execSeekBookmark(mBookmark.get());
+}
+
 //
 // EventQueryImpl
 //
 
-// 1 minute. 
-static constexpr DWORD CALL_FAILSAFE_TIMEOUT = 1000 * 60;
+// Longest a prefetch waits for new records. Keeps a live query from holding
+// a worker hostage while the caller isn't asking for anything.
+static constexpr DWORD PREFETCH_MAX_TIMEOUT = 100;
 
-EventLogQueryImpl::EventLogQueryImpl()
+EventLogQueryImpl::EventLogQueryImpl(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor)
 	: mQ{}
-	, mThread(Thread::begin(&EventLogQueryImpl::objectMain, this))
+	, mSource{ std::move(source) }
+	, mExecutor{ std::move(executor) }
+	, mStrand{ QueryStrand::create(*mExecutor, [this] { return runStrand(); }) }
 {
 }
 
@@ -451,225 +594,497 @@ EventLogQueryImpl::~EventLogQueryImpl()
 	terminate();
 }
 
-void EventLogQueryImpl::enqueueVoidReturnAndWait(RefPtr<IMethod<EventLogQueryImpl>> pMethod)
+void EventLogQueryImpl::destroy(EventLogQueryImpl *query) noexcept
 {
-	mQ.enqueue(pMethod);
+	if (query && std::this_thread::get_id() == query->mStrandThread.load())
+	{
+		query->mDestroyed = true;
+		query->mTerminating = true;
+		return;
+	}
 
-	WaitResult result = pMethod->wait(CALL_FAILSAFE_TIMEOUT);
+	delete query;
+}
 
-	WaitStatus status = result.getStatus();
-	switch (status)
+void EventLogQueryImpl::post(RefPtr<IMethod<EventLogQueryImpl>> pMethod)
+{
+	// From a callback on the strand. The strand is what empties the queue,
+	// so it mustn't wait for room.
+	if (std::this_thread::get_id() == mStrandThread.load())
 	{
-	case WaitStatus::Object_0:
+		mStrandCalls.push_back(std::move(pMethod));
+		return;
+	}
 
-		// Does nothing if no captured exception.
-		pMethod->rethrowCapturedException();
+	mQ.enqueue(std::move(pMethod));
+	mStrand->notify();
+}
 
-		break;
-	case WaitStatus::Timeout:
-		// This is the failsafe timeout. It's NOT expected so we throw.
-		THROW_(SystemException, ERROR_TIMEOUT);
+void EventLogQueryImpl::waitForCall(IMethod<EventLogQueryImpl> &call)
+{
+	RefPtr<ICancellationToken> token;
+	{
+		CriticalSection::Lock lck(mCancelLock);
+		token = mCancelToken;
+	}
 
-	case WaitStatus::Failed:
-		result.throwError(); // Does not return
+	if (token)
+	{
+		// The strand may be stuck behind other queries' fetches, so the 
+		// caller is woken directly rather than when the call is failed.
+		uint64_t subscription = token->subscribe([&call] { call.cancelWait(); });
+		call.wait(INFINITE);
+		token->unsubscribe(subscription);
+	}
+	else
+	{
+		call.wait(INFINITE);
+	}
 
-	default:
-		// TODO: Should never get here. Is doing nothing reasonable? 
-		// but it isn't easy to solve this sort of thing ... 
-		break;
+	if (!call.isDone())
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
 	}
 
+	// Does nothing if no captured exception.
+	call.rethrowCapturedException();
+}
+
+void EventLogQueryImpl::enqueueVoidReturnAndWait(RefPtr<IMethod<EventLogQueryImpl>> pMethod)
+{
+	post(pMethod);
+	waitForCall(*pMethod);
 }
 
 void EventLogQueryImpl::queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir)
 {
-	RefPtr<QueryChannelXPathMethod> pQueryChannelXPath = QueryChannelXPathMethod::create(channel, xpathQuery, dir);
+	RefPtr<QueryChannelXPathMethod> pQueryChannelXPath = mQueryChannelXPathCalls.acquire(channel, xpathQuery, dir);
 	enqueueVoidReturnAndWait(pQueryChannelXPath);
 }
 
 void EventLogQueryImpl::queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir)
 {
-	RefPtr<QueryFileXPathMethod> pQueryFileXPath = QueryFileXPathMethod::create(filePath, xpathQuery, dir);
+	RefPtr<QueryFileXPathMethod> pQueryFileXPath = mQueryFileXPathCalls.acquire(filePath, xpathQuery, dir);
 	enqueueVoidReturnAndWait(pQueryFileXPath);
 }
 
 void EventLogQueryImpl::queryStructuredXML(const std::string &structuredXML, Direction dir)
 {
-	RefPtr<QueryStructuredXMLMethod> pQuery = QueryStructuredXMLMethod::create(structuredXML, dir);
+	RefPtr<QueryStructuredXMLMethod> pQuery = mQueryStructuredXMLCalls.acquire(structuredXML, dir);
 	enqueueVoidReturnAndWait(pQuery);
 }
 
 Ref<IQueryBatchResult> EventLogQueryImpl::getNextBatch(uint32_t batchSize, uint32_t timeout)
 {
-	RefPtr<GetNextBatchMethod> pNextCall = GetNextBatchMethod::create(batchSize, timeout);
-
-	mQ.enqueue(pNextCall);
-
-	WaitResult result = pNextCall->wait(CALL_FAILSAFE_TIMEOUT);
+	// Prefetched batches don't go through the strand.
+	if (mCancelled)
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
+	}
 
-	WaitStatus status = result.getStatus();
-	switch (status)
+	std::optional<PrefetchedBatch> prefetched;
+	bool wake = false;
 	{
-	case WaitStatus::Object_0:
+		CriticalSection::Lock lck(mPrefetchLock);
+		bool couldPrefetch = canPrefetchLocked();
 
-		// Does nothing if no captured exception.
-		pNextCall->rethrowCapturedException();
+		mPrefetchBatchSize = batchSize;
+		mPrefetchTimeout = timeout;
+		mPrefetchStalled = false;
 
-		switch (pNextCall->Status)
+		if (!mPrefetched.empty())
 		{
-		case QueryNextStatus::Success:
-			return QueryBatchResult::createSuccess(std::move(pNextCall->Events), pNextCall->BatchCount);
-		case QueryNextStatus::NoMoreItems:
-			return QueryBatchResult::createNoMoreItems();
-		case QueryNextStatus::Timeout: // Specified timeout. Expected.
-			return QueryBatchResult::createTimeout();
-		default: // Never happens.
-			return QueryBatchResult::createNoMoreItems();
+			prefetched = std::move(mPrefetched.front());
+			mPrefetched.pop_front();
 		}
 
-		break; // Never get here.
-	case WaitStatus::Timeout: // Failsafe timeout. Not expected.
-		THROW_(SystemException, ERROR_TIMEOUT);
+		// The strand goes idle when it can't prefetch.
+		wake = !couldPrefetch && canPrefetchLocked();
+	}
 
-	case WaitStatus::Failed:
-		result.throwError(); // Does not return
+	if (wake)
+	{
+		mStrand->notify();
+	}
+
+	if (prefetched)
+	{
+		if (prefetched->exception)
+			std::rethrow_exception(prefetched->exception);
 
-	default: // Never happens.
-		return QueryBatchResult::createNoMoreItems();
+		return prefetched->result;
 	}
+
+	// Nothing ready, so fetch it on the query's strand and wait.
+	RefPtr<GetNextBatchMethod> pNextCall = mGetNextBatchCalls.acquire(batchSize, timeout);
+
+	post(pNextCall);
+	waitForCall(*pNextCall);
+
+	return pNextCall->Result;
 }
 
 void EventLogQueryImpl::close()
 {
-	RefPtr<CloseMethod> pCloseMethod(RefObject<CloseMethod>::create());
+	RefPtr<CloseMethod> pCloseMethod = mCloseCalls.acquire();
 	enqueueVoidReturnAndWait(pCloseMethod);
 }
 
 void EventLogQueryImpl::seek(int64_t position, SeekOption whence)
 {
-	RefPtr<SeekMethod> pSeekMethod(RefObject<SeekMethod>::create(position, whence));
+	RefPtr<SeekMethod> pSeekMethod = mSeekCalls.acquire(position, whence);
 	enqueueVoidReturnAndWait(pSeekMethod);
 }
 
-unsigned EventLogQueryImpl::objectMain(void *arg)
+void EventLogQueryImpl::seek(const IBookmark &bookmark)
 {
-	try
+	RefPtr<SeekBookmarkMethod> pMethod = mSeekBookmarkCalls.acquire(bookmark);
+	enqueueVoidReturnAndWait(pMethod);
+}
+
+void EventLogQueryImpl::getNextBatchAsync(uint32_t batchSize, uint32_t timeout, IEventLogQuery::BatchCallback callback)
+{
+	// Prefetching follows this call as it would getNextBatch. Anything 
+	// already prefetched is handed over on the strand.
 	{
-		return static_cast<EventLogQueryImpl*>(arg)->objectThisMain();
+		CriticalSection::Lock lck(mPrefetchLock);
+		mPrefetchBatchSize = batchSize;
+		mPrefetchTimeout = timeout;
+		mPrefetchStalled = false;
 	}
-	catch (...) // This is the top of thread stack, so swallow everything.
+
+	post(mGetNextBatchAsyncCalls.acquire(batchSize, timeout, std::move(callback)));
+}
+
+void EventLogQueryImpl::seekAsync(int64_t position, SeekOption whence, IEventLogQuery::SeekCallback callback)
+{
+	post(mSeekAsyncCalls.acquire(position, whence, std::move(callback)));
+}
+
+void EventLogQueryImpl::setRenderThreads(uint32_t threadCount)
+{
+	RefPtr<SetRenderThreadsMethod> pMethod = mSetRenderThreadsCalls.acquire(threadCount);
+	enqueueVoidReturnAndWait(pMethod);
+}
+
+void EventLogQueryImpl::setFields(EventField fields)
+{
+	RefPtr<SetFieldsMethod> pMethod = mSetFieldsCalls.acquire(fields);
+	enqueueVoidReturnAndWait(pMethod);
+}
+
+void EventLogQueryImpl::setCancellationToken(Ref<ICancellationToken> token)
+{
+	CriticalSection::Lock lck(mCancelLock);
+	if (mCancelToken)
 	{
-		return 1;
+		mCancelToken->unsubscribe(mCancelSubscription);
 	}
+	mCancelToken = &token.get();
+	mCancelSubscription = token->subscribe([this] { cancel(); });
+}
+
+void EventLogQueryImpl::cancel()
+{
+	mCancelled = true;
+
+	// Stops a fetch in progress, e.g. EvtNext waiting out its timeout.
+	mSource->cancel();
+
+	// Has the strand fail whatever is queued.
+	mStrand->notify();
+}
+
+uint32_t EventLogQueryImpl::getPrefetchDepth() const
+{
+	CriticalSection::Lock lck(mPrefetchLock);
+	return mPrefetchDepth;
 }
 
-unsigned EventLogQueryImpl::objectThisMain()
+void EventLogQueryImpl::setPrefetchDepth(uint32_t depth)
 {
-	bool done = false;
-	while (!done)
+	bool wake = false;
 	{
-		auto p = mQ.dequeue();
-		if (p.has_value())
-		{
-			RefPtr<IMethod<EventLogQueryImpl>> c = p.value();
-			if (c)
-			{
-				try
-				{
-					c->process(this);
-				}
-				catch (...)
-				{
-					c->captureCurrentException();
-				}
-
-				c->complete();
-			}
-			else
-			{
-				done = true;
-			}
-		}
-		else
-		{ 
-			done = true;
-		}
+		CriticalSection::Lock lck(mPrefetchLock);
+		bool couldPrefetch = canPrefetchLocked();
+		mPrefetchDepth = depth;
+		wake = !couldPrefetch && canPrefetchLocked();
 	}
 
-	return 0;
+	if (wake)
+	{
+		mStrand->notify();
+	}
 }
 
-void EventLogQueryImpl::terminate() noexcept
+void EventLogQueryImpl::runCall(IMethod<EventLogQueryImpl> &call)
 {
-	mQ.enqueue({});
-	mThread.wait(CALL_FAILSAFE_TIMEOUT);
-	// TODO: Do we care about the result?
-	// If it fails, there's nothing we can do.
+	try
+	{
+		if (mCancelled)
+		{
+			THROW_(SystemException, ERROR_CANCELLED);
+		}
+		call.process(this);
+	}
+	catch (...)
+	{
+		call.captureCurrentException();
+	}
+
+	call.complete();
 }
 
-void EventLogQueryImpl::execQueryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir)
+bool EventLogQueryImpl::runStrand()
 {
-	if (mQueryHandle)
+	mStrandThread = std::this_thread::get_id();
+
+	// Calls first, their callers are waiting. A call from each queue in 
+	// turn, so neither holds up the other.
+	while (!mTerminating)
 	{
-		SysErr err = execClose();
-		if (err.failed()) 
+		bool ran = false;
+		if (auto p = mQ.dequeue(0))
+		{
+			runCall(*p.value());
+			ran = true;
+		}
+
+		if (!mTerminating && !mStrandCalls.empty())
 		{
-			THROW_(SystemException, err.getCode());
+			RefPtr<IMethod<EventLogQueryImpl>> c = std::move(mStrandCalls.front());
+			mStrandCalls.pop_front();
+			runCall(*c);
+			ran = true;
 		}
+
+		if (!ran)
+			break;
+	}
+
+	// Dropped by a callback. Still the strand, so terminate closes it 
+	// without waiting on itself.
+	if (mDestroyed)
+	{
+		delete this;
+		return false;
 	}
-	uint32_t flags = EvtQueryChannelPath | 
-		(dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
 
-	mQueryHandle = QueryHandle::query(to_utf16(channel).c_str(), to_utf16(xpathQuery).c_str(), flags);
+	mStrandThread = std::thread::id();
+
+	// Then one batch ahead before giving the other queries a turn.
+	if (mTerminating || mCancelled || !canPrefetch())
+		return false;
+
+	prefetch();
+	return canPrefetch();
 }
 
-void EventLogQueryImpl::execQueryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir)
+void EventLogQueryImpl::terminate() noexcept
 {
-	if (mQueryHandle)
+	// No more calls from the token once this returns.
 	{
-		SysErr err = execClose();
-		if (err.failed()) 
+		CriticalSection::Lock lck(mCancelLock);
+		if (mCancelToken)
 		{
-			THROW_(SystemException, err.getCode());
+			mCancelToken->unsubscribe(mCancelSubscription);
 		}
 	}
 
-	uint32_t flags = EvtQueryFilePath | 
-		(dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
+	// Don't wait for a fetch in progress to time out.
+	mTerminating = true;
+	try
+	{
+		mSource->cancel();
+	}
+	catch (...)
+	{
+	}
+	mStrand->close();
+
+	// Only async calls can still be queued, their callbacks are told. They 
+	// may start more, which are cancelled in turn.
+	auto cancelCall = [](IMethod<EventLogQueryImpl> &call)
+	{
+		try
+		{
+			THROW_(SystemException, ERROR_CANCELLED);
+		}
+		catch (...)
+		{
+			call.captureCurrentException();
+		}
+
+		call.complete();
+	};
 
-	mQueryHandle = QueryHandle::query(to_utf16(filePath).c_str(), to_utf16(xpathQuery).c_str(), flags);
+	for (;;)
+	{
+		if (!mStrandCalls.empty())
+		{
+			RefPtr<IMethod<EventLogQueryImpl>> c = std::move(mStrandCalls.front());
+			mStrandCalls.pop_front();
+			cancelCall(*c);
+		}
+		else if (auto p = mQ.dequeue(0))
+		{
+			cancelCall(*p.value());
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+void EventLogQueryImpl::execQueryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir)
+{
+	resetPrefetch(false);
+	mSource->queryChannelXPath(channel, xpathQuery, dir);
+	resetPrefetch(true);
+}
+
+void EventLogQueryImpl::execQueryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir)
+{
+	resetPrefetch(false);
+	mSource->queryFileXPath(filePath, xpathQuery, dir);
+	resetPrefetch(true);
 }
 
 void EventLogQueryImpl::execQueryStructuredXML(const std::string &structuredXML, Direction dir)
 {
-	if (mQueryHandle)
+	resetPrefetch(false);
+	mSource->queryStructuredXML(structuredXML, dir);
+	resetPrefetch(true);
+}
+
+Ref<IQueryBatchResult> EventLogQueryImpl::execGetNextBatch(uint32_t batchSize, uint32_t timeout)
+{
+	// Anything prefetched since the caller looked comes first.
+	std::optional<PrefetchedBatch> prefetched;
 	{
-		SysErr err = execClose();
-		if (err.failed()) 
+		CriticalSection::Lock lck(mPrefetchLock);
+		if (!mPrefetched.empty())
 		{
-			THROW_(SystemException, err.getCode());
+			prefetched = std::move(mPrefetched.front());
+			mPrefetched.pop_front();
 		}
 	}
-	uint32_t flags = (dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
 
-	mQueryHandle = QueryHandle::query(nullptr, to_utf16(structuredXML).c_str(), flags);
+	if (prefetched)
+	{
+		if (prefetched->exception)
+			std::rethrow_exception(prefetched->exception);
+
+		return prefetched->result;
+	}
+
+	return fetch(batchSize, timeout);
 }
 
-QueryNextStatus EventLogQueryImpl::execGetNextBatch(EvtHandleArray &a, uint32_t timeout, uint32_t *count)
+void EventLogQueryImpl::execSeek(int64_t position, SeekOption whence)
 {
-	uint32_t size = uint32_t(a.size());
-	QueryNextStatus status = mQueryHandle.next(size, ptr(a), timeout, 0, count);
-	return status;
+	// Prefetched batches are from the old position.
+	resetPrefetch(false);
+	mSource->seek(position, whence);
+	resetPrefetch(true);
 }
 
-void EventLogQueryImpl::execSeek(int64_t position, SeekOption whence)
+void EventLogQueryImpl::execSeekBookmark(const IBookmark &bookmark)
 {
-	mQueryHandle.seek(position, whence);
+	resetPrefetch(false);
+	mSource->seek(bookmark);
+	resetPrefetch(true);
 }
 
 SysErr EventLogQueryImpl::execClose()
 {
-	return mQueryHandle.close();
+	resetPrefetch(false);
+	return mSource->close();
+}
+
+void EventLogQueryImpl::execSetRenderThreads(uint32_t threadCount)
+{
+	if (threadCount == mRenderThreads)
+		return;
+
+	// Batches already handed out are finished by the old pool before it goes.
+	mRenderPool.reset();
+	if (threadCount > 0)
+		mRenderPool = std::make_unique<RenderPool>(threadCount);
+	mRenderThreads = threadCount;
+}
+
+void EventLogQueryImpl::execSetFields(EventField fields)
+{
+	mSource->setFields(fields);
+	mFields = fields;
+}
+
+Ref<IQueryBatchResult> EventLogQueryImpl::fetch(uint32_t batchSize, uint32_t timeout)
+{
+	Ref<IQueryBatchResult> batch = mSource->next(batchSize, timeout);
+	if (mRenderPool)
+		return mRenderPool->render(std::move(batch), mFields.load() & EventField::Display);
+	return batch;
+}
+
+bool EventLogQueryImpl::canPrefetchLocked() const
+{
+	// Stop after anything but a full success: the end of the log, a timeout 
+	// or an error is for the caller to see before going any further.
+	return mQueryOpen 
+		&& !mPrefetchStalled
+		&& mPrefetchBatchSize > 0
+		&& mPrefetched.size() < mPrefetchDepth
+		&& (mPrefetched.empty() || (!mPrefetched.back().exception 
+			&& mPrefetched.back().result->getStatus() == QueryNextStatus::Success));
+}
+
+bool EventLogQueryImpl::canPrefetch()
+{
+	CriticalSection::Lock lck(mPrefetchLock);
+	return canPrefetchLocked();
+}
+
+void EventLogQueryImpl::prefetch()
+{
+	uint32_t batchSize = 0;
+	uint32_t timeout = 0;
+	{
+		CriticalSection::Lock lck(mPrefetchLock);
+		batchSize = mPrefetchBatchSize;
+		timeout = std::min<uint32_t>(mPrefetchTimeout, PREFETCH_MAX_TIMEOUT);
+	}
+
+	PrefetchedBatch batch{ IQueryBatchResult::createEmpty(), nullptr };
+	try
+	{
+		batch.result = fetch(batchSize, timeout);
+	}
+	catch (...)
+	{
+		batch.exception = std::current_exception();
+	}
+
+	CriticalSection::Lock lck(mPrefetchLock);
+	if (!batch.exception && batch.result->getStatus() == QueryNextStatus::Timeout)
+	{
+		// Nothing was consumed. Leave the caller to wait with its own timeout.
+		mPrefetchStalled = true;
+	}
+	else
+	{
+		mPrefetched.push_back(std::move(batch));
+	}
+}
+
+void EventLogQueryImpl::resetPrefetch(bool queryOpen)
+{
+	CriticalSection::Lock lck(mPrefetchLock);
+	mPrefetched.clear();
+	mPrefetchStalled = false;
+	mQueryOpen = queryOpen;
 }
 
 //
@@ -678,17 +1093,28 @@ SysErr EventLogQueryImpl::execClose()
 
 Ref<IEventLogQuery> EventLogQuery::create()
 {
-	return RefObject<EventLogQuery>::createRef();
+	return create(createDefaultRecordSource());
+}
+
+Ref<IEventLogQuery> EventLogQuery::create(Ref<IRecordSource> source)
+{
+	return create(std::move(source), QueryExecutor::getDefault());
+}
+
+Ref<IEventLogQuery> EventLogQuery::create(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor)
+{
+	return RefObject<EventLogQuery>::createRef(std::move(source), std::move(executor));
 }
 
-EventLogQuery::EventLogQuery()
-	: d_ptr{ new EventLogQueryImpl{ } }
+EventLogQuery::EventLogQuery(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor)
+	: d_ptr{ new EventLogQueryImpl{ std::move(source), std::move(executor) } }
 {
 }
 
 EventLogQuery::~EventLogQuery()
 {
-	// Nothing.
+	// The last reference can go in a callback, on the strand.
+	EventLogQueryImpl::destroy(d_ptr.release());
 }
 
 void EventLogQuery::queryChannelXPath(const std::string &channel, const std::string &queryXPath, Direction dir)
@@ -716,15 +1142,67 @@ void EventLogQuery::seek(int64_t position, SeekOption flags)
 	return d_ptr->seek(position, flags);
 }
 
+void EventLogQuery::seek(const IBookmark &bookmark)
+{
+	d_ptr->seek(bookmark);
+}
+
+void EventLogQuery::getNextBatchAsync(uint32_t batchSize, uint32_t timeout, BatchCallback callback)
+{
+	d_ptr->getNextBatchAsync(batchSize, timeout, std::move(callback));
+}
+
+void EventLogQuery::seekAsync(int64_t position, SeekOption whence, SeekCallback callback)
+{
+	d_ptr->seekAsync(position, whence, std::move(callback));
+}
+
+void EventLogQuery::setCancellationToken(Ref<ICancellationToken> token)
+{
+	d_ptr->setCancellationToken(std::move(token));
+}
+
 // Closes the query handle.
 void EventLogQuery::close() 
 {
 	d_ptr->close();
 }
 
+uint32_t EventLogQuery::getPrefetchDepth() const
+{
+	return d_ptr->getPrefetchDepth();
+}
+
+void EventLogQuery::setPrefetchDepth(uint32_t depth)
+{
+	d_ptr->setPrefetchDepth(depth);
+}
+
+uint32_t EventLogQuery::getRenderThreads() const
+{
+	return d_ptr->getRenderThreads();
+}
+
+void EventLogQuery::setRenderThreads(uint32_t threadCount)
+{
+	d_ptr->setRenderThreads(threadCount);
+}
+
+EventField EventLogQuery::getFields() const
+{
+	return d_ptr->getFields();
+}
+
+void EventLogQuery::setFields(EventField fields)
+{
+	d_ptr->setFields(fields);
+}
+
 Ref<IQueryBatchResult> IQueryBatchResult::createEmpty()
 {
-	return EmptyQueryBatchResult::create();
+	// Immutable, so one will do.
+	static const Ref<IQueryBatchResult> empty = EmptyQueryBatchResult::create();
+	return empty;
 }
 
 }
@@ -29,6 +29,9 @@
 namespace Windows::EventLog 
 {
 
+class IRecordSource;
+class QueryExecutor;
+
 // Event log query implementation. 
 class EventLogQueryImpl;
 class EventLogQuery : public IEventLogQuery
@@ -36,8 +39,15 @@ class EventLogQuery : public IEventLogQuery
 public:
 	friend class RefObject<EventLogQuery>;
 
+	// Query using the platform's default record source.
 	static Ref<IEventLogQuery> create();
 
+	// Query using the given record source. 
+	static Ref<IEventLogQuery> create(Ref<IRecordSource> source);
+
+	// As above, running on the given executor rather than the shared one.
+	static Ref<IEventLogQuery> create(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor);
+
 	~EventLogQuery();
 
 	void queryChannelXPath(const std::string &channel, const std::string &queryXPath, Direction dir);
@@ -50,12 +60,32 @@ public:
 
 	void seek(int64_t position, SeekOption flags) override;
 
+	void seek(const IBookmark &bookmark) override;
+
+	void getNextBatchAsync(uint32_t batchSize, uint32_t timeout, BatchCallback callback) override;
+
+	void seekAsync(int64_t position, SeekOption whence, SeekCallback callback) override;
+
 	void close() override;
 
+	uint32_t getPrefetchDepth() const override;
+
+	void setPrefetchDepth(uint32_t depth) override;
+
+	uint32_t getRenderThreads() const override;
+
+	void setRenderThreads(uint32_t threadCount) override;
+
+	EventField getFields() const override;
+
+	void setFields(EventField fields) override;
+
+	void setCancellationToken(Ref<ICancellationToken> token) override;
+
 private:
 	std::unique_ptr<EventLogQueryImpl> d_ptr;
 
-	EventLogQuery();
+	EventLogQuery(Ref<IRecordSource> source, std::shared_ptr<QueryExecutor> executor);
 
 	EventLogQuery(const EventLogQuery &) = delete;
 	EventLogQuery &operator=(const EventLogQuery &) = delete;
@@ -23,11 +23,14 @@ misrepresented as being the original software.
 #include "EventReader.h"
 
 #include "EventLogQuery.h"
-#include "EventRecord.h"
-#include "PublisherMetadata.h"
+#include "EvtxRecordSource.h"
+#include "MetadataCatalog.h"
+#include "RecordSource.h"
 
-// TODO: make this configurable? 
-static constexpr uint32_t BatchSize = 16;
+#include <algorithm>
+#include <chrono>
+
+static constexpr uint32_t DefaultBatchSize = 16;
 
 namespace Windows::EventLog
 {
@@ -36,25 +39,56 @@ class EventReaderImpl
 {
 public:
 	struct ChannelReader {};
-	EventReaderImpl(const ChannelReader &, const std::string &channel,
+	EventReaderImpl(const ChannelReader &, Ref<IRecordSource> source, const std::string &channel,
 		const std::string &queryText, Direction direction);
 
 	struct FileReader {};
-	EventReaderImpl(const FileReader &, const std::string &filePath, 
+	EventReaderImpl(const FileReader &, Ref<IRecordSource> source, const std::string &filePath, 
 		const std::string &queryText, Direction direction);
 
-	EventReaderImpl(const std::string &queryText, Direction direction);
+	EventReaderImpl(Ref<IRecordSource> source, const std::string &queryText, Direction direction);
 
 	uint32_t getTimeout() const { return mTimeout; }	
 	void setTimeout(uint32_t timeout) { mTimeout = timeout; }
+
+	uint32_t getBatchSize() const { return mBatchSize; }
+	void setBatchSize(uint32_t batchSize);
+	void setAdaptiveBatchSize(uint32_t minBatchSize, uint32_t maxBatchSize);
+	bool isAdaptiveBatchSize() const { return mAdaptive; }
+
+	uint32_t getPrefetchDepth() const { return mQuery->getPrefetchDepth(); }
+	void setPrefetchDepth(uint32_t depth) { mQuery->setPrefetchDepth(depth); }
+
+	uint32_t getRenderThreads() const { return mQuery->getRenderThreads(); }
+	void setRenderThreads(uint32_t threadCount) { mQuery->setRenderThreads(threadCount); }
+
+	EventField getFields() const { return mQuery->getFields(); }
+	void setFields(EventField fields);
+
+	void setCancellationToken(Ref<ICancellationToken> token) { mQuery->setCancellationToken(std::move(token)); }
 	
 	bool next();
 	
 	Ref<IEventRecord> getCurrent() const { return mCurrentRecord; }
 
 	void seek(int64_t position, SeekOption option);
+	void seek(const IBookmark &bookmark);
+
+	void setCheckpoint(Ref<IBookmark> bookmark, uint32_t recordInterval, uint32_t timeInterval, 
+		IEventReader::CheckpointHandler handler);
+	void checkpoint();
 
 private:
+	Ref<IQueryBatchResult> fetchBatch();
+
+	// Moves the bookmark to the current record, checkpointing if that makes
+	// recordInterval records since the last checkpoint.
+	void markDone();
+	void saveCheckpoint();
+
+	// The rest of the current batch is from before a seek.
+	void resetBatch();
+
 	Ref<IEventLogQuery> mQuery;
 	Ref<IQueryBatchResult> mQueryBatch;
 
@@ -62,31 +96,46 @@ private:
 	uint32_t mEventCount = 0;
 	uint32_t mTimeout = UINT32_MAX;
 
+	uint32_t mBatchSize = DefaultBatchSize;
+	bool mAdaptive = false;
+	uint32_t mMinBatchSize = DefaultBatchSize;
+	uint32_t mMaxBatchSize = DefaultBatchSize;
+
 	Ref<IEventRecord> mCurrentRecord{IEventRecord::createEmpty()};
+	bool mHasCurrent = false;
+
+	// Null when not checkpointing.
+	RefPtr<IBookmark> mBookmark{};
+	IEventReader::CheckpointHandler mCheckpointHandler{};
+	uint32_t mCheckpointRecords = 0;
+	uint32_t mCheckpointMillis = 0;
+	// Records marked done since the last checkpoint.
+	uint32_t mSinceCheckpoint = 0;
+	std::chrono::steady_clock::time_point mLastCheckpoint{};
 };
 
 //
 // EventReaderImpl
 //
 
-EventReaderImpl::EventReaderImpl(const ChannelReader &, const std::string &channelPath, const std::string &queryText, Direction direction)
-	: mQuery{ EventLogQuery::create() }
+EventReaderImpl::EventReaderImpl(const ChannelReader &, Ref<IRecordSource> source, const std::string &channelPath, const std::string &queryText, Direction direction)
+	: mQuery{ EventLogQuery::create(std::move(source)) }
 	, mQueryBatch{ IQueryBatchResult::createEmpty() }
 	, mCurrentRecord{ IEventRecord::createEmpty() }
 {
 	mQuery->queryChannelXPath(channelPath, queryText, direction);
 }
 
-EventReaderImpl::EventReaderImpl(const FileReader &, const std::string &filePath, const std::string &queryText, Direction direction)
-	: mQuery{EventLogQuery::create()}
+EventReaderImpl::EventReaderImpl(const FileReader &, Ref<IRecordSource> source, const std::string &filePath, const std::string &queryText, Direction direction)
+	: mQuery{ EventLogQuery::create(std::move(source)) }
 	, mQueryBatch { IQueryBatchResult::createEmpty() }
 	, mCurrentRecord{ IEventRecord::createEmpty() }
 {
 	mQuery->queryFileXPath(filePath, queryText, direction);
 }
 
-EventReaderImpl::EventReaderImpl(const std::string &structuredXML, Direction dir)
-	: mQuery{EventLogQuery::create()}
+EventReaderImpl::EventReaderImpl(Ref<IRecordSource> source, const std::string &structuredXML, Direction dir)
+	: mQuery{ EventLogQuery::create(std::move(source)) }
 	, mQueryBatch { IQueryBatchResult::createEmpty() }
 	, mCurrentRecord{ IEventRecord::createEmpty() }
 {
@@ -97,39 +146,183 @@ bool EventReaderImpl::next()
 {
 	bool hasNext = false;
 
-	// If there are event records to retrieve
-	if ((mEventCount > 0) && (mCurrent < (mEventCount - 1)))
+	// Having asked for the next record the caller is done with this one.
+	if (mHasCurrent && mBookmark)
+	{
+		markDone();
+	}
+
+	// mCurrent is the index of the next record to hand out.
+	if (mCurrent < mEventCount)
 	{
 		mCurrentRecord = mQueryBatch->getRecord(mCurrent);
 		mCurrent += 1;		
 		hasNext = true;
 	}
-	else // -> mEventCount == 0 || mCurrent == (mEventCount - 1) 
+	else // -> mCurrent == mEventCount
 	{
+		// Time is only checked between batches, which is often enough and 
+		// keeps the clock out of the per-record path. Checkpoint before 
+		// fetching since that can block.
+		if (mBookmark && mCheckpointMillis != 0 && mSinceCheckpoint != 0 && 
+			std::chrono::steady_clock::now() - mLastCheckpoint >= std::chrono::milliseconds(mCheckpointMillis))
+		{
+			saveCheckpoint();
+		}
+
 		// We need events (either have none or need more) so fetch the next batch.
-		mQueryBatch = mQuery->getNextBatch(BatchSize, getTimeout());
+		mQueryBatch = fetchBatch();
 		mEventCount = mQueryBatch->getCount();
+		mCurrent = 0;
 		
-		if (mQueryBatch->getStatus() == QueryNextStatus::Success)
+		if (mQueryBatch->getStatus() == QueryNextStatus::Success && mEventCount > 0)
 		{
-			mCurrent = 0;
 			mCurrentRecord = mQueryBatch->getRecord(mCurrent);
+			mCurrent += 1;
 			hasNext = true;
 		}
 		else
 		{
 			// Ruh-roh. 
+			mEventCount = 0;
 			mCurrentRecord = IEventRecord::createEmpty();
 			hasNext = false;
 		}
 	}
 
+	mHasCurrent = hasNext;
+	if (!hasNext && mBookmark && mSinceCheckpoint != 0)
+	{
+		saveCheckpoint();
+	}
+
 	return hasNext;
 }
 
+void EventReaderImpl::markDone()
+{
+	mBookmark->update(mCurrentRecord.get());
+	mSinceCheckpoint += 1;
+	if (mSinceCheckpoint == mCheckpointRecords)
+	{
+		saveCheckpoint();
+	}
+}
+
+void EventReaderImpl::saveCheckpoint()
+{
+	mSinceCheckpoint = 0;
+	mLastCheckpoint = std::chrono::steady_clock::now();
+	mCheckpointHandler(*mBookmark);
+}
+
+Ref<IQueryBatchResult> EventReaderImpl::fetchBatch()
+{
+	Ref<IQueryBatchResult> batch = mQuery->getNextBatch(mBatchSize, getTimeout());
+
+	if (mAdaptive)
+	{
+		// A full batch suggests there's more waiting. A short one is just the
+		// end of what was available, so only a timeout shrinks the batch.
+		QueryNextStatus status = batch->getStatus();
+		if (status == QueryNextStatus::Success && batch->getCount() >= mBatchSize)
+		{
+			mBatchSize = uint32_t(std::min<uint64_t>(uint64_t(mBatchSize) * 2, mMaxBatchSize));
+		}
+		else if (status == QueryNextStatus::Timeout)
+		{
+			mBatchSize = std::max<uint32_t>(mBatchSize / 2, mMinBatchSize);
+		}
+	}
+
+	return batch;
+}
+
+void EventReaderImpl::setBatchSize(uint32_t batchSize)
+{
+	if (batchSize == 0)
+	{
+		THROW(InvalidArgumentException);
+	}
+
+	mBatchSize = batchSize;
+	mAdaptive = false;
+}
+
+void EventReaderImpl::setAdaptiveBatchSize(uint32_t minBatchSize, uint32_t maxBatchSize)
+{
+	if (minBatchSize == 0 || minBatchSize > maxBatchSize)
+	{
+		THROW(InvalidArgumentException);
+	}
+
+	mMinBatchSize = minBatchSize;
+	mMaxBatchSize = maxBatchSize;
+	mBatchSize = std::min<uint32_t>(std::max<uint32_t>(mBatchSize, minBatchSize), maxBatchSize);
+	mAdaptive = true;
+}
+
+void EventReaderImpl::setFields(EventField fields)
+{
+	if (mBookmark)
+		fields = fields | EventField::Channel | EventField::RecordId;
+	mQuery->setFields(fields);
+}
+
 void EventReaderImpl::seek(int64_t position, SeekOption option)
 {
 	this->mQuery->seek(position, option);
+	resetBatch();
+}
+
+void EventReaderImpl::seek(const IBookmark &bookmark)
+{
+	mQuery->seek(bookmark);
+	resetBatch();
+}
+
+void EventReaderImpl::resetBatch()
+{
+	mQueryBatch = IQueryBatchResult::createEmpty();
+	mEventCount = 0;
+	mCurrent = 0;
+	mCurrentRecord = IEventRecord::createEmpty();
+	mHasCurrent = false;
+}
+
+void EventReaderImpl::setCheckpoint(Ref<IBookmark> bookmark, uint32_t recordInterval, uint32_t timeInterval, 
+	IEventReader::CheckpointHandler handler)
+{
+	if (!handler)
+	{
+		mBookmark = nullptr;
+		mCheckpointHandler = nullptr;
+		return;
+	}
+
+	mBookmark = &bookmark.get();
+	mCheckpointHandler = std::move(handler);
+	mCheckpointRecords = recordInterval;
+	mCheckpointMillis = timeInterval;
+	mSinceCheckpoint = 0;
+	mLastCheckpoint = std::chrono::steady_clock::now();
+	setFields(getFields());
+}
+
+void EventReaderImpl::checkpoint()
+{
+	if (!mBookmark)
+	{
+		THROW(InvalidStateException);
+	}
+
+	// Already done with, next() mustn't count it again.
+	if (mHasCurrent)
+	{
+		mBookmark->update(mCurrentRecord.get());
+		mHasCurrent = false;
+	}
+	saveCheckpoint();
 }
 
 //
@@ -139,33 +332,51 @@ void EventReaderImpl::seek(int64_t position, SeekOption option)
 Ref<EventReader> EventReader::openChannel(const std::string &channel,
 	const std::string &queryText, Direction direction)
 {
-	return RefObject<EventReader>::createRef(OpenChannel{}, channel, queryText, direction);
+	return openChannel(createDefaultRecordSource(), channel, queryText, direction);
 }
 
 Ref<EventReader> EventReader::openFile(const std::string &channel,
 	const std::string &queryText, Direction direction)
 {
-	return RefObject<EventReader>::createRef(OpenFile{}, channel, queryText, direction);
+	return openFile(createDefaultRecordSource(), channel, queryText, direction);
 }
 
 Ref<EventReader> EventReader::openStructuredXML(const std::string &structuredQueryXML,
 	Direction direction)
 {
-	return RefObject<EventReader>::createRef(structuredQueryXML, direction);
+	return openStructuredXML(createDefaultRecordSource(), structuredQueryXML, direction);
+}
+
+Ref<EventReader> EventReader::openChannel(Ref<IRecordSource> source, const std::string &channel,
+	const std::string &queryText, Direction direction)
+{
+	return RefObject<EventReader>::createRef(OpenChannel{}, std::move(source), channel, queryText, direction);
+}
+
+Ref<EventReader> EventReader::openFile(Ref<IRecordSource> source, const std::string &channel,
+	const std::string &queryText, Direction direction)
+{
+	return RefObject<EventReader>::createRef(OpenFile{}, std::move(source), channel, queryText, direction);
+}
+
+Ref<EventReader> EventReader::openStructuredXML(Ref<IRecordSource> source, const std::string &structuredQueryXML,
+	Direction direction)
+{
+	return RefObject<EventReader>::createRef(std::move(source), structuredQueryXML, direction);
 }
 
-EventReader::EventReader(OpenChannel, const std::string &channel,
+EventReader::EventReader(OpenChannel, Ref<IRecordSource> source, const std::string &channel,
 	const std::string &queryText, Direction direction)
-	: d_ptr{std::make_unique<EventReaderImpl>(EventReaderImpl::ChannelReader{}, channel, queryText, direction)}
+	: d_ptr{std::make_unique<EventReaderImpl>(EventReaderImpl::ChannelReader{}, std::move(source), channel, queryText, direction)}
 {}
 
-EventReader::EventReader(OpenFile, const std::string &channel, 
+EventReader::EventReader(OpenFile, Ref<IRecordSource> source, const std::string &channel, 
 	const std::string queryText, Direction direction)
-	: d_ptr{std::make_unique<EventReaderImpl>(EventReaderImpl::FileReader{}, channel, queryText, direction)}
+	: d_ptr{std::make_unique<EventReaderImpl>(EventReaderImpl::FileReader{}, std::move(source), channel, queryText, direction)}
 {}
 
-EventReader::EventReader(const std::string &structuredQueryText, Direction direction)
-	: d_ptr{std::make_unique<EventReaderImpl>(structuredQueryText, direction)}
+EventReader::EventReader(Ref<IRecordSource> source, const std::string &structuredQueryText, Direction direction)
+	: d_ptr{std::make_unique<EventReaderImpl>(std::move(source), structuredQueryText, direction)}
 {}
 
 EventReader::~EventReader()
@@ -186,6 +397,56 @@ void EventReader::setTimeout(uint32_t timeout)
 	d_ptr->setTimeout(timeout);
 }
 
+uint32_t EventReader::getBatchSize() const
+{
+	return d_ptr->getBatchSize();
+}
+
+void EventReader::setBatchSize(uint32_t batchSize)
+{
+	d_ptr->setBatchSize(batchSize);
+}
+
+void EventReader::setAdaptiveBatchSize(uint32_t minBatchSize, uint32_t maxBatchSize)
+{
+	d_ptr->setAdaptiveBatchSize(minBatchSize, maxBatchSize);
+}
+
+bool EventReader::isAdaptiveBatchSize() const
+{
+	return d_ptr->isAdaptiveBatchSize();
+}
+
+uint32_t EventReader::getPrefetchDepth() const
+{
+	return d_ptr->getPrefetchDepth();
+}
+
+void EventReader::setPrefetchDepth(uint32_t depth)
+{
+	d_ptr->setPrefetchDepth(depth);
+}
+
+uint32_t EventReader::getRenderThreads() const
+{
+	return d_ptr->getRenderThreads();
+}
+
+void EventReader::setRenderThreads(uint32_t threadCount)
+{
+	d_ptr->setRenderThreads(threadCount);
+}
+
+EventField EventReader::getFields() const
+{
+	return d_ptr->getFields();
+}
+
+void EventReader::setFields(EventField fields)
+{
+	d_ptr->setFields(fields);
+}
+
 Ref<IEventRecord> EventReader::getRecord() const
 {
 	return d_ptr->getCurrent();
@@ -196,6 +457,27 @@ void EventReader::seek(int64_t position, SeekOption whence)
 	d_ptr->seek(position, whence);
 }
 
+void EventReader::seek(const IBookmark &bookmark)
+{
+	d_ptr->seek(bookmark);
+}
+
+void EventReader::setCheckpoint(Ref<IBookmark> bookmark, uint32_t recordInterval, uint32_t timeInterval, 
+	CheckpointHandler handler)
+{
+	d_ptr->setCheckpoint(std::move(bookmark), recordInterval, timeInterval, std::move(handler));
+}
+
+void EventReader::checkpoint()
+{
+	d_ptr->checkpoint();
+}
+
+void EventReader::setCancellationToken(Ref<ICancellationToken> token)
+{
+	d_ptr->setCancellationToken(std::move(token));
+}
+
 //
 // IEventReader
 //
@@ -216,4 +498,16 @@ Ref<IEventReader> IEventReader::openStructuredXML(const std::string &structuredQ
 	return EventReader::openStructuredXML(structuredQueryText, direction);
 }
 
+Ref<IEventReader> IEventReader::openEvtxFile(const std::string &filePath, Direction direction)
+{
+	return EventReader::openFile(EvtxRecordSource::create(), filePath, "*", direction);
+}
+
+Ref<IEventReader> IEventReader::openEvtxFile(const std::string &filePath, const std::string &catalogPath, Direction direction)
+{
+	EvtxRecordSource::Options options{};
+	options.catalog = MetadataCatalog::open(catalogPath);
+	return EventReader::openFile(EvtxRecordSource::create(options), filePath, "*", direction);
+}
+
 }
\ No newline at end of file
@@ -30,6 +30,8 @@
 namespace Windows::EventLog
 {
 
+class IRecordSource;
+
 class EventReaderImpl;
 class EventReader : public IEventReader
 {
@@ -45,29 +47,62 @@ public:
 	static Ref<EventReader> openStructuredXML(const std::string &structuredXML, 
 		Direction direction);
 
+	// As above, but reading from the given record source instead of the 
+	// platform default.
+
+	static Ref<EventReader> openChannel(Ref<IRecordSource> source, const std::string &channel, 
+		const std::string &queryText, Direction direction);
+
+	static Ref<EventReader> openFile(Ref<IRecordSource> source, const std::string &channel, 
+		const std::string &queryText, Direction direction);
+
+	static Ref<EventReader> openStructuredXML(Ref<IRecordSource> source, const std::string &structuredXML, 
+		Direction direction);
+
 	~EventReader();
 
 	uint32_t getTimeout() const override;
 	void setTimeout(uint32_t timeout) override;
 
+	uint32_t getBatchSize() const override;
+	void setBatchSize(uint32_t batchSize) override;
+	void setAdaptiveBatchSize(uint32_t minBatchSize, uint32_t maxBatchSize) override;
+	bool isAdaptiveBatchSize() const override;
+
+	uint32_t getPrefetchDepth() const override;
+	void setPrefetchDepth(uint32_t depth) override;
+
+	uint32_t getRenderThreads() const override;
+	void setRenderThreads(uint32_t threadCount) override;
+
+	EventField getFields() const override;
+	void setFields(EventField fields) override;
+
 	bool next() override;
 
 	Ref<IEventRecord> getRecord() const override;
 
 	void seek(int64_t position, SeekOption whence) override;
+	void seek(const IBookmark &bookmark) override;
+
+	void setCheckpoint(Ref<IBookmark> bookmark, uint32_t recordInterval, uint32_t timeInterval, 
+		CheckpointHandler handler) override;
+	void checkpoint() override;
+
+	void setCancellationToken(Ref<ICancellationToken> token) override;
 
 private:
 	struct OpenChannel {};
 	
-	EventReader(OpenChannel, const std::string &channel,
+	EventReader(OpenChannel, Ref<IRecordSource> source, const std::string &channel,
 		const std::string &queryText, Direction direction);
 
 	struct OpenFile {};
 
-	EventReader(OpenFile, const std::string &channel, 
+	EventReader(OpenFile, Ref<IRecordSource> source, const std::string &channel, 
 		const std::string queryText, Direction direction);
 
-	EventReader(const std::string &structuredQueryText, Direction direction);
+	EventReader(Ref<IRecordSource> source, const std::string &structuredQueryText, Direction direction);
 
 	std::unique_ptr<EventReaderImpl> d_ptr;
 
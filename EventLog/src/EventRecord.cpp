@@ -22,11 +22,23 @@ misrepresented as being the original software.
 
 #include "EventRecord.h"
 
+#include "AccountCache.h"
 #include "EvtHandle.h"
 #include "EvtVariant.h"
+#include "MessageTemplate.h"
+#include "PublisherCatalog.h"
 #include "PublisherMetadata.h"
+#include "ShardedCache.h"
+#include "StringUtils.h"
 #include "WinSys.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 namespace Windows::EventLog
 {
 
@@ -95,44 +107,49 @@ public:
 private:
 };
 
-// Null avoidance sentinel.
-class EmptyEventRecord : public IEventRecord
-{
-public:
-	static Ref<EmptyEventRecord> create() { return RefObject<EmptyEventRecord>::createRef(); }
-	std::optional<std::string> getProviderName() const override { return {}; }
-	std::optional<GUID> getProviderGuid() const override { return {}; }
-	std::optional<uint16_t> getEventId() const override { return {}; }
-	std::optional<uint16_t> getQualifers() const override { return {}; }
-	std::optional<uint8_t> getLevel() const override { return {}; }
-	std::optional<uint16_t> getTask() const override { return {}; }
-	std::optional<uint8_t> getOpcode() const override { return {}; }
-	std::optional<int64_t> getKeywords() const override { return {}; }
-	std::optional<Timestamp> getTimeCreated() const override { return {}; }
-	std::optional<uint64_t> getRecordId() const override { return {}; }
-	std::optional<GUID> getActivityId() const override { return {}; }
-	std::optional<uint32_t> getProcessId() const override { return {}; }
-	std::optional<uint32_t> getThreadId() const override { return {}; }
-	std::optional<std::string> getChannel() const override { return {}; }
-	std::optional<std::string> getComputer() const override { return {}; }
-	std::optional<std::string> getUser() const override { return {}; }
-	std::optional<uint8_t> getVersion() const override { return {}; }
-	std::string getMessage() const override { return {}; }
-	std::string getLevelDisplay() const override { return {}; }
-	std::string getTaskDisplay() const override { return {}; }
-	std::string getOpcodeDisplay() const override { return {}; }
-	std::vector<std::string> getKeywordsDisplay() const override { return {}; }
-	std::string getChannelMessage() const override { return {}; }
-	std::string getProviderMessage() const override { return {}; }
-};
-
 static EVT_HANDLE getDefaultSystemRenderContext()
 {
 	static RenderContext context{0, nullptr, EvtRenderContextSystem};
 	return context.handle();
 }
 
-static std::optional<std::string> getUserFromSID(const EVT_VARIANT &pUser)
+static EVT_HANDLE getDefaultUserRenderContext()
+{
+	static RenderContext context{0, nullptr, EvtRenderContextUser};
+	return context.handle();
+}
+
+// Renders the record's values with the context. 
+static EvtVariantArrayPtr render(EVT_HANDLE hContext, EVT_HANDLE hRecord, DWORD &propertyCount)
+{
+	DWORD size = 1024;
+	EvtVariantArrayPtr va = allocEvtVariantArray(size);
+
+	BOOL success = ::EvtRender(hContext, hRecord, EvtRenderEventValues, size, va.get(), &size, &propertyCount);
+	if (!success)
+	{
+		DWORD err = ::GetLastError();
+		if (err == ERROR_INSUFFICIENT_BUFFER)
+		{
+			va = allocEvtVariantArray(size);
+
+			success = ::EvtRender(hContext, hRecord, EvtRenderEventValues, size, va.get(), &size, &propertyCount);
+			if (!success)
+			{
+				err = ::GetLastError();
+				THROW_(SystemException, err);
+			}
+		}
+		else
+		{
+			THROW_(SystemException, err);
+		}
+	}
+	return va;
+}
+
+// The user SID's bytes, empty if there isn't one.
+static std::string getUserSID(const EVT_VARIANT &pUser)
 {
 	if (pUser.Type == EvtVarTypeNull)
 	{
@@ -140,7 +157,7 @@ static std::optional<std::string> getUserFromSID(const EVT_VARIANT &pUser)
 	}
 	else if (pUser.Type == EvtVarTypeSid)
 	{
-		return lookupAccount(pUser.SidVal);
+		return std::string(static_cast<const char *>(pUser.SidVal), ::GetLengthSid(pUser.SidVal));
 	}
 	else
 	{
@@ -148,100 +165,615 @@ static std::optional<std::string> getUserFromSID(const EVT_VARIANT &pUser)
 	}
 }
 
+// Resolves the SID to an account name. Failures, including the domain 
+// controller not answering, are cached as not found for a while.
+static std::optional<std::string> resolveAccount(PSID pSid)
+{
+	try
+	{
+		std::string user = lookupAccount(pSid);
+		if (!user.empty())
+			return user;
+	}
+	catch (std::exception &)
+	{
+	}
+	return {};
+}
+
+// The account name of the SID, through the account cache. Like Event Viewer,
+// the SID of an account that can't be found.
+static std::string accountName(const std::string &sid)
+{
+	PSID pSid = const_cast<char *>(sid.data());
+	std::optional<std::string> user = AccountCache::global().lookup(sid, [pSid] { return resolveAccount(pSid); });
+	return user ? std::move(*user) : sidToString(pSid);
+}
+
+//
+// RecordProjection
+//
+
+// System fields in EventField bit order, with their index in the system 
+// context's values and their path for a values context.
+struct SystemFieldPath
+{
+	EVT_SYSTEM_PROPERTY_ID id;
+	LPCWSTR path;
+};
+
+static const SystemFieldPath SystemFieldPaths[] = 
+{
+	{ EvtSystemProviderName, L"Event/System/Provider/@Name" },
+	{ EvtSystemProviderGuid, L"Event/System/Provider/@Guid" },
+	{ EvtSystemEventID, L"Event/System/EventID" },
+	{ EvtSystemQualifiers, L"Event/System/EventID/@Qualifiers" },
+	{ EvtSystemLevel, L"Event/System/Level" },
+	{ EvtSystemTask, L"Event/System/Task" },
+	{ EvtSystemOpcode, L"Event/System/Opcode" },
+	{ EvtSystemKeywords, L"Event/System/Keywords" },
+	{ EvtSystemTimeCreated, L"Event/System/TimeCreated/@SystemTime" },
+	{ EvtSystemEventRecordId, L"Event/System/EventRecordID" },
+	{ EvtSystemActivityID, L"Event/System/Correlation/@ActivityID" },
+	{ EvtSystemProcessID, L"Event/System/Execution/@ProcessID" },
+	{ EvtSystemThreadID, L"Event/System/Execution/@ThreadID" },
+	{ EvtSystemChannel, L"Event/System/Channel" },
+	{ EvtSystemComputer, L"Event/System/Computer" },
+	{ EvtSystemUserID, L"Event/System/Security/@UserID" },
+	{ EvtSystemVersion, L"Event/System/Version" },
+};
+
+static size_t fieldBit(EventField field)
+{
+	size_t bit = 0;
+	for (uint32_t v = uint32_t(field); v > 1; v >>= 1)
+		++bit;
+	return bit;
+}
+
+RecordProjection::RecordProjection(EventField fields)
+	: mFields(fields)
+{
+	static_assert(sizeof(SystemFieldPaths) / sizeof(SystemFieldPaths[0]) == SystemFieldCount, "One path per system field");
+
+	// Display strings are formatted with the provider's metadata, so they 
+	// need its name.
+	EventField rendered = fields & EventField::System;
+	if (hasAnyField(fields, EventField::Display))
+		rendered = rendered | EventField::ProviderName;
+
+	// The payload's render context and message template are looked up by 
+	// event definition.
+	if (hasAnyField(fields, EventField::Properties | EventField::Message))
+		rendered = rendered | EventField::ProviderName | EventField::EventId | EventField::Version;
+
+	mValueIndex.fill(-1);
+	if (rendered == EventField::System)
+	{
+		for (size_t i = 0; i < SystemFieldCount; ++i)
+			mValueIndex[i] = int(SystemFieldPaths[i].id);
+		mRendersValues = true;
+		return;
+	}
+
+	std::vector<LPCWSTR> paths;
+	for (size_t i = 0; i < SystemFieldCount; ++i)
+	{
+		if (hasAnyField(rendered, EventField(1u << i)))
+		{
+			mValueIndex[i] = int(paths.size());
+			paths.push_back(SystemFieldPaths[i].path);
+		}
+	}
+
+	if (!paths.empty())
+	{
+		mContext = std::make_unique<RenderContext>(DWORD(paths.size()), paths.data(), DWORD(EvtRenderContextValues));
+		mRendersValues = true;
+	}
+}
+
+RecordProjection::~RecordProjection()
+{}
+
+int RecordProjection::getValueIndex(EventField field) const
+{
+	return mValueIndex[fieldBit(field)];
+}
+
+//
+// Event definitions
+//
+
+// Whether the data name can be an element name, so can be a UserData 
+// property.
+static bool isElementName(const std::string &name)
+{
+	if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])) || name[0] == '-' || name[0] == '.')
+		return false;
+
+	return std::all_of(name.begin(), name.end(), [](char c) {
+		return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+	});
+}
+
+// What's needed from one event definition to render its records' payload 
+// and message. With the names from its template the payload is rendered 
+// with a values context of the EventData/Data[@Name] paths, so the values 
+// come back named and in a single render. Without, the user context and the
+// values are unnamed. The message template comes parsed from the catalog, so
+// messages can be formatted without EvtFormatMessage.
+//
+// The template from the publisher metadata doesn't say whether the payload 
+// is EventData or UserData, so when the names could be UserData elements 
+// the context has the UserData/*/name paths as well, after the EventData 
+// ones. getPayload picks the half the record has.
+class EventDefinition
+{
+public:
+	EventDefinition(std::vector<std::string> names, std::optional<MessageTemplate> message)
+		: mNames(std::move(names)), mMessage(std::move(message))
+	{
+		if (mNames.empty())
+			return;
+
+		bool userData = std::all_of(mNames.begin(), mNames.end(), isElementName);
+
+		std::vector<std::wstring> paths;
+		paths.reserve(userData ? 2 * mNames.size() : mNames.size());
+		for (const std::string &name : mNames)
+			paths.push_back(L"Event/EventData/Data[@Name='" + to_utf16(name) + L"']");
+		if (userData)
+		{
+			for (const std::string &name : mNames)
+				paths.push_back(L"Event/UserData/*/" + to_utf16(name));
+		}
+
+		std::vector<LPCWSTR> pathPtrs;
+		pathPtrs.reserve(paths.size());
+		for (const std::wstring &path : paths)
+			pathPtrs.push_back(path.c_str());
+
+		mContext = RenderContext(DWORD(pathPtrs.size()), pathPtrs.data(), EvtRenderContextValues);
+	}
+
+	const std::vector<std::string> &getNames() const { return mNames; }
+
+	EVT_HANDLE handle() const { return mContext ? mContext.handle() : getDefaultUserRenderContext(); }
+
+	// The payload values of a render with handle(), updating the count. Null
+	// if the record has none of the names, so the payload isn't laid out the
+	// way the template says and is better rendered with the user context.
+	const EVT_VARIANT *getPayload(const EVT_VARIANT *va, DWORD &count) const
+	{
+		if (mNames.empty())
+			return va;
+
+		auto anyValue = [](const EVT_VARIANT *first, const EVT_VARIANT *last) {
+			return std::any_of(first, last, [](const EVT_VARIANT &v) {
+				return (v.Type & EVT_VARIANT_TYPE_MASK) != EvtVarTypeNull;
+			});
+		};
+
+		DWORD names = DWORD(mNames.size());
+		const EVT_VARIANT *payload = nullptr;
+		if (count >= names && anyValue(va, va + names))
+			payload = va;
+		else if (count >= 2 * names && anyValue(va + names, va + 2 * names))
+			payload = va + names;
+
+		count = payload ? names : 0;
+		return payload;
+	}
+
+	// Null if the event has no message or it can't be parsed.
+	const MessageTemplate *getMessage() const { return mMessage ? &mMessage.value() : nullptr; }
+
+private:
+	std::vector<std::string> mNames;
+	RenderContext mContext{};
+	std::optional<MessageTemplate> mMessage;
+
+	EventDefinition(const EventDefinition &) = delete;
+	EventDefinition &operator=(const EventDefinition &) = delete;
+};
+
+// Event definitions by provider, event id and version. A provider's are all
+// created on its first lookup, from the publisher catalog.
+class EventDefinitionCache
+{
+public:
+	EventDefinitionCache() = default;
+	~EventDefinitionCache() = default;
+
+	// Never null, unknown events get the user context and no message.
+	std::shared_ptr<const EventDefinition> cacheLookup(const std::string &provider, uint16_t eventId, uint8_t version)
+	{
+		// Records are rendered on several threads at once. A provider is 
+		// loaded once however many of them miss it.
+		std::shared_ptr<const EventDefinitions> definitions = 
+			mProviders.lookup(provider, [&provider] { return loadProvider(provider); });
+
+		auto it = definitions->find(key(eventId, version));
+		return it != definitions->end() ? it->second : mUnknownEvent;
+	}
+
+private:
+	using EventDefinitions = std::unordered_map<uint32_t, std::shared_ptr<const EventDefinition>>;
+
+	static uint32_t key(uint16_t eventId, uint8_t version)
+	{
+		return (uint32_t(eventId) << 8) | version;
+	}
+
+	static std::shared_ptr<const EventDefinitions> loadProvider(const std::string &provider)
+	{
+		auto definitions = std::make_shared<EventDefinitions>();
+		std::shared_ptr<const CatalogPublisher> publisher = PublisherCatalog::global().lookup(provider);
+		if (!publisher)
+		{
+			return definitions;
+		}
+
+		for (const CatalogEvent &event : publisher->events)
+		{
+			if (event.dataNames.empty() && !event.messageTemplate)
+				continue;
+
+			definitions->emplace(key(event.id, event.version), 
+				std::make_shared<const EventDefinition>(event.dataNames, event.messageTemplate));
+		}
+		return definitions;
+	}
+
+	ShardedCache<std::string, std::shared_ptr<const EventDefinitions>> mProviders{};
+	const std::shared_ptr<const EventDefinition> mUnknownEvent{ std::make_shared<const EventDefinition>(std::vector<std::string>{}, std::nullopt) };
+
+	EventDefinitionCache(const EventDefinitionCache &) = delete;
+	EventDefinitionCache &operator=(const EventDefinitionCache &) = delete;
+};
+
+static EventDefinitionCache eventDefinitionCache{};
+
+// A payload value as a message insertion string, the way EvtFormatMessage 
+// writes it.
+static std::string insertionString(const EVT_VARIANT &v)
+{
+	char buf[32];
+	switch (v.Type & EVT_VARIANT_TYPE_MASK)
+	{
+	case EvtVarTypeNull:
+		return {};
+	case EvtVarTypeBoolean:
+		return v.BooleanVal ? "true" : "false";
+	case EvtVarTypeHexInt32:
+		std::snprintf(buf, sizeof(buf), "0x%X", unsigned(v.UInt32Val));
+		return buf;
+	case EvtVarTypeHexInt64:
+		std::snprintf(buf, sizeof(buf), "0x%llX", static_cast<unsigned long long>(v.UInt64Val));
+		return buf;
+	case EvtVarTypeSid:
+		return v.SidVal ? sidToString(v.SidVal) : std::string();
+	default:
+		return Variant::to_string(v);
+	}
+}
+
 //
 // EventRecord implementation
 //
 
-EventRecord::EventRecord(const EventRecordHandle &hRecord)
+EventRecord::EventRecord(std::shared_ptr<void> hRecord, const RecordProjection &projection)
+	: mFields(projection.getFields())
 {
-	DWORD propertyCount = 0;
-	DWORD size = 1024;
-	EvtVariantArrayPtr va = allocEvtVariantArray(size);
+	EventRecordHandle handle(static_cast<EVT_HANDLE>(hRecord.get()));
+	if (projection.rendersValues())
+	{
+		renderValues(handle, projection);
+	}
 
-	//
-	// First, 'render' the system values.
-	//
+	if (hasAnyField(mFields, EventField::Properties))
+	{
+		renderProperties(handle);
+	}
 
-	BOOL success = ::EvtRender(getDefaultSystemRenderContext(), hRecord, EvtRenderEventValues, size, va.get(), &size, &propertyCount);
-	if (!success)
+	// The human readable messages are formatted when first asked for, which 
+	// needs the event.
+	if (hasAnyField(mFields, EventField::Display))
 	{
-		DWORD err = ::GetLastError();
-		if (err == ERROR_INSUFFICIENT_BUFFER)
+		mEventHandle = std::move(hRecord);
+	}
+}
+
+const FormattedEventRecord &EventRecord::formatted(EventField field) const
+{
+	static constexpr size_t FirstDisplayBit = 17;
+
+	std::call_once(mFormatted[fieldBit(field) - FirstDisplayBit], [this, field]
+	{
+		if (!mEventHandle || !hasAnyField(mFields, field))
 		{
-			va = allocEvtVariantArray(size);
+			return;
+		}
 
-			success = ::EvtRender(getDefaultSystemRenderContext(), hRecord, EvtRenderEventValues, size, va.get(), &size, &propertyCount);
-			if (!success)
-			{
-				err = ::GetLastError();
-				THROW_(SystemException, err);
-			}
+		EventRecordHandle hRecord(static_cast<EVT_HANDLE>(mEventHandle.get()));
+
+		if (field == EventField::Message && formatMessage(hRecord))
+		{
+			return;
 		}
-		else
+
+		// If the publisher isn't found try to format without.
+		RefPtr<PublisherMetadata> publisher = mProviderName.has_value() ?
+			PublisherMetadata::cacheOpenProvider(mProviderName.value()) :
+			RefPtr<PublisherMetadata>(nullptr);
+		FormattedEventRecord record = publisher ? 
+			publisher->format(hRecord, field) : 
+			PublisherMetadata::formatEvent(hRecord, field);
+
+		switch (field)
 		{
-			THROW_(SystemException, err);
+		case EventField::Message: mRecord.message = std::move(record.message); break;
+		case EventField::LevelDisplay: mRecord.level = std::move(record.level); break;
+		case EventField::TaskDisplay: mRecord.task = std::move(record.task); break;
+		case EventField::OpcodeDisplay: mRecord.opcode = std::move(record.opcode); break;
+		case EventField::KeywordsDisplay: mRecord.keywords = std::move(record.keywords); break;
+		case EventField::ChannelMessage: mRecord.channelMessage = std::move(record.channelMessage); break;
+		case EventField::ProviderMessage: mRecord.providerMessage = std::move(record.providerMessage); break;
+		default: break;
 		}
+	});
+	return mRecord;
+}
+
+bool EventRecord::formatMessage(const EventRecordHandle &hRecord) const
+{
+	if (!mProviderName.has_value())
+	{
+		return false;
+	}
+
+	std::shared_ptr<const EventDefinition> definition = 
+		eventDefinitionCache.cacheLookup(mProviderName.value(), mEventId.value_or(0), mVersion.value_or(0));
+	const MessageTemplate *message = definition->getMessage();
+	if (!message)
+	{
+		return false;
 	}
 
-	mProviderName = Variant::getMaybeString(va[EvtSystemProviderName]);
-	mProviderGuid = Variant::getMaybeGuid(va[EvtSystemProviderGuid]);
-	mEventId = Variant::getMaybeUInt16(va[EvtSystemEventID]);
-	mQualifers = Variant::getMaybeUInt16(va[EvtSystemQualifiers]);
-	mLevel = Variant::getMaybeByte(va[EvtSystemLevel]);
-	mTask = Variant::getMaybeUInt16(va[EvtSystemTask]);
-	mOpcode = Variant::getMaybeByte(va[EvtSystemOpcode]);
+	DWORD propertyCount = 0;
+	EvtVariantArrayPtr rendered = render(definition->handle(), hRecord, propertyCount);
+	const EVT_VARIANT *va = definition->getPayload(rendered.get(), propertyCount);
+
+	// A payload that doesn't match the definition is left to EvtFormatMessage.
+	if (!va || propertyCount < message->getInsertionCount())
+	{
+		return false;
+	}
+
+	std::vector<std::string> insertions;
+	insertions.reserve(propertyCount);
+	for (DWORD i = 0; i < propertyCount; ++i)
+	{
+		insertions.push_back(insertionString(va[i]));
+
+		// A parameter message, like %%1833, that EvtFormatMessage expands.
+		if (insertions.back().compare(0, 2, "%%") == 0)
+			return false;
+	}
+
+	mRecord.message = message->format(insertions);
+	return true;
+}
+
+void EventRecord::renderValues(const EventRecordHandle &hRecord, const RecordProjection &projection)
+{
+	const RenderContext *pContext = projection.getRenderContext();
+	EVT_HANDLE hContext = pContext ? pContext->handle() : getDefaultSystemRenderContext();
+
+	DWORD propertyCount = 0;
+	EvtVariantArrayPtr va = render(hContext, hRecord, propertyCount);
+
+	// The field's rendered value, or null if it wasn't rendered.
+	auto value = [&](EventField field) -> EVT_VARIANT * 
+	{
+		int index = projection.getValueIndex(field);
+		return index >= 0 ? &va[size_t(index)] : nullptr;
+	};
+
+	if (EVT_VARIANT *v = value(EventField::ProviderName))
+		mProviderName = Variant::getMaybeString(*v);
+	if (EVT_VARIANT *v = value(EventField::ProviderGuid))
+		mProviderGuid = Variant::getMaybeGuid(*v);
+	if (EVT_VARIANT *v = value(EventField::EventId))
+		mEventId = Variant::getMaybeUInt16(*v);
+	if (EVT_VARIANT *v = value(EventField::Qualifiers))
+		mQualifers = Variant::getMaybeUInt16(*v);
+	if (EVT_VARIANT *v = value(EventField::Level))
+		mLevel = Variant::getMaybeByte(*v);
+	if (EVT_VARIANT *v = value(EventField::Task))
+		mTask = Variant::getMaybeUInt16(*v);
+	if (EVT_VARIANT *v = value(EventField::Opcode))
+		mOpcode = Variant::getMaybeByte(*v);
 
 	// Keywords is weird. No idea why it uses this type code.
-	if (va[EvtSystemKeywords].Type == EvtVarTypeHexInt64 ||
-		va[EvtSystemKeywords].Type == EvtVarTypeInt64 ||
-		va[EvtSystemKeywords].Type == EvtVarTypeUInt64)
+	EVT_VARIANT *keywords = value(EventField::Keywords);
+	if (keywords && (keywords->Type == EvtVarTypeHexInt64 ||
+		keywords->Type == EvtVarTypeInt64 ||
+		keywords->Type == EvtVarTypeUInt64))
 	{
 		// Docs say chop top 16. 
-		va[EvtSystemKeywords].UInt64Val &= 0x0000FFFFFFFFFFFF;
-		mKeywords = va[EvtSystemKeywords].Int64Val;
+		keywords->UInt64Val &= 0x0000FFFFFFFFFFFF;
+		mKeywords = keywords->Int64Val;
 	}
 	// else: leave it empty?
 
-	mTimeCreated = Variant::getMaybeTimestamp(va[EvtSystemTimeCreated]);
-	mRecordId = Variant::getMaybeUInt64(va[EvtSystemEventRecordId]);
-	mActivityId = Variant::getMaybeGuid(va[EvtSystemActivityID]);
-	mRelatedActivityId = Variant::getMaybeGuid(va[EvtSystemRelatedActivityID]);
-	mProcessId = Variant::getMaybeUInt32(va[EvtSystemProcessID]);
-	mThreadId = Variant::getMaybeUInt32(va[EvtSystemThreadID]);
-	mChannel = Variant::getMaybeString(va[EvtSystemChannel]);
-	mComputer = Variant::getMaybeString(va[EvtSystemComputer]);
+	if (EVT_VARIANT *v = value(EventField::TimeCreated))
+		mTimeCreated = Variant::getMaybeTimestamp(*v);
+	if (EVT_VARIANT *v = value(EventField::RecordId))
+		mRecordId = Variant::getMaybeUInt64(*v);
+	if (EVT_VARIANT *v = value(EventField::ActivityId))
+		mActivityId = Variant::getMaybeGuid(*v);
+	if (!pContext)
+		mRelatedActivityId = Variant::getMaybeGuid(va[EvtSystemRelatedActivityID]);
+	if (EVT_VARIANT *v = value(EventField::ProcessId))
+		mProcessId = Variant::getMaybeUInt32(*v);
+	if (EVT_VARIANT *v = value(EventField::ThreadId))
+		mThreadId = Variant::getMaybeUInt32(*v);
+	if (EVT_VARIANT *v = value(EventField::Channel))
+		mChannel = Variant::getMaybeString(*v);
+	if (EVT_VARIANT *v = value(EventField::Computer))
+		mComputer = Variant::getMaybeString(*v);
+
+	if (EVT_VARIANT *v = value(EventField::User))
+		mUserSid = getUserSID(*v);
+	if (EVT_VARIANT *v = value(EventField::Version))
+		mVersion = Variant::getMaybeByte(*v);
+}
 
-	mUser = getUserFromSID(va[EvtSystemUserID]);
-	mVersion = Variant::getMaybeByte(va[EvtSystemVersion]);
+void EventRecord::renderProperties(const EventRecordHandle &hRecord)
+{
+	std::shared_ptr<const EventDefinition> context = mProviderName.has_value() ?
+		eventDefinitionCache.cacheLookup(mProviderName.value(), mEventId.value_or(0), mVersion.value_or(0)) :
+		nullptr;
+	EVT_HANDLE hContext = context ? context->handle() : getDefaultUserRenderContext();
 
-	//
-	// Now format the human readable messages.
-	// 
+	DWORD propertyCount = 0;
+	EvtVariantArrayPtr rendered = render(hContext, hRecord, propertyCount);
+	const EVT_VARIANT *va = context ? context->getPayload(rendered.get(), propertyCount) : rendered.get();
+	if (!va)
+	{
+		// None of the template's names are in the record, the values are 
+		// rendered unnamed.
+		context = nullptr;
+		rendered = render(getDefaultUserRenderContext(), hRecord, propertyCount);
+		va = rendered.get();
+	}
 
-	if (mProviderName.has_value())
+	mProperties.reserve(propertyCount);
+	for (DWORD i = 0; i < propertyCount; ++i)
 	{
-		const std::string &providerName = mProviderName.value();
-		// If the publisher isn't found try to format without.
-		RefPtr<PublisherMetadata> publisher = PublisherMetadata::cacheOpenProvider(providerName);
-		if (publisher)
+		std::string name = context && i < context->getNames().size() ? context->getNames()[i] : std::string();
+		mProperties.push_back({ std::move(name), Variant::getPropertyValue(va[i]) });
+	}
+}
+
+void appendEventRecord(EventBatch &batch, void *hRecord, const RecordProjection &projection, std::vector<uint64_t> &buffer)
+{
+	EventBatch::Record r{};
+	if (!projection.rendersValues())
+	{
+		batch.append(r);
+		return;
+	}
+
+	const RenderContext *pContext = projection.getRenderContext();
+	EVT_HANDLE hContext = pContext ? pContext->handle() : getDefaultSystemRenderContext();
+
+	// Words, so the variants are aligned.
+	if (buffer.empty())
+		buffer.resize(1024 / sizeof(uint64_t));
+
+	DWORD size = 0;
+	DWORD propertyCount = 0;
+	if (!::EvtRender(hContext, hRecord, EvtRenderEventValues, DWORD(buffer.size() * sizeof(uint64_t)), buffer.data(), &size, &propertyCount))
+	{
+		DWORD err = ::GetLastError();
+		if (err != ERROR_INSUFFICIENT_BUFFER)
 		{
-			mRecord = publisher->format(hRecord);
+			THROW_(SystemException, err);
 		}
-		else
+
+		buffer.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		if (!::EvtRender(hContext, hRecord, EvtRenderEventValues, DWORD(buffer.size() * sizeof(uint64_t)), buffer.data(), &size, &propertyCount))
 		{
-			mRecord = PublisherMetadata::formatEvent(hRecord);
+			THROW_(SystemException, ::GetLastError());
 		}
 	}
-	else
+	const EVT_VARIANT *va = reinterpret_cast<const EVT_VARIANT *>(buffer.data());
+
+	// The field's rendered value, or null if it wasn't rendered.
+	auto value = [&](EventField field) -> const EVT_VARIANT * 
 	{
-		// Try to format without the provider.
-		mRecord = PublisherMetadata::formatEvent(hRecord);
+		int index = projection.getValueIndex(field);
+		return index >= 0 ? &va[size_t(index)] : nullptr;
+	};
+
+	// Sets the field if it was rendered and isn't null.
+	auto set = [&](EventField field, auto &to, auto get)
+	{
+		if (const EVT_VARIANT *v = value(field))
+		{
+			if (auto maybe = get(*v))
+			{
+				to = *maybe;
+				r.fields = r.fields | field;
+			}
+		}
+	};
+
+	// Strings are converted into s, which the record's view points at.
+	auto setString = [&](EventField field, std::optional<std::string> &s, std::string_view &to)
+	{
+		if (const EVT_VARIANT *v = value(field))
+			s = Variant::getMaybeString(*v);
+		if (s)
+		{
+			to = *s;
+			r.fields = r.fields | field;
+		}
+	};
+
+	std::optional<std::string> providerName, channel, computer;
+	std::string user;
+
+	setString(EventField::ProviderName, providerName, r.providerName);
+	set(EventField::ProviderGuid, r.providerGuid, Variant::getMaybeGuid);
+	set(EventField::EventId, r.eventId, Variant::getMaybeUInt16);
+	set(EventField::Qualifiers, r.qualifiers, Variant::getMaybeUInt16);
+	set(EventField::Level, r.level, Variant::getMaybeByte);
+	set(EventField::Task, r.task, Variant::getMaybeUInt16);
+	set(EventField::Opcode, r.opcode, Variant::getMaybeByte);
+
+	const EVT_VARIANT *keywords = value(EventField::Keywords);
+	if (keywords && (keywords->Type == EvtVarTypeHexInt64 ||
+		keywords->Type == EvtVarTypeInt64 ||
+		keywords->Type == EvtVarTypeUInt64))
+	{
+		r.keywords = int64_t(keywords->UInt64Val & 0x0000FFFFFFFFFFFF);
+		r.fields = r.fields | EventField::Keywords;
+	}
+
+	set(EventField::TimeCreated, r.timeCreated, [](const EVT_VARIANT &v) {
+		std::optional<Timestamp> t = Variant::getMaybeTimestamp(v);
+		return t ? std::optional<uint64_t>(t->timestamp) : std::nullopt;
+	});
+	set(EventField::RecordId, r.recordId, Variant::getMaybeUInt64);
+	set(EventField::ActivityId, r.activityId, Variant::getMaybeGuid);
+	set(EventField::ProcessId, r.processId, Variant::getMaybeUInt32);
+	set(EventField::ThreadId, r.threadId, Variant::getMaybeUInt32);
+
+	setString(EventField::Channel, channel, r.channel);
+	setString(EventField::Computer, computer, r.computer);
+
+	if (const EVT_VARIANT *v = value(EventField::User))
+	{
+		std::string sid = getUserSID(*v);
+		if (!sid.empty())
+		{
+			user = accountName(sid);
+			r.user = user;
+			r.fields = r.fields | EventField::User;
+		}
 	}
+	set(EventField::Version, r.version, Variant::getMaybeByte);
+
+	batch.append(r);
 }
 
-Ref<EventRecord> EventRecord::create(const EventRecordHandle &hRecord)
+Ref<EventRecord> EventRecord::create(std::shared_ptr<void> hRecord, const RecordProjection &projection)
 {
-	return RefObject<EventRecord>::createRef(hRecord);
+	return RefObject<EventRecord>::createRef(std::move(hRecord), projection);
 }
 
 std::optional<std::string> EventRecord::getProviderName() const
@@ -321,7 +853,16 @@ std::optional<std::string> EventRecord::getComputer() const
 
 std::optional<std::string> EventRecord::getUser() const
 {
-	return {};
+	std::call_once(mUserResolved, [this]
+	{
+		if (mUserSid.empty())
+		{
+			return;
+		}
+
+		mUser = accountName(mUserSid);
+	});
+	return mUser;
 }
 
 std::optional<uint8_t> EventRecord::getVersion() const
@@ -331,42 +872,52 @@ std::optional<uint8_t> EventRecord::getVersion() const
 
 std::string EventRecord::getMessage() const
 {
-	return mRecord.message;
+	return formatted(EventField::Message).message;
 }
 
 std::string EventRecord::getLevelDisplay() const
 {
-	return mRecord.level;
+	return formatted(EventField::LevelDisplay).level;
 }
 
 std::string EventRecord::getTaskDisplay() const
 {
-	return mRecord.task;
+	return formatted(EventField::TaskDisplay).task;
 }
 
 std::string EventRecord::getOpcodeDisplay() const 
 {
-	return mRecord.opcode;
+	return formatted(EventField::OpcodeDisplay).opcode;
 }
 
 std::vector<std::string> EventRecord::getKeywordsDisplay() const
 {
-	return mRecord.keywords;
+	return formatted(EventField::KeywordsDisplay).keywords;
 }
 
 std::string EventRecord::getChannelMessage() const
 {
-	return mRecord.channelMessage;
+	return formatted(EventField::ChannelMessage).channelMessage;
 }
 
 std::string EventRecord::getProviderMessage() const 
 {
-	return mRecord.providerMessage;
+	return formatted(EventField::ProviderMessage).providerMessage;
+}
+
+std::vector<EventProperty> EventRecord::getProperties() const
+{
+	return mProperties;
 }
 
-Ref<IEventRecord> IEventRecord::createEmpty()
+std::optional<EventPropertyValue> EventRecord::getProperty(const std::string &name) const
 {
-	return EmptyEventRecord::create();
+	for (const EventProperty &property : mProperties)
+	{
+		if (property.name == name)
+			return property.value;
+	}
+	return {};
 }
 
 }
\ No newline at end of file
@@ -22,6 +22,12 @@
 #pragma once
 
 #include "IEventRecord.h"
+#include "EventBatch.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace Windows::EventLog
 {
@@ -37,13 +43,59 @@ struct FormattedEventRecord
 	std::string providerMessage;
 };
 
+class RenderContext;
+
+// Which fields to render and the render context that renders them. With 
+// every system property it's the EvtRenderContextSystem context, otherwise
+// an EvtRenderContextValues context of just the requested properties.
+// Shared by all the records of batches fetched with it.
+class RecordProjection
+{
+public:
+	explicit RecordProjection(EventField fields);
+	~RecordProjection();
+
+	EventField getFields() const { return mFields; }
+
+	// False when no system fields are needed at all.
+	bool rendersValues() const { return mRendersValues; }
+
+	// Null means the system context.
+	const RenderContext *getRenderContext() const { return mContext.get(); }
+
+	// Index of the system field's value in the rendered values, or -1 when
+	// it isn't rendered.
+	int getValueIndex(EventField field) const;
+
+private:
+	static constexpr size_t SystemFieldCount = 17;
+
+	EventField mFields;
+	bool mRendersValues = false;
+	std::unique_ptr<RenderContext> mContext{};
+	std::array<int, SystemFieldCount> mValueIndex{};
+
+	RecordProjection(const RecordProjection &) = delete;
+	RecordProjection &operator=(const RecordProjection &) = delete;
+};
+
+// Appends the system fields of the record to the batch, with the values 
+// EventRecord would render for them. The values are rendered into buffer, 
+// which is kept from one record to the next.
+void appendEventRecord(EventBatch &batch, void *hRecord, const RecordProjection &projection, std::vector<uint64_t> &buffer);
+
 class EventRecordHandle;
+
+// Event record from the Event Log API. The system properties and payload are
+// rendered up front, the display strings are formatted on first use.
 class EventRecord : public IEventRecord
 {
 public:	
 	friend class RefObject<EventRecord>;
 
-	static Ref<EventRecord> create(const EventRecordHandle &hRecord);
+	// hRecord holds the EVT_HANDLE and keeps it open. The record holds on to
+	// it while it may still have display strings to format.
+	static Ref<EventRecord> create(std::shared_ptr<void> hRecord, const RecordProjection &projection);
 
 	~EventRecord() = default;
 
@@ -71,9 +123,20 @@ public:
 	std::vector<std::string> getKeywordsDisplay() const override;
 	std::string getChannelMessage() const override;
 	std::string getProviderMessage() const override;
+	std::vector<EventProperty> getProperties() const override;
+	std::optional<EventPropertyValue> getProperty(const std::string &name) const override;
 
 private:
-	explicit EventRecord(const EventRecordHandle &hRecord);
+	EventRecord(std::shared_ptr<void> hRecord, const RecordProjection &projection);
+
+	void renderValues(const EventRecordHandle &hRecord, const RecordProjection &projection);
+	void renderProperties(const EventRecordHandle &hRecord);
+
+	// Formats the display string the first time it's asked for.
+	const FormattedEventRecord &formatted(EventField field) const;
+	// Formats the message from the event definition's cached template, false
+	// if EvtFormatMessage has to do it.
+	bool formatMessage(const EventRecordHandle &hRecord) const;
 
 private:
 	std::optional<std::string> mProviderName{};
@@ -92,10 +155,21 @@ private:
 	std::optional<uint32_t> mThreadId{};
 	std::optional<std::string> mChannel{};
 	std::optional<std::string> mComputer{};
-	std::optional<std::string> mUser{};
+	// Resolved to the account name on first use.
+	std::string mUserSid{};
+	mutable std::optional<std::string> mUser{};
+	mutable std::once_flag mUserResolved{};
 	std::optional<uint8_t> mVersion{};
 
-	FormattedEventRecord mRecord{};
+	std::vector<EventProperty> mProperties{};
+
+	EventField mFields;
+	std::shared_ptr<void> mEventHandle{};
+
+	// Each string is only written under its own flag.
+	static constexpr size_t DisplayFieldCount = 7;
+	mutable FormattedEventRecord mRecord{};
+	mutable std::array<std::once_flag, DisplayFieldCount> mFormatted{};
 
 private:
 	EventRecord(const EventRecord &) = delete;
@@ -0,0 +1,418 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EventSubscription.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Batch without records, for a timeout or a closed subscription.
+class SubscriptionStatusBatch : public IQueryBatchResult
+{
+public:
+	friend class RefObject<SubscriptionStatusBatch>;
+
+	static Ref<SubscriptionStatusBatch> create(QueryNextStatus status)
+	{
+		return RefObject<SubscriptionStatusBatch>::createRef(status);
+	}
+
+	QueryNextStatus getStatus() const override { return mStatus; }
+	uint32_t getCount() const override { return 0u; }
+	Ref<IEventRecord> getRecord(uint32_t /* index */) const override { THROW(IndexOutOfBoundsException); }
+
+private:
+	explicit SubscriptionStatusBatch(QueryNextStatus status)
+		: mStatus(status)
+	{}
+
+	QueryNextStatus mStatus;
+};
+
+// Several buffered batches handed out as one. The reader reads whatever 
+// has arrived, often a record or two at a time, so the consumer would 
+// otherwise get batches as small as that.
+class CombinedBatch : public IQueryBatchResult
+{
+public:
+	friend class RefObject<CombinedBatch>;
+
+	static Ref<CombinedBatch> create(std::vector<Ref<IQueryBatchResult>> parts)
+	{
+		return RefObject<CombinedBatch>::createRef(std::move(parts));
+	}
+
+	QueryNextStatus getStatus() const override { return QueryNextStatus::Success; }
+	uint32_t getCount() const override { return mEnds.empty() ? 0u : mEnds.back(); }
+
+	Ref<IEventRecord> getRecord(uint32_t index) const override
+	{
+		auto it = std::upper_bound(mEnds.begin(), mEnds.end(), index);
+		if (it == mEnds.end())
+		{
+			THROW(IndexOutOfBoundsException);
+		}
+
+		const size_t part = size_t(it - mEnds.begin());
+		return mParts[part]->getRecord(part == 0 ? index : index - mEnds[part - 1]);
+	}
+
+private:
+	explicit CombinedBatch(std::vector<Ref<IQueryBatchResult>> parts)
+		: mParts(std::move(parts))
+	{
+		uint32_t end = 0;
+		for (const Ref<IQueryBatchResult> &part : mParts)
+		{
+			end += part->getCount();
+			mEnds.push_back(end);
+		}
+	}
+
+	std::vector<Ref<IQueryBatchResult>> mParts;
+	// Index one past the last record of each part.
+	std::vector<uint32_t> mEnds{};
+};
+
+//
+// EventSubscription
+//
+
+Ref<EventSubscription> EventSubscription::create(Ref<ISubscriptionSource> source, const std::string &channel, const std::string &query, 
+	const Options &options, BatchHandler handler)
+{
+	return RefObject<EventSubscription>::createRef(std::move(source), channel, query, options, std::move(handler));
+}
+
+EventSubscription::EventSubscription(Ref<ISubscriptionSource> source, const std::string &channel, const std::string &query, 
+	const Options &options, BatchHandler handler)
+	: mSource(std::move(source))
+	, mOptions(options)
+	, mHandler(std::move(handler))
+{
+	if (mOptions.batchSize == 0 || mOptions.bufferSize == 0)
+	{
+		THROW(InvalidArgumentException);
+	}
+
+	// Subscribe here so a bad channel or query throws to the caller.
+	mSource->setFields(mOptions.fields);
+	mSource->subscribe(channel, query, mOptions.start, mOptions.bookmark);
+
+	try
+	{
+		mReader = Thread::begin(&EventSubscription::readerMain, this);
+		if (mHandler)
+			mDispatcher = Thread::begin(&EventSubscription::dispatchMain, this);
+	}
+	catch (...)
+	{
+		// The destructor won't run, so stop the reader if it started.
+		terminate();
+		throw;
+	}
+}
+
+EventSubscription::~EventSubscription()
+{
+	terminate();
+}
+
+Ref<IQueryBatchResult> EventSubscription::getNextBatch(uint32_t timeout)
+{
+	if (mHandler)
+	{
+		THROW(InvalidStateException);
+	}
+
+	mReady.wait(timeout);
+	if (std::optional<Ref<IQueryBatchResult>> batch = pop())
+		return std::move(*batch);
+
+	std::exception_ptr error;
+	QueryNextStatus status = QueryNextStatus::Timeout;
+	{
+		CriticalSection::Lock lck(mLock);
+		error = mError;
+		if (mClosing || mStopped)
+			status = QueryNextStatus::NoMoreItems;
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+	return SubscriptionStatusBatch::create(status);
+}
+
+bool EventSubscription::waitForRecords(uint32_t timeout)
+{
+	if (mHandler)
+	{
+		THROW(InvalidStateException);
+	}
+
+	mReady.wait(timeout);
+
+	CriticalSection::Lock lck(mLock);
+	return !mBuffer.empty();
+}
+
+SubscriptionStats EventSubscription::getStats() const
+{
+	CriticalSection::Lock lck(mLock);
+	return mStats;
+}
+
+void EventSubscription::close()
+{
+	terminate();
+
+	std::exception_ptr error;
+	{
+		CriticalSection::Lock lck(mLock);
+		error = mError;
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+bool EventSubscription::push(Ref<IQueryBatchResult> batch)
+{
+	const uint64_t count = batch->getCount();
+	for (;;)
+	{
+		{
+			CriticalSection::Lock lck(mLock);
+			if (mClosing || mStopped)
+				return false;
+
+			// A batch bigger than the whole buffer still goes in on its own.
+			const bool fits = mStats.buffered + count <= mOptions.bufferSize || mBuffer.empty();
+			if (!fits && mOptions.overflow == OverflowPolicy::DropNewest)
+			{
+				mStats.dropped += count;
+				return true;
+			}
+
+			if (fits || mOptions.overflow == OverflowPolicy::DropOldest)
+			{
+				while (!mBuffer.empty() && mStats.buffered + count > mOptions.bufferSize)
+				{
+					const uint64_t dropped = mBuffer.front()->getCount();
+					mBuffer.pop_front();
+					mStats.buffered -= dropped;
+					mStats.dropped += dropped;
+				}
+
+				mBuffer.push_back(std::move(batch));
+				mStats.buffered += count;
+				mStats.peakBuffered = std::max(mStats.peakBuffered, mStats.buffered);
+				mReady.set();
+				return true;
+			}
+
+			++mStats.blocked;
+		}
+
+		// OverflowPolicy::Block. Wait for the consumer to take something.
+		mRoom.wait();
+	}
+}
+
+std::optional<Ref<IQueryBatchResult>> EventSubscription::pop()
+{
+	std::vector<Ref<IQueryBatchResult>> parts;
+	{
+		CriticalSection::Lock lck(mLock);
+		if (mBuffer.empty())
+			return std::nullopt;
+
+		// Up to a batch worth of records, but at least one batch.
+		uint64_t count = 0;
+		do
+		{
+			count += mBuffer.front()->getCount();
+			parts.push_back(std::move(mBuffer.front()));
+			mBuffer.pop_front();
+		} while (!mBuffer.empty() && count + mBuffer.front()->getCount() <= mOptions.batchSize);
+
+		mStats.buffered -= count;
+		mStats.delivered += count;
+
+		// Stays set once stopped, so waiters see it.
+		if (mBuffer.empty() && !mClosing && !mStopped)
+			mReady.reset();
+	}
+
+	mRoom.set();
+	if (parts.size() == 1)
+		return std::move(parts.front());
+	return Ref<IQueryBatchResult>(CombinedBatch::create(std::move(parts)));
+}
+
+unsigned EventSubscription::readerMain(void *arg)
+{
+	try
+	{
+		static_cast<EventSubscription *>(arg)->readerThisMain();
+		return 0;
+	}
+	catch (...) // This is the top of thread stack, so swallow everything.
+	{
+		return 1;
+	}
+}
+
+void EventSubscription::readerThisMain()
+{
+	try
+	{
+		for (;;)
+		{
+			{
+				CriticalSection::Lock lck(mLock);
+				if (mClosing || mStopped)
+					return;
+			}
+
+			Ref<IQueryBatchResult> batch = mSource->next(mOptions.batchSize);
+			if (batch->getCount() == 0)
+			{
+				// Woken early by cancel when closing.
+				mSource->wait(INFINITE);
+				continue;
+			}
+
+			if (!push(std::move(batch)))
+				return;
+		}
+	}
+	catch (...)
+	{
+		CriticalSection::Lock lck(mLock);
+		mError = std::current_exception();
+		mStopped = true;
+		mReady.set();
+	}
+}
+
+unsigned EventSubscription::dispatchMain(void *arg)
+{
+	try
+	{
+		static_cast<EventSubscription *>(arg)->dispatchThisMain();
+		return 0;
+	}
+	catch (...) // This is the top of thread stack, so swallow everything.
+	{
+		return 1;
+	}
+}
+
+void EventSubscription::dispatchThisMain()
+{
+	mDispatcherThread = std::this_thread::get_id();
+	for (;;)
+	{
+		mReady.wait();
+		{
+			// Closing discards what's buffered. After a reader error, the 
+			// batches read before it still go to the handler.
+			CriticalSection::Lock lck(mLock);
+			if (mClosing || (mStopped && mBuffer.empty()))
+				return;
+		}
+
+		std::optional<Ref<IQueryBatchResult>> batch = pop();
+		if (!batch)
+			continue;
+
+		try
+		{
+			mHandler(std::move(*batch));
+		}
+		catch (...)
+		{
+			{
+				CriticalSection::Lock lck(mLock);
+				mError = std::current_exception();
+				mStopped = true;
+			}
+
+			// The reader may be waiting on the source or for room.
+			mSource->cancel();
+			mRoom.set();
+			return;
+		}
+	}
+}
+
+void EventSubscription::terminate() noexcept
+{
+	bool closed = false;
+	{
+		CriticalSection::Lock lck(mLock);
+		closed = mClosing;
+		mClosing = true;
+		mReady.set();
+	}
+
+	mSource->cancel();
+	mRoom.set();
+	mReader.join();
+	// From the handler, the dispatcher sees mClosing once it returns.
+	if (mDispatcherThread.load() != std::this_thread::get_id())
+		mDispatcher.join();
+
+	if (!closed)
+	{
+		{
+			CriticalSection::Lock lck(mLock);
+			mBuffer.clear();
+			mStats.buffered = 0;
+		}
+		mSource->close();
+	}
+}
+
+//
+// IEventSubscription
+//
+
+Ref<IEventSubscription> IEventSubscription::subscribe(const std::string &channel, const std::string &query, const Options &options)
+{
+	return EventSubscription::create(createDefaultSubscriptionSource(), channel, query, options, nullptr);
+}
+
+Ref<IEventSubscription> IEventSubscription::subscribe(const std::string &channel, const std::string &query, const Options &options, 
+	BatchHandler handler)
+{
+	if (!handler)
+	{
+		THROW(InvalidArgumentException);
+	}
+	return EventSubscription::create(createDefaultSubscriptionSource(), channel, query, options, std::move(handler));
+}
+
+}
@@ -0,0 +1,109 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventSubscription.h"
+#include "SubscriptionSource.h"
+#include "SysPlatform.h"
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <thread>
+
+namespace Windows::EventLog
+{
+
+// Subscription over any ISubscriptionSource. The reader thread waits on the
+// source and moves what it has into the buffer a batch at a time; in push 
+// mode a second thread takes them out and calls the handler, so a slow 
+// handler backs up into the buffer rather than the source.
+class EventSubscription : public IEventSubscription
+{
+public:
+	friend class RefObject<EventSubscription>;
+
+	// A null handler subscribes in pull mode.
+	static Ref<EventSubscription> create(Ref<ISubscriptionSource> source, const std::string &channel, const std::string &query, 
+		const Options &options, BatchHandler handler);
+
+	~EventSubscription();
+
+	Ref<IQueryBatchResult> getNextBatch(uint32_t timeout) override;
+
+	bool waitForRecords(uint32_t timeout) override;
+
+	SubscriptionStats getStats() const override;
+
+	void close() override;
+
+private:
+	EventSubscription(Ref<ISubscriptionSource> source, const std::string &channel, const std::string &query, 
+		const Options &options, BatchHandler handler);
+
+	static unsigned readerMain(void *arg);
+	void readerThisMain();
+
+	static unsigned dispatchMain(void *arg);
+	void dispatchThisMain();
+
+	// Adds the batch to the buffer, making room as the overflow policy 
+	// says. Returns false if closed meanwhile.
+	bool push(Ref<IQueryBatchResult> batch);
+
+	// Takes the oldest batch out of the buffer, if there is one. 
+	std::optional<Ref<IQueryBatchResult>> pop();
+
+	// Stops both threads and waits for them, except for the dispatcher when 
+	// called from the handler. Doesn't throw.
+	void terminate() noexcept;
+
+	Ref<ISubscriptionSource> mSource;
+	const Options mOptions;
+	const BatchHandler mHandler;
+
+	// Everything below is shared by the threads and guarded by mLock.
+	mutable CriticalSection mLock{};
+	std::deque<Ref<IQueryBatchResult>> mBuffer{};
+	SubscriptionStats mStats{};
+	bool mClosing = false;
+	// Set when the reader stops on an error or the handler throws.
+	bool mStopped = false;
+	std::exception_ptr mError{};
+
+	// Set while there are batches to take, or once stopped.
+	ManualResetEvent mReady{ FALSE };
+	// Set when batches are taken out, for a reader blocked on a full buffer.
+	AutoResetEvent mRoom{ FALSE };
+
+	Thread mReader{};
+	Thread mDispatcher{};
+	// Set by the dispatcher thread, so close from the handler can tell.
+	std::atomic<std::thread::id> mDispatcherThread{};
+
+	EventSubscription(const EventSubscription &) = delete;
+	EventSubscription &operator=(const EventSubscription &) = delete;
+};
+
+}
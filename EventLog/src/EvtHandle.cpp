@@ -631,6 +631,18 @@ QueryHandle QueryHandle::query(const wchar_t *channel, const wchar_t *queryText,
 	return QueryHandle(h);
 }
 
+QueryHandle QueryHandle::subscribe(HANDLE signal, const wchar_t *channel, const wchar_t *queryText, EVT_HANDLE bookmark, uint32_t flags)
+{
+	EVT_HANDLE h = ::EvtSubscribe(nullptr, signal, channel, queryText, bookmark, nullptr, nullptr, flags);
+	if (!h)
+	{
+		DWORD err = ::GetLastError();
+		THROW_(SystemException, err);
+	}
+
+	return QueryHandle(h);
+}
+
 QueryNextStatus QueryHandle::next(uint32_t eventSize, EVT_HANDLE *events, uint32_t timeout, uint32_t flags, uint32_t *numberReturned)
 {
 	DWORD count = 0;
@@ -644,6 +656,7 @@ QueryNextStatus QueryHandle::next(uint32_t eventSize, EVT_HANDLE *events, uint32
 			return QueryNextStatus::NoMoreItems;
 		case ERROR_TIMEOUT:
 			return QueryNextStatus::Timeout;
+		case ERROR_CANCELLED: // See cancel
 		default:
 			THROW_(SystemException, err);
 		}				
@@ -652,6 +665,14 @@ QueryNextStatus QueryHandle::next(uint32_t eventSize, EVT_HANDLE *events, uint32
 	return QueryNextStatus::Success;
 }
 
+SysErr QueryHandle::cancel() noexcept
+{
+	SysErr err{};
+	if (!::EvtCancel(mHandle.handle()))
+		err = ::GetLastError();
+	return err;
+}
+
 static inline DWORD to_EvtSeekFlag(SeekOption option)
 {
 	switch (option)
@@ -679,6 +700,16 @@ void QueryHandle::seek(int64_t position, SeekOption whence)
 	}
 }
 
+void QueryHandle::seek(EVT_HANDLE hBookmark, int64_t position)
+{
+	BOOL success = ::EvtSeek(mHandle.handle(), position, hBookmark, 0, EvtSeekRelativeToBookmark);
+	if (!success)
+	{
+		DWORD err = ::GetLastError();
+		THROW_(SystemException, err);
+	}
+}
+
 
 //
 // EventMetadataHandle
@@ -488,6 +488,11 @@ public:
 	// see EvtQuery()
 	static QueryHandle query(const wchar_t *channel, const wchar_t *queryText, uint32_t flags);
 
+	// see EvtSubscribe(). The service sets signal when records arrive, 
+	// next() reads them. bookmark can be null.
+	static QueryHandle subscribe(HANDLE signal, const wchar_t *channel, const wchar_t *queryText, 
+		EVT_HANDLE bookmark, uint32_t flags);
+
 	constexpr QueryHandle() noexcept : mHandle{nullptr} {}
 	constexpr explicit QueryHandle(std::nullptr_t) noexcept : mHandle{nullptr} {}
 	QueryHandle(QueryHandle &&rhs) = default;
@@ -517,13 +522,18 @@ public:
 
 	void seek(int64_t position, SeekOption flags);
 
-	// TODO: void seek(EVT_HANDLE hBookmark, int64_t position);
+	// See EvtSeek with EvtSeekRelativeToBookmark.
+	void seek(EVT_HANDLE hBookmark, int64_t position);
 
 	SysErr close()
 	{
 		return this->mHandle.close();
 	}
 
+	// See EvtCancel. Makes an EvtNext in progress on another thread fail 
+	// with ERROR_CANCELLED.
+	SysErr cancel() noexcept;
+
 	bool isNull() const noexcept
 	{
 		return this->mHandle.isNull();
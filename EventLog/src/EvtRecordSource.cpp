@@ -0,0 +1,381 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EvtRecordSource.h"
+
+#include "Array.h"
+#include "EventRecord.h"
+#include "QueryPlan.h"
+#include "StringUtils.h"
+
+namespace Windows::EventLog
+{
+
+using EvtHandleArray = Array<EVT_HANDLE, EvtHandleClose>;
+
+// Bookmarks are kept as XML and only made into a handle to give to the 
+// service, which is cheaper than EvtUpdateBookmark on every record read.
+static EvtHandle createBookmark(const std::string &xml)
+{
+	EvtHandle hBookmark{ ::EvtCreateBookmark(to_utf16(xml).c_str()) };
+	if (!hBookmark)
+	{
+		DWORD err = ::GetLastError();
+		THROW_(SystemException, err);
+	}
+	return hBookmark;
+}
+
+//
+// QueryBatchResult 
+//
+
+class QueryBatchResult : public IQueryBatchResult
+{
+public:
+	friend RefObject<QueryBatchResult>;
+
+	static Ref<QueryBatchResult> createTimeout();
+
+	static Ref<QueryBatchResult> createNoMoreItems();
+
+	static Ref<QueryBatchResult> createSuccess(EvtHandleArray events, uint32_t count, std::shared_ptr<const RecordProjection> projection);
+
+	~QueryBatchResult();
+
+	QueryNextStatus getStatus() const override;
+	void setStatus(QueryNextStatus status);
+
+	uint32_t getCount() const override;
+
+	Ref<IEventRecord> getRecord(uint32_t index) const override;
+
+	Ref<IEventBatch> getEventBatch() const override;
+
+private:
+	QueryNextStatus mStatus{QueryNextStatus::Success};
+	std::shared_ptr<const EvtHandleArray> mEvents{};
+	uint32_t mCount{0};
+	std::shared_ptr<const RecordProjection> mProjection{};
+
+private:
+	QueryBatchResult(QueryNextStatus status, EvtHandleArray events, uint32_t count, std::shared_ptr<const RecordProjection> projection);
+	QueryBatchResult(QueryNextStatus status);
+
+};
+
+Ref<QueryBatchResult> QueryBatchResult::createTimeout()
+{
+	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::Timeout);
+}
+
+Ref<QueryBatchResult> QueryBatchResult::createNoMoreItems()
+{
+	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::NoMoreItems);
+}
+
+Ref<QueryBatchResult> QueryBatchResult::createSuccess(EvtHandleArray events, uint32_t count, std::shared_ptr<const RecordProjection> projection)
+{
+	return RefObject<QueryBatchResult>::createRef(QueryNextStatus::Success, std::move(events), count, std::move(projection));
+}
+
+QueryBatchResult::QueryBatchResult(QueryNextStatus status, EvtHandleArray events, uint32_t count, std::shared_ptr<const RecordProjection> projection)
+	: mStatus{ status }
+	, mEvents{ std::make_shared<const EvtHandleArray>(std::move(events)) }
+	, mCount(count)
+	, mProjection{ std::move(projection) }
+{
+}
+
+QueryBatchResult::QueryBatchResult(QueryNextStatus status)
+	: mStatus{ status }
+{}
+
+QueryBatchResult::~QueryBatchResult()
+{}
+
+QueryNextStatus QueryBatchResult::getStatus() const 
+{
+	return mStatus;
+}
+
+void QueryBatchResult::setStatus(QueryNextStatus status)
+{
+	mStatus = status;
+}
+
+uint32_t QueryBatchResult::getCount() const 
+{
+	return mCount;
+}
+
+Ref<IEventRecord> QueryBatchResult::getRecord(uint32_t index) const 
+{
+	if (index >= mCount)
+	{
+		THROW(IndexOutOfBoundsException);
+	}
+
+	// Records share the batch's handles, they format display strings later.
+	std::shared_ptr<void> hRecord(mEvents, (*mEvents)[index]);
+	return EventRecord::create(std::move(hRecord), *mProjection);
+}
+
+Ref<IEventBatch> QueryBatchResult::getEventBatch() const
+{
+	Ref<EventBatch> batch = EventBatch::create(mCount);
+	if (mCount == 0)
+	{
+		return batch;
+	}
+
+	// One render buffer for the whole batch.
+	std::vector<uint64_t> buffer;
+	for (uint32_t i = 0; i < mCount; ++i)
+		appendEventRecord(batch.get(), (*mEvents)[i], *mProjection, buffer);
+	return batch;
+}
+
+//
+// EvtRecordSource
+//
+
+Ref<EvtRecordSource> EvtRecordSource::create()
+{
+	return RefObject<EvtRecordSource>::createRef();
+}
+
+EvtRecordSource::EvtRecordSource()
+	: mProjection{ std::make_shared<const RecordProjection>(EventField::All) }
+{}
+
+void EvtRecordSource::query(const wchar_t *path, const std::string &queryText, uint32_t flags)
+{
+	if (mQueryHandle)
+	{
+		SysErr err = close();
+		if (err.failed()) 
+		{
+			THROW_(SystemException, err.getCode());
+		}
+	}
+
+	QueryHandle handle = QueryHandle::query(path, to_utf16(queryText).c_str(), flags);
+
+	CriticalSection::Lock lck(mHandleLock);
+	if (mCancelled)
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
+	}
+	mQueryHandle = std::move(handle);
+}
+
+void EvtRecordSource::queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir)
+{
+	uint32_t flags = EvtQueryChannelPath | 
+		(dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
+
+	query(to_utf16(channel).c_str(), xpathQuery, flags);
+}
+
+void EvtRecordSource::queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir)
+{
+	uint32_t flags = EvtQueryFilePath | 
+		(dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
+
+	query(to_utf16(filePath).c_str(), xpathQuery, flags);
+}
+
+void EvtRecordSource::queryStructuredXML(const std::string &structuredXML, Direction dir)
+{
+	uint32_t flags = (dir == Direction::Forward ? EvtQueryForwardDirection : EvtQueryReverseDirection);
+
+	// The service evaluates every Select and Suppress separately, so hand it
+	// the optimized plan. Anything the plan doesn't understand goes as is.
+	std::string optimized;
+	try
+	{
+		QueryPlan plan = QueryPlan::parse(structuredXML);
+		plan.optimize();
+		optimized = plan.toXml();
+	}
+	catch (const SystemException &)
+	{
+		optimized = structuredXML;
+	}
+
+	query(nullptr, optimized, flags);
+}
+
+Ref<IQueryBatchResult> EvtRecordSource::next(uint32_t batchSize, uint32_t timeout)
+{
+	throwIfCancelled();
+
+	EvtHandleArray events(batchSize);
+	uint32_t count = 0;
+	QueryNextStatus status = mQueryHandle.next(batchSize, ptr(events), timeout, 0, &count);
+	// A cancel after the check above but before EvtNext started doesn't 
+	// stop it, so look again. 
+	throwIfCancelled();
+	switch (status)
+	{
+	case QueryNextStatus::Success:
+		return QueryBatchResult::createSuccess(std::move(events), count, mProjection);
+	case QueryNextStatus::Timeout: // Specified timeout. Expected.
+		return QueryBatchResult::createTimeout();
+	case QueryNextStatus::NoMoreItems:
+	default:
+		return QueryBatchResult::createNoMoreItems();
+	}
+}
+
+void EvtRecordSource::seek(int64_t position, SeekOption whence)
+{
+	mQueryHandle.seek(position, whence);
+}
+
+void EvtRecordSource::seek(const IBookmark &bookmark)
+{
+	EvtHandle hBookmark = createBookmark(bookmark.toXml());
+	mQueryHandle.seek(hBookmark.handle(), 1);
+}
+
+void EvtRecordSource::setFields(EventField fields)
+{
+	// Batches already fetched keep the projection they were fetched with.
+	mProjection = std::make_shared<const RecordProjection>(fields);
+}
+
+SysErr EvtRecordSource::close()
+{
+	CriticalSection::Lock lck(mHandleLock);
+	return mQueryHandle.close();
+}
+
+void EvtRecordSource::throwIfCancelled()
+{
+	CriticalSection::Lock lck(mHandleLock);
+	if (mCancelled)
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
+	}
+}
+
+void EvtRecordSource::cancel()
+{
+	CriticalSection::Lock lck(mHandleLock);
+	mCancelled = true;
+	if (mQueryHandle)
+	{
+		mQueryHandle.cancel();
+	}
+}
+
+Ref<IRecordSource> createDefaultRecordSource()
+{
+	return EvtRecordSource::create();
+}
+
+//
+// EvtSubscriptionSource
+//
+
+Ref<EvtSubscriptionSource> EvtSubscriptionSource::create()
+{
+	return RefObject<EvtSubscriptionSource>::createRef();
+}
+
+EvtSubscriptionSource::EvtSubscriptionSource()
+	: mProjection{ std::make_shared<const RecordProjection>(EventField::All) }
+{}
+
+void EvtSubscriptionSource::subscribe(const std::string &channel, const std::string &query, SubscriptionStart start, 
+	const std::string &bookmark)
+{
+	if (mSubscriptionHandle)
+	{
+		SysErr err = close();
+		if (err.failed()) 
+		{
+			THROW_(SystemException, err.getCode());
+		}
+	}
+
+	uint32_t flags = 0;
+	EvtHandle hBookmark{};
+	switch (start)
+	{
+	case SubscriptionStart::FutureEvents:
+		flags = EvtSubscribeToFutureEvents;
+		break;
+	case SubscriptionStart::Oldest:
+		flags = EvtSubscribeStartAtOldestRecord;
+		break;
+	case SubscriptionStart::AfterBookmark:
+		flags = EvtSubscribeStartAfterBookmark;
+		hBookmark = createBookmark(bookmark);
+		break;
+	}
+
+	// The service only needs the bookmark while subscribing.
+	mSubscriptionHandle = QueryHandle::subscribe(mSignal.handle(), to_utf16(channel).c_str(), to_utf16(query).c_str(), 
+		hBookmark.handle(), flags);
+}
+
+Ref<IQueryBatchResult> EvtSubscriptionSource::next(uint32_t batchSize)
+{
+	EvtHandleArray events(batchSize);
+	uint32_t count = 0;
+	QueryNextStatus status = mSubscriptionHandle.next(batchSize, ptr(events), 0, 0, &count);
+	if (status == QueryNextStatus::Success)
+		return QueryBatchResult::createSuccess(std::move(events), count, mProjection);
+
+	// Nothing arrived yet.
+	return QueryBatchResult::createNoMoreItems();
+}
+
+void EvtSubscriptionSource::wait(uint32_t timeout)
+{
+	mSignal.wait(timeout);
+}
+
+void EvtSubscriptionSource::cancel()
+{
+	mSignal.set();
+}
+
+void EvtSubscriptionSource::setFields(EventField fields)
+{
+	mProjection = std::make_shared<const RecordProjection>(fields);
+}
+
+SysErr EvtSubscriptionSource::close()
+{
+	return mSubscriptionHandle.close();
+}
+
+Ref<ISubscriptionSource> createDefaultSubscriptionSource()
+{
+	return EvtSubscriptionSource::create();
+}
+
+}
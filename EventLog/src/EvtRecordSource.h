@@ -0,0 +1,118 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "RecordSource.h"
+#include "EvtHandle.h"
+#include "SubscriptionSource.h"
+
+#include <memory>
+
+namespace Windows::EventLog
+{
+
+class RecordProjection;
+
+// Record source backed by the Windows Event Log API. 
+class EvtRecordSource : public IRecordSource
+{
+public:
+	friend class RefObject<EvtRecordSource>;
+
+	static Ref<EvtRecordSource> create();
+
+	~EvtRecordSource() = default;
+
+	void queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir) override;
+	void queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir) override;
+	void queryStructuredXML(const std::string &structuredXML, Direction dir) override;
+
+	Ref<IQueryBatchResult> next(uint32_t batchSize, uint32_t timeout) override;
+
+	void seek(int64_t position, SeekOption whence) override;
+	void seek(const IBookmark &bookmark) override;
+
+	void setFields(EventField fields) override;
+
+	SysErr close() override;
+
+	void cancel() override;
+
+private:
+	EvtRecordSource();
+
+	// Closes any open query, then opens a new one. 
+	void query(const wchar_t *path, const std::string &queryText, uint32_t flags);
+
+	// Throws SystemException with ERROR_CANCELLED once cancel was called.
+	void throwIfCancelled();
+
+	// The handle changes on the strand while cancel uses it from elsewhere,
+	// so both hold the lock. Not held during EvtNext, cancel is what stops it.
+	CriticalSection mHandleLock{};
+	bool mCancelled = false;
+	QueryHandle mQueryHandle{};
+	std::shared_ptr<const RecordProjection> mProjection{};
+
+	EvtRecordSource(const EvtRecordSource &) = delete;
+	EvtRecordSource &operator=(const EvtRecordSource &) = delete;
+};
+
+// Subscription source backed by EvtSubscribe in pull mode: the service 
+// signals an event when records arrive and EvtNext reads them as it does 
+// a query's.
+class EvtSubscriptionSource : public ISubscriptionSource
+{
+public:
+	friend class RefObject<EvtSubscriptionSource>;
+
+	static Ref<EvtSubscriptionSource> create();
+
+	~EvtSubscriptionSource() = default;
+
+	void subscribe(const std::string &channel, const std::string &query, SubscriptionStart start, 
+		const std::string &bookmark) override;
+
+	Ref<IQueryBatchResult> next(uint32_t batchSize) override;
+
+	void wait(uint32_t timeout) override;
+
+	void cancel() override;
+
+	void setFields(EventField fields) override;
+
+	SysErr close() override;
+
+private:
+	EvtSubscriptionSource();
+
+	// Set by the service when records arrive, and by cancel.
+	AutoResetEvent mSignal{ FALSE };
+	QueryHandle mSubscriptionHandle{};
+	std::shared_ptr<const RecordProjection> mProjection{};
+
+	EvtSubscriptionSource(const EvtSubscriptionSource &) = delete;
+	EvtSubscriptionSource &operator=(const EvtSubscriptionSource &) = delete;
+};
+
+}
@@ -777,5 +777,79 @@ int32_t getHexInt32(const EVT_VARIANT &v)
 	return v.Int32Val;
 }
 
+EventPropertyValue getPropertyValue(const EVT_VARIANT &v)
+{
+	if (v.Type & EVT_VARIANT_TYPE_ARRAY)
+	{
+		if ((v.Type & EVT_VARIANT_TYPE_MASK) != EvtVarTypeString)
+			return {};
+
+		std::string s;
+		for (DWORD i = 0; i < v.Count; ++i)
+		{
+			if (i > 0)
+				s.append(", ");
+			s.append(to_utf8(v.StringArr[i]));
+		}
+		return s;
+	}
+
+	switch (v.Type)
+	{
+	case EvtVarTypeString:
+		return to_utf8(v.StringVal);
+	case EvtVarTypeAnsiString:
+		return std::string(v.AnsiStringVal);
+	case EvtVarTypeSByte:
+		return int64_t(v.SByteVal);
+	case EvtVarTypeInt16:
+		return int64_t(v.Int16Val);
+	case EvtVarTypeInt32:
+		return int64_t(v.Int32Val);
+	case EvtVarTypeInt64:
+		return int64_t(v.Int64Val);
+	case EvtVarTypeByte:
+		return uint64_t(v.ByteVal);
+	case EvtVarTypeUInt16:
+		return uint64_t(v.UInt16Val);
+	case EvtVarTypeUInt32:
+	case EvtVarTypeHexInt32:
+		return uint64_t(v.UInt32Val);
+	case EvtVarTypeUInt64:
+	case EvtVarTypeHexInt64:
+		return uint64_t(v.UInt64Val);
+	case EvtVarTypeSizeT:
+		return uint64_t(v.SizeTVal);
+	case EvtVarTypeSingle:
+		return double(v.SingleVal);
+	case EvtVarTypeDouble:
+		return v.DoubleVal;
+	case EvtVarTypeBoolean:
+		return v.BooleanVal != FALSE;
+	case EvtVarTypeGuid:
+		if (!v.GuidVal)
+			return {};
+		return *v.GuidVal;
+	case EvtVarTypeFileTime:
+		return Timestamp{ v.FileTimeVal };
+	case EvtVarTypeSysTime:
+	{
+		FILETIME ft{};
+		if (!v.SysTimeVal || !::SystemTimeToFileTime(v.SysTimeVal, &ft))
+			return {};
+		return Timestamp{ (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime };
+	}
+	case EvtVarTypeBinary:
+		return std::vector<uint8_t>(v.BinaryVal, v.BinaryVal + v.Count);
+	case EvtVarTypeSid:
+		return sidToString(v.SidVal);
+	case EvtVarTypeEvtXml:
+		return to_utf8(v.XmlVal);
+	case EvtVarTypeNull:
+	default:
+		return {};
+	}
+}
+
 } // namespace
 } // namespace
\ No newline at end of file
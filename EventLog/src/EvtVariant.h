@@ -129,6 +129,10 @@ std::string to_string(const EVT_VARIANT &v);
 int64_t getHexInt64(const EVT_VARIANT &v);
 int32_t getHexInt32(const EVT_VARIANT &v);
 
+// Payload property value. String arrays are joined with ", ", other arrays 
+// aren't supported and come back empty.
+EventPropertyValue getPropertyValue(const EVT_VARIANT &v);
+
 }
 
 } // namespace 
\ No newline at end of file
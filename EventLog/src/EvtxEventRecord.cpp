@@ -0,0 +1,335 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EvtxEventRecord.h"
+
+#include <type_traits>
+#include <variant>
+
+namespace Windows::EventLog
+{
+
+using Evtx::SystemField;
+
+//
+// EvtxChunk
+//
+
+EvtxChunk::EvtxChunk(std::shared_ptr<const MappedFile> file, uint64_t offset)
+	: file(std::move(file))
+	, offset(offset)
+	, data(this->file->data() + offset)
+	, parser(data)
+	, records(parser.parse())
+{}
+
+EvtxChunk::~EvtxChunk()
+{
+	file->release(offset, Evtx::ChunkSize);
+}
+
+void appendEvtxRecord(const EvtxChunk &chunk, size_t index, EventField fields, EventBatch &batch)
+{
+	const Evtx::RecordView &view = chunk.records[index];
+	EventBatch::Record r{};
+
+	// The field's values in the chunk, null if it isn't wanted.
+	auto refs = [&](EventField field, SystemField f) -> const Evtx::ValueRefs *
+	{
+		return hasAnyField(fields, field) ? view.tmpl->system[size_t(f)] : nullptr;
+	};
+
+	// Each sets the field if it's wanted and the record has it.
+	auto setUInt = [&](EventField field, SystemField f, auto &to)
+	{
+		if (std::optional<uint64_t> v = Evtx::decodeUInt(chunk.data, view, refs(field, f)))
+		{
+			to = std::remove_reference_t<decltype(to)>(*v);
+			r.fields = r.fields | field;
+		}
+	};
+	auto setGuid = [&](EventField field, SystemField f, GUID &to)
+	{
+		if (std::optional<GUID> v = Evtx::decodeGuid(chunk.data, view, refs(field, f)))
+		{
+			to = *v;
+			r.fields = r.fields | field;
+		}
+	};
+	auto setString = [&](EventField field, SystemField f, std::optional<std::string> &value, std::string_view &to)
+	{
+		value = Evtx::decodeString(chunk.data, view, refs(field, f));
+		if (value)
+		{
+			to = *value;
+			r.fields = r.fields | field;
+		}
+	};
+
+	std::optional<std::string> providerName, channel, computer, user;
+	setString(EventField::ProviderName, SystemField::ProviderName, providerName, r.providerName);
+	setGuid(EventField::ProviderGuid, SystemField::ProviderGuid, r.providerGuid);
+	setUInt(EventField::EventId, SystemField::EventId, r.eventId);
+	setUInt(EventField::Qualifiers, SystemField::Qualifiers, r.qualifiers);
+	setUInt(EventField::Level, SystemField::Level, r.level);
+	setUInt(EventField::Task, SystemField::Task, r.task);
+	setUInt(EventField::Opcode, SystemField::Opcode, r.opcode);
+	setUInt(EventField::Keywords, SystemField::Keywords, r.keywords);
+	// Same masking as EventRecord.
+	r.keywords &= 0x0000FFFFFFFFFFFFll;
+
+	if (hasAnyField(fields, EventField::TimeCreated))
+	{
+		std::optional<uint64_t> timeCreated = Evtx::decodeFileTime(chunk.data, view, refs(EventField::TimeCreated, SystemField::TimeCreated));
+		r.timeCreated = timeCreated.value_or(view.written);
+		r.fields = r.fields | EventField::TimeCreated;
+	}
+	if (hasAnyField(fields, EventField::RecordId))
+	{
+		r.recordId = view.recordId;
+		r.fields = r.fields | EventField::RecordId;
+	}
+
+	setGuid(EventField::ActivityId, SystemField::ActivityId, r.activityId);
+	setUInt(EventField::ProcessId, SystemField::ProcessId, r.processId);
+	setUInt(EventField::ThreadId, SystemField::ThreadId, r.threadId);
+	setString(EventField::Channel, SystemField::Channel, channel, r.channel);
+	setString(EventField::Computer, SystemField::Computer, computer, r.computer);
+	setString(EventField::User, SystemField::UserId, user, r.user);
+	setUInt(EventField::Version, SystemField::Version, r.version);
+
+	batch.append(r);
+}
+
+//
+// EvtxEventRecord
+//
+
+// A payload value as a message insertion string.
+static std::string insertionString(const EventPropertyValue &value)
+{
+	return std::visit([](const auto &v) -> std::string {
+		using T = std::decay_t<decltype(v)>;
+		if constexpr (std::is_same_v<T, std::string>)
+			return v;
+		else if constexpr (std::is_same_v<T, GUID> || std::is_same_v<T, Timestamp>)
+			return Windows::to_string(v);
+		else if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t> || std::is_same_v<T, double>)
+			return std::to_string(v);
+		else if constexpr (std::is_same_v<T, bool>)
+			return v ? "true" : "false";
+		else
+			return {};
+	}, value);
+}
+
+Ref<EvtxEventRecord> EvtxEventRecord::create(std::shared_ptr<const EvtxChunk> chunk, size_t index, 
+	std::shared_ptr<const MetadataCatalog> catalog)
+{
+	return RefObject<EvtxEventRecord>::createRef(std::move(chunk), index, std::move(catalog));
+}
+
+EvtxEventRecord::EvtxEventRecord(std::shared_ptr<const EvtxChunk> chunk, size_t index, std::shared_ptr<const MetadataCatalog> catalog)
+	: mChunk(std::move(chunk))
+	, mView(&mChunk->records[index])
+	, mCatalog(std::move(catalog))
+{}
+
+std::shared_ptr<const CatalogPublisher> EvtxEventRecord::getPublisher() const
+{
+	if (!mCatalog)
+	{
+		return nullptr;
+	}
+
+	std::optional<std::string> provider = getProviderName();
+	return provider ? mCatalog->find(*provider) : nullptr;
+}
+
+std::optional<std::string> EvtxEventRecord::getProviderName() const
+{
+	return Evtx::decodeString(mChunk->data, *mView, field(SystemField::ProviderName));
+}
+
+std::optional<GUID> EvtxEventRecord::getProviderGuid() const
+{
+	return Evtx::decodeGuid(mChunk->data, *mView, field(SystemField::ProviderGuid));
+}
+
+std::optional<uint16_t> EvtxEventRecord::getEventId() const
+{
+	return getUInt<uint16_t>(SystemField::EventId);
+}
+
+std::optional<uint16_t> EvtxEventRecord::getQualifers() const
+{
+	return getUInt<uint16_t>(SystemField::Qualifiers);
+}
+
+std::optional<uint8_t> EvtxEventRecord::getLevel() const
+{
+	return getUInt<uint8_t>(SystemField::Level);
+}
+
+std::optional<uint16_t> EvtxEventRecord::getTask() const
+{
+	return getUInt<uint16_t>(SystemField::Task);
+}
+
+std::optional<uint8_t> EvtxEventRecord::getOpcode() const
+{
+	return getUInt<uint8_t>(SystemField::Opcode);
+}
+
+std::optional<int64_t> EvtxEventRecord::getKeywords() const
+{
+	std::optional<uint64_t> v = Evtx::decodeUInt(mChunk->data, *mView, field(SystemField::Keywords));
+	if (!v)
+		return std::nullopt;
+	// Same masking as EventRecord.
+	return int64_t(*v & 0x0000FFFFFFFFFFFFull);
+}
+
+std::optional<Timestamp> EvtxEventRecord::getTimeCreated() const
+{
+	std::optional<uint64_t> v = Evtx::decodeFileTime(mChunk->data, *mView, field(SystemField::TimeCreated));
+	return Timestamp{ v.value_or(mView->written) };
+}
+
+std::optional<uint64_t> EvtxEventRecord::getRecordId() const
+{
+	return mView->recordId;
+}
+
+std::optional<GUID> EvtxEventRecord::getActivityId() const
+{
+	return Evtx::decodeGuid(mChunk->data, *mView, field(SystemField::ActivityId));
+}
+
+std::optional<uint32_t> EvtxEventRecord::getProcessId() const
+{
+	return getUInt<uint32_t>(SystemField::ProcessId);
+}
+
+std::optional<uint32_t> EvtxEventRecord::getThreadId() const
+{
+	return getUInt<uint32_t>(SystemField::ThreadId);
+}
+
+std::optional<std::string> EvtxEventRecord::getChannel() const
+{
+	return Evtx::decodeString(mChunk->data, *mView, field(SystemField::Channel));
+}
+
+std::optional<std::string> EvtxEventRecord::getComputer() const
+{
+	return Evtx::decodeString(mChunk->data, *mView, field(SystemField::Computer));
+}
+
+std::optional<std::string> EvtxEventRecord::getUser() const
+{
+	return Evtx::decodeString(mChunk->data, *mView, field(SystemField::UserId));
+}
+
+std::optional<uint8_t> EvtxEventRecord::getVersion() const
+{
+	return getUInt<uint8_t>(SystemField::Version);
+}
+
+std::string EvtxEventRecord::getMessage() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	const CatalogEvent *event = publisher ? 
+		publisher->findEvent(getEventId().value_or(0), getVersion().value_or(0)) : 
+		nullptr;
+	if (!event || !event->messageTemplate)
+	{
+		return {};
+	}
+
+	Evtx::RecordView payload = Evtx::payloadView(*mView);
+	std::vector<std::string> insertions;
+	insertions.reserve(payload.tmpl->payload.size());
+	for (const Evtx::PayloadField &field : payload.tmpl->payload)
+		insertions.push_back(insertionString(Evtx::decodeProperty(mChunk->data, payload, field.value)));
+	return event->messageTemplate->format(insertions);
+}
+
+std::string EvtxEventRecord::getLevelDisplay() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	return publisher ? publisher->getLevelDisplay(getLevel().value_or(0)) : std::string();
+}
+
+std::string EvtxEventRecord::getTaskDisplay() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	return publisher ? publisher->getTaskDisplay(getTask().value_or(0)) : std::string();
+}
+
+std::string EvtxEventRecord::getOpcodeDisplay() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	return publisher ? publisher->getOpcodeDisplay(getTask().value_or(0), getOpcode().value_or(0)) : std::string();
+}
+
+std::vector<std::string> EvtxEventRecord::getKeywordsDisplay() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	return publisher ? publisher->getKeywordsDisplay(uint64_t(getKeywords().value_or(0))) : std::vector<std::string>();
+}
+
+std::string EvtxEventRecord::getChannelMessage() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	std::optional<std::string> channel = getChannel();
+	return publisher && channel ? publisher->getChannelDisplay(*channel) : std::string();
+}
+
+std::string EvtxEventRecord::getProviderMessage() const
+{
+	std::shared_ptr<const CatalogPublisher> publisher = getPublisher();
+	return publisher ? publisher->message : std::string();
+}
+
+std::vector<EventProperty> EvtxEventRecord::getProperties() const
+{
+	Evtx::RecordView payload = Evtx::payloadView(*mView);
+	std::vector<EventProperty> properties;
+	properties.reserve(payload.tmpl->payload.size());
+	for (const Evtx::PayloadField &field : payload.tmpl->payload)
+		properties.push_back({ field.name, Evtx::decodeProperty(mChunk->data, payload, field.value) });
+	return properties;
+}
+
+std::optional<EventPropertyValue> EvtxEventRecord::getProperty(const std::string &name) const
+{
+	Evtx::RecordView payload = Evtx::payloadView(*mView);
+	for (const Evtx::PayloadField &field : payload.tmpl->payload)
+	{
+		if (field.name == name)
+			return Evtx::decodeProperty(mChunk->data, payload, field.value);
+	}
+	return {};
+}
+
+}
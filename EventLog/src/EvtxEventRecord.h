@@ -0,0 +1,135 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventRecord.h"
+#include "EventBatch.h"
+#include "EvtxParser.h"
+#include "MetadataCatalog.h"
+#include "SysPlatform.h"
+
+#include <memory>
+
+namespace Windows::EventLog
+{
+
+// A parsed chunk of a mapped EVTX file. Records are views into it and keep
+// it alive. When the last one goes the chunk's pages are released, so 
+// memory use doesn't grow with the size of the file.
+struct EvtxChunk
+{
+	EvtxChunk(std::shared_ptr<const MappedFile> file, uint64_t offset);
+	~EvtxChunk();
+
+	const std::shared_ptr<const MappedFile> file;
+	const uint64_t offset;
+	const uint8_t *const data;
+	Evtx::ChunkParser parser;
+
+	// In query order.
+	std::vector<Evtx::RecordView> records{};
+
+	EvtxChunk(const EvtxChunk &) = delete;
+	EvtxChunk &operator=(const EvtxChunk &) = delete;
+};
+
+// Appends the wanted system fields of the chunk's record at index to the 
+// batch, decoded straight from the chunk with the values EvtxEventRecord 
+// gives.
+void appendEvtxRecord(const EvtxChunk &chunk, size_t index, EventField fields, EventBatch &batch);
+
+// Event record read from an EVTX file by EvtxRecordSource. A view into the 
+// mapped chunk: properties are decoded when asked for. The display strings
+// are formatted from the source's metadata catalog, if it has one and the 
+// publisher is in it, otherwise they're empty. The user is the SID.
+class EvtxEventRecord : public IEventRecord
+{
+public:
+	friend class RefObject<EvtxEventRecord>;
+
+	// catalog can be null.
+	static Ref<EvtxEventRecord> create(std::shared_ptr<const EvtxChunk> chunk, size_t index, 
+		std::shared_ptr<const MetadataCatalog> catalog);
+
+	~EvtxEventRecord() = default;
+
+	// Points the record at another record of its chunk, so one record can be
+	// reused to go over a whole chunk.
+	void setIndex(size_t index) { mView = &mChunk->records[index]; }
+
+	std::optional<std::string> getProviderName() const override;
+	std::optional<GUID> getProviderGuid() const override;
+	std::optional<uint16_t> getEventId() const override;
+	std::optional<uint16_t> getQualifers() const override;
+	std::optional<uint8_t> getLevel() const override;
+	std::optional<uint16_t> getTask() const override;
+	std::optional<uint8_t> getOpcode() const override;
+	std::optional<int64_t> getKeywords() const override;
+	std::optional<Timestamp> getTimeCreated() const override;
+	std::optional<uint64_t> getRecordId() const override;
+	std::optional<GUID> getActivityId() const override;
+	std::optional<uint32_t> getProcessId() const override;
+	std::optional<uint32_t> getThreadId() const override;
+	std::optional<std::string> getChannel() const override;
+	std::optional<std::string> getComputer() const override;
+	std::optional<std::string> getUser() const override;
+	std::optional<uint8_t> getVersion() const override;
+	std::string getMessage() const override;
+	std::string getLevelDisplay() const override;
+	std::string getTaskDisplay() const override;
+	std::string getOpcodeDisplay() const override;
+	std::vector<std::string> getKeywordsDisplay() const override;
+	std::string getChannelMessage() const override;
+	std::string getProviderMessage() const override;
+	std::vector<EventProperty> getProperties() const override;
+	std::optional<EventPropertyValue> getProperty(const std::string &name) const override;
+
+private:
+	EvtxEventRecord(std::shared_ptr<const EvtxChunk> chunk, size_t index, std::shared_ptr<const MetadataCatalog> catalog);
+
+	// The record's publisher in the catalog, null if it isn't there.
+	std::shared_ptr<const CatalogPublisher> getPublisher() const;
+
+	const Evtx::ValueRefs *field(Evtx::SystemField f) const
+	{
+		return mView->tmpl->system[size_t(f)];
+	}
+
+	template<typename T>
+	std::optional<T> getUInt(Evtx::SystemField f) const
+	{
+		std::optional<uint64_t> v = Evtx::decodeUInt(mChunk->data, *mView, field(f));
+		if (!v)
+			return std::nullopt;
+		return T(*v);
+	}
+
+	std::shared_ptr<const EvtxChunk> mChunk;
+	const Evtx::RecordView *mView;
+	std::shared_ptr<const MetadataCatalog> mCatalog;
+
+	EvtxEventRecord(const EvtxEventRecord &) = delete;
+	EvtxEventRecord &operator=(const EvtxEventRecord &) = delete;
+};
+
+}
@@ -0,0 +1,1259 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EvtxParser.h"
+
+#include "SysPlatform.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace Windows::EventLog::Evtx
+{
+
+//
+// Little endian readers. EVTX is always little endian.
+//
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+	return uint16_t(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline uint64_t rd64(const uint8_t *p)
+{
+	return uint64_t(rd32(p)) | (uint64_t(rd32(p + 4)) << 32);
+}
+
+static constexpr uint32_t RecordSignature = 0x00002a2a;
+
+// Smallest possible record: header, empty fragment and trailing size.
+static constexpr size_t MinRecordSize = 28;
+
+// Deepest element nesting parsed. Events are a few levels deep, this stops a
+// corrupt record nesting elements until the parser's stack runs out.
+static constexpr uint32_t MaxElementDepth = 256;
+
+// Deepest embedded BinXML followed to find a payload. 
+static constexpr uint32_t MaxFragmentDepth = 4;
+
+static constexpr char FileSignature[8] = { 'E', 'l', 'f', 'F', 'i', 'l', 'e', '\0' };
+static constexpr char ChunkSignature[8] = { 'E', 'l', 'f', 'C', 'h', 'n', 'k', '\0' };
+
+[[noreturn]] static void throwCorrupt()
+{
+	THROW_(SystemException, ERROR_INVALID_DATA);
+}
+
+//
+// Text helpers.
+//
+
+static void appendUtf8(std::string &out, uint32_t cp)
+{
+	if (cp < 0x80)
+	{
+		out.push_back(char(cp));
+	}
+	else if (cp < 0x800)
+	{
+		out.push_back(char(0xc0 | (cp >> 6)));
+		out.push_back(char(0x80 | (cp & 0x3f)));
+	}
+	else if (cp < 0x10000)
+	{
+		out.push_back(char(0xe0 | (cp >> 12)));
+		out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+		out.push_back(char(0x80 | (cp & 0x3f)));
+	}
+	else
+	{
+		out.push_back(char(0xf0 | (cp >> 18)));
+		out.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+		out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+		out.push_back(char(0x80 | (cp & 0x3f)));
+	}
+}
+
+std::string utf16ToUtf8(const uint8_t *p, size_t chars)
+{
+	std::string out;
+	out.reserve(chars);
+	for (size_t i = 0; i < chars; ++i)
+	{
+		uint32_t c = rd16(p + i * 2);
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < chars)
+		{
+			uint32_t lo = rd16(p + (i + 1) * 2);
+			if (lo >= 0xdc00 && lo < 0xe000)
+			{
+				c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+				++i;
+			}
+		}
+		appendUtf8(out, c);
+	}
+	return out;
+}
+
+// UTF-16 string of size bytes, without trailing NULs.
+static std::string utf16Value(const uint8_t *p, size_t size)
+{
+	size_t chars = size / 2;
+	while (chars > 0 && rd16(p + (chars - 1) * 2) == 0)
+		--chars;
+	return utf16ToUtf8(p, chars);
+}
+
+static std::string hexString(uint64_t value)
+{
+	char buf[24];
+	std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(value));
+	return buf;
+}
+
+//
+// Time. FILETIME is 100ns ticks since 1601-01-01 UTC.
+//
+
+static constexpr int64_t TicksPerSecond = 10000000;
+static constexpr int64_t TicksPerDay = TicksPerSecond * 86400;
+
+// Days between 1601-01-01 and 1970-01-01.
+static constexpr int64_t EpochDays1601 = 134774;
+
+// Days since 1970-01-01 of the given civil date.
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = unsigned(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + int64_t(doe) - 719468;
+}
+
+static void civilFromDays(int64_t z, int64_t &y, unsigned &m, unsigned &d)
+{
+	z += 719468;
+	const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned doe = unsigned(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = int64_t(yoe) + era * 400 + (m <= 2);
+}
+
+static uint64_t fileTimeFromCivil(int64_t y, unsigned mo, unsigned d, unsigned h, unsigned mi, unsigned s, uint64_t fraction)
+{
+	int64_t days = daysFromCivil(y, mo, d) + EpochDays1601;
+	return uint64_t(days * TicksPerDay + (int64_t(h) * 3600 + int64_t(mi) * 60 + int64_t(s)) * TicksPerSecond) + fraction;
+}
+
+// SYSTEMTIME: year, month, day of week, day, hour, minute, second, millis.
+static uint64_t fileTimeFromSystemTime(const uint8_t *p)
+{
+	return fileTimeFromCivil(rd16(p), rd16(p + 2), rd16(p + 6), rd16(p + 8), rd16(p + 10), rd16(p + 12), 
+		uint64_t(rd16(p + 14)) * 10000);
+}
+
+// Same form as the XML rendering: 2023-01-01T00:00:00.0000000Z
+std::string formatFileTime(uint64_t ft)
+{
+	int64_t days = int64_t(ft / TicksPerDay) - EpochDays1601;
+	uint64_t rem = ft % TicksPerDay;
+	int64_t y;
+	unsigned m, d;
+	civilFromDays(days, y, m, d);
+	uint64_t secs = rem / TicksPerSecond;
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04lld-%02u-%02uT%02u:%02u:%02u.%07uZ", static_cast<long long>(y), m, d, 
+		unsigned(secs / 3600), unsigned((secs / 60) % 60), unsigned(secs % 60), unsigned(rem % TicksPerSecond));
+	return buf;
+}
+
+std::optional<uint64_t> parseFileTime(const std::string &s)
+{
+	int y = 0;
+	unsigned mo = 0, d = 0, h = 0, mi = 0, sec = 0;
+	int n = 0;
+	if (std::sscanf(s.c_str(), "%4d-%2u-%2uT%2u:%2u:%2u%n", &y, &mo, &d, &h, &mi, &sec, &n) != 6)
+		return std::nullopt;
+
+	uint64_t fraction = 0;
+	size_t i = size_t(n);
+	if (i < s.size() && s[i] == '.')
+	{
+		uint64_t scale = TicksPerSecond / 10;
+		for (++i; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i, scale /= 10)
+			fraction += uint64_t(s[i] - '0') * scale;
+	}
+	return fileTimeFromCivil(y, mo, d, h, mi, sec, fraction);
+}
+
+std::optional<uint64_t> parseUInt(const std::string &s)
+{
+	if (s.empty())
+		return std::nullopt;
+
+	const char *p = s.c_str();
+	char *end = nullptr;
+	uint64_t value = (s.size() > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) 
+		? std::strtoull(p + 2, &end, 16) 
+		: std::strtoull(p, &end, 10);
+	if (end == p || *end != '\0')
+		return std::nullopt;
+	return value;
+}
+
+std::optional<GUID> parseGuid(const std::string &s)
+{
+	unsigned d1 = 0, d2 = 0, d3 = 0;
+	unsigned d4[8]{};
+	if (std::sscanf(s.c_str(), "{%8x-%4x-%4x-%2x%2x-%2x%2x%2x%2x%2x%2x}", &d1, &d2, &d3, 
+		&d4[0], &d4[1], &d4[2], &d4[3], &d4[4], &d4[5], &d4[6], &d4[7]) != 11)
+		return std::nullopt;
+
+	GUID g{};
+	g.Data1 = d1;
+	g.Data2 = uint16_t(d2);
+	g.Data3 = uint16_t(d3);
+	for (int i = 0; i < 8; ++i)
+		g.Data4[i] = uint8_t(d4[i]);
+	return g;
+}
+
+static GUID readGuid(const uint8_t *p)
+{
+	GUID g{};
+	g.Data1 = rd32(p);
+	g.Data2 = rd16(p + 4);
+	g.Data3 = rd16(p + 6);
+	std::memcpy(g.Data4, p + 8, 8);
+	return g;
+}
+
+static std::string formatSid(const uint8_t *p, size_t size)
+{
+	if (size < 8)
+		return {};
+
+	uint8_t count = p[1];
+	if (size < 8 + size_t(count) * 4)
+		return {};
+
+	uint64_t authority = 0;
+	for (int i = 2; i < 8; ++i)
+		authority = (authority << 8) | p[i];
+
+	std::string s = "S-" + std::to_string(p[0]) + "-" + std::to_string(authority);
+	for (uint8_t i = 0; i < count; ++i)
+		s.append("-").append(std::to_string(rd32(p + 8 + i * 4)));
+	return s;
+}
+
+//
+// Headers
+//
+
+std::optional<FileHeader> readFileHeader(const uint8_t *data, size_t size)
+{
+	if (size < 128 || std::memcmp(data, FileSignature, sizeof(FileSignature)) != 0)
+		return std::nullopt;
+
+	FileHeader h{};
+	h.firstChunkNumber = rd64(data + 8);
+	h.lastChunkNumber = rd64(data + 16);
+	h.nextRecordId = rd64(data + 24);
+	h.minorVersion = rd16(data + 36);
+	h.majorVersion = rd16(data + 38);
+	h.chunkCount = rd16(data + 42);
+	h.flags = rd32(data + 120);
+	return h;
+}
+
+std::optional<ChunkHeader> readChunkHeader(const uint8_t *chunk, size_t size)
+{
+	if (size < ChunkHeaderSize || std::memcmp(chunk, ChunkSignature, sizeof(ChunkSignature)) != 0)
+		return std::nullopt;
+
+	ChunkHeader h{};
+	h.firstRecordNumber = rd64(chunk + 8);
+	h.lastRecordNumber = rd64(chunk + 16);
+	h.firstRecordId = rd64(chunk + 24);
+	h.lastRecordId = rd64(chunk + 32);
+	h.lastRecordOffset = rd32(chunk + 44);
+	h.freeSpaceOffset = rd32(chunk + 48);
+
+	if (h.lastRecordNumber < h.firstRecordNumber 
+		|| h.lastRecordNumber - h.firstRecordNumber >= (ChunkSize - ChunkHeaderSize) / MinRecordSize
+		|| h.freeSpaceOffset > ChunkSize)
+		return std::nullopt;
+	return h;
+}
+
+//
+// BinXmlReader
+//
+
+// BinXML tokens. 0x40 on the element, value and attribute tokens is a 
+// "more data follows" flag and is masked off.
+enum : uint8_t
+{
+	TokenEndOfStream = 0x00,
+	TokenOpenStartElement = 0x01,
+	TokenCloseStartElement = 0x02,
+	TokenCloseEmptyElement = 0x03,
+	TokenEndElement = 0x04,
+	TokenValue = 0x05,
+	TokenAttribute = 0x06,
+	TokenCDataSection = 0x07,
+	TokenCharRef = 0x08,
+	TokenEntityRef = 0x09,
+	TokenPITarget = 0x0a,
+	TokenPIData = 0x0b,
+	TokenTemplateInstance = 0x0c,
+	TokenNormalSubstitution = 0x0d,
+	TokenOptionalSubstitution = 0x0e,
+	TokenFragmentHeader = 0x0f,
+	TokenFlagMore = 0x40
+};
+
+class BinXmlReader
+{
+public:
+	BinXmlReader(ChunkParser &chunk, size_t pos, size_t end)
+		: mChunk(chunk)
+		, mData(chunk.mChunk)
+		, mPos(pos)
+		, mEnd(end)
+	{}
+
+	size_t getPos() const { return mPos; }
+
+	uint8_t peek() const
+	{
+		need(1);
+		return mData[mPos];
+	}
+
+	uint8_t u8()
+	{
+		need(1);
+		return mData[mPos++];
+	}
+
+	uint16_t u16()
+	{
+		need(2);
+		uint16_t v = rd16(mData + mPos);
+		mPos += 2;
+		return v;
+	}
+
+	uint32_t u32()
+	{
+		need(4);
+		uint32_t v = rd32(mData + mPos);
+		mPos += 4;
+		return v;
+	}
+
+	void skip(size_t n)
+	{
+		need(n);
+		mPos += n;
+	}
+
+	// Fragment header, if present.
+	void fragmentHeader()
+	{
+		if (mPos < mEnd && mData[mPos] == TokenFragmentHeader)
+			skip(4);
+	}
+
+	// depth is the number of elements e is nested in.
+	void element(Element &e, uint32_t depth = 0);
+
+private:
+	void need(size_t n) const
+	{
+		if (n > mEnd - mPos)
+			throwCorrupt();
+	}
+
+	std::string name(uint32_t offset);
+	bool isValueToken(uint8_t token) const;
+	void value(ValueRefs &out);
+
+	ChunkParser &mChunk;
+	const uint8_t *mData;
+	size_t mPos;
+	size_t mEnd;
+};
+
+// Names are shared by the whole chunk. Defined inline the first time and 
+// referenced by offset after that.
+std::string BinXmlReader::name(uint32_t offset)
+{
+	if (offset == mPos)
+	{
+		need(8);
+		skip(8 + size_t(rd16(mData + mPos + 6)) * 2 + 2);
+	}
+
+	auto it = mChunk.mNames.find(offset);
+	if (it != mChunk.mNames.end())
+		return it->second;
+
+	if (size_t(offset) + 8 > ChunkSize)
+		throwCorrupt();
+	size_t chars = rd16(mData + offset + 6);
+	if (offset + 8 + chars * 2 > ChunkSize)
+		throwCorrupt();
+
+	return mChunk.mNames.emplace(offset, utf16ToUtf8(mData + offset + 8, chars)).first->second;
+}
+
+bool BinXmlReader::isValueToken(uint8_t token) const
+{
+	switch (token & ~TokenFlagMore)
+	{
+	case TokenValue:
+	case TokenCDataSection:
+	case TokenCharRef:
+	case TokenEntityRef:
+	case TokenPITarget:
+	case TokenPIData:
+	case TokenNormalSubstitution:
+	case TokenOptionalSubstitution:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void BinXmlReader::value(ValueRefs &out)
+{
+	std::string text;
+	uint8_t token = u8();
+	switch (token & ~TokenFlagMore)
+	{
+	case TokenValue:
+	{
+		u8(); // value type, always a string.
+		size_t chars = u16();
+		need(chars * 2);
+		text = utf16ToUtf8(mData + mPos, chars);
+		mPos += chars * 2;
+		break;
+	}
+	case TokenCDataSection:
+	{
+		size_t chars = u16();
+		need(chars * 2);
+		text = utf16ToUtf8(mData + mPos, chars);
+		mPos += chars * 2;
+		break;
+	}
+	case TokenCharRef:
+		appendUtf8(text, u16());
+		break;
+	case TokenEntityRef:
+	{
+		std::string entity = name(u32());
+		if (entity == "amp") text = "&";
+		else if (entity == "lt") text = "<";
+		else if (entity == "gt") text = ">";
+		else if (entity == "quot") text = "\"";
+		else if (entity == "apos") text = "'";
+		break;
+	}
+	case TokenPITarget:
+		name(u32());
+		return;
+	case TokenPIData:
+		skip(size_t(u16()) * 2);
+		return;
+	case TokenNormalSubstitution:
+	case TokenOptionalSubstitution:
+	{
+		ValueRef ref{};
+		ref.substitution = true;
+		ref.index = u16();
+		ref.type = u8();
+		out.push_back(std::move(ref));
+		return;
+	}
+	default:
+		throwCorrupt();
+	}
+
+	// Adjacent text is merged.
+	if (!out.empty() && !out.back().substitution)
+	{
+		out.back().literal.append(text);
+	}
+	else
+	{
+		ValueRef ref{};
+		ref.literal = std::move(text);
+		out.push_back(std::move(ref));
+	}
+}
+
+void BinXmlReader::element(Element &e, uint32_t depth)
+{
+	uint8_t token = u8();
+	if ((token & ~TokenFlagMore) != TokenOpenStartElement || depth >= MaxElementDepth)
+		throwCorrupt();
+
+	u16(); // dependency id
+	u32(); // data size
+	e.name = name(u32());
+	if (token & TokenFlagMore)
+		u32(); // attribute list size
+
+	while ((peek() & ~TokenFlagMore) == TokenAttribute)
+	{
+		u8();
+		Attribute attr{};
+		attr.name = name(u32());
+		while (isValueToken(peek()))
+			value(attr.value);
+		e.attributes.push_back(std::move(attr));
+	}
+
+	token = u8();
+	if (token == TokenCloseEmptyElement)
+		return;
+	if (token != TokenCloseStartElement)
+		throwCorrupt();
+
+	for (;;)
+	{
+		token = peek();
+		if (token == TokenEndElement)
+		{
+			u8();
+			return;
+		}
+
+		if ((token & ~TokenFlagMore) == TokenOpenStartElement)
+		{
+			e.children.emplace_back();
+			element(e.children.back(), depth + 1);
+		}
+		else if (isValueToken(token))
+		{
+			value(e.content);
+		}
+		else
+		{
+			throwCorrupt();
+		}
+	}
+}
+
+//
+// System property lookup
+//
+
+static const Element *findChild(const Element &e, const char *name)
+{
+	for (const Element &child : e.children)
+	{
+		if (child.name == name)
+			return &child;
+	}
+	return nullptr;
+}
+
+static const ValueRefs *findAttribute(const Element *e, const char *name)
+{
+	if (!e)
+		return nullptr;
+
+	for (const Attribute &attr : e->attributes)
+	{
+		if (attr.name == name)
+			return &attr.value;
+	}
+	return nullptr;
+}
+
+static const ValueRefs *findContent(const Element *system, const char *name)
+{
+	const Element *e = findChild(*system, name);
+	return e ? &e->content : nullptr;
+}
+
+static void compileSystem(Template &t)
+{
+	if (t.root.name != "Event")
+		return;
+
+	const Element *system = findChild(t.root, "System");
+	if (!system)
+		return;
+
+	auto set = [&t](SystemField field, const ValueRefs *refs) { t.system[size_t(field)] = refs; };
+
+	const Element *provider = findChild(*system, "Provider");
+	set(SystemField::ProviderName, findAttribute(provider, "Name"));
+	set(SystemField::ProviderGuid, findAttribute(provider, "Guid"));
+	set(SystemField::EventId, findContent(system, "EventID"));
+	set(SystemField::Qualifiers, findAttribute(findChild(*system, "EventID"), "Qualifiers"));
+	set(SystemField::Version, findContent(system, "Version"));
+	set(SystemField::Level, findContent(system, "Level"));
+	set(SystemField::Task, findContent(system, "Task"));
+	set(SystemField::Opcode, findContent(system, "Opcode"));
+	set(SystemField::Keywords, findContent(system, "Keywords"));
+	set(SystemField::TimeCreated, findAttribute(findChild(*system, "TimeCreated"), "SystemTime"));
+	set(SystemField::EventRecordId, findContent(system, "EventRecordID"));
+	set(SystemField::ActivityId, findAttribute(findChild(*system, "Correlation"), "ActivityID"));
+	const Element *execution = findChild(*system, "Execution");
+	set(SystemField::ProcessId, findAttribute(execution, "ProcessID"));
+	set(SystemField::ThreadId, findAttribute(execution, "ThreadID"));
+	set(SystemField::Channel, findContent(system, "Channel"));
+	set(SystemField::Computer, findContent(system, "Computer"));
+	set(SystemField::UserId, findAttribute(findChild(*system, "Security"), "UserID"));
+}
+
+// Name of a Data element. Nothing if it's substituted rather than literal,
+// which the compiled template can't know.
+static std::string literalText(const ValueRefs *refs)
+{
+	std::string s;
+	if (!refs)
+		return s;
+	for (const ValueRef &ref : *refs)
+	{
+		if (ref.substitution)
+			return {};
+		s.append(ref.literal);
+	}
+	return s;
+}
+
+static void compileEventData(Template &t, const Element &eventData)
+{
+	for (const Element &data : eventData.children)
+	{
+		if (data.name == "Data")
+			t.payload.push_back({ literalText(findAttribute(&data, "Name")), &data.content });
+	}
+}
+
+static void compileUserData(Template &t, const Element &userData)
+{
+	// UserData holds one provider defined element, its children are the
+	// properties.
+	if (!userData.children.empty())
+	{
+		for (const Element &data : userData.children.front().children)
+			t.payload.push_back({ data.name, &data.content });
+	}
+}
+
+static void compilePayload(Template &t)
+{
+	// The root of an embedded payload.
+	if (t.root.name == "EventData")
+	{
+		compileEventData(t, t.root);
+		return;
+	}
+	if (t.root.name == "UserData")
+	{
+		compileUserData(t, t.root);
+		return;
+	}
+
+	if (t.root.name != "Event")
+		return;
+
+	if (const Element *eventData = findChild(t.root, "EventData"))
+	{
+		compileEventData(t, *eventData);
+	}
+	else if (const Element *userData = findChild(t.root, "UserData"))
+	{
+		compileUserData(t, *userData);
+	}
+	else
+	{
+		// Substituted as a whole, found once the record's values are.
+		for (const ValueRef &ref : t.root.content)
+		{
+			if (ref.substitution && ref.type == uint8_t(ValueType::BinXml))
+			{
+				t.payloadFragment = ref.index;
+				break;
+			}
+		}
+	}
+}
+
+//
+// ChunkParser
+//
+
+ChunkParser::ChunkParser(const uint8_t *chunk)
+	: mChunk(chunk)
+{}
+
+// Template definition: next offset(4), guid(16), data size(4), fragment.
+const Template *ChunkParser::parseTemplateAt(uint32_t offset)
+{
+	auto it = mTemplates.find(offset);
+	if (it != mTemplates.end())
+		return it->second.get();
+
+	if (size_t(offset) + 24 > ChunkSize)
+		throwCorrupt();
+	size_t dataSize = rd32(mChunk + offset + 20);
+	if (offset + 24 + dataSize > ChunkSize)
+		throwCorrupt();
+
+	auto t = std::make_unique<Template>();
+	BinXmlReader reader(*this, offset + 24, offset + 24 + dataSize);
+	reader.fragmentHeader();
+	reader.element(t->root);
+	compileSystem(*t);
+	compilePayload(*t);
+
+	return mTemplates.emplace(offset, std::move(t)).first->second.get();
+}
+
+const Template *ChunkParser::parseRecordBody(size_t pos, size_t end, RecordView &rec)
+{
+	BinXmlReader reader(*this, pos, end);
+	reader.fragmentHeader();
+
+	if (reader.peek() != TokenTemplateInstance)
+	{
+		// Plain BinXML, no substitutions. Kept by the position of the body,
+		// which can't be the offset of a template definition.
+		auto t = std::make_unique<Template>();
+		reader.element(t->root);
+		compileSystem(*t);
+		compilePayload(*t);
+		return mTemplates.emplace(uint32_t(pos), std::move(t)).first->second.get();
+	}
+
+	reader.u8();
+	reader.u8(); // unknown
+	reader.u32(); // template id
+	uint32_t offset = reader.u32();
+
+	// The definition follows inline the first time the template is used.
+	if (offset == reader.getPos())
+	{
+		reader.skip(24);
+		reader.skip(rd32(mChunk + offset + 20));
+	}
+
+	const Template *t = parseTemplateAt(offset);
+
+	// Descriptors are size(2), type(1), padding(1). Check the values fit 
+	// now so decoding doesn't have to.
+	uint32_t count = reader.u32();
+	if (count > (end - reader.getPos()) / 4)
+		throwCorrupt();
+
+	rec.values = uint32_t(reader.getPos());
+	rec.valueCount = count;
+	size_t dataSize = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		dataSize += rd16(mChunk + rec.values + i * 4);
+	reader.skip(size_t(count) * 4);
+	reader.skip(dataSize);
+
+	return t;
+}
+
+void ChunkParser::parsePayload(RecordView &rec)
+{
+	rec.payloadTmpl = rec.tmpl;
+	rec.payloadValues = rec.values;
+	rec.payloadValueCount = rec.valueCount;
+
+	// An embedded payload is a fragment of its own, a template instance or 
+	// plain BinXML, inside the value. Its values are in it too.
+	for (uint32_t depth = 0; rec.payloadTmpl->payloadFragment && depth < MaxFragmentDepth; ++depth)
+	{
+		std::optional<Substitution> value = getValue(mChunk, payloadView(rec), *rec.payloadTmpl->payloadFragment);
+		if (!value || value->type != uint8_t(ValueType::BinXml))
+			return;
+
+		RecordView fragment{};
+		const Template *t = parseRecordBody(value->offset, size_t(value->offset) + value->size, fragment);
+		rec.payloadTmpl = t;
+		rec.payloadValues = fragment.values;
+		rec.payloadValueCount = fragment.valueCount;
+	}
+}
+
+std::vector<RecordView> ChunkParser::parse()
+{
+	std::vector<RecordView> records;
+
+	std::optional<ChunkHeader> header = readChunkHeader(mChunk, ChunkSize);
+	if (!header)
+		return records;
+
+	records.reserve(size_t(header->lastRecordNumber - header->firstRecordNumber + 1));
+
+	size_t pos = ChunkHeaderSize;
+	size_t end = header->freeSpaceOffset;
+	while (pos + MinRecordSize <= end)
+	{
+		// signature(4), size(4), record id(8), written(8), BinXML, size(4)
+		const uint8_t *p = mChunk + pos;
+		uint32_t size = rd32(p + 4);
+		if (rd32(p) != RecordSignature || size < MinRecordSize || size > end - pos)
+			break;
+
+		RecordView rec{};
+		rec.recordId = rd64(p + 8);
+		rec.written = rd64(p + 16);
+		try
+		{
+			rec.tmpl = parseRecordBody(pos + 24, pos + size - 4, rec);
+			parsePayload(rec);
+		}
+		catch (const SystemException &)
+		{
+			// Corrupt record. The rest of the chunk can't be trusted.
+			break;
+		}
+
+		records.push_back(std::move(rec));
+		pos += size;
+	}
+
+	return records;
+}
+
+//
+// Value decoding
+//
+
+std::optional<Substitution> getValue(const uint8_t *chunk, const RecordView &rec, uint16_t index)
+{
+	if (index >= rec.valueCount)
+		return std::nullopt;
+
+	// Values are packed after the descriptors, so the offset is the sum of
+	// the sizes before it.
+	const uint8_t *desc = chunk + rec.values;
+	uint32_t offset = rec.values + rec.valueCount * 4;
+	for (uint16_t i = 0; i < index; ++i)
+		offset += rd16(desc + i * 4);
+
+	Substitution value{};
+	value.offset = offset;
+	value.size = rd16(desc + index * 4);
+	value.type = desc[index * 4 + 2];
+
+	if (value.type == uint8_t(ValueType::Null) || (value.size == 0 && value.type != uint8_t(ValueType::String)))
+		return std::nullopt;
+	return value;
+}
+
+static uint64_t readUnsigned(const uint8_t *p, size_t size)
+{
+	switch (size)
+	{
+	case 1: return p[0];
+	case 2: return rd16(p);
+	case 4: return rd32(p);
+	case 8: return rd64(p);
+	default: return 0;
+	}
+}
+
+static std::string formatScalar(const uint8_t *p, size_t size, ValueType type)
+{
+	switch (type)
+	{
+	case ValueType::String:
+		return utf16Value(p, size);
+	case ValueType::AnsiString:
+	{
+		size_t n = size;
+		while (n > 0 && p[n - 1] == 0)
+			--n;
+		return std::string(reinterpret_cast<const char *>(p), n);
+	}
+	case ValueType::Int8:
+		return std::to_string(int8_t(p[0]));
+	case ValueType::Int16:
+		return std::to_string(int16_t(rd16(p)));
+	case ValueType::Int32:
+		return std::to_string(int32_t(rd32(p)));
+	case ValueType::Int64:
+		return std::to_string(int64_t(rd64(p)));
+	case ValueType::UInt8:
+	case ValueType::UInt16:
+	case ValueType::UInt32:
+	case ValueType::UInt64:
+		return std::to_string(readUnsigned(p, size));
+	case ValueType::SizeT:
+	case ValueType::HexInt32:
+	case ValueType::HexInt64:
+		return hexString(readUnsigned(p, size));
+	case ValueType::Real32:
+	{
+		float f;
+		std::memcpy(&f, p, sizeof(f));
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%g", double(f));
+		return buf;
+	}
+	case ValueType::Real64:
+	{
+		double d;
+		std::memcpy(&d, p, sizeof(d));
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%g", d);
+		return buf;
+	}
+	case ValueType::Bool:
+		return rd32(p) ? "true" : "false";
+	case ValueType::Guid:
+		return Windows::to_string(readGuid(p));
+	case ValueType::FileTime:
+		return formatFileTime(rd64(p));
+	case ValueType::SysTime:
+		return formatFileTime(fileTimeFromSystemTime(p));
+	case ValueType::Sid:
+		return formatSid(p, size);
+	case ValueType::Binary:
+	{
+		static const char digits[] = "0123456789ABCDEF";
+		std::string s;
+		s.reserve(size * 2);
+		for (size_t i = 0; i < size; ++i)
+		{
+			s.push_back(digits[p[i] >> 4]);
+			s.push_back(digits[p[i] & 0xf]);
+		}
+		return s;
+	}
+	default:
+		// Embedded BinXML and unknown types have no text form here.
+		return {};
+	}
+}
+
+static size_t fixedSize(ValueType type)
+{
+	switch (type)
+	{
+	case ValueType::Int8:
+	case ValueType::UInt8:
+		return 1;
+	case ValueType::Int16:
+	case ValueType::UInt16:
+		return 2;
+	case ValueType::Int32:
+	case ValueType::UInt32:
+	case ValueType::Real32:
+	case ValueType::Bool:
+	case ValueType::HexInt32:
+		return 4;
+	case ValueType::Int64:
+	case ValueType::UInt64:
+	case ValueType::Real64:
+	case ValueType::FileTime:
+	case ValueType::HexInt64:
+		return 8;
+	case ValueType::Guid:
+	case ValueType::SysTime:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+std::string formatValue(const uint8_t *chunk, const Substitution &value)
+{
+	const uint8_t *p = chunk + value.offset;
+	ValueType type = ValueType(value.type & ~uint8_t(ValueType::ArrayFlag));
+
+	if (!(value.type & uint8_t(ValueType::ArrayFlag)))
+	{
+		size_t size = fixedSize(type);
+		if (size > value.size)
+			return {};
+		return formatScalar(p, value.size, type);
+	}
+
+	// Arrays render as a comma separated list. String arrays are NUL 
+	// separated, everything else is fixed size.
+	std::string s;
+	if (type == ValueType::String)
+	{
+		size_t start = 0;
+		size_t chars = value.size / 2;
+		for (size_t i = 0; i <= chars; ++i)
+		{
+			if (i == chars || rd16(p + i * 2) == 0)
+			{
+				if (i > start || i < chars)
+				{
+					if (!s.empty())
+						s.append(", ");
+					s.append(utf16ToUtf8(p + start * 2, i - start));
+				}
+				start = i + 1;
+			}
+		}
+		return s;
+	}
+
+	size_t size = fixedSize(type);
+	if (size == 0)
+		return s;
+	for (size_t i = 0; i + size <= value.size; i += size)
+	{
+		if (!s.empty())
+			s.append(", ");
+		s.append(formatScalar(p + i, size, type));
+	}
+	return s;
+}
+
+std::optional<std::string> decodeString(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs)
+{
+	if (!refs || refs->empty())
+		return std::nullopt;
+
+	if (refs->size() == 1)
+	{
+		const ValueRef &ref = refs->front();
+		if (!ref.substitution)
+			return ref.literal;
+
+		std::optional<Substitution> value = getValue(chunk, rec, ref.index);
+		if (!value)
+			return std::nullopt;
+		return formatValue(chunk, *value);
+	}
+
+	std::string s;
+	for (const ValueRef &ref : *refs)
+	{
+		if (!ref.substitution)
+		{
+			s.append(ref.literal);
+		}
+		else if (std::optional<Substitution> value = getValue(chunk, rec, ref.index))
+		{
+			s.append(formatValue(chunk, *value));
+		}
+	}
+	return s;
+}
+
+std::optional<uint64_t> decodeUInt(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs)
+{
+	if (!refs || refs->empty())
+		return std::nullopt;
+
+	if (refs->size() == 1 && refs->front().substitution)
+	{
+		std::optional<Substitution> value = getValue(chunk, rec, refs->front().index);
+		if (!value)
+			return std::nullopt;
+
+		switch (ValueType(value->type))
+		{
+		case ValueType::Int8:
+		case ValueType::UInt8:
+		case ValueType::Int16:
+		case ValueType::UInt16:
+		case ValueType::Int32:
+		case ValueType::UInt32:
+		case ValueType::Int64:
+		case ValueType::UInt64:
+		case ValueType::SizeT:
+		case ValueType::HexInt32:
+		case ValueType::HexInt64:
+		case ValueType::Bool:
+			return readUnsigned(chunk + value->offset, value->size);
+		default:
+			break;
+		}
+	}
+
+	std::optional<std::string> s = decodeString(chunk, rec, refs);
+	return s ? parseUInt(*s) : std::nullopt;
+}
+
+std::optional<GUID> decodeGuid(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs)
+{
+	if (!refs || refs->empty())
+		return std::nullopt;
+
+	if (refs->size() == 1 && refs->front().substitution)
+	{
+		std::optional<Substitution> value = getValue(chunk, rec, refs->front().index);
+		if (!value)
+			return std::nullopt;
+
+		if (value->type == uint8_t(ValueType::Guid) && value->size >= 16)
+			return readGuid(chunk + value->offset);
+	}
+
+	std::optional<std::string> s = decodeString(chunk, rec, refs);
+	return s ? parseGuid(*s) : std::nullopt;
+}
+
+EventPropertyValue decodeProperty(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs)
+{
+	if (!refs || refs->empty())
+		return {};
+
+	if (refs->size() == 1 && refs->front().substitution)
+	{
+		std::optional<Substitution> value = getValue(chunk, rec, refs->front().index);
+		if (!value)
+			return {};
+
+		const uint8_t *p = chunk + value->offset;
+		ValueType type = ValueType(value->type);
+		if (fixedSize(type) <= value->size)
+		{
+			switch (type)
+			{
+			case ValueType::String:
+			case ValueType::AnsiString:
+			case ValueType::Sid:
+				return formatScalar(p, value->size, type);
+			case ValueType::Int8:
+				return int64_t(int8_t(p[0]));
+			case ValueType::Int16:
+				return int64_t(int16_t(rd16(p)));
+			case ValueType::Int32:
+				return int64_t(int32_t(rd32(p)));
+			case ValueType::Int64:
+				return int64_t(rd64(p));
+			case ValueType::UInt8:
+			case ValueType::UInt16:
+			case ValueType::UInt32:
+			case ValueType::UInt64:
+			case ValueType::SizeT:
+			case ValueType::HexInt32:
+			case ValueType::HexInt64:
+				return readUnsigned(p, value->size);
+			case ValueType::Real32:
+			{
+				float f;
+				std::memcpy(&f, p, sizeof(f));
+				return double(f);
+			}
+			case ValueType::Real64:
+			{
+				double d;
+				std::memcpy(&d, p, sizeof(d));
+				return d;
+			}
+			case ValueType::Bool:
+				return rd32(p) != 0;
+			case ValueType::Guid:
+				return readGuid(p);
+			case ValueType::FileTime:
+				return Timestamp{ rd64(p) };
+			case ValueType::SysTime:
+				return Timestamp{ fileTimeFromSystemTime(p) };
+			case ValueType::Binary:
+				return std::vector<uint8_t>(p, p + value->size);
+			default:
+				break;
+			}
+		}
+	}
+
+	std::optional<std::string> s = decodeString(chunk, rec, refs);
+	if (!s)
+		return {};
+	return std::move(*s);
+}
+
+std::optional<uint64_t> decodeFileTime(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs)
+{
+	if (!refs || refs->empty())
+		return std::nullopt;
+
+	if (refs->size() == 1 && refs->front().substitution)
+	{
+		std::optional<Substitution> value = getValue(chunk, rec, refs->front().index);
+		if (!value)
+			return std::nullopt;
+
+		if (value->type == uint8_t(ValueType::FileTime) && value->size >= 8)
+			return rd64(chunk + value->offset);
+		if (value->type == uint8_t(ValueType::SysTime) && value->size >= 16)
+			return fileTimeFromSystemTime(chunk + value->offset);
+	}
+
+	std::optional<std::string> s = decodeString(chunk, rec, refs);
+	return s ? parseFileTime(*s) : std::nullopt;
+}
+
+//
+// CRC32 (IEEE 802.3, reflected)
+//
+
+static std::array<uint32_t, 256> makeCrcTable()
+{
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		table[i] = c;
+	}
+	return table;
+}
+
+uint32_t crc32(const uint8_t *p, size_t size, uint32_t crc)
+{
+	static const std::array<uint32_t, 256> table = makeCrcTable();
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+} // namespace Windows::EventLog::Evtx
@@ -0,0 +1,287 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+// Reader for the EVTX file format: the file header, 64 KiB chunks, event 
+// records and the binary XML (BinXML) they are encoded in. Portable, no 
+// Windows API involved.
+//
+// Templates are parsed once per chunk and compiled into an element tree 
+// whose values are either literal text or references to the record's 
+// substitution values. The system properties of a record are then located 
+// through the template rather than by walking XML.
+
+#include "CommonTypes.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Windows::EventLog::Evtx
+{
+
+constexpr size_t FileHeaderSize = 4096;
+constexpr size_t ChunkSize = 65536;
+constexpr size_t ChunkHeaderSize = 512;
+
+// BinXML substitution value types.
+enum class ValueType : uint8_t
+{
+	Null = 0x00,
+	String = 0x01,
+	AnsiString = 0x02,
+	Int8 = 0x03,
+	UInt8 = 0x04,
+	Int16 = 0x05,
+	UInt16 = 0x06,
+	Int32 = 0x07,
+	UInt32 = 0x08,
+	Int64 = 0x09,
+	UInt64 = 0x0a,
+	Real32 = 0x0b,
+	Real64 = 0x0c,
+	Bool = 0x0d,
+	Binary = 0x0e,
+	Guid = 0x0f,
+	SizeT = 0x10,
+	FileTime = 0x11,
+	SysTime = 0x12,
+	Sid = 0x13,
+	HexInt32 = 0x14,
+	HexInt64 = 0x15,
+	BinXml = 0x21,
+	ArrayFlag = 0x80
+};
+
+// The system properties found under Event/System.
+enum class SystemField : uint8_t
+{
+	ProviderName,
+	ProviderGuid,
+	EventId,
+	Qualifiers,
+	Version,
+	Level,
+	Task,
+	Opcode,
+	Keywords,
+	TimeCreated,
+	EventRecordId,
+	ActivityId,
+	ProcessId,
+	ThreadId,
+	Channel,
+	Computer,
+	UserId,
+	Count
+};
+
+// Piece of an attribute value or element content.
+struct ValueRef
+{
+	std::string literal{};
+	uint16_t index = 0;
+	uint8_t type = 0;
+	bool substitution = false;
+};
+
+using ValueRefs = std::vector<ValueRef>;
+
+struct Attribute
+{
+	std::string name{};
+	ValueRefs value{};
+};
+
+struct Element
+{
+	std::string name{};
+	std::vector<Attribute> attributes{};
+	ValueRefs content{};
+	std::vector<Element> children{};
+};
+
+// EventData or UserData property of a template.
+struct PayloadField
+{
+	std::string name{};
+	const ValueRefs *value = nullptr;
+};
+
+// Compiled template. Records without a template instance get one of their 
+// own made of literals.
+struct Template
+{
+	Element root{};
+
+	// Where each system property comes from. Null if the template lacks it.
+	std::array<const ValueRefs *, size_t(SystemField::Count)> system{};
+
+	// The EventData/Data elements, or the elements under UserData's root.
+	std::vector<PayloadField> payload{};
+
+	// Index of the substitution the payload is in as embedded BinXML, as 
+	// many publishers write UserData, when the template has neither.
+	std::optional<uint16_t> payloadFragment{};
+};
+
+// Substitution value of a record. Offset is relative to the chunk.
+struct Substitution
+{
+	uint32_t offset = 0;
+	uint16_t size = 0;
+	uint8_t type = 0;
+};
+
+// A parsed record: its header and where its values are in the chunk. Values
+// are decoded from the chunk on demand, nothing is copied out of it.
+struct RecordView
+{
+	uint64_t recordId = 0;
+	uint64_t written = 0;
+
+	// Owned by the chunk parser.
+	const Template *tmpl = nullptr;
+
+	// Chunk offset of the value descriptors. The values follow them.
+	uint32_t values = 0;
+	uint32_t valueCount = 0;
+
+	// As tmpl, values and valueCount, for the payload. The same unless the 
+	// payload is embedded BinXML, in which case they're the embedded 
+	// fragment's. See payloadView.
+	const Template *payloadTmpl = nullptr;
+	uint32_t payloadValues = 0;
+	uint32_t payloadValueCount = 0;
+};
+
+// The record as far as its payload goes: the template whose payload fields
+// to decode and the values they refer to.
+inline RecordView payloadView(const RecordView &rec)
+{
+	RecordView view{};
+	view.recordId = rec.recordId;
+	view.written = rec.written;
+	view.tmpl = rec.payloadTmpl;
+	view.values = rec.payloadValues;
+	view.valueCount = rec.payloadValueCount;
+	return view;
+}
+
+struct FileHeader
+{
+	uint64_t firstChunkNumber = 0;
+	uint64_t lastChunkNumber = 0;
+	uint64_t nextRecordId = 0;
+	uint16_t minorVersion = 0;
+	uint16_t majorVersion = 0;
+	uint16_t chunkCount = 0;
+	uint32_t flags = 0;
+};
+
+struct ChunkHeader
+{
+	uint64_t firstRecordNumber = 0;
+	uint64_t lastRecordNumber = 0;
+	uint64_t firstRecordId = 0;
+	uint64_t lastRecordId = 0;
+	uint32_t lastRecordOffset = 0;
+	uint32_t freeSpaceOffset = 0;
+};
+
+// Returns the file header or nothing if the signature doesn't match.
+std::optional<FileHeader> readFileHeader(const uint8_t *data, size_t size);
+
+// Returns the chunk header or nothing if the chunk is unused or invalid.
+std::optional<ChunkHeader> readChunkHeader(const uint8_t *chunk, size_t size);
+
+// Parses the records of one chunk. Parsing stops at the first corrupt record.
+// The records refer to templates owned by the parser so it must outlive them.
+class ChunkParser
+{
+public:
+	// chunk must point to ChunkSize bytes that outlive the parser. 
+	explicit ChunkParser(const uint8_t *chunk);
+
+	ChunkParser(ChunkParser &&) = default;
+	ChunkParser &operator=(ChunkParser &&) = default;
+
+	std::vector<RecordView> parse();
+
+private:
+	const Template *parseTemplateAt(uint32_t offset);
+	const Template *parseRecordBody(size_t pos, size_t end, RecordView &rec);
+
+	// Finds the payload of a parsed record, parsing embedded BinXML.
+	void parsePayload(RecordView &rec);
+
+	const uint8_t *mChunk;
+	std::unordered_map<uint32_t, std::unique_ptr<const Template>> mTemplates{};
+	std::unordered_map<uint32_t, std::string> mNames{};
+
+	friend class BinXmlReader;
+};
+
+//
+// Value decoding. Each takes the chunk the record's substitutions refer to.
+// Literal text is parsed, substitutions are decoded according to their type. 
+//
+
+std::optional<std::string> decodeString(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs);
+std::optional<uint64_t> decodeUInt(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs);
+std::optional<GUID> decodeGuid(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs);
+std::optional<uint64_t> decodeFileTime(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs);
+
+// Typed value of a payload property. A single substitution keeps its type, 
+// anything else is decoded as a string.
+EventPropertyValue decodeProperty(const uint8_t *chunk, const RecordView &rec, const ValueRefs *refs);
+
+// Returns the record's substitution value at the given index. Nothing if 
+// there isn't one or it's null.
+std::optional<Substitution> getValue(const uint8_t *chunk, const RecordView &rec, uint16_t index);
+
+// Formats a single substitution value as text.
+std::string formatValue(const uint8_t *chunk, const Substitution &value);
+
+// Parsers for the text forms of values, as found in literal text: 
+// 2023-01-01T00:00:00.0000000Z to 100 nanos since 1601, decimal or 0x hex,
+// and {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}.
+std::optional<uint64_t> parseFileTime(const std::string &s);
+
+// 100 nanos since 1601 as 2023-01-01T00:00:00.0000000Z.
+std::string formatFileTime(uint64_t ft);
+std::optional<uint64_t> parseUInt(const std::string &s);
+std::optional<GUID> parseGuid(const std::string &s);
+
+// UTF-16LE to UTF-8. 
+std::string utf16ToUtf8(const uint8_t *p, size_t chars);
+
+// CRC32 as used by the EVTX header and record checksums.
+uint32_t crc32(const uint8_t *p, size_t size, uint32_t crc = 0);
+
+} // namespace Windows::EventLog::Evtx
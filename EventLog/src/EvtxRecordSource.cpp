@@ -0,0 +1,525 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "EvtxRecordSource.h"
+
+#include "EvtxEventRecord.h"
+#include "EvtxParser.h"
+#include "QueryPlan.h"
+#include "XPathFilter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+namespace Windows::EventLog
+{
+
+// Parses the chunk and drops the first skip records, then the ones the 
+// filter doesn't match, if there is one.
+static std::shared_ptr<const EvtxChunk> parseChunk(std::shared_ptr<const MappedFile> file, uint64_t offset, Direction dir, 
+	uint64_t skip, const IXPathFilter *filter)
+{
+	auto chunk = std::make_shared<EvtxChunk>(std::move(file), offset);
+	std::vector<Evtx::RecordView> &records = chunk->records;
+	if (dir == Direction::Reverse)
+		std::reverse(records.begin(), records.end());
+	records.erase(records.begin(), records.begin() + ptrdiff_t(std::min<uint64_t>(skip, records.size())));
+
+	if (filter && !records.empty())
+	{
+		// One record is pointed at each record in turn, and a record is only 
+		// moved down once tested, so it never reads one already overwritten.
+		Ref<EvtxEventRecord> record = EvtxEventRecord::create(chunk, 0, nullptr);
+		size_t kept = 0;
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			record->setIndex(i);
+			if (filter->matches(record.get()))
+				records[kept++] = records[i];
+		}
+		records.resize(kept);
+	}
+	return chunk;
+}
+
+//
+// EvtxChunkPipeline
+//
+
+// Parses chunks on worker threads and returns them in order. Each worker 
+// claims the next chunk index and parses it into the slot for that index. 
+// The free slot semaphore bounds how far ahead of the consumer they get.
+class EvtxChunkPipeline
+{
+public:
+	// Offsets are in query order. Parsing starts at offsets[first], without
+	// its first skip records. filter can be null.
+	EvtxChunkPipeline(std::shared_ptr<const MappedFile> file, std::vector<uint64_t> offsets, size_t first, uint64_t skip,
+		RefPtr<IXPathFilter> filter, Direction dir, uint32_t workerCount, uint32_t readAhead);
+
+	~EvtxChunkPipeline();
+
+	// Returns the next chunk in order or null after the last one.
+	std::shared_ptr<const EvtxChunk> next();
+
+private:
+	struct Slot
+	{
+		ManualResetEvent ready{ FALSE };
+		std::shared_ptr<const EvtxChunk> chunk{};
+		std::exception_ptr error{};
+	};
+
+	static unsigned workerMain(void *arg);
+	void workerThisMain();
+
+	const std::shared_ptr<const MappedFile> mFile;
+	const std::vector<uint64_t> mOffsets;
+	const size_t mFirst;
+	const uint64_t mSkip;
+	const RefPtr<IXPathFilter> mFilter;
+	const Direction mDirection;
+
+	std::vector<std::unique_ptr<Slot>> mSlots;
+	Semaphore mFree;
+	std::atomic<size_t> mNextToParse;
+	std::atomic<bool> mStop{ false };
+	size_t mNextToConsume;
+
+	std::vector<Thread> mThreads{};
+
+	EvtxChunkPipeline(const EvtxChunkPipeline &) = delete;
+	EvtxChunkPipeline &operator=(const EvtxChunkPipeline &) = delete;
+};
+
+EvtxChunkPipeline::EvtxChunkPipeline(std::shared_ptr<const MappedFile> file, std::vector<uint64_t> offsets, size_t first, uint64_t skip,
+	RefPtr<IXPathFilter> filter, Direction dir, uint32_t workerCount, uint32_t readAhead)
+	: mFile(std::move(file))
+	, mOffsets(std::move(offsets))
+	, mFirst(first)
+	, mSkip(skip)
+	, mFilter(std::move(filter))
+	, mDirection(dir)
+	, mSlots()
+	, mFree(LONG(readAhead), LONG(readAhead + workerCount))
+	, mNextToParse(first)
+	, mNextToConsume(first)
+{
+	for (uint32_t i = 0; i < readAhead; ++i)
+		mSlots.push_back(std::make_unique<Slot>());
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+		mThreads.push_back(Thread::begin(&EvtxChunkPipeline::workerMain, this));
+}
+
+EvtxChunkPipeline::~EvtxChunkPipeline()
+{
+	mStop = true;
+	mFree.release(LONG(mThreads.size()));
+	for (Thread &thread : mThreads)
+		thread.join();
+}
+
+std::shared_ptr<const EvtxChunk> EvtxChunkPipeline::next()
+{
+	if (mNextToConsume >= mOffsets.size())
+		return nullptr;
+
+	Slot &slot = *mSlots[mNextToConsume % mSlots.size()];
+	slot.ready.wait();
+	slot.ready.reset();
+
+	std::shared_ptr<const EvtxChunk> chunk = std::move(slot.chunk);
+	std::exception_ptr error = std::move(slot.error);
+	slot.chunk.reset();
+	slot.error = nullptr;
+
+	++mNextToConsume;
+	mFree.release();
+
+	if (error)
+		std::rethrow_exception(error);
+	return chunk;
+}
+
+unsigned EvtxChunkPipeline::workerMain(void *arg)
+{
+	try
+	{
+		static_cast<EvtxChunkPipeline *>(arg)->workerThisMain();
+		return 0;
+	}
+	catch (...) // This is the top of thread stack, so swallow everything.
+	{
+		return 1;
+	}
+}
+
+void EvtxChunkPipeline::workerThisMain()
+{
+	for (;;)
+	{
+		mFree.wait();
+		if (mStop)
+			break;
+
+		size_t index = mNextToParse++;
+		if (index >= mOffsets.size())
+		{
+			// Out of chunks. Pass the wake up on so the other workers exit too.
+			mFree.release();
+			break;
+		}
+
+		Slot &slot = *mSlots[index % mSlots.size()];
+		try
+		{
+			slot.chunk = parseChunk(mFile, mOffsets[index], mDirection, index == mFirst ? mSkip : 0, mFilter.get());
+		}
+		catch (...)
+		{
+			slot.error = std::current_exception();
+		}
+		slot.ready.set();
+	}
+}
+
+//
+// EvtxBatch
+//
+
+class EvtxBatch : public IQueryBatchResult
+{
+public:
+	friend class RefObject<EvtxBatch>;
+
+	static Ref<EvtxBatch> create(QueryNextStatus status)
+	{
+		return RefObject<EvtxBatch>::createRef(status);
+	}
+
+	static Ref<EvtxBatch> create(std::shared_ptr<const EvtxChunk> chunk, size_t first, uint32_t count, 
+		std::shared_ptr<const MetadataCatalog> catalog, EventField fields)
+	{
+		return RefObject<EvtxBatch>::createRef(std::move(chunk), first, count, std::move(catalog), fields);
+	}
+
+	QueryNextStatus getStatus() const override { return mStatus; }
+
+	uint32_t getCount() const override { return mCount; }
+
+	Ref<IEventRecord> getRecord(uint32_t index) const override
+	{
+		if (index >= mCount)
+		{
+			THROW(IndexOutOfBoundsException);
+		}
+		return EvtxEventRecord::create(mChunk, mFirst + index, mCatalog);
+	}
+
+	Ref<IEventBatch> getEventBatch() const override
+	{
+		Ref<EventBatch> batch = EventBatch::create(mCount);
+		for (uint32_t i = 0; i < mCount; ++i)
+			appendEvtxRecord(*mChunk, mFirst + i, mFields, batch.get());
+		return batch;
+	}
+
+private:
+	explicit EvtxBatch(QueryNextStatus status)
+		: mStatus(status)
+	{}
+
+	EvtxBatch(std::shared_ptr<const EvtxChunk> chunk, size_t first, uint32_t count, std::shared_ptr<const MetadataCatalog> catalog, 
+		EventField fields)
+		: mStatus(QueryNextStatus::Success)
+		, mChunk(std::move(chunk))
+		, mFirst(first)
+		, mCount(count)
+		, mCatalog(std::move(catalog))
+		, mFields(fields)
+	{}
+
+	QueryNextStatus mStatus;
+	std::shared_ptr<const EvtxChunk> mChunk{};
+	size_t mFirst = 0;
+	uint32_t mCount = 0;
+	std::shared_ptr<const MetadataCatalog> mCatalog{};
+	EventField mFields = EventField::All;
+};
+
+//
+// EvtxRecordSource
+//
+
+Ref<EvtxRecordSource> EvtxRecordSource::create()
+{
+	return RefObject<EvtxRecordSource>::createRef(Options{});
+}
+
+Ref<EvtxRecordSource> EvtxRecordSource::create(const Options &options)
+{
+	return RefObject<EvtxRecordSource>::createRef(options);
+}
+
+EvtxRecordSource::EvtxRecordSource(const Options &options)
+	: mOptions(options)
+{
+	if (mOptions.workerCount == 0)
+		mOptions.workerCount = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	if (mOptions.readAhead == 0)
+		mOptions.readAhead = mOptions.workerCount * 2;
+}
+
+EvtxRecordSource::~EvtxRecordSource()
+{
+	close();
+}
+
+void EvtxRecordSource::queryChannelXPath(const std::string &, const std::string &, Direction)
+{
+	THROW_(SystemException, ERROR_NOT_SUPPORTED);
+}
+
+void EvtxRecordSource::queryStructuredXML(const std::string &structuredXML, Direction dir)
+{
+	// A QueryList over a single file, its Queries evaluated here. 
+	static const char FilePrefix[] = "file://";
+	QueryPlan plan = QueryPlan::parse(structuredXML);
+	if (plan.getPaths().size() != 1 || plan.getPaths().front().path.compare(0, sizeof(FilePrefix) - 1, FilePrefix) != 0)
+	{
+		THROW_(SystemException, ERROR_NOT_SUPPORTED);
+	}
+
+	plan.optimize();
+	const std::string &path = plan.getPaths().front().path;
+	open(path.substr(sizeof(FilePrefix) - 1), *plan.getFilter(path), dir);
+}
+
+void EvtxRecordSource::queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir)
+{
+	open(filePath, XPath::parse(xpathQuery), dir);
+}
+
+void EvtxRecordSource::open(const std::string &filePath, const XPath::Node &query, Direction dir)
+{
+	close();
+
+	std::shared_ptr<const MappedFile> file = MappedFile::open(filePath);
+	if (!Evtx::readFileHeader(file->data(), size_t(std::min<uint64_t>(file->size(), Evtx::FileHeaderSize))))
+	{
+		THROW_(SystemException, ERROR_INVALID_DATA);
+	}
+
+	// Use the file size rather than the header's chunk count, which lags 
+	// behind when the log wasn't closed cleanly. Unused and corrupt chunks 
+	// are skipped. Only the headers are needed now so they're released as 
+	// they're read, along with the previous chunk since the OS can map 
+	// neighbouring pages on a fault.
+	std::vector<ChunkInfo> chunks;
+	for (uint64_t offset = Evtx::FileHeaderSize; offset + Evtx::ChunkSize <= file->size(); offset += Evtx::ChunkSize)
+	{
+		if (auto h = Evtx::readChunkHeader(file->data() + offset, Evtx::ChunkHeaderSize))
+			chunks.push_back({ offset, h->firstRecordNumber, h->lastRecordNumber - h->firstRecordNumber + 1 });
+		file->release(offset - Evtx::FileHeaderSize, Evtx::ChunkSize + Evtx::FileHeaderSize);
+	}
+
+	// Circular logs wrap so file order isn't log order.
+	std::sort(chunks.begin(), chunks.end(), 
+		[](const ChunkInfo &a, const ChunkInfo &b) { return a.firstRecordNumber < b.firstRecordNumber; });
+	if (dir == Direction::Reverse)
+		std::reverse(chunks.begin(), chunks.end());
+
+	mChunks = std::move(chunks);
+	mRecordCount = 0;
+	for (const ChunkInfo &chunk : mChunks)
+		mRecordCount += chunk.recordCount;
+
+	mFile = std::move(file);
+	if (query.kind != XPath::NodeKind::True)
+		mFilter = &XPathFilter::create(query).get();
+	mDirection = dir;
+	mOpen = true;
+	mCursor = 0;
+	startPipeline(0, 0);
+}
+
+void EvtxRecordSource::startPipeline(size_t chunk, uint64_t skip)
+{
+	mPipeline.reset();
+	mChunk.reset();
+	mChunkPos = 0;
+
+	std::vector<uint64_t> offsets;
+	offsets.reserve(mChunks.size());
+	for (const ChunkInfo &info : mChunks)
+		offsets.push_back(info.fileOffset);
+
+	mNextChunk = chunk;
+	mNextChunkBase = 0;
+	for (size_t i = 0; i < chunk; ++i)
+		mNextChunkBase += mChunks[i].recordCount;
+
+	mPipeline = std::make_unique<EvtxChunkPipeline>(mFile, std::move(offsets), chunk, skip, mFilter, mDirection, 
+		mOptions.workerCount, mOptions.readAhead);
+}
+
+Ref<IQueryBatchResult> EvtxRecordSource::next(uint32_t batchSize, uint32_t)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	if (mCancelled)
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
+	}
+
+	if (batchSize == 0)
+	{
+		return EvtxBatch::create(QueryNextStatus::NoMoreItems);
+	}
+
+	// Batches don't span chunks, so may be short.
+	while (!mChunk || mChunkPos >= mChunk->records.size())
+	{
+		mChunk = mPipeline->next();
+		if (!mChunk)
+		{
+			return EvtxBatch::create(QueryNextStatus::NoMoreItems);
+		}
+		mChunkPos = 0;
+		mChunkIndex = mNextChunk++;
+		mChunkBase = mNextChunkBase;
+		mNextChunkBase += mChunks[mChunkIndex].recordCount;
+	}
+
+	uint32_t count = uint32_t(std::min<size_t>(batchSize, mChunk->records.size() - mChunkPos));
+	size_t first = mChunkPos;
+	mChunkPos += count;
+	if (mFilter)
+	{
+		// The records that matched aren't contiguous, go by the last one's id.
+		const ChunkInfo &info = mChunks[mChunkIndex];
+		uint64_t id = mChunk->records[mChunkPos - 1].recordId;
+		mCursor = mChunkBase + 1 + (mDirection == Direction::Forward 
+			? id - info.firstRecordNumber 
+			: info.firstRecordNumber + info.recordCount - 1 - id);
+	}
+	else
+	{
+		mCursor += count;
+	}
+
+	return EvtxBatch::create(mChunk, first, count, mOptions.catalog, mFields);
+}
+
+void EvtxRecordSource::seek(int64_t position, SeekOption whence)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	// Same reference points as EvtSeek.
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SeekOption::RelativeToFirst:
+		base = 0;
+		break;
+	case SeekOption::RelativeToLast:
+		base = int64_t(mRecordCount) - 1;
+		break;
+	case SeekOption::RelativeToCurrent:
+		base = int64_t(mCursor) - 1;
+		break;
+	}
+
+	int64_t target = base + position;
+	if (target < 0 || uint64_t(target) > mRecordCount)
+	{
+		THROW_(SystemException, ERROR_INVALID_PARAMETER);
+	}
+
+	// Find the chunk by the record counts in the chunk headers.
+	size_t chunk = 0;
+	uint64_t remaining = uint64_t(target);
+	while (chunk < mChunks.size() && remaining >= mChunks[chunk].recordCount)
+	{
+		remaining -= mChunks[chunk].recordCount;
+		++chunk;
+	}
+
+	startPipeline(chunk, remaining);
+	mCursor = uint64_t(target);
+}
+
+void EvtxRecordSource::seek(const IBookmark &bookmark)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	// Count the records up to and including the bookmarked one from the 
+	// chunk headers, so only the chunk it's in gets parsed. Ids that aren't 
+	// in the log any more, e.g. overwritten in a circular log, start from 
+	// the oldest record still there.
+	uint64_t recordId = getBookmarkedRecordId(bookmark);
+	uint64_t target = 0;
+	for (const ChunkInfo &info : mChunks)
+	{
+		uint64_t last = info.firstRecordNumber + info.recordCount - 1;
+		if (mDirection == Direction::Forward ? last <= recordId : info.firstRecordNumber >= recordId)
+		{
+			target += info.recordCount;
+			continue;
+		}
+		if (mDirection == Direction::Forward && info.firstRecordNumber <= recordId)
+			target += recordId - info.firstRecordNumber + 1;
+		else if (mDirection == Direction::Reverse && last >= recordId)
+			target += last - recordId + 1;
+		break;
+	}
+
+	seek(int64_t(target), SeekOption::RelativeToFirst);
+}
+
+SysErr EvtxRecordSource::close()
+{
+	mPipeline.reset();
+	mChunk.reset();
+	mChunks.clear();
+	mFile.reset();
+	mFilter.reset();
+	mChunkPos = 0;
+	mCursor = 0;
+	mRecordCount = 0;
+	mOpen = false;
+	return {};
+}
+
+}
@@ -0,0 +1,148 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IXPathFilter.h"
+#include "RecordSource.h"
+#include "XPath.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+class EvtxChunkPipeline;
+class MetadataCatalog;
+struct EvtxChunk;
+
+// Record source that reads EVTX files directly rather than through the 
+// Event Log service, so exported logs can be read off Windows and without 
+// the per-record cost of EvtNext/EvtRender. 
+//
+// The file is memory mapped and records are views into it, decoded as 
+// their properties are asked for. Chunks are self-contained (their own 
+// string and template tables) so they are parsed on a pool of worker 
+// threads, a bounded number ahead of the reader, and handed back in log 
+// order. Pages are released as chunks are finished with, so memory use
+// stays flat however large the file.
+//
+// Only file queries are supported, XPath or a QueryList over one file (a 
+// file:// path). The query is compiled to an XPathFilter and records are 
+// tested on the parser threads, so batches only hold the ones that match.
+// Seek positions still count every record of the file, matching or not.
+class EvtxRecordSource : public IRecordSource
+{
+public:
+	friend class RefObject<EvtxRecordSource>;
+
+	struct Options
+	{
+		// Number of parser threads. Zero for one per hardware thread.
+		uint32_t workerCount = 0;
+
+		// Number of chunks parsed ahead of the reader. Zero for twice the 
+		// number of workers.
+		uint32_t readAhead = 0;
+
+		// Publisher metadata to format the display strings with, e.g. 
+		// exported on the machine that wrote the log. Without it they're 
+		// empty.
+		std::shared_ptr<const MetadataCatalog> catalog{};
+	};
+
+	static Ref<EvtxRecordSource> create();
+	static Ref<EvtxRecordSource> create(const Options &options);
+
+	~EvtxRecordSource();
+
+	void queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir) override;
+	void queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir) override;
+	void queryStructuredXML(const std::string &structuredXML, Direction dir) override;
+
+	Ref<IQueryBatchResult> next(uint32_t batchSize, uint32_t timeout) override;
+
+	void seek(int64_t position, SeekOption whence) override;
+	void seek(const IBookmark &bookmark) override;
+
+	// Records decode fields on demand anyway, only the batch columns skip
+	// the fields that aren't wanted.
+	void setFields(EventField fields) override { mFields = fields; }
+
+	SysErr close() override;
+
+	// Reading a file doesn't wait on anything, so this only fails the 
+	// calls after it.
+	void cancel() override { mCancelled = true; }
+
+private:
+	explicit EvtxRecordSource(const Options &options);
+
+	void open(const std::string &filePath, const XPath::Node &query, Direction dir);
+
+	// Location of a chunk in the file and how many records its header claims.
+	struct ChunkInfo
+	{
+		uint64_t fileOffset;
+		uint64_t firstRecordNumber;
+		uint64_t recordCount;
+	};
+
+	// Parses from the chunk on, skipping its first skip records.
+	void startPipeline(size_t chunk, uint64_t skip);
+
+	Options mOptions;
+
+	bool mOpen = false;
+	std::atomic<bool> mCancelled{ false };
+	std::shared_ptr<const MappedFile> mFile{};
+	Direction mDirection = Direction::Forward;
+	EventField mFields = EventField::All;
+
+	// Null for "*".
+	RefPtr<IXPathFilter> mFilter{};
+
+	// Chunks in query order.
+	std::vector<ChunkInfo> mChunks{};
+	uint64_t mRecordCount = 0;
+
+	std::unique_ptr<EvtxChunkPipeline> mPipeline{};
+	std::shared_ptr<const EvtxChunk> mChunk{};
+	size_t mChunkPos = 0;
+
+	// Index of mChunk in mChunks and the position of its first record, 
+	// then the same for the chunk after it.
+	size_t mChunkIndex = 0;
+	uint64_t mChunkBase = 0;
+	size_t mNextChunk = 0;
+	uint64_t mNextChunkBase = 0;
+
+	// Position, in query order, of the next record to return.
+	uint64_t mCursor = 0;
+
+	EvtxRecordSource(const EvtxRecordSource &) = delete;
+	EvtxRecordSource &operator=(const EvtxRecordSource &) = delete;
+};
+
+}
@@ -21,7 +21,7 @@ misrepresented as being the original software.
 */
 
 #include "Exceptions.h"
-#include "WinSys.h"
+#include "SysPlatform.h"
 
 namespace Windows
 {
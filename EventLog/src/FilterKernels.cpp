@@ -0,0 +1,451 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "FilterKernels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EVENTLOG_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC takes the intrinsics of any instruction set without options.
+#define EVENTLOG_AVX2
+#else
+#define EVENTLOG_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace Windows::EventLog
+{
+
+// Narrows bits by W values at a time: block(p) returns the result bits of 
+// the W values at p, test(v) tests the ones left over at the end.
+template<uint32_t W, typename T, typename Block, typename Test>
+static inline void narrow(const T *values, uint32_t count, uint64_t *bits, const Block &block, const Test &test)
+{
+	static_assert(64 % W == 0, "Blocks don't straddle words");
+
+	for (uint32_t base = 0; base < count; base += 64)
+	{
+		uint64_t &word = bits[base / 64];
+		if (word == 0)
+			continue;
+
+		const T *p = values + base;
+		const uint32_t n = std::min<uint32_t>(64, count - base);
+		uint64_t m = 0;
+		uint32_t i = 0;
+		for (; i + W <= n; i += W)
+			m |= uint64_t(block(p + i)) << i;
+		for (; i < n; ++i)
+			m |= uint64_t(test(p[i])) << i;
+		word &= m;
+	}
+}
+
+//
+// Scalar
+//
+
+template<typename T, typename Test>
+static void narrowScalar(const T *values, uint32_t count, uint64_t *bits, const Test &test)
+{
+	narrow<1>(values, count, bits, [&test](const T *p) { return test(*p); }, test);
+}
+
+static void rangeU8Scalar(const uint8_t *values, uint32_t count, uint8_t min, uint8_t max, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [min, max](uint8_t v) { return v >= min && v <= max; });
+}
+
+static void rangeU64Scalar(const uint64_t *values, uint32_t count, uint64_t min, uint64_t max, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [min, max](uint64_t v) { return v >= min && v <= max; });
+}
+
+template<typename T>
+static bool inSet(T v, const T *set, size_t setSize)
+{
+	bool in = false;
+	for (size_t i = 0; i < setSize; ++i)
+		in |= v == set[i];
+	return in;
+}
+
+static void inSetU16Scalar(const uint16_t *values, uint32_t count, const uint16_t *set, size_t setSize, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [set, setSize](uint16_t v) { return inSet(v, set, setSize); });
+}
+
+static void inSetU32Scalar(const uint32_t *values, uint32_t count, const uint32_t *set, size_t setSize, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [set, setSize](uint32_t v) { return inSet(v, set, setSize); });
+}
+
+static void inTableU16Scalar(const uint16_t *values, uint32_t count, const uint64_t *table, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [table](uint16_t v) { return (table[v / 64] >> (v % 64)) & 1; });
+}
+
+static void anyBits64Scalar(const int64_t *values, uint32_t count, int64_t mask, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [mask](int64_t v) { return (v & mask) != 0; });
+}
+
+static void allFieldsScalar(const EventField *values, uint32_t count, EventField mask, uint64_t *bits)
+{
+	narrowScalar(values, count, bits, [mask](EventField v) { return (v & mask) == mask; });
+}
+
+static const FilterKernels scalarKernels = 
+{
+	"scalar",
+	rangeU8Scalar,
+	rangeU64Scalar,
+	inSetU16Scalar,
+	inSetU32Scalar,
+	inTableU16Scalar,
+	anyBits64Scalar,
+	allFieldsScalar
+};
+
+#ifdef EVENTLOG_X64
+
+//
+// SSE2, always there on x86-64. There's no 64 bit compare until SSE4.2, 
+// the range test stays scalar.
+//
+
+static void rangeU8Sse2(const uint8_t *values, uint32_t count, uint8_t min, uint8_t max, uint64_t *bits)
+{
+	const __m128i lo = _mm_set1_epi8(char(min));
+	const __m128i hi = _mm_set1_epi8(char(max));
+	auto block = [lo, hi](const uint8_t *p)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v), _mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+		return uint32_t(_mm_movemask_epi8(in));
+	};
+	narrow<16>(values, count, bits, block, [min, max](uint8_t v) { return v >= min && v <= max; });
+}
+
+static void inSetU16Sse2(const uint16_t *values, uint32_t count, const uint16_t *set, size_t setSize, uint64_t *bits)
+{
+	__m128i sets[FilterKernels::MaxSetSize];
+	for (size_t i = 0; i < setSize; ++i)
+		sets[i] = _mm_set1_epi16(short(set[i]));
+
+	auto block = [&sets, setSize](const uint16_t *p)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8));
+		__m128i inA = _mm_setzero_si128();
+		__m128i inB = _mm_setzero_si128();
+		for (size_t i = 0; i < setSize; ++i)
+		{
+			inA = _mm_or_si128(inA, _mm_cmpeq_epi16(a, sets[i]));
+			inB = _mm_or_si128(inB, _mm_cmpeq_epi16(b, sets[i]));
+		}
+		return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(inA, inB)));
+	};
+	narrow<16>(values, count, bits, block, [set, setSize](uint16_t v) { return inSet(v, set, setSize); });
+}
+
+static void inSetU32Sse2(const uint32_t *values, uint32_t count, const uint32_t *set, size_t setSize, uint64_t *bits)
+{
+	__m128i sets[FilterKernels::MaxSetSize];
+	for (size_t i = 0; i < setSize; ++i)
+		sets[i] = _mm_set1_epi32(int(set[i]));
+
+	auto block = [&sets, setSize](const uint32_t *p)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i in = _mm_setzero_si128();
+		for (size_t i = 0; i < setSize; ++i)
+			in = _mm_or_si128(in, _mm_cmpeq_epi32(v, sets[i]));
+		return uint32_t(_mm_movemask_ps(_mm_castsi128_ps(in)));
+	};
+	narrow<4>(values, count, bits, block, [set, setSize](uint32_t v) { return inSet(v, set, setSize); });
+}
+
+static void anyBits64Sse2(const int64_t *values, uint32_t count, int64_t mask, uint64_t *bits)
+{
+	const __m128i m = _mm_set1_epi64x(mask);
+	auto block = [m](const int64_t *p)
+	{
+		__m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), m);
+		// Each half zero, then both halves of each value.
+		__m128i zero = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+		zero = _mm_and_si128(zero, _mm_shuffle_epi32(zero, _MM_SHUFFLE(2, 3, 0, 1)));
+		return uint32_t(~_mm_movemask_pd(_mm_castsi128_pd(zero)) & 0x3);
+	};
+	narrow<2>(values, count, bits, block, [mask](int64_t v) { return (v & mask) != 0; });
+}
+
+static void allFieldsSse2(const EventField *values, uint32_t count, EventField mask, uint64_t *bits)
+{
+	const __m128i m = _mm_set1_epi32(int(mask));
+	auto block = [m](const EventField *p)
+	{
+		__m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), m);
+		return uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, m))));
+	};
+	narrow<4>(values, count, bits, block, [mask](EventField v) { return (v & mask) == mask; });
+}
+
+static const FilterKernels sse2Kernels = 
+{
+	"sse2",
+	rangeU8Sse2,
+	rangeU64Scalar,
+	inSetU16Sse2,
+	inSetU32Sse2,
+	inTableU16Scalar,
+	anyBits64Sse2,
+	allFieldsSse2
+};
+
+//
+// AVX2. Blocks are functors rather than lambdas, the lambda's call operator
+// wouldn't be compiled for AVX2.
+//
+
+template<uint32_t W, typename T, typename Block, typename Test>
+EVENTLOG_AVX2 static void narrowAvx2(const T *values, uint32_t count, uint64_t *bits, const Block &block, const Test &test)
+{
+	for (uint32_t base = 0; base < count; base += 64)
+	{
+		uint64_t &word = bits[base / 64];
+		if (word == 0)
+			continue;
+
+		const T *p = values + base;
+		const uint32_t n = std::min<uint32_t>(64, count - base);
+		uint64_t m = 0;
+		uint32_t i = 0;
+		for (; i + W <= n; i += W)
+			m |= uint64_t(block(p + i)) << i;
+		for (; i < n; ++i)
+			m |= uint64_t(test(p[i])) << i;
+		word &= m;
+	}
+}
+
+struct RangeU8Avx2
+{
+	uint8_t min;
+	uint8_t max;
+
+	EVENTLOG_AVX2 uint32_t operator()(const uint8_t *p) const
+	{
+		const __m256i lo = _mm256_set1_epi8(char(min));
+		const __m256i hi = _mm256_set1_epi8(char(max));
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		__m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo), v), _mm256_cmpeq_epi8(_mm256_min_epu8(v, hi), v));
+		return uint32_t(_mm256_movemask_epi8(in));
+	}
+};
+
+EVENTLOG_AVX2 static void rangeU8Avx2(const uint8_t *values, uint32_t count, uint8_t min, uint8_t max, uint64_t *bits)
+{
+	narrowAvx2<32>(values, count, bits, RangeU8Avx2{ min, max }, [min, max](uint8_t v) { return v >= min && v <= max; });
+}
+
+struct RangeU64Avx2
+{
+	uint64_t min;
+	uint64_t max;
+
+	// Unsigned compares as signed ones, with the sign bit flipped.
+	EVENTLOG_AVX2 uint32_t operator()(const uint64_t *p) const
+	{
+		const __m256i sign = _mm256_set1_epi64x(int64_t(1ull << 63));
+		const __m256i lo = _mm256_xor_si256(_mm256_set1_epi64x(int64_t(min)), sign);
+		const __m256i hi = _mm256_xor_si256(_mm256_set1_epi64x(int64_t(max)), sign);
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), sign);
+		__m256i out = _mm256_or_si256(_mm256_cmpgt_epi64(lo, v), _mm256_cmpgt_epi64(v, hi));
+		return uint32_t(~_mm256_movemask_pd(_mm256_castsi256_pd(out)) & 0xf);
+	}
+};
+
+EVENTLOG_AVX2 static void rangeU64Avx2(const uint64_t *values, uint32_t count, uint64_t min, uint64_t max, uint64_t *bits)
+{
+	narrowAvx2<4>(values, count, bits, RangeU64Avx2{ min, max }, [min, max](uint64_t v) { return v >= min && v <= max; });
+}
+
+struct InSetU16Avx2
+{
+	const uint16_t *set;
+	size_t setSize;
+
+	// Two vectors packed to bytes. The pack works within 128 bit lanes, 
+	// the permute puts the quarters back in order.
+	EVENTLOG_AVX2 uint32_t operator()(const uint16_t *p) const
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 16));
+		__m256i inA = _mm256_setzero_si256();
+		__m256i inB = _mm256_setzero_si256();
+		for (size_t i = 0; i < setSize; ++i)
+		{
+			__m256i s = _mm256_set1_epi16(short(set[i]));
+			inA = _mm256_or_si256(inA, _mm256_cmpeq_epi16(a, s));
+			inB = _mm256_or_si256(inB, _mm256_cmpeq_epi16(b, s));
+		}
+		__m256i in = _mm256_permute4x64_epi64(_mm256_packs_epi16(inA, inB), _MM_SHUFFLE(3, 1, 2, 0));
+		return uint32_t(_mm256_movemask_epi8(in));
+	}
+};
+
+EVENTLOG_AVX2 static void inSetU16Avx2(const uint16_t *values, uint32_t count, const uint16_t *set, size_t setSize, uint64_t *bits)
+{
+	narrowAvx2<32>(values, count, bits, InSetU16Avx2{ set, setSize }, [set, setSize](uint16_t v) { return inSet(v, set, setSize); });
+}
+
+struct InSetU32Avx2
+{
+	const uint32_t *set;
+	size_t setSize;
+
+	EVENTLOG_AVX2 uint32_t operator()(const uint32_t *p) const
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		__m256i in = _mm256_setzero_si256();
+		for (size_t i = 0; i < setSize; ++i)
+			in = _mm256_or_si256(in, _mm256_cmpeq_epi32(v, _mm256_set1_epi32(int(set[i]))));
+		return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(in)));
+	}
+};
+
+EVENTLOG_AVX2 static void inSetU32Avx2(const uint32_t *values, uint32_t count, const uint32_t *set, size_t setSize, uint64_t *bits)
+{
+	narrowAvx2<8>(values, count, bits, InSetU32Avx2{ set, setSize }, [set, setSize](uint32_t v) { return inSet(v, set, setSize); });
+}
+
+struct AnyBits64Avx2
+{
+	int64_t mask;
+
+	EVENTLOG_AVX2 uint32_t operator()(const int64_t *p) const
+	{
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), _mm256_set1_epi64x(mask));
+		__m256i zero = _mm256_cmpeq_epi64(v, _mm256_setzero_si256());
+		return uint32_t(~_mm256_movemask_pd(_mm256_castsi256_pd(zero)) & 0xf);
+	}
+};
+
+EVENTLOG_AVX2 static void anyBits64Avx2(const int64_t *values, uint32_t count, int64_t mask, uint64_t *bits)
+{
+	narrowAvx2<4>(values, count, bits, AnyBits64Avx2{ mask }, [mask](int64_t v) { return (v & mask) != 0; });
+}
+
+struct AllFieldsAvx2
+{
+	EventField mask;
+
+	EVENTLOG_AVX2 uint32_t operator()(const EventField *p) const
+	{
+		const __m256i m = _mm256_set1_epi32(int(mask));
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), m);
+		return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, m))));
+	}
+};
+
+EVENTLOG_AVX2 static void allFieldsAvx2(const EventField *values, uint32_t count, EventField mask, uint64_t *bits)
+{
+	narrowAvx2<8>(values, count, bits, AllFieldsAvx2{ mask }, [mask](EventField v) { return (v & mask) == mask; });
+}
+
+static const FilterKernels avx2Kernels = 
+{
+	"avx2",
+	rangeU8Avx2,
+	rangeU64Avx2,
+	inSetU16Avx2,
+	inSetU32Avx2,
+	inTableU16Scalar,
+	anyBits64Avx2,
+	allFieldsAvx2
+};
+
+// AVX2 needs the OS to save the YMM registers too.
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4] = {};
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+//
+// FilterKernels
+//
+
+const FilterKernels &FilterKernels::scalar()
+{
+	return scalarKernels;
+}
+
+const FilterKernels *FilterKernels::sse2()
+{
+#ifdef EVENTLOG_X64
+	return &sse2Kernels;
+#else
+	return nullptr;
+#endif
+}
+
+const FilterKernels *FilterKernels::avx2()
+{
+#ifdef EVENTLOG_X64
+	static const bool hasAvx2 = cpuHasAvx2();
+	return hasAvx2 ? &avx2Kernels : nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+const FilterKernels &FilterKernels::best()
+{
+	static const FilterKernels &kernels = avx2() ? *avx2() : sse2() ? *sse2() : scalar();
+	return kernels;
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Windows::EventLog
+{
+
+// Kernels that narrow a selection bitmap by one column. Each clears the 
+// bit of every record whose value fails its test and skips the words that
+// are already clear, so the conditions that select least should go first.
+// bits holds (count + 63) / 64 words, bit i % 64 of word i / 64 is record i.
+//
+// There's a set per instruction set. The SIMD sets only exist on x86-64, 
+// the scalar one is everywhere. 
+struct FilterKernels
+{
+	// Most values a set test compares against one by one. Larger sets go 
+	// through a table, see inTableU16.
+	static constexpr size_t MaxSetSize = 16;
+
+	const char *name;
+
+	// min <= value <= max.
+	void (*rangeU8)(const uint8_t *values, uint32_t count, uint8_t min, uint8_t max, uint64_t *bits);
+	void (*rangeU64)(const uint64_t *values, uint32_t count, uint64_t min, uint64_t max, uint64_t *bits);
+
+	// value is one of the setSize values of set, at most MaxSetSize.
+	void (*inSetU16)(const uint16_t *values, uint32_t count, const uint16_t *set, size_t setSize, uint64_t *bits);
+	void (*inSetU32)(const uint32_t *values, uint32_t count, const uint32_t *set, size_t setSize, uint64_t *bits);
+
+	// The value's bit is set in table, which has 65536 bits.
+	void (*inTableU16)(const uint16_t *values, uint32_t count, const uint64_t *table, uint64_t *bits);
+
+	// value & mask isn't zero.
+	void (*anyBits64)(const int64_t *values, uint32_t count, int64_t mask, uint64_t *bits);
+
+	// Every field in mask is present.
+	void (*allFields)(const EventField *values, uint32_t count, EventField mask, uint64_t *bits);
+
+	static const FilterKernels &scalar();
+
+	// Null when the CPU or the build doesn't have them.
+	static const FilterKernels *sse2();
+	static const FilterKernels *avx2();
+
+	// The fastest set the CPU has.
+	static const FilterKernels &best();
+};
+
+}
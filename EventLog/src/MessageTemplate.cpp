@@ -0,0 +1,162 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "MessageTemplate.h"
+
+#include <algorithm>
+
+namespace Windows::EventLog
+{
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+std::optional<MessageTemplate> MessageTemplate::parse(std::string_view message)
+{
+	MessageTemplate t;
+	size_t literal = 0;
+	size_t i = 0;
+	while (i < message.size())
+	{
+		if (message[i] != '%' || i + 1 >= message.size())
+		{
+			++i;
+			continue;
+		}
+
+		t.appendLiteral(message.substr(literal, i - literal));
+		char c = message[i + 1];
+		i += 2;
+
+		if (isDigit(c) && c != '0')
+		{
+			uint32_t number = uint32_t(c - '0');
+			if (i < message.size() && isDigit(message[i]))
+				number = number * 10 + uint32_t(message[i++] - '0');
+
+			// Only the default string format, the others need the values 
+			// rather than insertion strings.
+			if (i < message.size() && message[i] == '!')
+			{
+				size_t end = message.find('!', i + 1);
+				if (end == std::string_view::npos)
+					return std::nullopt;
+				std::string_view format = message.substr(i + 1, end - i - 1);
+				if (format != "s" && format != "S")
+					return std::nullopt;
+				i = end + 1;
+			}
+			t.appendInsertion(number);
+		}
+		else
+		{
+			switch (c)
+			{
+			case '0':
+				// Ends the message, without a new line.
+				return t;
+			case 'n':
+				t.appendLiteral("\r\n");
+				break;
+			case 'r':
+				t.appendLiteral("\r");
+				break;
+			case 't':
+				t.appendLiteral("\t");
+				break;
+			case 'b':
+				t.appendLiteral(" ");
+				break;
+			case '%':
+				// %%n is a parameter string, from the provider's parameter 
+				// file.
+				if (i < message.size() && isDigit(message[i]))
+					return std::nullopt;
+				t.appendLiteral("%");
+				break;
+			default:
+				// %. %! and the like escape the character.
+				t.appendLiteral(message.substr(i - 1, 1));
+				break;
+			}
+		}
+		literal = i;
+	}
+	t.appendLiteral(message.substr(literal));
+	return t;
+}
+
+void MessageTemplate::appendLiteral(std::string_view text)
+{
+	if (text.empty())
+		return;
+
+	// Adjacent literals are merged.
+	if (!mSegments.empty() && mSegments.back().number == 0)
+	{
+		mSegments.back().length += uint32_t(text.size());
+	}
+	else
+	{
+		mSegments.push_back({ uint32_t(mText.size()), uint32_t(text.size()), 0 });
+	}
+	mText.append(text);
+}
+
+void MessageTemplate::appendInsertion(uint32_t number)
+{
+	mSegments.push_back({ 0, 0, number });
+	mInsertionCount = std::max<uint32_t>(mInsertionCount, number);
+}
+
+std::string MessageTemplate::format(const std::vector<std::string> &insertions) const
+{
+	size_t size = mText.size();
+	for (const Segment &segment : mSegments)
+	{
+		if (segment.number != 0 && segment.number <= insertions.size())
+			size += insertions[segment.number - 1].size();
+	}
+
+	std::string out;
+	out.reserve(size);
+	for (const Segment &segment : mSegments)
+	{
+		if (segment.number == 0)
+		{
+			out.append(mText, segment.offset, segment.length);
+		}
+		else if (segment.number <= insertions.size())
+		{
+			out.append(insertions[segment.number - 1]);
+		}
+		else
+		{
+			out.append("%").append(std::to_string(segment.number));
+		}
+	}
+	return out;
+}
+
+}
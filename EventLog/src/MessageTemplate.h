@@ -0,0 +1,71 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// An event message in FormatMessage syntax, compiled once so formatting a 
+// record's message is just appending literals and insertion strings. 
+//
+// Handles %1..%99 insertions (with an optional !s! format), %n, %r, %t, 
+// %b, %0 and the escaped characters. Messages that need more than that, 
+// parameter strings (%%n) or printf style insertion formats, don't parse 
+// and have to be left to FormatMessage.
+class MessageTemplate
+{
+public:
+	static std::optional<MessageTemplate> parse(std::string_view message);
+
+	// Substitutes the insertion strings, %1 being the first. Insertions 
+	// without a string are left as written.
+	std::string format(const std::vector<std::string> &insertions) const;
+
+	// Highest insertion number used, 0 if none.
+	uint32_t getInsertionCount() const { return mInsertionCount; }
+
+private:
+	MessageTemplate() = default;
+
+	// Literal text of mText, or an insertion if number isn't 0.
+	struct Segment
+	{
+		uint32_t offset;
+		uint32_t length;
+		uint32_t number;
+	};
+
+	void appendLiteral(std::string_view text);
+	void appendInsertion(uint32_t number);
+
+	std::string mText{};
+	std::vector<Segment> mSegments{};
+	uint32_t mInsertionCount = 0;
+};
+
+}
@@ -0,0 +1,466 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "MetadataCatalog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace Windows::EventLog
+{
+
+static constexpr char Magic[8] = { 'E', 'V', 'T', 'M', 'C', 'T', 'L', 'G' };
+static constexpr size_t HeaderSize = 32;
+static constexpr size_t DirectoryEntrySize = 24;
+// Smallest encodings: a string is its u32 length, a value is a u64 and two
+// strings, an event is its id, version, message, name count and flag.
+static constexpr size_t MinStringSize = 4;
+static constexpr size_t MinValueSize = 8 + 2 * MinStringSize;
+static constexpr size_t MinEventSize = 2 + 1 + MinStringSize + 4 + 1;
+
+//
+// Encoding
+//
+
+class CatalogEncoder
+{
+public:
+	void u8(uint8_t v) { mData.push_back(char(v)); }
+	void u16(uint16_t v) { put(v, 2); }
+	void u32(uint32_t v) { put(v, 4); }
+	void u64(uint64_t v) { put(v, 8); }
+
+	void str(const std::string &s)
+	{
+		u32(uint32_t(s.size()));
+		mData.append(s);
+	}
+
+	void guid(const GUID &g)
+	{
+		u32(g.Data1);
+		u16(g.Data2);
+		u16(g.Data3);
+		for (uint8_t b : g.Data4)
+			u8(b);
+	}
+
+	size_t size() const { return mData.size(); }
+	std::string &data() { return mData; }
+
+	// Overwrites a u32 or u64 written earlier.
+	void patch(size_t offset, uint64_t v, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; ++i)
+			mData[offset + i] = char((v >> (8 * i)) & 0xff);
+	}
+
+private:
+	void put(uint64_t v, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; ++i)
+			mData.push_back(char((v >> (8 * i)) & 0xff));
+	}
+
+	std::string mData{};
+};
+
+class CatalogDecoder
+{
+public:
+	CatalogDecoder(const uint8_t *data, size_t size)
+		: mPos(data), mEnd(data + size)
+	{}
+
+	uint8_t u8() { return uint8_t(get(1)); }
+	uint16_t u16() { return uint16_t(get(2)); }
+	uint32_t u32() { return uint32_t(get(4)); }
+	uint64_t u64() { return get(8); }
+
+	std::string str()
+	{
+		uint32_t length = u32();
+		need(length);
+		std::string s(reinterpret_cast<const char *>(mPos), length);
+		mPos += length;
+		return s;
+	}
+
+	// A count of elements encoded in at least elementSize bytes each. More 
+	// than the rest of the data can hold means the file is corrupt, so it 
+	// isn't trusted to size anything.
+	uint32_t count(size_t elementSize)
+	{
+		uint32_t n = u32();
+		if (size_t(mEnd - mPos) / elementSize < n)
+		{
+			THROW_(SystemException, ERROR_INVALID_DATA);
+		}
+		return n;
+	}
+
+	GUID guid()
+	{
+		GUID g{};
+		g.Data1 = u32();
+		g.Data2 = u16();
+		g.Data3 = u16();
+		for (uint8_t &b : g.Data4)
+			b = u8();
+		return g;
+	}
+
+private:
+	void need(size_t bytes) const
+	{
+		if (size_t(mEnd - mPos) < bytes)
+		{
+			THROW_(SystemException, ERROR_INVALID_DATA);
+		}
+	}
+
+	uint64_t get(size_t bytes)
+	{
+		need(bytes);
+		uint64_t v = 0;
+		for (size_t i = 0; i < bytes; ++i)
+			v |= uint64_t(mPos[i]) << (8 * i);
+		mPos += bytes;
+		return v;
+	}
+
+	const uint8_t *mPos;
+	const uint8_t *const mEnd;
+};
+
+static void writeValues(CatalogEncoder &out, const std::vector<CatalogValue> &values)
+{
+	out.u32(uint32_t(values.size()));
+	for (const CatalogValue &v : values)
+	{
+		out.u64(v.value);
+		out.str(v.name);
+		out.str(v.message);
+	}
+}
+
+static std::vector<CatalogValue> readValues(CatalogDecoder &in)
+{
+	std::vector<CatalogValue> values(in.count(MinValueSize));
+	for (CatalogValue &v : values)
+	{
+		v.value = in.u64();
+		v.name = in.str();
+		v.message = in.str();
+	}
+	return values;
+}
+
+// A publisher's data. The name comes first so the directory can point into
+// it rather than repeat it.
+static void writePublisher(CatalogEncoder &out, const CatalogPublisher &publisher)
+{
+	out.str(publisher.name);
+	out.u8(publisher.guid.has_value() ? 1 : 0);
+	out.guid(publisher.guid.value_or(GUID{}));
+	out.str(publisher.resourceFilePath);
+	out.str(publisher.messageFilePath);
+	out.str(publisher.parameterFilePath);
+	out.u64(publisher.fileTime);
+	out.str(publisher.message);
+
+	writeValues(out, publisher.channels);
+	writeValues(out, publisher.levels);
+	writeValues(out, publisher.tasks);
+	writeValues(out, publisher.opcodes);
+	writeValues(out, publisher.keywords);
+
+	out.u32(uint32_t(publisher.events.size()));
+	for (const CatalogEvent &event : publisher.events)
+	{
+		out.u16(event.id);
+		out.u8(event.version);
+		out.str(event.message);
+		out.u32(uint32_t(event.dataNames.size()));
+		for (const std::string &name : event.dataNames)
+			out.str(name);
+		out.u8(event.mapsData ? 1 : 0);
+	}
+}
+
+static CatalogPublisher readPublisher(CatalogDecoder &in)
+{
+	CatalogPublisher publisher{};
+	publisher.name = in.str();
+	bool hasGuid = in.u8() != 0;
+	GUID guid = in.guid();
+	if (hasGuid)
+		publisher.guid = guid;
+	publisher.resourceFilePath = in.str();
+	publisher.messageFilePath = in.str();
+	publisher.parameterFilePath = in.str();
+	publisher.fileTime = in.u64();
+	publisher.message = in.str();
+
+	publisher.channels = readValues(in);
+	publisher.levels = readValues(in);
+	publisher.tasks = readValues(in);
+	publisher.opcodes = readValues(in);
+	publisher.keywords = readValues(in);
+
+	publisher.events.resize(in.count(MinEventSize));
+	for (CatalogEvent &event : publisher.events)
+	{
+		event.id = in.u16();
+		event.version = in.u8();
+		event.message = in.str();
+		event.dataNames.resize(in.count(MinStringSize));
+		for (std::string &name : event.dataNames)
+			name = in.str();
+		event.mapsData = in.u8() != 0;
+		if (!event.message.empty() && !event.mapsData)
+			event.messageTemplate = MessageTemplate::parse(event.message);
+	}
+	return publisher;
+}
+
+//
+// CatalogPublisher
+//
+
+// Message if there is one, like EvtFormatMessage, otherwise the name.
+static const std::string &display(const CatalogValue &v)
+{
+	return v.message.empty() ? v.name : v.message;
+}
+
+static const CatalogValue *findValue(const std::vector<CatalogValue> &values, uint64_t value)
+{
+	auto it = std::find_if(values.begin(), values.end(), [value](const CatalogValue &v) { return v.value == value; });
+	return it != values.end() ? &*it : nullptr;
+}
+
+const CatalogEvent *CatalogPublisher::findEvent(uint16_t id, uint8_t version) const
+{
+	auto it = std::lower_bound(events.begin(), events.end(), std::make_pair(id, version),
+		[](const CatalogEvent &e, const std::pair<uint16_t, uint8_t> &key) { return std::make_pair(e.id, e.version) < key; });
+	return it != events.end() && it->id == id && it->version == version ? &*it : nullptr;
+}
+
+std::string CatalogPublisher::getLevelDisplay(uint8_t level) const
+{
+	const CatalogValue *v = findValue(levels, level);
+	return v ? display(*v) : std::string();
+}
+
+std::string CatalogPublisher::getTaskDisplay(uint16_t task) const
+{
+	const CatalogValue *v = findValue(tasks, task);
+	return v ? display(*v) : std::string();
+}
+
+// Opcode values are the opcode in the high word and the task it belongs to,
+// if any, in the low.
+std::string CatalogPublisher::getOpcodeDisplay(uint16_t task, uint8_t opcode) const
+{
+	const CatalogValue *v = findValue(opcodes, (uint64_t(opcode) << 16) | task);
+	if (!v)
+		v = findValue(opcodes, uint64_t(opcode) << 16);
+	return v ? display(*v) : std::string();
+}
+
+std::vector<std::string> CatalogPublisher::getKeywordsDisplay(uint64_t value) const
+{
+	std::vector<std::string> result;
+	for (const CatalogValue &v : keywords)
+	{
+		if (value & v.value)
+			result.push_back(display(v));
+	}
+	return result;
+}
+
+std::string CatalogPublisher::getChannelDisplay(const std::string &channel) const
+{
+	for (const CatalogValue &v : channels)
+	{
+		if (v.name == channel)
+			return display(v);
+	}
+	return {};
+}
+
+//
+// MetadataCatalog
+//
+
+std::shared_ptr<const MetadataCatalog> MetadataCatalog::open(const std::string &path)
+{
+	return std::shared_ptr<const MetadataCatalog>(new MetadataCatalog(MappedFile::open(path)));
+}
+
+MetadataCatalog::MetadataCatalog(std::shared_ptr<const MappedFile> file)
+	: mFile(std::move(file))
+{
+	if (mFile->size() < HeaderSize || std::memcmp(mFile->data(), Magic, sizeof(Magic)) != 0)
+	{
+		THROW_(SystemException, ERROR_INVALID_DATA);
+	}
+
+	CatalogDecoder header(mFile->data() + sizeof(Magic), HeaderSize - sizeof(Magic));
+	uint32_t version = header.u32();
+	mPublisherCount = header.u32();
+	mDirectoryOffset = header.u64();
+	uint64_t fileSize = header.u64();
+
+	// A newer format or a file cut short.
+	if (version != Version || fileSize != mFile->size() || 
+		mDirectoryOffset > fileSize || (fileSize - mDirectoryOffset) / DirectoryEntrySize < mPublisherCount)
+	{
+		THROW_(SystemException, ERROR_INVALID_DATA);
+	}
+}
+
+void MetadataCatalog::write(const std::string &path, const std::vector<std::shared_ptr<const CatalogPublisher>> &publishers)
+{
+	std::vector<const CatalogPublisher *> sorted;
+	for (const std::shared_ptr<const CatalogPublisher> &publisher : publishers)
+	{
+		if (publisher)
+			sorted.push_back(publisher.get());
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const CatalogPublisher *a, const CatalogPublisher *b) { return a->name < b->name; });
+	sorted.erase(std::unique(sorted.begin(), sorted.end(), 
+		[](const CatalogPublisher *a, const CatalogPublisher *b) { return a->name == b->name; }), sorted.end());
+
+	CatalogEncoder out;
+	out.data().append(Magic, sizeof(Magic));
+	out.u32(Version);
+	out.u32(uint32_t(sorted.size()));
+	out.u64(0); // directory offset
+	out.u64(0); // file size
+
+	std::vector<std::pair<uint64_t, uint64_t>> extents;
+	for (const CatalogPublisher *publisher : sorted)
+	{
+		size_t offset = out.size();
+		writePublisher(out, *publisher);
+		extents.push_back({ offset, out.size() - offset });
+	}
+
+	size_t directoryOffset = out.size();
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		out.u64(extents[i].first + 4);
+		out.u32(uint32_t(sorted[i]->name.size()));
+		out.u32(uint32_t(extents[i].second));
+		out.u64(extents[i].first);
+	}
+	out.patch(16, directoryOffset, 8);
+	out.patch(24, out.size(), 8);
+
+	// Written aside and renamed over the old file, so a reader never maps a
+	// half written catalog.
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(out.data().data(), std::streamsize(out.size()));
+		file.close();
+		if (!file)
+		{
+			std::remove(tempPath.c_str());
+			THROW_(SystemException, ERROR_ACCESS_DENIED);
+		}
+	}
+
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		// Windows doesn't rename over an existing file.
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+		{
+			std::remove(tempPath.c_str());
+			THROW_(SystemException, ERROR_ACCESS_DENIED);
+		}
+	}
+}
+
+std::shared_ptr<const CatalogPublisher> MetadataCatalog::find(const std::string &name) const
+{
+	return mDecoded.lookup(name, [this, &name] { return decode(name); });
+}
+
+std::string MetadataCatalog::getName(uint32_t index) const
+{
+	CatalogDecoder entry(mFile->data() + mDirectoryOffset + size_t(index) * DirectoryEntrySize, DirectoryEntrySize);
+	uint64_t offset = entry.u64();
+	uint32_t length = entry.u32();
+	if (offset > mFile->size() || length > mFile->size() - offset)
+	{
+		THROW_(SystemException, ERROR_INVALID_DATA);
+	}
+	return std::string(reinterpret_cast<const char *>(mFile->data() + offset), length);
+}
+
+std::shared_ptr<const CatalogPublisher> MetadataCatalog::decode(const std::string &name) const
+{
+	// Binary search of the directory, straight from the mapping.
+	uint32_t lo = 0;
+	uint32_t hi = mPublisherCount;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (getName(mid) < name)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == mPublisherCount || getName(lo) != name)
+	{
+		return nullptr;
+	}
+
+	// Past the name offset and length.
+	CatalogDecoder entry(mFile->data() + mDirectoryOffset + size_t(lo) * DirectoryEntrySize + 12, DirectoryEntrySize - 12);
+	uint32_t size = entry.u32();
+	uint64_t offset = entry.u64();
+	if (offset > mFile->size() || size > mFile->size() - offset)
+	{
+		THROW_(SystemException, ERROR_INVALID_DATA);
+	}
+
+	CatalogDecoder data(mFile->data() + offset, size);
+	return std::make_shared<const CatalogPublisher>(readPublisher(data));
+}
+
+std::vector<std::string> MetadataCatalog::getPublisherNames() const
+{
+	std::vector<std::string> names;
+	names.reserve(mPublisherCount);
+	for (uint32_t i = 0; i < mPublisherCount; ++i)
+		names.push_back(getName(i));
+	return names;
+}
+
+}
@@ -0,0 +1,151 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "MessageTemplate.h"
+#include "ShardedCache.h"
+#include "SysPlatform.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// A level, task, opcode, keyword or channel of a publisher. Channels are 
+// named by their path.
+struct CatalogValue
+{
+	uint64_t value = 0;
+	std::string name{};
+	std::string message{};
+};
+
+struct CatalogEvent
+{
+	uint16_t id = 0;
+	uint8_t version = 0;
+	// Names of the template's data elements, in order.
+	std::vector<std::string> dataNames{};
+	// The raw message, with its %1 insertions.
+	std::string message{};
+	// Some data has a valueMap or bitMap, or an outType like win:HResult, 
+	// which only EvtFormatMessage turns into text.
+	bool mapsData = false;
+	// Parsed from message when read from a catalog, not written. Not for 
+	// events that map data.
+	std::optional<MessageTemplate> messageTemplate{};
+};
+
+// What formatting a publisher's events needs from its metadata. 
+struct CatalogPublisher
+{
+	std::string name{};
+	std::optional<GUID> guid{};
+	std::string resourceFilePath{};
+	std::string messageFilePath{};
+	std::string parameterFilePath{};
+	// Last write time of the resource and message files when the entry was 
+	// made, so a changed publisher is noticed. 0 if unknown.
+	uint64_t fileTime = 0;
+	std::string message{};
+
+	std::vector<CatalogValue> channels{};
+	std::vector<CatalogValue> levels{};
+	std::vector<CatalogValue> tasks{};
+	std::vector<CatalogValue> opcodes{};
+	std::vector<CatalogValue> keywords{};
+
+	// Ordered by id then version.
+	std::vector<CatalogEvent> events{};
+
+	// Null if there's no such event.
+	const CatalogEvent *findEvent(uint16_t id, uint8_t version) const;
+
+	// The display strings, as EvtFormatMessage would. Empty if the value 
+	// isn't known.
+	std::string getLevelDisplay(uint8_t level) const;
+	std::string getTaskDisplay(uint16_t task) const;
+	std::string getOpcodeDisplay(uint16_t task, uint8_t opcode) const;
+	std::vector<std::string> getKeywordsDisplay(uint64_t keywords) const;
+	std::string getChannelDisplay(const std::string &channel) const;
+};
+
+// Publisher metadata saved to a file, so a process doesn't have to load it 
+// from every publisher it meets before it can format their events. The 
+// file is portable: a catalog written on Windows formats messages of 
+// EVTX files read anywhere.
+//
+// The file is memory mapped and publishers are decoded as they're looked 
+// up. It is little endian throughout:
+//
+//   header     magic "EVTMCTLG", u32 version, u32 publisher count, 
+//              u64 directory offset, u64 file size
+//   publishers one after another, see writePublisher
+//   directory  per publisher, sorted by name: u64 name offset, 
+//              u32 name length, u32 data size, u64 data offset
+//
+// Strings are a u32 byte count then UTF-8. 
+class MetadataCatalog
+{
+public:
+	static constexpr uint32_t Version = 2;
+
+	// Throws SystemException if the file can't be read or isn't a catalog.
+	static std::shared_ptr<const MetadataCatalog> open(const std::string &path);
+
+	// Replaces the file, atomically where the platform allows.
+	static void write(const std::string &path, const std::vector<std::shared_ptr<const CatalogPublisher>> &publishers);
+
+	~MetadataCatalog() = default;
+
+	// Null if the publisher isn't in the catalog. Decoded publishers are 
+	// cached.
+	std::shared_ptr<const CatalogPublisher> find(const std::string &name) const;
+
+	uint32_t getPublisherCount() const { return mPublisherCount; }
+
+	std::vector<std::string> getPublisherNames() const;
+
+private:
+	explicit MetadataCatalog(std::shared_ptr<const MappedFile> file);
+
+	// Name of the publisher at the index of the directory.
+	std::string getName(uint32_t index) const;
+	std::shared_ptr<const CatalogPublisher> decode(const std::string &name) const;
+
+	const std::shared_ptr<const MappedFile> mFile;
+	uint32_t mPublisherCount = 0;
+	uint64_t mDirectoryOffset = 0;
+
+	mutable ShardedCache<std::string, std::shared_ptr<const CatalogPublisher>> mDecoded;
+
+	MetadataCatalog(const MetadataCatalog &) = delete;
+	MetadataCatalog &operator=(const MetadataCatalog &) = delete;
+};
+
+}
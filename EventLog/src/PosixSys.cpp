@@ -0,0 +1,367 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "PosixSys.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+
+#include <fcntl.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Windows
+{
+
+// Unconditionally throw a SystemError with the contained error code.
+[[noreturn]] void WaitResult::throwError() 
+{
+	THROW_(SystemException, mLastErr.getCode());
+}
+
+//
+// Thread
+//
+
+struct Thread::State
+{
+	std::mutex mutex{};
+	std::condition_variable cond{};
+	bool exited = false;
+	std::thread thread{};
+
+	~State()
+	{
+		if (thread.joinable())
+			thread.detach();
+	}
+};
+
+Thread Thread::begin(unsigned(*pfn)(void *), void *arg)
+{
+	auto state = std::make_shared<State>();
+	try
+	{
+		// The thread keeps a reference to the state so the proxy can go 
+		// away before the thread exits.
+		state->thread = std::thread([pfn, arg, state]() 
+		{
+			pfn(arg);
+			{
+				std::lock_guard<std::mutex> lck(state->mutex);
+				state->exited = true;
+			}
+			state->cond.notify_all();
+		});
+	}
+	catch (const std::system_error &e)
+	{
+		THROW_(SystemException, e.code().value());
+	}
+	return Thread(std::move(state));
+}
+
+WaitResult Thread::wait(DWORD timeout, BOOL) noexcept
+{
+	if (!mState)
+		return WaitResult::make(WaitStatus::Failed, ERROR_INVALID_PARAMETER);
+
+	std::unique_lock<std::mutex> lck(mState->mutex);
+	if (!waitFor(mState->cond, lck, timeout, [this] { return mState->exited; }))
+		return WaitResult::make(WaitStatus::Timeout);
+	lck.unlock();
+
+	// Exited, so this won't block for long.
+	if (mState->thread.joinable() && mState->thread.get_id() != std::this_thread::get_id())
+		mState->thread.join();
+
+	return WaitResult::make(WaitStatus::Object_0);
+}
+
+void Thread::join()
+{
+	wait(INFINITE);
+}
+
+//
+// Semaphore
+//
+
+Semaphore::Semaphore(LONG initial, LONG max)
+	: mCount(initial)
+	, mMax(max)
+{
+	if (initial < 0 || max <= 0 || initial > max)
+	{
+		THROW_(SystemException, ERROR_INVALID_PARAMETER);
+	}
+}
+
+SysErr Semaphore::release(LONG releaseCount, LONG *previousCount)
+{
+	{
+		std::lock_guard<std::mutex> lck(mMutex);
+		if (releaseCount <= 0 || mCount > mMax - releaseCount)
+			return ERROR_INVALID_PARAMETER; // ERROR_TOO_MANY_POSTS on Windows
+		if (previousCount)
+			*previousCount = mCount;
+		mCount += releaseCount;
+	}
+	if (releaseCount == 1)
+		mCond.notify_one();
+	else
+		mCond.notify_all();
+	return {};
+}
+
+WaitResult Semaphore::wait(DWORD timeout, BOOL)
+{
+	std::unique_lock<std::mutex> lck(mMutex);
+	if (!waitFor(mCond, lck, timeout, [this] { return mCount > 0; }))
+		return WaitResult::make(WaitStatus::Timeout);
+	mCount -= 1;
+	return WaitResult::make(WaitStatus::Object_0);
+}
+
+//
+// Event
+//
+
+Event::Event(BOOL bManualReset, BOOL bInitialState)
+	: mState(std::make_shared<State>())
+{
+	mState->manualReset = bManualReset != FALSE;
+	mState->signaled = bInitialState != FALSE;
+}
+
+void Event::reset()
+{
+	std::lock_guard<std::mutex> lck(mState->mutex);
+	mState->signaled = false;
+}
+
+void Event::set()
+{
+	{
+		std::lock_guard<std::mutex> lck(mState->mutex);
+		mState->signaled = true;
+	}
+	if (mState->manualReset)
+		mState->cond.notify_all();
+	else
+		mState->cond.notify_one();
+}
+
+WaitResult Event::wait(DWORD timeout, BOOL) noexcept
+{
+	std::unique_lock<std::mutex> lck(mState->mutex);
+	if (!waitFor(mState->cond, lck, timeout, [this] { return mState->signaled; }))
+		return WaitResult::make(WaitStatus::Timeout);
+	if (!mState->manualReset)
+		mState->signaled = false;
+	return WaitResult::make(WaitStatus::Object_0);
+}
+
+Event Event::duplicate() const
+{
+	return Event(mState);
+}
+
+//
+// Futex
+//
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex needs a plain 32 bit atomic");
+
+void Futex::wait(const std::atomic<uint32_t> &value, uint32_t expected, DWORD timeout) noexcept
+{
+#ifdef __linux__
+	timespec ts{};
+	timespec *pts = nullptr;
+	if (timeout != INFINITE)
+	{
+		ts.tv_sec = time_t(timeout / 1000);
+		ts.tv_nsec = long(timeout % 1000) * 1000000;
+		pts = &ts;
+	}
+	::syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&value), FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+#else
+	// No futex, so poll. Waiters recheck the value anyway.
+	if (timeout > 0 && value.load() == expected)
+		std::this_thread::sleep_for(std::chrono::microseconds(std::min<uint64_t>(uint64_t(timeout) * 1000, 100)));
+#endif
+}
+
+void Futex::wakeOne(const std::atomic<uint32_t> &value) noexcept
+{
+#ifdef __linux__
+	::syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&value), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+	(void)value;
+#endif
+}
+
+void Futex::wakeAll(const std::atomic<uint32_t> &value) noexcept
+{
+#ifdef __linux__
+	::syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&value), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+	(void)value;
+#endif
+}
+
+//
+// MappedFile
+//
+
+static SysErr fromErrno(int err)
+{
+	switch (err)
+	{
+	case ENOENT: return ERROR_FILE_NOT_FOUND;
+	case EACCES: return ERROR_ACCESS_DENIED;
+	case ENOMEM: return ERROR_NOT_ENOUGH_MEMORY;
+	default: return ERROR_INVALID_FUNCTION;
+	}
+}
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string &path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		THROW_(SystemException, fromErrno(errno).getCode());
+	}
+
+	struct stat st{};
+	if (::fstat(fd, &st) != 0)
+	{
+		SysErr err = fromErrno(errno);
+		::close(fd);
+		THROW_(SystemException, err.getCode());
+	}
+
+	// Can't map an empty file.
+	void *p = nullptr;
+	if (st.st_size > 0)
+	{
+		p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			SysErr err = fromErrno(errno);
+			::close(fd);
+			THROW_(SystemException, err.getCode());
+		}
+	}
+
+	// The mapping keeps the file open.
+	::close(fd);
+	return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const uint8_t *>(p), uint64_t(st.st_size)));
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+		::munmap(const_cast<uint8_t *>(mData), size_t(mSize));
+}
+
+void MappedFile::release(uint64_t offset, uint64_t size) const noexcept
+{
+	static const uint64_t pageSize = uint64_t(::sysconf(_SC_PAGESIZE));
+
+	if (offset >= mSize)
+		return;
+	size = std::min<uint64_t>(size, mSize - offset);
+
+	// Whole pages within the range only.
+	uint64_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	uint64_t end = (offset + size) / pageSize * pageSize;
+	if (end > begin)
+		::madvise(const_cast<uint8_t *>(mData) + begin, size_t(end - begin), MADV_DONTNEED);
+}
+
+std::string formatMessage(uint32_t errorCode)
+{
+	switch (errorCode)
+	{
+	case ERROR_SUCCESS: return "The operation completed successfully.";
+	case ERROR_INVALID_FUNCTION: return "Incorrect function.";
+	case ERROR_FILE_NOT_FOUND: return "The system cannot find the file specified.";
+	case ERROR_ACCESS_DENIED: return "Access is denied.";
+	case ERROR_NOT_ENOUGH_MEMORY: return "Not enough memory resources are available to process this command.";
+	case ERROR_INVALID_DATA: return "The data is invalid.";
+	case ERROR_HANDLE_EOF: return "Reached the end of the file.";
+	case ERROR_NOT_SUPPORTED: return "The request is not supported.";
+	case ERROR_INVALID_PARAMETER: return "The parameter is incorrect.";
+	case ERROR_INSUFFICIENT_BUFFER: return "The data area passed to a system call is too small.";
+	case ERROR_NO_MORE_ITEMS: return "No more data is available.";
+	case ERROR_CANCELLED: return "The operation was canceled by the user.";
+	case ERROR_TIMEOUT: return "This operation returned because the timeout period expired.";
+	case ERROR_EVT_INVALID_QUERY: return "The specified query is invalid.";
+	default: return {};
+	}
+}
+
+std::string to_string(GUID g)
+{
+	// {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}'\0'
+	char buf[39] = {};
+	snprintf(buf, sizeof(buf), "{%08" PRIX32 "-%04" PRIX16 "-%04" PRIX16 "-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+		g.Data1, g.Data2, g.Data3, 
+		g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3], 
+		g.Data4[4], g.Data4[5], g.Data4[6], g.Data4[7]);
+	return { buf };
+}
+
+std::string to_string(const Timestamp &ts)
+{
+	// 100 nanos between 1601-01-01 and 1970-01-01.
+	static constexpr uint64_t EpochDelta = 116444736000000000ull;
+	static constexpr uint64_t TicksPerSecond = 10000000ull;
+
+	if (ts.timestamp < EpochDelta)
+		return {};
+
+	uint64_t ticks = ts.timestamp - EpochDelta;
+	std::time_t secs = std::time_t(ticks / TicksPerSecond);
+	unsigned millis = unsigned((ticks % TicksPerSecond) / 10000u);
+
+	std::tm tm{};
+	if (!gmtime_r(&secs, &tm))
+		return {};
+
+	char buf[64] = {};
+	snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%03u", 
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, 
+		tm.tm_hour, tm.tm_min, tm.tm_sec, millis);
+	return { buf };
+}
+
+} // namespace Windows
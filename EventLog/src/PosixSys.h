@@ -0,0 +1,411 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+// Non-Windows stand-ins for the subset of WinSys.h used by the query 
+// pipeline (threads, events, semaphores, locks, futexes). The 
+// names and signatures match WinSys.h so code written against SysPlatform.h 
+// compiles unchanged on either platform. 
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "CommonTypes.h"
+#include "Exceptions.h"
+#include "RefObject.h"
+
+namespace Windows
+{
+
+using DWORD = uint32_t;
+using LONG = int32_t;
+using BOOL = int;
+
+constexpr BOOL FALSE = 0;
+constexpr BOOL TRUE = 1;
+
+constexpr DWORD INFINITE = 0xFFFFFFFF;
+
+// Subset of the Windows system error codes the portable code reports.
+constexpr DWORD ERROR_SUCCESS = 0;
+constexpr DWORD ERROR_INVALID_FUNCTION = 1;
+constexpr DWORD ERROR_FILE_NOT_FOUND = 2;
+constexpr DWORD ERROR_ACCESS_DENIED = 5;
+constexpr DWORD ERROR_NOT_ENOUGH_MEMORY = 8;
+constexpr DWORD ERROR_INVALID_DATA = 13;
+constexpr DWORD ERROR_HANDLE_EOF = 38;
+constexpr DWORD ERROR_NOT_SUPPORTED = 50;
+constexpr DWORD ERROR_INVALID_PARAMETER = 87;
+constexpr DWORD ERROR_INSUFFICIENT_BUFFER = 122;
+constexpr DWORD ERROR_NO_MORE_ITEMS = 259;
+constexpr DWORD ERROR_TIMEOUT = 1460;
+constexpr DWORD ERROR_CANCELLED = 1223;
+constexpr DWORD ERROR_EVT_INVALID_QUERY = 15001;
+
+// Windows API system error codes.
+class SysErr
+{
+public:
+	SysErr() = default;
+	SysErr(const SysErr &rhs) = default;
+	SysErr &operator=(const SysErr &rhs) = default;
+
+	constexpr SysErr(DWORD err) noexcept
+		: mErr(err)
+	{}
+
+	SysErr &operator=(DWORD code) noexcept
+	{
+		mErr = code;
+		return *this;
+	}
+
+	DWORD getCode() const noexcept
+	{
+		return mErr;
+	}
+
+	bool succeeded() const noexcept
+	{
+		return mErr == 0;
+	}
+
+	bool failed() const noexcept
+	{
+		return mErr != 0;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return failed();
+	}
+
+private:
+	DWORD mErr{};
+};
+
+enum class WaitStatus : DWORD
+{
+	Abandoned = 0x80, 
+	IoCompletion = 0xC0, 
+	Object_0 = 0, /**< Object signaled */
+	Timeout = 0x102, /**< Timeout */
+	Failed = 0xFFFFFFFF /**< Error. */
+};
+
+class WaitResult final
+{
+	WaitStatus mStatus{WaitStatus::Failed};
+	SysErr mLastErr{};
+public:
+
+	static WaitResult make(WaitStatus status, SysErr err = {}) noexcept
+	{
+		WaitResult r{};
+		r.mStatus = status;
+		r.mLastErr = err;
+		return r;
+	}
+
+	WaitResult &operator=(const WaitResult &) = default;
+
+	// Return the status of the wait operation.
+	WaitStatus getStatus() const { return mStatus; }
+
+	// Return the error, if any, associated with the operation. 
+	SysErr getError() const { return mLastErr; }
+
+	// Unconditionally throw a SystemError with the contained error code.
+	[[noreturn]] void throwError();
+};
+
+// Waits on cv until pred is true or the timeout (milliseconds) expires.
+// INFINITE waits forever. Returns pred().
+template<typename Pred>
+bool waitFor(std::condition_variable &cv, std::unique_lock<std::mutex> &lck, DWORD timeout, Pred pred)
+{
+	if (timeout == INFINITE)
+	{
+		cv.wait(lck, pred);
+		return true;
+	}
+	return cv.wait_for(lck, std::chrono::milliseconds(timeout), pred);
+}
+
+class IRunnable : public IRefObject
+{
+public:
+	virtual ~IRunnable() = default;
+	virtual void run() = 0;
+};
+
+// std::thread based equivalent of the Windows Thread proxy. As on Windows,
+// destroying the proxy does not stop or join the thread.
+class Thread
+{
+public:
+	// Spin-up a new thread.
+	static Thread begin(unsigned(*pfn)(void *), void *arg);
+
+	// Default constructed thread is empty. 
+	Thread() = default;
+
+	Thread(Thread &&rhs) noexcept = default;
+	Thread &operator=(Thread &&rhs) noexcept = default;
+
+	~Thread() = default;
+
+	// Wait for this thread to exit.
+	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE) noexcept;
+
+	// Wait forever for this thread to exit.
+	void join();
+
+private:
+	struct State;
+	explicit Thread(std::shared_ptr<State> state) noexcept
+		: mState(std::move(state))
+	{}
+
+	Thread(const Thread &) = delete;
+	Thread &operator=(const Thread &) = delete;
+
+private:
+	std::shared_ptr<State> mState{};
+};
+
+class Semaphore
+{
+	std::mutex mMutex{};
+	std::condition_variable mCond{};
+	LONG mCount;
+	LONG mMax;
+public:
+	Semaphore(LONG initial, LONG max);
+
+	~Semaphore() = default;
+
+	// Increments the semaphore.
+	SysErr release(LONG releaseCount = 1, LONG *previousCount = nullptr);
+
+	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE);
+
+private:
+	Semaphore() = delete;
+	Semaphore(const Semaphore &) = delete;
+};
+
+class CriticalSection
+{
+	std::mutex mMutex{};
+public:
+
+	// Scoped lock. 
+	class Lock
+	{
+		CriticalSection &cs;
+	public:
+		explicit Lock(CriticalSection &cs) noexcept : cs(cs) { cs.enter(); }
+		~Lock() noexcept { cs.leave(); }
+	};
+
+	CriticalSection() = default;
+	~CriticalSection() = default;
+
+	void enter() { mMutex.lock(); }
+	bool tryEnter() { return mMutex.try_lock(); }
+	void leave() { mMutex.unlock(); }
+
+private:
+	CriticalSection(const CriticalSection &) = delete;
+	CriticalSection &operator=(const CriticalSection &) = delete;
+};
+
+class ReadWriteLock
+{
+	std::shared_mutex mMutex{};
+public:
+
+	// Scoped shared lock. 
+	class ReadLock
+	{
+		ReadWriteLock &rw;
+	public:
+		explicit ReadLock(ReadWriteLock &rw) noexcept : rw(rw) { rw.enterShared(); }
+		~ReadLock() noexcept { rw.leaveShared(); }
+	};
+
+	// Scoped exclusive lock. 
+	class WriteLock
+	{
+		ReadWriteLock &rw;
+	public:
+		explicit WriteLock(ReadWriteLock &rw) noexcept : rw(rw) { rw.enter(); }
+		~WriteLock() noexcept { rw.leave(); }
+	};
+
+	ReadWriteLock() = default;
+	~ReadWriteLock() = default;
+
+	void enterShared() { mMutex.lock_shared(); }
+	void leaveShared() { mMutex.unlock_shared(); }
+	void enter() { mMutex.lock(); }
+	void leave() { mMutex.unlock(); }
+
+private:
+	ReadWriteLock(const ReadWriteLock &) = delete;
+	ReadWriteLock &operator=(const ReadWriteLock &) = delete;
+};
+
+class Event
+{
+	struct State
+	{
+		std::mutex mutex{};
+		std::condition_variable cond{};
+		bool manualReset = false;
+		bool signaled = false;
+	};
+	std::shared_ptr<State> mState;
+
+public:
+	Event(BOOL bManualReset, BOOL bInitialState);
+
+	Event(Event &&rhs) = default;
+	Event &operator=(Event &&rhs) = default;
+	~Event() = default;
+
+	void reset();
+
+	void set();
+
+	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE) noexcept;
+
+	// Refers to the same event.
+	Event duplicate() const;
+
+private:
+	explicit Event(std::shared_ptr<State> state) noexcept
+		: mState(std::move(state))
+	{}
+
+	Event(const Event &) = delete;
+	Event &operator=(const Event &) = delete;
+};
+
+class ManualResetEvent
+{
+	Event mEvent;
+public:
+	explicit ManualResetEvent(BOOL initialState)
+		: mEvent(TRUE, initialState)
+	{}
+
+	ManualResetEvent(ManualResetEvent &&rhs) = default;
+	ManualResetEvent &operator=(ManualResetEvent &&rhs) = default;
+	~ManualResetEvent() = default;
+
+	void set() { mEvent.set(); }
+	void reset() { mEvent.reset(); }
+
+	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE) noexcept
+	{
+		return mEvent.wait(timeout, alertable);
+	}
+};
+
+class AutoResetEvent
+{
+	Event mEvent;
+public:
+	explicit AutoResetEvent(BOOL initialState)
+		: mEvent(FALSE, initialState)
+	{}
+
+	AutoResetEvent(AutoResetEvent &&rhs) = default;
+	AutoResetEvent &operator=(AutoResetEvent &&rhs) = default;
+	~AutoResetEvent() = default;
+
+	void set() { mEvent.set(); }
+
+	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE) noexcept
+	{
+		return mEvent.wait(timeout, alertable);
+	}
+};
+
+// Waits on the value of a 32 bit atomic, like a Linux futex. Lets a thread 
+// sleep until another changes the value, without a kernel object.
+class Futex
+{
+public:
+	// Blocks while value == expected until woken or the timeout (milliseconds)
+	// expires. Can return early, so callers recheck the value.
+	static void wait(const std::atomic<uint32_t> &value, uint32_t expected, DWORD timeout = INFINITE) noexcept;
+
+	// Wakes one or all threads waiting on the value.
+	static void wakeOne(const std::atomic<uint32_t> &value) noexcept;
+	static void wakeAll(const std::atomic<uint32_t> &value) noexcept;
+};
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+public:
+	// Throws SystemException if the file can't be opened or mapped.
+	static std::shared_ptr<const MappedFile> open(const std::string &path);
+
+	~MappedFile();
+
+	const uint8_t *data() const { return mData; }
+	uint64_t size() const { return mSize; }
+
+	// Drops the pages of the range from memory. The data stays valid, it's
+	// read from the file again if touched. 
+	void release(uint64_t offset, uint64_t size) const noexcept;
+
+private:
+	MappedFile(const uint8_t *data, uint64_t size) noexcept
+		: mData(data)
+		, mSize(size)
+	{}
+
+	const uint8_t *mData;
+	uint64_t mSize;
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// Returns the message for the given error code. 
+// Does not throw.
+std::string formatMessage(uint32_t errorCode);
+
+} // namespace Windows
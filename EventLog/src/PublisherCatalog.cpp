@@ -0,0 +1,353 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "PublisherCatalog.h"
+
+#include "IEventMetadata.h"
+#include "PublisherMetadata.h"
+#include "StringUtils.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Last write time of a resource file, 0 if it can't be read. The paths have
+// environment variables, e.g. %SystemRoot%\system32\wevtapi.dll.
+static uint64_t lastWriteTime(const std::string &path)
+{
+	if (path.empty())
+	{
+		return 0;
+	}
+
+	std::wstring unexpanded = to_utf16(path);
+	DWORD size = ::ExpandEnvironmentStringsW(unexpanded.c_str(), nullptr, 0);
+	if (size == 0)
+	{
+		return 0;
+	}
+	std::wstring expanded(size, L'\0');
+	::ExpandEnvironmentStringsW(unexpanded.c_str(), expanded.data(), size);
+
+	WIN32_FILE_ATTRIBUTE_DATA data{};
+	if (!::GetFileAttributesExW(expanded.c_str(), GetFileExInfoStandard, &data))
+	{
+		return 0;
+	}
+	return (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+static uint64_t publisherFileTime(const IPublisherMetadata &publisher)
+{
+	return std::max<uint64_t>(
+		lastWriteTime(publisher.getResourceFilePath().value_or("")), 
+		lastWriteTime(publisher.getMessageFilePath().value_or("")));
+}
+
+// A string value of the key as stored, without expanding variables. Empty
+// if there isn't one.
+static std::string registryString(HKEY hKey, const wchar_t *name)
+{
+	const DWORD flags = RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND;
+	DWORD size = 0;
+	if (::RegGetValueW(hKey, nullptr, name, flags, nullptr, nullptr, &size) != ERROR_SUCCESS || size == 0)
+	{
+		return {};
+	}
+
+	std::wstring value(size / sizeof(wchar_t), L'\0');
+	if (::RegGetValueW(hKey, nullptr, name, flags, nullptr, value.data(), &size) != ERROR_SUCCESS)
+	{
+		return {};
+	}
+	// The size counts the terminator.
+	value.resize(size / sizeof(wchar_t));
+	while (!value.empty() && value.back() == L'\0')
+		value.pop_back();
+	return to_utf8(value);
+}
+
+// Whether the entry still matches the publisher. The file paths are those
+// of its registration, the same the metadata reports, so the publisher's 
+// metadata needn't be opened to check.
+static bool isCurrent(const CatalogPublisher &entry)
+{
+	if (!entry.guid)
+	{
+		return false;
+	}
+
+	std::wstring path = L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\WINEVT\\Publishers\\" + 
+		Guid::to_wstring(entry.guid.value());
+	HKEY hKey = nullptr;
+	if (::RegOpenKeyExW(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS)
+	{
+		return false;
+	}
+
+	std::string resourceFilePath = registryString(hKey, L"ResourceFileName");
+	std::string messageFilePath = registryString(hKey, L"MessageFileName");
+	::RegCloseKey(hKey);
+
+	return entry.resourceFilePath == resourceFilePath &&
+		entry.messageFilePath == messageFilePath &&
+		entry.fileTime == std::max(lastWriteTime(resourceFilePath), lastWriteTime(messageFilePath));
+}
+
+// Names of the data elements of an event template, in order. The template 
+// is like <template xmlns="..."><data name="SubjectUserSid" inType=... />...
+static std::vector<std::string> templateDataNames(const std::string &tmpl)
+{
+	static const std::string tag = "<data ";
+	static const std::string nameAttr = "name=\"";
+
+	std::vector<std::string> names;
+	for (size_t pos = tmpl.find(tag); pos != std::string::npos; pos = tmpl.find(tag, pos + 1))
+	{
+		size_t end = tmpl.find('>', pos);
+		size_t name = tmpl.find(nameAttr, pos);
+		if (name == std::string::npos || name > end)
+			continue;
+
+		name += nameAttr.size();
+		size_t quote = tmpl.find('"', name);
+		if (quote == std::string::npos)
+			break;
+		names.push_back(tmpl.substr(name, quote - name));
+	}
+	return names;
+}
+
+// Whether any data element of the template is mapped or formatted by 
+// EvtFormatMessage rather than written as its value.
+static bool templateMapsData(const std::string &tmpl)
+{
+	static const char *const attrs[] = { 
+		" map=\"", 
+		"outType=\"win:HResult\"", 
+		"outType=\"win:NTStatus\"", 
+		"outType=\"win:Win32Error\"" 
+	};
+
+	return std::any_of(std::begin(attrs), std::end(attrs), [&tmpl](const char *attr) {
+		return tmpl.find(attr) != std::string::npos;
+	});
+}
+
+static void readEvents(const IPublisherMetadata &publisher, CatalogPublisher &entry)
+{
+	// Like a missing publisher, metadata that can't be read leaves the 
+	// events unknown.
+	try
+	{
+		Ref<IEventMetadataEnumerator> events = publisher.openEventMetadataEnum();
+		while (events->next())
+		{
+			RefPtr<IEventMetadata> metadata = events->getCurrent();
+			if (!metadata)
+				continue;
+
+			CatalogEvent event{};
+			event.id = uint16_t(metadata->getId().value_or(0) & 0xffff);
+			event.version = uint8_t(metadata->getVersion().value_or(0));
+
+			std::optional<std::string> tmpl = metadata->getTemplate();
+			if (tmpl)
+			{
+				event.dataNames = templateDataNames(*tmpl);
+				event.mapsData = templateMapsData(*tmpl);
+			}
+
+			// The message display is the raw message with its %1 insertions.
+			event.message = metadata->getMessageDisplay();
+			if (!event.message.empty() && !event.mapsData)
+				event.messageTemplate = MessageTemplate::parse(event.message);
+
+			entry.events.push_back(std::move(event));
+		}
+	}
+	catch (std::exception &)
+	{
+	}
+
+	std::sort(entry.events.begin(), entry.events.end(), [](const CatalogEvent &a, const CatalogEvent &b) {
+		return a.id != b.id ? a.id < b.id : a.version < b.version;
+	});
+}
+
+static void readValues(const IPublisherMetadata &publisher, CatalogPublisher &entry)
+{
+	Ref<IPublisherChannelArray> channels = publisher.getChannels();
+	for (uint32_t i = 0; i < channels->getSize(); ++i)
+		entry.channels.push_back({ channels->getChannelReferenceID(i), channels->getChannelReferencePath(i), channels->getMessage(i) });
+
+	Ref<IPublisherLevelArray> levels = publisher.getLevels();
+	for (uint32_t i = 0; i < levels->getSize(); ++i)
+		entry.levels.push_back({ levels->getValue(i), levels->getName(i), levels->getMessage(i) });
+
+	Ref<IPublisherTaskArray> tasks = publisher.getTasks();
+	for (uint32_t i = 0; i < tasks->getSize(); ++i)
+		entry.tasks.push_back({ tasks->getValue(i), tasks->getName(i), tasks->getMessage(i) });
+
+	Ref<IPublisherOpcodeArray> opcodes = publisher.getOpcodes();
+	for (uint32_t i = 0; i < opcodes->getSize(); ++i)
+		entry.opcodes.push_back({ opcodes->getValue(i), opcodes->getName(i), opcodes->getMessage(i) });
+
+	Ref<IPublisherKeywordArray> keywords = publisher.getKeywords();
+	for (uint32_t i = 0; i < keywords->getSize(); ++i)
+		entry.keywords.push_back({ keywords->getValue(i), keywords->getName(i), keywords->getMessage(i) });
+}
+
+// The publisher's entry. The levels, tasks and so on are only needed to 
+// save it.
+static std::shared_ptr<const CatalogPublisher> readPublisher(const std::string &provider, const IPublisherMetadata &publisher, bool complete)
+{
+	auto entry = std::make_shared<CatalogPublisher>();
+	entry->name = provider;
+	entry->guid = publisher.getPublisherGuid();
+	entry->resourceFilePath = publisher.getResourceFilePath().value_or("");
+	entry->messageFilePath = publisher.getMessageFilePath().value_or("");
+	entry->parameterFilePath = publisher.getParametersFilePath().value_or("");
+	entry->fileTime = publisherFileTime(publisher);
+	entry->message = publisher.getPublisherMessage();
+
+	readEvents(publisher, *entry);
+	if (complete)
+	{
+		readValues(publisher, *entry);
+	}
+	return entry;
+}
+
+//
+// PublisherCatalog
+//
+
+PublisherCatalog &PublisherCatalog::global()
+{
+	static PublisherCatalog theCatalog;
+	return theCatalog;
+}
+
+void PublisherCatalog::open(const std::string &path)
+{
+	std::shared_ptr<const MetadataCatalog> catalog;
+	try
+	{
+		catalog = MetadataCatalog::open(path);
+	}
+	catch (std::exception &)
+	{
+	}
+
+	CriticalSection::Lock lck(mLock);
+	mCatalog = std::move(catalog);
+	mPublishers.clear();
+	mOpened = true;
+}
+
+void PublisherCatalog::save(const std::string &path)
+{
+	std::vector<std::shared_ptr<const CatalogPublisher>> publishers;
+	{
+		CriticalSection::Lock lck(mLock);
+
+		// Carry over what wasn't looked up, it's checked when it is. The 
+		// mapping is dropped so the file can be replaced.
+		if (mCatalog)
+		{
+			for (const std::string &name : mCatalog->getPublisherNames())
+			{
+				if (mPublishers.find(name) == mPublishers.end())
+					mPublishers.emplace(name, mCatalog->find(name));
+			}
+			mCatalog.reset();
+		}
+
+		for (const auto &publisher : mPublishers)
+			publishers.push_back(publisher.second);
+	}
+
+	MetadataCatalog::write(path, publishers);
+}
+
+std::shared_ptr<const CatalogPublisher> PublisherCatalog::lookup(const std::string &provider)
+{
+	std::shared_ptr<const MetadataCatalog> catalog;
+	bool opened = false;
+	{
+		CriticalSection::Lock lck(mLock);
+		auto it = mPublishers.find(provider);
+		if (it != mPublishers.end())
+		{
+			return it->second;
+		}
+		catalog = mCatalog;
+		opened = mOpened;
+	}
+
+	std::shared_ptr<const CatalogPublisher> entry;
+	try
+	{
+		entry = catalog ? catalog->find(provider) : nullptr;
+	}
+	catch (std::exception &)
+	{
+	}
+
+	// Only a missing or stale entry needs the publisher opened.
+	if (!entry || !isCurrent(*entry))
+	{
+		RefPtr<PublisherMetadata> publisher = PublisherMetadata::cacheOpenProvider(provider);
+		if (!publisher)
+		{
+			return nullptr;
+		}
+		entry = readPublisher(provider, *publisher, opened);
+	}
+
+	if (opened)
+	{
+		CriticalSection::Lock lck(mLock);
+		mPublishers.emplace(provider, entry);
+	}
+	return entry;
+}
+
+//
+// IPublisherMetadata
+//
+
+void IPublisherMetadata::openCatalog(const std::string &path)
+{
+	PublisherCatalog::global().open(path);
+}
+
+void IPublisherMetadata::saveCatalog(const std::string &path)
+{
+	PublisherCatalog::global().save(path);
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "MetadataCatalog.h"
+#include "WinSys.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace Windows::EventLog
+{
+
+// The metadata of the publishers records are formatted with, read from a 
+// MetadataCatalog where it's still current and from the publishers where 
+// it isn't. An entry is current while the publisher's resource and message
+// file paths and their write times haven't changed. That's checked against
+// the publisher's registration, so a current entry is used without opening
+// the publisher.
+//
+// Until a catalog is opened nothing is kept, and only what formatting 
+// records needs (the events) is read from a publisher.
+class PublisherCatalog
+{
+public:
+	PublisherCatalog() = default;
+	~PublisherCatalog() = default;
+
+	// The catalog behind IPublisherMetadata::openCatalog.
+	static PublisherCatalog &global();
+
+	// A missing or unreadable file opens an empty catalog.
+	void open(const std::string &path);
+
+	// Writes the publishers looked up so far, along with the rest of the 
+	// opened catalog.
+	void save(const std::string &path);
+
+	// Null if the publisher can't be opened.
+	std::shared_ptr<const CatalogPublisher> lookup(const std::string &provider);
+
+private:
+	CriticalSection mLock{};
+	std::shared_ptr<const MetadataCatalog> mCatalog{};
+	bool mOpened = false;
+
+	// Looked up since the catalog was opened.
+	std::unordered_map<std::string, std::shared_ptr<const CatalogPublisher>> mPublishers{};
+
+	PublisherCatalog(const PublisherCatalog &) = delete;
+	PublisherCatalog &operator=(const PublisherCatalog &) = delete;
+};
+
+}
@@ -26,6 +26,7 @@ misrepresented as being the original software.
 #include "EvtVariant.h"
 #include "Exceptions.h"
 #include "PublisherMetadataImpl.h"
+#include "ShardedCache.h"
 #include "StringUtils.h"
 
 #include <unordered_map>
@@ -643,62 +644,9 @@ bool EventMetadataEnum::next()
 // PublisherMetadataCache
 //
 
-class PublisherMetadataCache
-{
-public:
-	// Use RefPtr because it is default constructable. 
-	using CacheType = std::unordered_map<std::string, RefPtr<PublisherMetadata> > ;
-	using iterator = typename CacheType::iterator;
-	using const_iterator = typename CacheType::const_iterator;
-
-	PublisherMetadataCache() = default;
-	~PublisherMetadataCache() = default;
-
-	RefPtr<PublisherMetadata> cacheLookup(const std::string &publisher) 
-	{
-		using std::make_pair;
-
-		iterator publisherMetaIt = mCache.find(publisher);
-
-		// If the publisher metadata is not in the cache, create it and return it
-		// Otherwise just return the cached item
-		
-		if (publisherMetaIt != mCache.end())
-		{
-			return publisherMetaIt->second;
-		}
-		else
-		{
-			// Opening the publisher metadata can fail e.g. the publisher is
-			// misconfigured. 
-			try
-			{
-				Ref<PublisherMetadata> publisherMeta = PublisherMetadata::create(publisher);
-				RefPtr<PublisherMetadata> publisherMetaPtr = publisherMeta.ptr();
-				return mCache.insert(make_pair(publisher, publisherMetaPtr)).first->second;
-			}
-			catch (std::exception &)
-			{
-				// If opening fails, we add a null to the cache for the provider.
-				// This way, we don't repeatedly try to open the provider that is doomed to fail.
-				return mCache.insert(make_pair(publisher, RefPtr<PublisherMetadata>(nullptr))).first->second;
-			}
-		}
-	}
-
-	iterator begin() { return mCache.begin(); }
-	const_iterator begin() const { return mCache.begin(); }
-
-	iterator end() { return mCache.end(); }
-	const_iterator end() const { return mCache.end(); }
-
-private:
-	CacheType mCache{};
-
-	// NO! 
-	PublisherMetadataCache(const PublisherMetadataCache &) = delete;
-	PublisherMetadataCache &operator=(const PublisherMetadataCache &) = delete;
-};
+// Publisher metadata is looked up for every record rendered, from every 
+// render thread.
+using PublisherMetadataCache = ShardedCache<std::string, RefPtr<PublisherMetadata>>;
 
 static PublisherMetadataCache &cache()
 {
@@ -1552,6 +1500,11 @@ RefPtr<IPublisherMetadata> IPublisherMetadata::cacheOpenProvider(const std::stri
 	return PublisherMetadata::cacheOpenProvider(provider);
 }
 
+MetadataCacheStats IPublisherMetadata::getCacheStats()
+{
+	return cache().getStats();
+}
+
 //
 // PublisherMetadataImpl
 //
@@ -1563,11 +1516,6 @@ PublisherMetadataImpl::PublisherMetadataImpl(PublisherMetadataHandle publisherMe
 	, mMessageFilePath{ getPublisherMetadataPropertyString(publisherMetaHandle, EvtPublisherMetadataMessageFilePath) }
 	, mHelpLink{ getPublisherMetadataPropertyString(publisherMetaHandle, EvtPublisherMetadataHelpLink) }
 	, mMessageId{ getPublisherMetadataPropertyUInt32(publisherMetaHandle, EvtPublisherMetadataPublisherMessageID) }
-	, mChannels{ PublisherChannelArray::create(publisherMetaHandle) }
-	, mLevels{ PublisherLevelArray::create(publisherMetaHandle) }
-	, mTasks{ PublisherTaskArray::create(publisherMetaHandle) }
-	, mOpcodes{ PublisherOpcodeArray::create(publisherMetaHandle) }
-	, mKeywords{ PublisherKeywordArray::create(publisherMetaHandle) }
 {
 	if (mMessageId.has_value())
 	{
@@ -1582,37 +1530,76 @@ PublisherMetadataImpl::PublisherMetadataImpl(PublisherMetadataHandle publisherMe
 	mPublisherMetadataHandle = std::move(publisherMetaHandle);
 }
 
-FormattedEventRecord PublisherMetadataImpl::format(const EventRecordHandle &recordHandle) const
+Ref<IPublisherChannelArray> PublisherMetadataImpl::getChannels() const
 {
-	return FormattedEventRecord{
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageEvent),
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageLevel),
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageTask),
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageOpcode),
-		formatKeyword(mPublisherMetadataHandle, recordHandle),
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageChannel),
-		formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageProvider),
-	};
+	return mChannels.get([this] { return PublisherChannelArray::create(mPublisherMetadataHandle); });
+}
+
+Ref<IPublisherLevelArray> PublisherMetadataImpl::getLevels() const
+{
+	return mLevels.get([this] { return PublisherLevelArray::create(mPublisherMetadataHandle); });
+}
+
+Ref<IPublisherTaskArray> PublisherMetadataImpl::getTasks() const
+{
+	return mTasks.get([this] { return PublisherTaskArray::create(mPublisherMetadataHandle); });
+}
+
+Ref<IPublisherOpcodeArray> PublisherMetadataImpl::getOpcodes() const
+{
+	return mOpcodes.get([this] { return PublisherOpcodeArray::create(mPublisherMetadataHandle); });
+}
+
+Ref<IPublisherKeywordArray> PublisherMetadataImpl::getKeywords() const
+{
+	return mKeywords.get([this] { return PublisherKeywordArray::create(mPublisherMetadataHandle); });
+}
+
+FormattedEventRecord PublisherMetadataImpl::format(const EventRecordHandle &recordHandle, EventField fields) const
+{
+	FormattedEventRecord record{};
+	if (hasAnyField(fields, EventField::Message))
+		record.message = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageEvent);
+	if (hasAnyField(fields, EventField::LevelDisplay))
+		record.level = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageLevel);
+	if (hasAnyField(fields, EventField::TaskDisplay))
+		record.task = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageTask);
+	if (hasAnyField(fields, EventField::OpcodeDisplay))
+		record.opcode = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageOpcode);
+	if (hasAnyField(fields, EventField::KeywordsDisplay))
+		record.keywords = formatKeyword(mPublisherMetadataHandle, recordHandle);
+	if (hasAnyField(fields, EventField::ChannelMessage))
+		record.channelMessage = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageChannel);
+	if (hasAnyField(fields, EventField::ProviderMessage))
+		record.providerMessage = formatMessage(mPublisherMetadataHandle, recordHandle, EvtFormatMessageProvider);
+	return record;
 }
 
 //
 // PublisherMetadata implementation
 //
 
-FormattedEventRecord PublisherMetadata::formatEvent(const EventRecordHandle &recordHandle)
+FormattedEventRecord PublisherMetadata::formatEvent(const EventRecordHandle &recordHandle, EventField fields)
 {
 	using Windows::EventLog::formatMessage;
 	using Windows::EventLog::formatKeyword;
 
-	return FormattedEventRecord{
-		formatMessage(recordHandle, EvtFormatMessageEvent),
-		formatMessage(recordHandle, EvtFormatMessageLevel),
-		formatMessage(recordHandle, EvtFormatMessageTask),
-		formatMessage(recordHandle, EvtFormatMessageOpcode),
-		formatKeyword(recordHandle),
-		formatMessage(recordHandle, EvtFormatMessageChannel),
-		formatMessage(recordHandle, EvtFormatMessageProvider),
-	};
+	FormattedEventRecord record{};
+	if (hasAnyField(fields, EventField::Message))
+		record.message = formatMessage(recordHandle, EvtFormatMessageEvent);
+	if (hasAnyField(fields, EventField::LevelDisplay))
+		record.level = formatMessage(recordHandle, EvtFormatMessageLevel);
+	if (hasAnyField(fields, EventField::TaskDisplay))
+		record.task = formatMessage(recordHandle, EvtFormatMessageTask);
+	if (hasAnyField(fields, EventField::OpcodeDisplay))
+		record.opcode = formatMessage(recordHandle, EvtFormatMessageOpcode);
+	if (hasAnyField(fields, EventField::KeywordsDisplay))
+		record.keywords = formatKeyword(recordHandle);
+	if (hasAnyField(fields, EventField::ChannelMessage))
+		record.channelMessage = formatMessage(recordHandle, EvtFormatMessageChannel);
+	if (hasAnyField(fields, EventField::ProviderMessage))
+		record.providerMessage = formatMessage(recordHandle, EvtFormatMessageProvider);
+	return record;
 }
 
 PublisherMetadata::~PublisherMetadata()
@@ -1620,7 +1607,20 @@ PublisherMetadata::~PublisherMetadata()
 
 RefPtr<PublisherMetadata> PublisherMetadata::cacheOpenProvider(const std::string &id)
 {
-	return cache().cacheLookup(id);
+	return cache().lookup(id, [&id]() -> RefPtr<PublisherMetadata>
+	{
+		// Opening the publisher metadata can fail e.g. the publisher is
+		// misconfigured. The null is cached, this way we don't repeatedly 
+		// try to open the provider that is doomed to fail.
+		try
+		{
+			return PublisherMetadata::create(id).ptr();
+		}
+		catch (std::exception &)
+		{
+			return nullptr;
+		}
+	});
 }
 
 Ref<IPublisherMetadata> PublisherMetadata::openProvider(const std::string &publisherId)
@@ -1697,31 +1697,31 @@ std::string PublisherMetadata::getPublisherMessage() const
 // EvtPublisherMetadataChannelReferences
 Ref<IPublisherChannelArray> PublisherMetadata::getChannels() const
 {
-	return d_ptr->mChannels;
+	return d_ptr->getChannels();
 }
 
 // EvtPublisherMetadataLevels
 Ref<IPublisherLevelArray> PublisherMetadata::getLevels() const
 {
-	return d_ptr->mLevels;
+	return d_ptr->getLevels();
 }
 
 // EvtPublisherMetadataTasks
 Ref<IPublisherTaskArray> PublisherMetadata::getTasks() const
 {
-	return d_ptr->mTasks;
+	return d_ptr->getTasks();
 }
 
 // EvtPublisherMetadataOpcodes
 Ref<IPublisherOpcodeArray> PublisherMetadata::getOpcodes() const
 {
-	return d_ptr->mOpcodes;
+	return d_ptr->getOpcodes();
 }
 
 // EvtPublisherMetadataKeywords
 Ref<IPublisherKeywordArray> PublisherMetadata::getKeywords() const
 {
-	return d_ptr->mKeywords;
+	return d_ptr->getKeywords();
 }
 
 Ref<IEventMetadataEnumerator> PublisherMetadata::openEventMetadataEnum() const 
@@ -1817,9 +1817,9 @@ std::vector<std::string> PublisherMetadata::lookupKeywordsDisplay(uint64_t maskB
 	return keywords->getDisplay(maskBits);
 }
 
-FormattedEventRecord PublisherMetadata::format(const EventRecordHandle &recordHandle) const
+FormattedEventRecord PublisherMetadata::format(const EventRecordHandle &recordHandle, EventField fields) const
 {
-	return d_ptr->format(recordHandle);
+	return d_ptr->format(recordHandle, fields);
 }
 
 }
\ No newline at end of file
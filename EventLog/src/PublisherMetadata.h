@@ -99,9 +99,10 @@ public:
 	std::string lookupOpcodesDisplay(uint32_t op_task) const override;
 	std::vector<std::string> lookupKeywordsDisplay(uint64_t maskBits) const override;
 
-	FormattedEventRecord format(const EventRecordHandle &recordHandle) const;
+	// Formats the display strings in fields. The others are left empty.
+	FormattedEventRecord format(const EventRecordHandle &recordHandle, EventField fields = EventField::All) const;
 	
-	static FormattedEventRecord formatEvent(const EventRecordHandle &recordHandle);
+	static FormattedEventRecord formatEvent(const EventRecordHandle &recordHandle, EventField fields = EventField::All);
 
 private:
 	// Hide the messy details behind PImpl.
@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <optional>
 #include <string>
 
@@ -32,6 +33,30 @@
 namespace Windows::EventLog
 { 
 
+// A Ref created on first use. 
+template<typename T>
+class LazyRef
+{
+public:
+	LazyRef() = default;
+
+	// Returns the Ref, calling create to make it if this is the first call. 
+	// If create throws the next call tries again.
+	template<typename Create>
+	Ref<T> get(Create &&create) const
+	{
+		std::call_once(mOnce, [&] { mValue = create().ptr(); });
+		return Ref<T>(*mValue);
+	}
+
+private:
+	mutable std::once_flag mOnce{};
+	mutable RefPtr<T> mValue{};
+
+	LazyRef(const LazyRef &) = delete;
+	LazyRef &operator=(const LazyRef &) = delete;
+};
+
 //
 // PublisherMetadataImpl
 //
@@ -41,7 +66,15 @@ class PublisherMetadataImpl
 public:
 	explicit PublisherMetadataImpl(PublisherMetadataHandle publisherMetaHandle);
 	~PublisherMetadataImpl() = default;
-	FormattedEventRecord format(const EventRecordHandle &h) const;
+	FormattedEventRecord format(const EventRecordHandle &h, EventField fields) const;
+
+	// The arrays are read when first asked for. Most publishers are only 
+	// opened to format records, which doesn't need them.
+	Ref<IPublisherChannelArray> getChannels() const;
+	Ref<IPublisherLevelArray> getLevels() const;
+	Ref<IPublisherTaskArray> getTasks() const;
+	Ref<IPublisherOpcodeArray> getOpcodes() const;
+	Ref<IPublisherKeywordArray> getKeywords() const;
 
 	std::optional<GUID> mPublisherGuid{};
 	std::optional<std::string> mResourceFilePath{};
@@ -51,11 +84,11 @@ public:
 	std::optional<uint32_t> mMessageId{};
 	std::string mMessage{};
 
-	Ref<IPublisherChannelArray> mChannels;
-	Ref<IPublisherLevelArray> mLevels;
-	Ref<IPublisherTaskArray> mTasks;
-	Ref<IPublisherOpcodeArray> mOpcodes;
-	Ref<IPublisherKeywordArray> mKeywords;
+	LazyRef<IPublisherChannelArray> mChannels{};
+	LazyRef<IPublisherLevelArray> mLevels{};
+	LazyRef<IPublisherTaskArray> mTasks{};
+	LazyRef<IPublisherOpcodeArray> mOpcodes{};
+	LazyRef<IPublisherKeywordArray> mKeywords{};
 
 	PublisherMetadataHandle mPublisherMetadataHandle{};
 
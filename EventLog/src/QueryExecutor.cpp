@@ -0,0 +1,165 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "QueryExecutor.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+namespace Windows::EventLog
+{
+
+//
+// QueryStrand
+//
+
+RefPtr<QueryStrand> QueryStrand::create(QueryExecutor &executor, std::function<bool()> work)
+{
+	return RefObject<QueryStrand>::create(executor, std::move(work));
+}
+
+QueryStrand::QueryStrand(QueryExecutor &executor, std::function<bool()> work)
+	: mExecutor(executor)
+	, mWork(std::move(work))
+{}
+
+void QueryStrand::notify()
+{
+	// Only the first notification schedules, the rest are picked up by the
+	// run that follows.
+	if (mPending.fetch_add(1) == 0)
+		mExecutor.schedule(RefPtr<QueryStrand>(this));
+}
+
+void QueryStrand::close()
+{
+	// From the work, which holds the lock already.
+	if (isRunning())
+	{
+		mClosed = true;
+		return;
+	}
+
+	CriticalSection::Lock lck(mRunLock);
+	mClosed = true;
+}
+
+void QueryStrand::run()
+{
+	uint32_t pending = mPending.load();
+	bool more = false;
+	{
+		CriticalSection::Lock lck(mRunLock);
+		if (mClosed)
+			return;
+		mRunThread = std::this_thread::get_id();
+		try
+		{
+			more = mWork();
+		}
+		catch (...) // The work handles its own errors, just keep the worker.
+		{
+			more = false;
+		}
+		mRunThread = std::thread::id();
+
+		// Closed by the work.
+		if (mClosed)
+			return;
+	}
+
+	// Go round again if there's more to do or a notification came in while
+	// running, behind whatever else is queued.
+	if (more || mPending.fetch_sub(pending) != pending)
+		mExecutor.schedule(RefPtr<QueryStrand>(this));
+}
+
+//
+// QueryExecutor
+//
+
+QueryExecutor::QueryExecutor(uint32_t threadCount)
+	: mQueued(0, std::numeric_limits<LONG>::max())
+{
+	for (uint32_t i = 0; i < std::max<uint32_t>(threadCount, 1); ++i)
+		mThreads.push_back(Thread::begin(&QueryExecutor::workerMain, this));
+}
+
+QueryExecutor::~QueryExecutor()
+{
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		schedule(nullptr);
+
+	for (Thread &thread : mThreads)
+		thread.join();
+}
+
+std::shared_ptr<QueryExecutor> QueryExecutor::getDefault()
+{
+	static const std::shared_ptr<QueryExecutor> executor = 
+		std::make_shared<QueryExecutor>(std::max<uint32_t>(1, std::thread::hardware_concurrency()));
+	return executor;
+}
+
+void QueryExecutor::schedule(RefPtr<QueryStrand> strand)
+{
+	{
+		CriticalSection::Lock lck(mLock);
+		mQ.push_back(std::move(strand));
+	}
+	mQueued.release();
+}
+
+unsigned QueryExecutor::workerMain(void *arg)
+{
+	try
+	{
+		static_cast<QueryExecutor *>(arg)->workerThisMain();
+		return 0;
+	}
+	catch (...) // This is the top of thread stack, so swallow everything.
+	{
+		return 1;
+	}
+}
+
+void QueryExecutor::workerThisMain()
+{
+	for (;;)
+	{
+		mQueued.wait();
+
+		RefPtr<QueryStrand> strand;
+		{
+			CriticalSection::Lock lck(mLock);
+			strand = std::move(mQ.front());
+			mQ.pop_front();
+		}
+		if (!strand)
+			break;
+
+		strand->run();
+	}
+}
+
+}
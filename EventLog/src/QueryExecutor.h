@@ -0,0 +1,128 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "RefObject.h"
+#include "RefPtr.h"
+#include "SysPlatform.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+class QueryExecutor;
+
+// A serial queue of work on a QueryExecutor. Its work runs on one worker at
+// a time, never two at once, so everything a query does with its handles 
+// stays in order as if it had a thread of its own. The Event Log API only
+// needs calls on a handle serialized, not made from the same thread.
+class QueryStrand : public IRefObject
+{
+public:
+	friend class RefObject<QueryStrand>;
+
+	// work is called on a worker after notify(). It returns true if it has
+	// more to do, to be called again once other strands have had a turn.
+	static RefPtr<QueryStrand> create(QueryExecutor &executor, std::function<bool()> work);
+
+	// Has the work run soon. If it's running now it runs again afterwards.
+	void notify();
+
+	// Waits for the work if it's running and stops it being called again. 
+	// Called from the work it can't wait, the work is only not called again
+	// and the caller must be done with whatever it uses when it returns.
+	void close();
+
+	// Whether the calling thread is running the work.
+	bool isRunning() const { return mRunThread.load() == std::this_thread::get_id(); }
+
+	// Called by the executor.
+	void run();
+
+private:
+	QueryStrand(QueryExecutor &executor, std::function<bool()> work);
+
+	QueryExecutor &mExecutor;
+	const std::function<bool()> mWork;
+
+	// Notifications not yet seen by a run. Nonzero while scheduled.
+	std::atomic<uint32_t> mPending{ 0 };
+
+	// Held while the work runs.
+	CriticalSection mRunLock{};
+	bool mClosed = false;
+	// The thread running the work, if it's running.
+	std::atomic<std::thread::id> mRunThread{};
+
+	QueryStrand(const QueryStrand &) = delete;
+	QueryStrand &operator=(const QueryStrand &) = delete;
+};
+
+// A fixed pool of threads that queries run on, instead of a thread each. 
+// Most queries are idle most of the time, e.g. a collector following 
+// hundreds of channels, so a thread per query is mostly threads doing 
+// nothing. Each query gets a QueryStrand, and strands with work take turns
+// on the workers in the order they were notified.
+//
+// Work on a strand must not wait on another strand or it can deadlock the 
+// pool. Blocking on a record source is fine, it only holds up the others.
+class QueryExecutor
+{
+public:
+	explicit QueryExecutor(uint32_t threadCount);
+
+	// Runs whatever is scheduled, then stops the workers.
+	~QueryExecutor();
+
+	// Shared by every query not given an executor of its own. A worker per
+	// hardware thread.
+	static std::shared_ptr<QueryExecutor> getDefault();
+
+	uint32_t getThreadCount() const { return uint32_t(mThreads.size()); }
+
+	// Queues the strand to run on the next free worker.
+	void schedule(RefPtr<QueryStrand> strand);
+
+private:
+	static unsigned workerMain(void *arg);
+	void workerThisMain();
+
+	// Null tells a worker to exit. Unbounded since workers requeue strands 
+	// and must never wait for room.
+	CriticalSection mLock{};
+	std::deque<RefPtr<QueryStrand>> mQ{};
+	Semaphore mQueued;
+
+	std::vector<Thread> mThreads{};
+
+	QueryExecutor(const QueryExecutor &) = delete;
+	QueryExecutor &operator=(const QueryExecutor &) = delete;
+};
+
+}
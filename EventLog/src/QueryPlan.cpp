@@ -0,0 +1,454 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "QueryPlan.h"
+
+#include "SysPlatform.h"
+#include "XmlReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+#include <utility>
+
+namespace Windows::EventLog
+{
+
+using XPath::Node;
+using XPath::NodeKind;
+
+[[noreturn]] static void fail()
+{
+	THROW_(SystemException, ERROR_EVT_INVALID_QUERY);
+}
+
+// Channel names and paths don't depend on case.
+static bool samePath(const std::string &a, const std::string &b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), 
+		[](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+}
+
+//
+// Rewriting
+//
+
+// Rough relative cost of evaluating the node. Event id and level are plain
+// integers every record has; strings are copied out of the record and 
+// compared, EventData is looked up by name.
+static int cost(const Node &node)
+{
+	switch (node.kind)
+	{
+	case NodeKind::True:
+		return 0;
+	case NodeKind::And:
+	case NodeKind::Or:
+	case NodeKind::Not:
+	{
+		int sum = 0;
+		for (const Node &child : node.children)
+			sum += cost(child);
+		return sum;
+	}
+	case NodeKind::Band:
+		return 2;
+	case NodeKind::TimeDiff:
+		return 6;
+	default:
+		break;
+	}
+
+	switch (node.field)
+	{
+	case EventField::None: return 20;
+	case EventField::EventId:
+	case EventField::Level: return 1;
+	case EventField::ProviderGuid:
+	case EventField::ActivityId: return 4;
+	case EventField::ProviderName:
+	case EventField::Channel:
+	case EventField::Computer: return 8;
+	case EventField::User: return 12;
+	default: return 2;
+	}
+}
+
+static Node makeNode(NodeKind kind, std::vector<Node> children)
+{
+	Node n;
+	n.kind = kind;
+	n.children = std::move(children);
+	return n;
+}
+
+// And or Or of the nodes, True for no nodes when it's an And.
+static Node combine(NodeKind kind, std::vector<Node> nodes)
+{
+	if (nodes.empty())
+		return makeNode(NodeKind::True, {});
+	if (nodes.size() == 1)
+		return std::move(nodes.front());
+	return makeNode(kind, std::move(nodes));
+}
+
+// Conditions are told apart by their text.
+static std::string key(const Node &node)
+{
+	return XPath::format(node);
+}
+
+// The operands of an And, or the node itself.
+static std::vector<Node> conjuncts(const Node &node)
+{
+	return node.kind == NodeKind::And ? node.children : std::vector<Node>{ node };
+}
+
+static Node simplify(Node node);
+
+// Or of disjuncts without duplicates and without those another one implies,
+// with the conditions they all have taken out in front.
+static Node simplifyOr(std::vector<Node> disjuncts)
+{
+	for (const Node &d : disjuncts)
+	{
+		if (d.kind == NodeKind::True)
+			return d;
+	}
+
+	// Each disjunct's conditions. A disjunct with every condition of another 
+	// one is implied by it, Level=2 or (Level=2 and EventID=1) is Level=2.
+	std::vector<std::unordered_set<std::string>> keys;
+	for (const Node &d : disjuncts)
+	{
+		std::unordered_set<std::string> k;
+		for (const Node &c : conjuncts(d))
+			k.insert(key(c));
+		keys.push_back(std::move(k));
+	}
+	std::vector<bool> drop(disjuncts.size(), false);
+	for (size_t i = 0; i < disjuncts.size(); ++i)
+	{
+		for (size_t j = 0; j < disjuncts.size() && !drop[i]; ++j)
+		{
+			if (i == j || drop[j] || keys[j].size() > keys[i].size())
+				continue;
+			// Equal sets keep the first.
+			if (keys[j].size() == keys[i].size() && j > i)
+				continue;
+			drop[i] = std::all_of(keys[j].begin(), keys[j].end(), [&](const std::string &k) { return keys[i].count(k) != 0; });
+		}
+	}
+
+	std::vector<Node> kept;
+	std::vector<std::unordered_set<std::string>> keptKeys;
+	for (size_t i = 0; i < disjuncts.size(); ++i)
+	{
+		if (!drop[i])
+		{
+			kept.push_back(std::move(disjuncts[i]));
+			keptKeys.push_back(std::move(keys[i]));
+		}
+	}
+	if (kept.size() == 1)
+		return std::move(kept.front());
+
+	// Hoist what every disjunct has: (a and b) or (a and c) is a and (b or c).
+	std::vector<Node> common;
+	for (const Node &c : conjuncts(kept.front()))
+	{
+		std::string k = key(c);
+		bool everywhere = std::all_of(keptKeys.begin() + 1, keptKeys.end(), 
+			[&k](const std::unordered_set<std::string> &other) { return other.count(k) != 0; });
+		if (everywhere)
+			common.push_back(c);
+	}
+
+	if (common.empty())
+	{
+		std::stable_sort(kept.begin(), kept.end(), [](const Node &a, const Node &b) { return cost(a) < cost(b); });
+		return makeNode(NodeKind::Or, std::move(kept));
+	}
+
+	std::unordered_set<std::string> commonKeys;
+	for (const Node &c : common)
+		commonKeys.insert(key(c));
+
+	// No disjunct is left empty, it would have implied the others.
+	std::vector<Node> rest;
+	for (const Node &d : kept)
+	{
+		std::vector<Node> remaining;
+		for (Node &c : conjuncts(d))
+		{
+			if (commonKeys.count(key(c)) == 0)
+				remaining.push_back(std::move(c));
+		}
+		rest.push_back(combine(NodeKind::And, std::move(remaining)));
+	}
+	common.push_back(simplifyOr(std::move(rest)));
+	return simplify(makeNode(NodeKind::And, std::move(common)));
+}
+
+// Flattens nested Ands and Ors, removes duplicates and what's implied, 
+// hoists common conditions and orders operands cheapest first, so and/or 
+// decide as early as they can.
+static Node simplify(Node node)
+{
+	switch (node.kind)
+	{
+	case NodeKind::Not:
+	{
+		Node operand = simplify(std::move(node.children.front()));
+		if (operand.kind == NodeKind::Not)
+			return std::move(operand.children.front());
+		node.children.front() = std::move(operand);
+		return node;
+	}
+
+	case NodeKind::And:
+	{
+		std::vector<Node> operands;
+		std::unordered_set<std::string> seen;
+		for (Node &child : node.children)
+		{
+			Node c = simplify(std::move(child));
+			for (Node &o : conjuncts(c))
+			{
+				if (o.kind != NodeKind::True && seen.insert(key(o)).second)
+					operands.push_back(std::move(o));
+			}
+		}
+		std::stable_sort(operands.begin(), operands.end(), [](const Node &a, const Node &b) { return cost(a) < cost(b); });
+		return combine(NodeKind::And, std::move(operands));
+	}
+
+	case NodeKind::Or:
+	{
+		std::vector<Node> operands;
+		for (Node &child : node.children)
+		{
+			Node c = simplify(std::move(child));
+			if (c.kind == NodeKind::Or)
+			{
+				for (Node &o : c.children)
+					operands.push_back(std::move(o));
+			}
+			else
+			{
+				operands.push_back(std::move(c));
+			}
+		}
+		return simplifyOr(std::move(operands));
+	}
+
+	default:
+		return node;
+	}
+}
+
+//
+// QueryPlan
+//
+
+QueryPlan QueryPlan::parse(const std::string &queryList)
+{
+	QueryPlan plan;
+	XmlReader reader(queryList, ERROR_EVT_INVALID_QUERY);
+	XmlReader::Element element;
+	if (!reader.startElement(element) || element.name != "QueryList")
+		fail();
+
+	if (!element.empty)
+	{
+		XmlReader::Element query;
+		while (reader.startElement(query))
+		{
+			if (query.name != "Query")
+				fail();
+			const std::string *queryPath = query.attribute("Path");
+
+			// This Query's clause for each of its paths.
+			std::vector<Path> paths;
+			auto clause = [&paths](const std::string &path) -> Clause &
+			{
+				auto it = std::find_if(paths.begin(), paths.end(), [&path](const Path &p) { return samePath(p.path, path); });
+				if (it == paths.end())
+				{
+					paths.push_back({ path, { Clause{} } });
+					return paths.back().clauses.front();
+				}
+				return it->clauses.front();
+			};
+
+			XmlReader::Element select;
+			while (!query.empty && reader.startElement(select))
+			{
+				const bool suppress = select.name == "Suppress";
+				if (!suppress && select.name != "Select")
+					fail();
+
+				const std::string *path = select.attribute("Path");
+				if (!path)
+					path = queryPath;
+				if (!path)
+					fail();
+
+				std::string xpath;
+				if (!select.empty)
+				{
+					xpath = reader.text();
+					reader.endElement(select.name);
+				}
+
+				Clause &c = clause(*path);
+				(suppress ? c.suppresses : c.selects).push_back(XPath::parse(xpath));
+			}
+			if (!query.empty)
+				reader.endElement("Query");
+
+			// A path only suppressed from selects nothing.
+			for (Path &p : paths)
+			{
+				if (p.clauses.front().selects.empty())
+					continue;
+
+				auto it = std::find_if(plan.mPaths.begin(), plan.mPaths.end(), [&p](const Path &o) { return samePath(o.path, p.path); });
+				if (it == plan.mPaths.end())
+					plan.mPaths.push_back(std::move(p));
+				else
+					it->clauses.push_back(std::move(p.clauses.front()));
+			}
+		}
+		reader.endElement("QueryList");
+	}
+
+	if (!reader.atEnd())
+		fail();
+	return plan;
+}
+
+void QueryPlan::optimize()
+{
+	for (Path &path : mPaths)
+	{
+		// One expression each for the selects and the suppresses, the clauses
+		// with the same suppresses merged.
+		std::vector<Clause> merged;
+		std::vector<std::string> suppressKeys;
+		for (Clause &c : path.clauses)
+		{
+			Node select = simplify(makeNode(NodeKind::Or, std::move(c.selects)));
+			std::vector<Node> suppresses;
+			if (!c.suppresses.empty())
+				suppresses.push_back(simplify(makeNode(NodeKind::Or, std::move(c.suppresses))));
+			std::string suppressKey = suppresses.empty() ? std::string() : key(suppresses.front());
+
+			auto it = std::find(suppressKeys.begin(), suppressKeys.end(), suppressKey);
+			if (it == suppressKeys.end())
+			{
+				merged.push_back({ { std::move(select) }, std::move(suppresses) });
+				suppressKeys.push_back(std::move(suppressKey));
+			}
+			else
+			{
+				Clause &into = merged[size_t(it - suppressKeys.begin())];
+				into.selects.front() = simplify(makeNode(NodeKind::Or, { std::move(into.selects.front()), std::move(select) }));
+			}
+		}
+
+		// A clause selecting everything without suppressing anything makes 
+		// the others redundant.
+		for (Clause &c : merged)
+		{
+			if (c.suppresses.empty() && c.selects.front().kind == NodeKind::True)
+			{
+				Clause all = std::move(c);
+				merged.clear();
+				merged.push_back(std::move(all));
+				break;
+			}
+		}
+
+		// Cheapest clause first, a record one of them selects skips the rest.
+		auto clauseCost = [](const Clause &c)
+		{
+			int sum = cost(c.selects.front());
+			for (const Node &s : c.suppresses)
+				sum += cost(s);
+			return sum;
+		};
+		std::stable_sort(merged.begin(), merged.end(), [&clauseCost](const Clause &a, const Clause &b) { return clauseCost(a) < clauseCost(b); });
+
+		path.clauses = std::move(merged);
+	}
+}
+
+std::optional<XPath::Node> QueryPlan::getFilter(const std::string &path) const
+{
+	auto it = std::find_if(mPaths.begin(), mPaths.end(), [&path](const Path &p) { return samePath(p.path, path); });
+	if (it == mPaths.end())
+		return std::nullopt;
+
+	std::vector<Node> clauses;
+	for (const Clause &c : it->clauses)
+	{
+		std::vector<Node> operands;
+		operands.push_back(combine(NodeKind::Or, c.selects));
+		if (!c.suppresses.empty())
+			operands.push_back(makeNode(NodeKind::Not, { combine(NodeKind::Or, c.suppresses) }));
+		clauses.push_back(combine(NodeKind::And, std::move(operands)));
+	}
+	return combine(NodeKind::Or, std::move(clauses));
+}
+
+std::string QueryPlan::toXml() const
+{
+	std::string xml = "<QueryList>\n";
+	uint32_t id = 0;
+	for (const Path &path : mPaths)
+	{
+		for (const Clause &c : path.clauses)
+		{
+			xml += "  <Query Id=\"" + std::to_string(id++) + "\" Path=\"";
+			appendEscaped(xml, path.path);
+			xml += "\">\n";
+			auto element = [&xml, &path](const char *name, const Node &node)
+			{
+				xml += std::string("    <") + name + " Path=\"";
+				appendEscaped(xml, path.path);
+				xml += "\">";
+				appendEscaped(xml, XPath::format(node));
+				xml += std::string("</") + name + ">\n";
+			};
+			for (const Node &select : c.selects)
+				element("Select", select);
+			for (const Node &suppress : c.suppresses)
+				element("Suppress", suppress);
+			xml += "  </Query>\n";
+		}
+	}
+	xml += "</QueryList>\n";
+	return xml;
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "XPath.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// A structured query, the QueryList XML, as a plan per path (channel or 
+// log file):
+//
+//   <QueryList>
+//     <Query Id="0" Path="Application">
+//       <Select Path="Application">*[System[Level=2]]</Select>
+//       <Select Path="System">*[System[Level=1]]</Select>
+//       <Suppress Path="Application">*[System[EventID=100]]</Suppress>
+//     </Query>
+//   </QueryList>
+//
+// An event of a path is selected by a Query if one of the Query's Selects 
+// for the path matches it and none of its Suppresses does. The list selects
+// what any of its Queries does.
+//
+// optimize rewrites the plan so it's cheaper to evaluate, either by the 
+// Event Log service from toXml or here through getFilter and XPathFilter.
+class QueryPlan
+{
+public:
+	// What one Query selects from a path.
+	struct Clause
+	{
+		std::vector<XPath::Node> selects{};
+		std::vector<XPath::Node> suppresses{};
+	};
+
+	struct Path
+	{
+		std::string path;
+		std::vector<Clause> clauses{};
+	};
+
+	// Throws SystemException with ERROR_EVT_INVALID_QUERY if the XML isn't a
+	// QueryList or an XPath expression in it is outside the XPath subset.
+	static QueryPlan parse(const std::string &queryList);
+
+	// Per path: merges the Queries with the same Suppresses and the Selects 
+	// of each into one expression, drops duplicates and anything an "*" 
+	// already selects, hoists conditions every alternative has and puts the 
+	// cheapest tests, event id and level, first.
+	void optimize();
+
+	// Paths in the order the list first names them.
+	const std::vector<Path> &getPaths() const { return mPaths; }
+
+	// What the plan selects from the path as one expression, nothing if the
+	// plan doesn't read the path.
+	std::optional<XPath::Node> getFilter(const std::string &path) const;
+
+	// The plan as a QueryList, a Query per clause.
+	std::string toXml() const;
+
+private:
+	std::vector<Path> mPaths{};
+};
+
+}
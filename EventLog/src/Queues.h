@@ -25,8 +25,12 @@ misrepresented as being the original software.
 #include <cstdint>
 #include <optional>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
 
-#include "WinSys.h"
+#include "SysPlatform.h"
 // namespace MSWin
 namespace Windows 
 {
@@ -117,11 +121,12 @@ public:
 		}
 	}
 
-	std::optional<T> dequeue()
+	// Returns nothing if the timeout in milliseconds expires first.
+	std::optional<T> dequeue(DWORD timeout = INFINITE)
 	{
 		std::optional<T> tmp;
 
-		auto status = mOccupied.wait();
+		auto status = mOccupied.wait(timeout);
 		if (status.getStatus() == WaitStatus::Object_0)
 		{
 			{
@@ -154,4 +159,350 @@ private:
 	BoundedSynchQueue &operator=(BoundedSynchQueue &&) = delete;
 };
 
+// Hint to the CPU that we're spinning.
+inline void cpuRelax() noexcept
+{
+#if defined(_MSC_VER)
+	YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// An index on its own cache line, so producers and consumers don't 
+// invalidate each other's.
+struct PaddedIndex
+{
+	static constexpr size_t CacheLineSize = 64;
+
+	std::atomic<uint32_t> value{ 0 };
+	char pad[CacheLineSize - sizeof(std::atomic<uint32_t>)]{};
+};
+
+// Blocking for the ring queues. A waiter spins on the operation for a 
+// while, then sleeps on a futex. notify() bumps the epoch after every 
+// operation and only makes a system call when someone is asleep.
+class RingWaiter
+{
+public:
+	static constexpr uint32_t SpinCount = 64;
+
+	// Retries tryOp until it succeeds or the timeout (milliseconds) expires.
+	template<typename TryOp>
+	bool wait(TryOp &&tryOp, DWORD timeout)
+	{
+		if (tryOp())
+			return true;
+		if (timeout == 0)
+			return false;
+
+		for (uint32_t i = 0; i < spinCount(); ++i)
+		{
+			cpuRelax();
+			if (tryOp())
+				return true;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (;;)
+		{
+			// Register before taking the epoch and retrying. A notify that 
+			// misses the retry either sees us waiting or changes the epoch 
+			// before the futex checks it.
+			mWaiters.fetch_add(1);
+			uint32_t epoch = mEpoch.load();
+			if (tryOp())
+			{
+				mWaiters.fetch_sub(1);
+				return true;
+			}
+
+			DWORD remaining = remainingTime(start, timeout);
+			if (remaining == 0)
+			{
+				mWaiters.fetch_sub(1);
+				return false;
+			}
+
+			Futex::wait(mEpoch, epoch, remaining);
+			mWaiters.fetch_sub(1);
+		}
+	}
+
+	void notify() noexcept
+	{
+		mEpoch.fetch_add(1);
+		if (mWaiters.load() > 0)
+			Futex::wakeOne(mEpoch);
+	}
+
+	// Spinning only helps if the other side can run at the same time.
+	static uint32_t spinCount()
+	{
+		static const uint32_t count = std::thread::hardware_concurrency() > 1 ? SpinCount : 0;
+		return count;
+	}
+
+	static DWORD remainingTime(std::chrono::steady_clock::time_point start, DWORD timeout)
+	{
+		if (timeout == INFINITE)
+			return INFINITE;
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		return elapsed >= timeout ? 0 : DWORD(timeout - elapsed);
+	}
+
+private:
+	std::atomic<uint32_t> mEpoch{ 0 };
+	std::atomic<uint32_t> mWaiters{ 0 };
+};
+
+// One-shot signal for a call: one thread waits, another sets it when the 
+// call is done. An atomic flag that's spun on for a while, then slept on 
+// with a futex, so there's no kernel object to create and set() only makes
+// a system call if the waiter is asleep. reset() rearms it.
+class Completion
+{
+public:
+	void reset() noexcept
+	{
+		mState.store(Pending, std::memory_order_relaxed);
+	}
+
+	void set() noexcept
+	{
+		if (mState.exchange(Done, std::memory_order_acq_rel) == Sleeping)
+			Futex::wakeAll(mState);
+	}
+
+	// Returns false if the timeout (milliseconds) expires first.
+	bool wait(DWORD timeout = INFINITE) noexcept
+	{
+		if (isSet())
+			return true;
+		if (timeout == 0)
+			return false;
+
+		for (uint32_t i = 0; i < RingWaiter::spinCount(); ++i)
+		{
+			cpuRelax();
+			if (isSet())
+				return true;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (;;)
+		{
+			// Say we're going to sleep, unless it's done already.
+			uint32_t state = Pending;
+			if (!mState.compare_exchange_strong(state, Sleeping) && state == Done)
+				return true;
+
+			DWORD remaining = RingWaiter::remainingTime(start, timeout);
+			if (remaining == 0)
+				return isSet();
+
+			Futex::wait(mState, Sleeping, remaining);
+			if (isSet())
+				return true;
+		}
+	}
+
+private:
+	bool isSet() const noexcept
+	{
+		return mState.load(std::memory_order_acquire) == Done;
+	}
+
+	static constexpr uint32_t Pending = 0;
+	static constexpr uint32_t Sleeping = 1;
+	static constexpr uint32_t Done = 2;
+
+	std::atomic<uint32_t> mState{ Pending };
+};
+
+// Lock-free bounded queue for exactly one producer thread and one consumer 
+// thread. N must be a power of two.
+template<typename T, uint32_t N = 16u>
+class SpscRingQueue
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+public:
+	static constexpr uint32_t MaxSize = N;
+
+	SpscRingQueue() = default;
+	~SpscRingQueue() = default;
+
+	// Moves from value and returns true if there was room.
+	bool tryEnqueue(T &value)
+	{
+		uint32_t tail = mTail.value.load(std::memory_order_relaxed);
+		if (tail - mHead.value.load(std::memory_order_acquire) == N)
+			return false;
+
+		mSlots[tail & (N - 1)] = std::move(value);
+		mTail.value.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns true and moves the oldest element to value if there is one.
+	bool tryDequeue(T &value)
+	{
+		uint32_t head = mHead.value.load(std::memory_order_relaxed);
+		if (head == mTail.value.load(std::memory_order_acquire))
+			return false;
+
+		// Don't keep a moved from element alive in the ring.
+		T &slot = mSlots[head & (N - 1)];
+		value = std::move(slot);
+		slot = T{};
+		mHead.value.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Waits while the queue is full.
+	void enqueue(T value)
+	{
+		mNotFull.wait([&] { return tryEnqueue(value); }, INFINITE);
+		mNotEmpty.notify();
+	}
+
+	// Returns nothing if the timeout in milliseconds expires first.
+	std::optional<T> dequeue(DWORD timeout = INFINITE)
+	{
+		T value{};
+		if (!mNotEmpty.wait([&] { return tryDequeue(value); }, timeout))
+			return {};
+
+		mNotFull.notify();
+		return value;
+	}
+
+private:
+	PaddedIndex mHead{};
+	PaddedIndex mTail{};
+	std::array<T, N> mSlots{};
+
+	RingWaiter mNotEmpty{};
+	RingWaiter mNotFull{};
+
+	SpscRingQueue(const SpscRingQueue &) = delete;
+	SpscRingQueue &operator=(const SpscRingQueue &) = delete;
+};
+
+// Lock-free bounded queue for any number of producers and consumers, after
+// Dmitry Vyukov's. Each cell's sequence number says whether it's ready to 
+// be written or read at a given position. N must be a power of two.
+template<typename T, uint32_t N = 16u>
+class MpmcRingQueue
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+public:
+	static constexpr uint32_t MaxSize = N;
+
+	MpmcRingQueue()
+	{
+		for (uint32_t i = 0; i < N; ++i)
+			mCells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	~MpmcRingQueue() = default;
+
+	// Moves from value and returns true if there was room.
+	bool tryEnqueue(T &value)
+	{
+		uint32_t pos = mEnqueuePos.value.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = mCells[pos & (N - 1)];
+			uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+			int32_t diff = int32_t(sequence - pos);
+			if (diff == 0)
+			{
+				if (mEnqueuePos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false; // Full
+			}
+			else
+			{
+				pos = mEnqueuePos.value.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns true and moves the oldest element to value if there is one.
+	bool tryDequeue(T &value)
+	{
+		uint32_t pos = mDequeuePos.value.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = mCells[pos & (N - 1)];
+			uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+			int32_t diff = int32_t(sequence - (pos + 1));
+			if (diff == 0)
+			{
+				if (mDequeuePos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					value = std::move(cell.value);
+					cell.value = T{};
+					cell.sequence.store(pos + N, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false; // Empty
+			}
+			else
+			{
+				pos = mDequeuePos.value.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Waits while the queue is full.
+	void enqueue(T value)
+	{
+		mNotFull.wait([&] { return tryEnqueue(value); }, INFINITE);
+		mNotEmpty.notify();
+	}
+
+	// Returns nothing if the timeout in milliseconds expires first.
+	std::optional<T> dequeue(DWORD timeout = INFINITE)
+	{
+		T value{};
+		if (!mNotEmpty.wait([&] { return tryDequeue(value); }, timeout))
+			return {};
+
+		mNotFull.notify();
+		return value;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<uint32_t> sequence;
+		T value{};
+	};
+
+	PaddedIndex mEnqueuePos{};
+	PaddedIndex mDequeuePos{};
+	std::array<Cell, N> mCells{};
+
+	RingWaiter mNotEmpty{};
+	RingWaiter mNotFull{};
+
+	MpmcRingQueue(const MpmcRingQueue &) = delete;
+	MpmcRingQueue &operator=(const MpmcRingQueue &) = delete;
+};
+
 }
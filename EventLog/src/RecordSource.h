@@ -0,0 +1,86 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IBookmark.h"
+#include "IEventLogQuery.h"
+#include "SysPlatform.h"
+
+#include <string>
+
+namespace Windows::EventLog
+{
+
+// Backend that produces event records for EventLogQuery. The Windows Event 
+// Log API (EvtQuery/EvtNext/EvtRender) is one implementation, the in-memory
+// SyntheticRecordSource is another.
+// 
+// All methods are called on the query's strand, one at a time, apart from
+// cancel, so implementations need not be thread safe otherwise. Batches returned by next() are 
+// consumed on other threads and must not refer back to mutable source state.
+class IRecordSource : public IRefObject
+{
+public:
+	virtual ~IRecordSource() = default;
+
+	// Starts a new query over the given channel. Any open query is closed.
+	virtual void queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir) = 0;
+
+	// Starts a new query over the given log file. Any open query is closed.
+	virtual void queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir) = 0;
+
+	// Starts a new structured XML query. Any open query is closed.
+	virtual void queryStructuredXML(const std::string &structuredXML, Direction dir) = 0;
+
+	// Fetches up to batchSize records. The status of the returned batch
+	// reports Timeout and NoMoreItems, other failures throw.
+	virtual Ref<IQueryBatchResult> next(uint32_t batchSize, uint32_t timeout) = 0;
+
+	virtual void seek(int64_t position, SeekOption whence) = 0;
+
+	// Moves to the record after the one the bookmark is at in its current 
+	// channel, in query order, like EvtSeek with EvtSeekRelativeToBookmark 
+	// and an offset of 1.
+	virtual void seek(const IBookmark &bookmark) = 0;
+
+	// Fields to render in records of batches returned from now on. Sources
+	// may render more, but must render these.
+	virtual void setFields(EventField fields) = 0;
+
+	// Closes the current query, if any.
+	virtual SysErr close() = 0;
+
+	// Makes a next() in progress return early, and it and every call after
+	// throw SystemException with ERROR_CANCELLED. Called from any thread.
+	virtual void cancel() = 0;
+};
+
+// The record id a source seeks after. Throws SystemException with 
+// ERROR_INVALID_PARAMETER if the bookmark is empty.
+uint64_t getBookmarkedRecordId(const IBookmark &bookmark);
+
+// The default source for the platform. Windows Event Log API on Windows,
+// the EVTX file reader elsewhere.
+Ref<IRecordSource> createDefaultRecordSource();
+
+}
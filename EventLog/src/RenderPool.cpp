@@ -0,0 +1,173 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "RenderPool.h"
+
+#include <algorithm>
+
+namespace Windows::EventLog
+{
+
+// Spans per worker. More spans let the consumer start sooner and even out 
+// the load, at the cost of an event each.
+static constexpr uint32_t SpansPerThread = 4;
+
+//
+// RenderedBatch
+//
+
+// Formats the record's lazy display strings so the consumer doesn't have to.
+static void formatDisplay(const IEventRecord &record, EventField display)
+{
+	if (hasAnyField(display, EventField::Message))
+		record.getMessage();
+	if (hasAnyField(display, EventField::LevelDisplay))
+		record.getLevelDisplay();
+	if (hasAnyField(display, EventField::TaskDisplay))
+		record.getTaskDisplay();
+	if (hasAnyField(display, EventField::OpcodeDisplay))
+		record.getOpcodeDisplay();
+	if (hasAnyField(display, EventField::KeywordsDisplay))
+		record.getKeywordsDisplay();
+	if (hasAnyField(display, EventField::ChannelMessage))
+		record.getChannelMessage();
+	if (hasAnyField(display, EventField::ProviderMessage))
+		record.getProviderMessage();
+}
+
+RenderedBatch::RenderedBatch(Ref<IQueryBatchResult> batch, uint32_t threadCount, EventField display)
+	: mBatch(std::move(batch))
+	, mCount(mBatch->getCount())
+	, mDisplay(display)
+	, mRecords(mCount)
+{
+	uint32_t spanCount = std::min<uint32_t>(mCount, threadCount * SpansPerThread);
+	mSpanSize = (mCount + spanCount - 1) / spanCount;
+	spanCount = (mCount + mSpanSize - 1) / mSpanSize;
+
+	for (uint32_t i = 0; i < spanCount; ++i)
+		mSpans.push_back(std::make_unique<Span>());
+}
+
+Ref<IEventRecord> RenderedBatch::getRecord(uint32_t index) const
+{
+	if (index >= mCount)
+	{
+		THROW(IndexOutOfBoundsException);
+	}
+
+	Span &span = *mSpans[index / mSpanSize];
+	span.ready.wait();
+	if (span.error)
+		std::rethrow_exception(span.error);
+
+	return Ref<IEventRecord>(*mRecords[index]);
+}
+
+void RenderedBatch::work()
+{
+	for (;;)
+	{
+		uint32_t index = mNextSpan++;
+		if (index >= mSpans.size())
+			break;
+
+		Span &span = *mSpans[index];
+		uint32_t first = index * mSpanSize;
+		uint32_t last = std::min<uint32_t>(first + mSpanSize, mCount);
+		try
+		{
+			for (uint32_t i = first; i < last; ++i)
+			{
+				mRecords[i] = mBatch->getRecord(i).ptr();
+				formatDisplay(*mRecords[i], mDisplay);
+			}
+		}
+		catch (...)
+		{
+			span.error = std::current_exception();
+		}
+		span.ready.set();
+	}
+}
+
+//
+// RenderPool
+//
+
+RenderPool::RenderPool(uint32_t threadCount)
+{
+	for (uint32_t i = 0; i < threadCount; ++i)
+		mThreads.push_back(Thread::begin(&RenderPool::workerMain, this));
+}
+
+RenderPool::~RenderPool()
+{
+	// Queued after any outstanding work, so that gets done first.
+	for (size_t i = 0; i < mThreads.size(); ++i)
+		mQ.enqueue(nullptr);
+
+	for (Thread &thread : mThreads)
+		thread.join();
+}
+
+Ref<IQueryBatchResult> RenderPool::render(Ref<IQueryBatchResult> batch, EventField display)
+{
+	if (mThreads.empty() || batch->getStatus() != QueryNextStatus::Success || batch->getCount() == 0)
+		return batch;
+
+	RefPtr<RenderedBatch> rendered = RenderedBatch::create(std::move(batch), getThreadCount(), display);
+
+	// One ticket per worker that has a span to work on.
+	uint32_t tickets = std::min<uint32_t>(getThreadCount(), rendered->getSpanCount());
+	for (uint32_t i = 0; i < tickets; ++i)
+		mQ.enqueue(rendered);
+
+	return Ref<IQueryBatchResult>(*rendered);
+}
+
+unsigned RenderPool::workerMain(void *arg)
+{
+	try
+	{
+		static_cast<RenderPool *>(arg)->workerThisMain();
+		return 0;
+	}
+	catch (...) // This is the top of thread stack, so swallow everything.
+	{
+		return 1;
+	}
+}
+
+void RenderPool::workerThisMain()
+{
+	for (;;)
+	{
+		auto p = mQ.dequeue();
+		if (!p.has_value() || !p.value())
+			break;
+
+		p.value()->work();
+	}
+}
+
+}
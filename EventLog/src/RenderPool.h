@@ -0,0 +1,118 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventLogQuery.h"
+#include "Queues.h"
+#include "SysPlatform.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// A batch being rendered by a RenderPool.
+class RenderedBatch : public IQueryBatchResult
+{
+public:
+	friend class RefObject<RenderedBatch>;
+
+	static RefPtr<RenderedBatch> create(Ref<IQueryBatchResult> batch, uint32_t threadCount, EventField display)
+	{
+		return RefObject<RenderedBatch>::create(std::move(batch), threadCount, display);
+	}
+
+	QueryNextStatus getStatus() const override { return mBatch->getStatus(); }
+
+	uint32_t getCount() const override { return mCount; }
+
+	Ref<IEventRecord> getRecord(uint32_t index) const override;
+
+	// The columns come from the batch itself, they don't wait on the pool.
+	Ref<IEventBatch> getEventBatch() const override { return mBatch->getEventBatch(); }
+
+	uint32_t getSpanCount() const { return uint32_t(mSpans.size()); }
+
+	// Renders spans until there are none left to claim. Called by workers.
+	void work();
+
+private:
+	RenderedBatch(Ref<IQueryBatchResult> batch, uint32_t threadCount, EventField display);
+
+	struct Span
+	{
+		ManualResetEvent ready{ FALSE };
+		std::exception_ptr error{};
+	};
+
+	const Ref<IQueryBatchResult> mBatch;
+	const uint32_t mCount;
+	const EventField mDisplay;
+	uint32_t mSpanSize = 1;
+
+	std::vector<RefPtr<IEventRecord>> mRecords;
+	std::vector<std::unique_ptr<Span>> mSpans{};
+	std::atomic<uint32_t> mNextSpan{ 0 };
+};
+
+// Renders the records of query batches on a pool of worker threads. 
+// Rendering a record (EvtRender and the EvtFormatMessage calls for the 
+// display strings, on Windows) is most of the cost of reading a log, and 
+// records render independently of each other. Records that format their
+// display strings on first use have the wanted ones formatted here too.
+//
+// Each batch is split into spans that the workers claim in order, so the 
+// first records of a batch are ready first. The returned batch hands 
+// records back in order, waiting for any that aren't rendered yet. 
+class RenderPool
+{
+public:
+	explicit RenderPool(uint32_t threadCount);
+
+	// Finishes rendering every batch already handed out, then stops the workers.
+	~RenderPool();
+
+	uint32_t getThreadCount() const { return uint32_t(mThreads.size()); }
+
+	// Starts rendering the records of the batch, and their display strings,
+	// and returns a batch that hands them back. Batches without records are
+	// returned as is.
+	Ref<IQueryBatchResult> render(Ref<IQueryBatchResult> batch, EventField display);
+
+private:
+	static unsigned workerMain(void *arg);
+	void workerThisMain();
+
+	// Null tells a worker to exit.
+	MpmcRingQueue<RefPtr<RenderedBatch>, 64> mQ{};
+
+	std::vector<Thread> mThreads{};
+
+	RenderPool(const RenderPool &) = delete;
+	RenderPool &operator=(const RenderPool &) = delete;
+};
+
+}
@@ -0,0 +1,268 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "SysPlatform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Bounded cache of values that are slow to load, read from many threads.
+//
+// Keys are spread over shards, each with its own reader/writer lock, so 
+// hits only take a shared lock and threads hitting different shards don't
+// contend at all. Concurrent misses on a key are coalesced: one thread 
+// loads, the others wait for its result. Loads happen outside the lock.
+//
+// When a shard is full an entry is evicted with the clock (second chance) 
+// algorithm. Hits only set an entry's referenced bit, so unlike LRU they 
+// don't need the exclusive lock.
+//
+// A load that throws isn't cached, the exception goes to the loading thread
+// and any waiting on it. Loaders that want failures remembered return a 
+// value meaning so, e.g. null.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedCache
+{
+public:
+	struct Options
+	{
+		// Entries over all shards.
+		size_t capacity = 2048;
+		size_t shards = 16;
+	};
+
+	ShardedCache()
+		: ShardedCache(Options{})
+	{}
+
+	explicit ShardedCache(Options options)
+		: mShardCount(std::max<size_t>(options.shards, 1))
+		, mShardCapacity(std::max<size_t>(options.capacity / mShardCount, 1))
+		, mShards(std::make_unique<Shard[]>(mShardCount))
+	{}
+
+	~ShardedCache() = default;
+
+	// The cached value for the key, or load() called to get it on a miss.
+	template<typename Load>
+	Value lookup(const Key &key, Load &&load)
+	{
+		Shard &shard = shardFor(key);
+		{
+			ReadWriteLock::ReadLock lck(shard.lock);
+			if (const Entry *entry = findLocked(shard, key))
+			{
+				return entry->value;
+			}
+		}
+
+		std::promise<Value> promise;
+		std::shared_future<Value> loading;
+		{
+			ReadWriteLock::WriteLock lck(shard.lock);
+
+			// Loaded, or being loaded, since the read lock was dropped.
+			if (const Entry *entry = findLocked(shard, key))
+			{
+				return entry->value;
+			}
+
+			auto loadingIt = shard.loading.find(key);
+			if (loadingIt != shard.loading.end())
+			{
+				loading = loadingIt->second;
+				shard.waits.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				shard.loading.emplace(key, promise.get_future().share());
+				shard.misses.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		// Rethrows if the load failed.
+		if (loading.valid())
+		{
+			return loading.get();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto elapsed = [start]
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		};
+
+		try
+		{
+			Value value = load();
+			shard.loadNanoseconds.fetch_add(elapsed(), std::memory_order_relaxed);
+			{
+				ReadWriteLock::WriteLock lck(shard.lock);
+				shard.loading.erase(key);
+				insertLocked(shard, key, value);
+			}
+			promise.set_value(value);
+			return value;
+		}
+		catch (...)
+		{
+			shard.loadNanoseconds.fetch_add(elapsed(), std::memory_order_relaxed);
+			{
+				ReadWriteLock::WriteLock lck(shard.lock);
+				shard.loading.erase(key);
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+	}
+
+	MetadataCacheStats getStats() const
+	{
+		MetadataCacheStats stats{};
+		for (size_t i = 0; i < mShardCount; ++i)
+		{
+			Shard &shard = mShards[i];
+			stats.hits += shard.hits.load(std::memory_order_relaxed);
+			stats.waits += shard.waits.load(std::memory_order_relaxed);
+			stats.misses += shard.misses.load(std::memory_order_relaxed);
+			stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+			stats.loadNanoseconds += shard.loadNanoseconds.load(std::memory_order_relaxed);
+
+			ReadWriteLock::ReadLock lck(shard.lock);
+			stats.size += shard.ring.size();
+		}
+		return stats;
+	}
+
+	// Drops the cached values. Loads in progress still complete and are 
+	// cached.
+	void clear()
+	{
+		for (size_t i = 0; i < mShardCount; ++i)
+		{
+			Shard &shard = mShards[i];
+			ReadWriteLock::WriteLock lck(shard.lock);
+			shard.index.clear();
+			shard.ring.clear();
+			shard.hand = 0;
+		}
+	}
+
+private:
+	struct Entry
+	{
+		Entry(const Key &key, Value value)
+			: key(key), value(std::move(value))
+		{}
+
+		const Key key;
+		const Value value;
+		// Set on every hit, cleared as the clock hand passes.
+		std::atomic<bool> referenced{ true };
+	};
+
+	struct Shard
+	{
+		ReadWriteLock lock{};
+		std::unordered_map<Key, size_t, Hash> index{};
+		// The clock, in slot order. 
+		std::vector<std::unique_ptr<Entry>> ring{};
+		size_t hand = 0;
+		std::unordered_map<Key, std::shared_future<Value>, Hash> loading{};
+
+		std::atomic<uint64_t> hits{ 0 };
+		std::atomic<uint64_t> waits{ 0 };
+		std::atomic<uint64_t> misses{ 0 };
+		std::atomic<uint64_t> evictions{ 0 };
+		std::atomic<uint64_t> loadNanoseconds{ 0 };
+	};
+
+	Shard &shardFor(const Key &key) const
+	{
+		return mShards[Hash{}(key) % mShardCount];
+	}
+
+	// Counts a hit. Either lock.
+	static const Entry *findLocked(Shard &shard, const Key &key)
+	{
+		auto it = shard.index.find(key);
+		if (it == shard.index.end())
+		{
+			return nullptr;
+		}
+
+		Entry *entry = shard.ring[it->second].get();
+		entry->referenced.store(true, std::memory_order_relaxed);
+		shard.hits.fetch_add(1, std::memory_order_relaxed);
+		return entry;
+	}
+
+	void insertLocked(Shard &shard, const Key &key, Value value)
+	{
+		if (shard.ring.size() < mShardCapacity)
+		{
+			shard.index.emplace(key, shard.ring.size());
+			shard.ring.push_back(std::make_unique<Entry>(key, std::move(value)));
+			return;
+		}
+
+		// Every entry gets a second chance, so this takes at most one turn.
+		for (;; shard.hand = (shard.hand + 1) % shard.ring.size())
+		{
+			std::unique_ptr<Entry> &slot = shard.ring[shard.hand];
+			if (slot->referenced.exchange(false, std::memory_order_relaxed))
+			{
+				continue;
+			}
+
+			shard.index.erase(slot->key);
+			slot = std::make_unique<Entry>(key, std::move(value));
+			shard.index.emplace(key, shard.hand);
+			shard.hand = (shard.hand + 1) % shard.ring.size();
+			shard.evictions.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	const size_t mShardCount;
+	const size_t mShardCapacity;
+	const std::unique_ptr<Shard[]> mShards;
+
+	ShardedCache(const ShardedCache &) = delete;
+	ShardedCache &operator=(const ShardedCache &) = delete;
+};
+
+}
@@ -0,0 +1,71 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventLogQuery.h"
+#include "SysPlatform.h"
+
+#include <string>
+
+namespace Windows::EventLog
+{
+
+// Backend that reads live records for EventSubscription. EvtSubscribe is
+// one implementation, the simulated SyntheticSubscriptionSource another.
+//
+// Methods are called on the subscription's reader thread, apart from 
+// cancel, so implementations need not be thread safe otherwise.
+class ISubscriptionSource : public IRefObject
+{
+public:
+	virtual ~ISubscriptionSource() = default;
+
+	// Starts reading the channel. bookmark is the bookmark XML for 
+	// SubscriptionStart::AfterBookmark. Throws if the subscription can't 
+	// be made.
+	virtual void subscribe(const std::string &channel, const std::string &query, SubscriptionStart start, 
+		const std::string &bookmark) = 0;
+
+	// Returns up to batchSize records already written, without waiting. 
+	// The status is NoMoreItems when there are none.
+	virtual Ref<IQueryBatchResult> next(uint32_t batchSize) = 0;
+
+	// Waits up to timeout milliseconds for more records to be written, or
+	// for cancel. Can return early, callers check with next.
+	virtual void wait(uint32_t timeout) = 0;
+
+	// Wakes the reader from wait. Called from any thread.
+	virtual void cancel() = 0;
+
+	// Fields to render in records returned from now on.
+	virtual void setFields(EventField fields) = 0;
+
+	virtual SysErr close() = 0;
+};
+
+// The default source for the platform, EvtSubscribe on Windows. There's no
+// Event Log service to subscribe to elsewhere, so it throws 
+// ERROR_NOT_SUPPORTED.
+Ref<ISubscriptionSource> createDefaultSubscriptionSource();
+
+}
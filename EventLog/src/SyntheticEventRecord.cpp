@@ -0,0 +1,172 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "SyntheticEventRecord.h"
+
+namespace Windows::EventLog
+{
+
+Ref<SyntheticEventRecord> SyntheticEventRecord::create(SyntheticEventData data)
+{
+	return RefObject<SyntheticEventRecord>::createRef(std::move(data));
+}
+
+SyntheticEventRecord::SyntheticEventRecord(SyntheticEventData data)
+	: mData(std::move(data))
+{}
+
+std::optional<std::string> SyntheticEventRecord::getProviderName() const
+{
+	return mData.providerName;
+}
+
+std::optional<GUID> SyntheticEventRecord::getProviderGuid() const
+{
+	return mData.providerGuid;
+}
+
+std::optional<uint16_t> SyntheticEventRecord::getEventId() const
+{
+	return mData.eventId;
+}
+
+std::optional<uint16_t> SyntheticEventRecord::getQualifers() const
+{
+	return mData.qualifiers;
+}
+
+std::optional<uint8_t> SyntheticEventRecord::getLevel() const
+{
+	return mData.level;
+}
+
+std::optional<uint16_t> SyntheticEventRecord::getTask() const
+{
+	return mData.task;
+}
+
+std::optional<uint8_t> SyntheticEventRecord::getOpcode() const
+{
+	return mData.opcode;
+}
+
+std::optional<int64_t> SyntheticEventRecord::getKeywords() const
+{
+	return mData.keywords;
+}
+
+std::optional<Timestamp> SyntheticEventRecord::getTimeCreated() const
+{
+	return Timestamp{ mData.timeCreated };
+}
+
+std::optional<uint64_t> SyntheticEventRecord::getRecordId() const
+{
+	return mData.recordId;
+}
+
+std::optional<GUID> SyntheticEventRecord::getActivityId() const
+{
+	return mData.activityId;
+}
+
+std::optional<uint32_t> SyntheticEventRecord::getProcessId() const
+{
+	return mData.processId;
+}
+
+std::optional<uint32_t> SyntheticEventRecord::getThreadId() const
+{
+	return mData.threadId;
+}
+
+std::optional<std::string> SyntheticEventRecord::getChannel() const
+{
+	return mData.channel;
+}
+
+std::optional<std::string> SyntheticEventRecord::getComputer() const
+{
+	return mData.computer;
+}
+
+std::optional<std::string> SyntheticEventRecord::getUser() const
+{
+	return mData.user;
+}
+
+std::optional<uint8_t> SyntheticEventRecord::getVersion() const
+{
+	return mData.version;
+}
+
+std::string SyntheticEventRecord::getMessage() const
+{
+	return mData.message;
+}
+
+std::string SyntheticEventRecord::getLevelDisplay() const
+{
+	return mData.levelDisplay;
+}
+
+std::string SyntheticEventRecord::getTaskDisplay() const
+{
+	return mData.taskDisplay;
+}
+
+std::string SyntheticEventRecord::getOpcodeDisplay() const
+{
+	return mData.opcodeDisplay;
+}
+
+std::vector<std::string> SyntheticEventRecord::getKeywordsDisplay() const
+{
+	return mData.keywordsDisplay;
+}
+
+std::string SyntheticEventRecord::getChannelMessage() const
+{
+	return mData.channelMessage;
+}
+
+std::string SyntheticEventRecord::getProviderMessage() const
+{
+	return mData.providerMessage;
+}
+
+std::vector<EventProperty> SyntheticEventRecord::getProperties() const
+{
+	return mData.properties;
+}
+
+std::optional<EventPropertyValue> SyntheticEventRecord::getProperty(const std::string &name) const
+{
+	for (const EventProperty &property : mData.properties)
+	{
+		if (property.name == name)
+			return property.value;
+	}
+	return {};
+}
+
+}
@@ -0,0 +1,108 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IEventRecord.h"
+
+namespace Windows::EventLog
+{
+
+// Rendered values of a synthetic record.
+struct SyntheticEventData
+{
+	std::string providerName{};
+	GUID providerGuid{};
+	uint16_t eventId{};
+	std::optional<uint16_t> qualifiers{};
+	uint8_t level{};
+	uint16_t task{};
+	uint8_t opcode{};
+	int64_t keywords{};
+	uint64_t timeCreated{};
+	uint64_t recordId{};
+	std::optional<GUID> activityId{};
+	uint32_t processId{};
+	uint32_t threadId{};
+	std::string channel{};
+	std::string computer{};
+	std::optional<std::string> user{};
+	uint8_t version{};
+
+	std::string message{};
+	std::string levelDisplay{};
+	std::string taskDisplay{};
+	std::string opcodeDisplay{};
+	std::vector<std::string> keywordsDisplay{};
+	std::string channelMessage{};
+	std::string providerMessage{};
+
+	std::vector<EventProperty> properties{};
+};
+
+// Event record produced by SyntheticRecordSource.
+class SyntheticEventRecord : public IEventRecord
+{
+public:
+	friend class RefObject<SyntheticEventRecord>;
+
+	static Ref<SyntheticEventRecord> create(SyntheticEventData data);
+
+	~SyntheticEventRecord() = default;
+
+	std::optional<std::string> getProviderName() const override;
+	std::optional<GUID> getProviderGuid() const override;
+	std::optional<uint16_t> getEventId() const override;
+	std::optional<uint16_t> getQualifers() const override;
+	std::optional<uint8_t> getLevel() const override;
+	std::optional<uint16_t> getTask() const override;
+	std::optional<uint8_t> getOpcode() const override;
+	std::optional<int64_t> getKeywords() const override;
+	std::optional<Timestamp> getTimeCreated() const override;
+	std::optional<uint64_t> getRecordId() const override;
+	std::optional<GUID> getActivityId() const override;
+	std::optional<uint32_t> getProcessId() const override;
+	std::optional<uint32_t> getThreadId() const override;
+	std::optional<std::string> getChannel() const override;
+	std::optional<std::string> getComputer() const override;
+	std::optional<std::string> getUser() const override;
+	std::optional<uint8_t> getVersion() const override;
+	std::string getMessage() const override;
+	std::string getLevelDisplay() const override;
+	std::string getTaskDisplay() const override;
+	std::string getOpcodeDisplay() const override;
+	std::vector<std::string> getKeywordsDisplay() const override;
+	std::string getChannelMessage() const override;
+	std::string getProviderMessage() const override;
+	std::vector<EventProperty> getProperties() const override;
+	std::optional<EventPropertyValue> getProperty(const std::string &name) const override;
+
+private:
+	explicit SyntheticEventRecord(SyntheticEventData data);
+
+	SyntheticEventData mData;
+
+	SyntheticEventRecord(const SyntheticEventRecord &) = delete;
+	SyntheticEventRecord &operator=(const SyntheticEventRecord &) = delete;
+};
+
+}
@@ -0,0 +1,906 @@
+/*
+Copyright (C) 2022-2023 Patrick Griffiths
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software. If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "SyntheticRecordSource.h"
+
+#include "EventBatch.h"
+#include "MessageTemplate.h"
+#include "MetadataCatalog.h"
+#include "SyntheticEventRecord.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+//
+// Catalog of providers and events the generator draws from. Weights are 
+// relative within their table.
+//
+
+enum class ArgKind : uint8_t
+{
+	User,
+	LogonType,
+	LogonId,
+	ProcessPath,
+	IpAddress,
+	Service,
+	ServiceState,
+	StartType,
+	Count,
+	ErrorCode,
+	Time,
+	HivePath,
+	Update,
+	Application,
+	Version,
+	Guid,
+	Sid,
+	TaskName,
+	Product
+};
+
+struct SyntheticEventDef
+{
+	uint16_t id;
+	uint8_t version;
+	uint8_t level;
+	uint16_t task;
+	uint8_t opcode;
+	uint64_t keywords;
+	uint32_t weight;
+	const char *channel;
+	const char *taskName;
+	const char *opcodeName;
+	const char *keywordName;
+	const char *message;
+	std::vector<ArgKind> args;
+};
+
+struct SyntheticProviderDef
+{
+	const char *name;
+	GUID guid;
+	uint32_t weight;
+	uint32_t processId;
+	bool hasUser;
+	std::vector<SyntheticEventDef> events;
+};
+
+struct SyntheticCatalog
+{
+	// Size of the sampling table. Power of 2 so sampling is a mask.
+	static constexpr uint32_t TableSize = 4096;
+
+	struct Entry
+	{
+		uint16_t provider;
+		uint16_t event;
+	};
+
+	std::vector<SyntheticProviderDef> providers;
+	std::vector<Entry> table;
+
+	// Compiled messages, by provider then event.
+	std::vector<std::vector<MessageTemplate>> messages;
+};
+
+static constexpr uint64_t KeywordAuditSuccess = 0x8020000000000000ull;
+static constexpr uint64_t KeywordAuditFailure = 0x8010000000000000ull;
+static constexpr uint64_t KeywordClassic = 0x0080000000000000ull;
+static constexpr uint64_t KeywordOperational = 0x4000000000000000ull;
+
+static std::vector<SyntheticProviderDef> makeProviders()
+{
+	using A = ArgKind;
+	return {
+		{ "Microsoft-Windows-Security-Auditing", { 0x54849625, 0x5478, 0x4994, { 0xa5, 0xba, 0x3e, 0x3b, 0x03, 0x28, 0xc3, 0x0d } }, 450, 744, false, {
+			{ 4624, 2, 0, 12544, 0, KeywordAuditSuccess, 40, "Security", "Logon", "Info", "Audit Success",
+				"An account was successfully logged on.\r\n\r\nSubject:\r\n\tAccount Name:\t\t%1\r\n\r\nLogon Information:\r\n\tLogon Type:\t\t%2\r\n\tNew Logon ID:\t\t%3\r\n\r\nProcess Information:\r\n\tProcess Name:\t\t%4\r\n\r\nNetwork Information:\r\n\tSource Network Address:\t%5",
+				{ A::User, A::LogonType, A::LogonId, A::ProcessPath, A::IpAddress } },
+			{ 4625, 0, 0, 12544, 0, KeywordAuditFailure, 3, "Security", "Logon", "Info", "Audit Failure",
+				"An account failed to log on.\r\n\r\nAccount For Which Logon Failed:\r\n\tAccount Name:\t\t%1\r\n\r\nFailure Information:\r\n\tStatus:\t\t\t%2\r\n\tLogon Type:\t\t%3\r\n\r\nNetwork Information:\r\n\tSource Network Address:\t%4",
+				{ A::User, A::ErrorCode, A::LogonType, A::IpAddress } },
+			{ 4634, 0, 0, 12545, 0, KeywordAuditSuccess, 25, "Security", "Logoff", "Info", "Audit Success",
+				"An account was logged off.\r\n\r\nSubject:\r\n\tAccount Name:\t\t%1\r\n\tLogon ID:\t\t%2\r\n\r\nLogon Type:\t\t\t%3",
+				{ A::User, A::LogonId, A::LogonType } },
+			{ 4672, 0, 0, 12548, 0, KeywordAuditSuccess, 20, "Security", "Special Logon", "Info", "Audit Success",
+				"Special privileges assigned to new logon.\r\n\r\nSubject:\r\n\tAccount Name:\t\t%1\r\n\tLogon ID:\t\t%2\r\n\r\nPrivileges:\t\tSeSecurityPrivilege\r\n\t\t\tSeBackupPrivilege\r\n\t\t\tSeRestorePrivilege",
+				{ A::User, A::LogonId } },
+			{ 4688, 2, 0, 13312, 0, KeywordAuditSuccess, 12, "Security", "Process Creation", "Info", "Audit Success",
+				"A new process has been created.\r\n\r\nCreator Subject:\r\n\tAccount Name:\t\t%1\r\n\tLogon ID:\t\t%2\r\n\r\nProcess Information:\r\n\tNew Process Name:\t%3\r\n\tCreator Process Name:\t%4",
+				{ A::User, A::LogonId, A::ProcessPath, A::ProcessPath } },
+		} },
+		{ "Service Control Manager", { 0x555908d1, 0xa6d7, 0x4695, { 0x8e, 0x1e, 0x26, 0x93, 0x1d, 0x20, 0x12, 0xf4 } }, 120, 696, false, {
+			{ 7036, 0, 4, 0, 0, KeywordClassic, 70, "System", "None", "Info", "Classic",
+				"The %1 service entered the %2 state.",
+				{ A::Service, A::ServiceState } },
+			{ 7040, 0, 4, 0, 0, KeywordClassic, 20, "System", "None", "Info", "Classic",
+				"The start type of the %1 service was changed from %2 to %3.",
+				{ A::Service, A::StartType, A::StartType } },
+			{ 7000, 0, 2, 0, 0, KeywordClassic, 7, "System", "None", "Info", "Classic",
+				"The %1 service failed to start due to the following error: \r\n%2",
+				{ A::Service, A::ErrorCode } },
+			{ 7031, 0, 1, 0, 0, KeywordClassic, 3, "System", "None", "Info", "Classic",
+				"The %1 service terminated unexpectedly.  It has done this %2 time(s).",
+				{ A::Service, A::Count } },
+		} },
+		{ "Microsoft-Windows-TaskScheduler", { 0xde7b24ea, 0x73c8, 0x4a09, { 0x98, 0x5d, 0x5b, 0xda, 0xdc, 0xfa, 0x90, 0x17 } }, 80, 1620, true, {
+			{ 100, 0, 4, 100, 1, KeywordOperational, 35, "Microsoft-Windows-TaskScheduler/Operational", "Task Started", "Start", "Operational",
+				"Task Scheduler started \"%1\" instance of the \"%2\" task for user \"%3\".",
+				{ A::Guid, A::TaskName, A::User } },
+			{ 102, 0, 4, 102, 2, KeywordOperational, 35, "Microsoft-Windows-TaskScheduler/Operational", "Task completed", "Stop", "Operational",
+				"Task Scheduler successfully finished \"%1\" instance of the \"%2\" task for user \"%3\".",
+				{ A::Guid, A::TaskName, A::User } },
+			{ 201, 0, 4, 201, 2, KeywordOperational, 30, "Microsoft-Windows-TaskScheduler/Operational", "Action completed", "Stop", "Operational",
+				"Task Scheduler successfully completed task \"%1\" , instance \"%2\" , action \"%3\" with return code %4.",
+				{ A::TaskName, A::Guid, A::ProcessPath, A::Count } },
+		} },
+		{ "Microsoft-Windows-DistributedCOM", { 0x1b562e86, 0xb7aa, 0x4131, { 0xba, 0xdc, 0xb6, 0xf3, 0xa0, 0x01, 0x40, 0x7e } }, 60, 1084, true, {
+			{ 10016, 0, 3, 0, 0, KeywordClassic, 100, "System", "None", "Info", "Classic",
+				"The application-specific permission settings do not grant Local Activation permission for the COM Server application with CLSID \r\n%1\r\n to the user %2 SID (%3). This security permission can be modified using the Component Services administrative tool.",
+				{ A::Guid, A::User, A::Sid } },
+		} },
+		{ "Microsoft-Windows-Kernel-General", { 0xa68ca8b7, 0x004f, 0xd7b6, { 0xa6, 0x98, 0x07, 0xe2, 0xde, 0x0f, 0x1f, 0x5d } }, 40, 4, false, {
+			{ 1, 1, 4, 1, 0, KeywordClassic, 50, "System", "None", "Info", "Time",
+				"The system time has changed to %1 from %2.",
+				{ A::Time, A::Time } },
+			{ 16, 0, 4, 0, 0, KeywordClassic, 50, "System", "None", "Info", "Classic",
+				"The access history in hive %1 was cleared updating %2 keys and creating %3 modified pages.",
+				{ A::HivePath, A::Count, A::Count } },
+		} },
+		{ "Microsoft-Windows-GroupPolicy", { 0xaea1b4fa, 0x97d1, 0x45f2, { 0xa6, 0x4c, 0x4d, 0x69, 0xff, 0xfd, 0x92, 0xc9 } }, 40, 1304, true, {
+			{ 1500, 0, 4, 0, 0, KeywordOperational, 60, "System", "None", "Info", "Operational",
+				"The Group Policy settings for the computer were processed successfully. There were no changes detected since the last successful processing of Group Policy.",
+				{ } },
+			{ 1502, 0, 4, 0, 0, KeywordOperational, 40, "System", "None", "Info", "Operational",
+				"The Group Policy settings for the user were processed successfully. New settings from %1 Group Policy objects were detected and applied.",
+				{ A::Count } },
+		} },
+		{ "Microsoft-Windows-WindowsUpdateClient", { 0x945a8954, 0xc147, 0x4acd, { 0x92, 0x3f, 0x40, 0xc4, 0x54, 0x05, 0xa6, 0x58 } }, 30, 3212, false, {
+			{ 19, 1, 4, 1, 13, KeywordOperational, 60, "System", "Windows Update Agent", "Installation", "Installation",
+				"Installation Successful: Windows successfully installed the following update: %1",
+				{ A::Update } },
+			{ 20, 1, 2, 1, 13, KeywordOperational, 10, "System", "Windows Update Agent", "Installation", "Installation",
+				"Installation Failure: Windows failed to install the following update with error %2: %1.",
+				{ A::Update, A::ErrorCode } },
+			{ 43, 1, 4, 1, 12, KeywordOperational, 30, "System", "Windows Update Agent", "Installation", "Installation",
+				"Installation Started: Windows has started installing the following update: %1",
+				{ A::Update } },
+		} },
+		{ "Microsoft-Windows-Winlogon", { 0xdbe9b383, 0x7cf3, 0x4331, { 0x91, 0xcc, 0xa3, 0xcb, 0x16, 0xa3, 0xb5, 0x38 } }, 30, 612, true, {
+			{ 7001, 0, 4, 1101, 0, KeywordOperational, 50, "System", "None", "Info", "Operational",
+				"User Logon Notification for Customer Experience Improvement Program",
+				{ } },
+			{ 7002, 0, 4, 1102, 0, KeywordOperational, 50, "System", "None", "Info", "Operational",
+				"User Logoff Notification for Customer Experience Improvement Program",
+				{ } },
+		} },
+		{ "Microsoft-Windows-Kernel-Power", { 0x331c3b3a, 0x2005, 0x44c2, { 0xac, 0x5e, 0x77, 0x22, 0x0c, 0x37, 0xd6, 0xb4 } }, 20, 4, false, {
+			{ 42, 3, 4, 64, 0, KeywordOperational, 45, "System", "None", "Info", "Operational",
+				"The system is entering sleep.\r\n\r\nSleep Reason: %1",
+				{ A::Count } },
+			{ 107, 0, 4, 102, 0, KeywordOperational, 50, "System", "None", "Info", "Operational",
+				"The system has resumed from sleep.",
+				{ } },
+			{ 41, 8, 1, 63, 0, KeywordOperational, 5, "System", "None", "Info", "Operational",
+				"The system has rebooted without cleanly shutting down first. This error could be caused if the system stopped responding, crashed, or lost power unexpectedly.",
+				{ } },
+		} },
+		{ "Application Error", { 0xa0e9b465, 0xb939, 0x57d7, { 0xb2, 0x7d, 0x95, 0xd8, 0xe2, 0xcb, 0x28, 0xfc } }, 15, 5188, false, {
+			{ 1000, 0, 2, 100, 0, KeywordClassic, 100, "Application", "Application Crashing Events", "Info", "Classic",
+				"Faulting application name: %1, version: %2\r\nFaulting module name: %1, version: %2\r\nException code: %3\r\nFaulting application path: %4",
+				{ A::Application, A::Version, A::ErrorCode, A::ProcessPath } },
+		} },
+		{ "MsiInstaller", { 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } }, 10, 4268, true, {
+			{ 11707, 0, 4, 0, 0, KeywordClassic, 85, "Application", "None", "Info", "Classic",
+				"Product: %1 -- Installation completed successfully.",
+				{ A::Product } },
+			{ 11708, 0, 2, 0, 0, KeywordClassic, 15, "Application", "None", "Info", "Classic",
+				"Product: %1 -- Installation operation failed.",
+				{ A::Product } },
+		} },
+	};
+}
+
+static std::shared_ptr<const SyntheticCatalog> makeCatalog()
+{
+	auto catalog = std::make_shared<SyntheticCatalog>();
+	catalog->providers = makeProviders();
+
+	for (const SyntheticProviderDef &provider : catalog->providers)
+	{
+		std::vector<MessageTemplate> messages;
+		for (const SyntheticEventDef &e : provider.events)
+			messages.push_back(MessageTemplate::parse(e.message).value());
+		catalog->messages.push_back(std::move(messages));
+	}
+
+	// Expand provider weight * event weight into a table of entries so 
+	// sampling is a single lookup. 
+	std::vector<std::pair<SyntheticCatalog::Entry, double>> weights;
+	double total = 0.0;
+	for (size_t p = 0; p < catalog->providers.size(); ++p)
+	{
+		const SyntheticProviderDef &provider = catalog->providers[p];
+		uint32_t providerTotal = 0;
+		for (const SyntheticEventDef &e : provider.events)
+			providerTotal += e.weight;
+
+		for (size_t e = 0; e < provider.events.size(); ++e)
+		{
+			double w = double(provider.weight) * provider.events[e].weight / providerTotal;
+			weights.push_back({ { uint16_t(p), uint16_t(e) }, w });
+			total += w;
+		}
+	}
+
+	catalog->table.reserve(SyntheticCatalog::TableSize);
+	double acc = 0.0;
+	for (const auto &w : weights)
+	{
+		acc += w.second;
+		size_t end = std::min<size_t>(SyntheticCatalog::TableSize, size_t(acc / total * SyntheticCatalog::TableSize + 0.5));
+		// Every event gets at least one slot.
+		end = std::max<size_t>(end, catalog->table.size() + 1);
+		while (catalog->table.size() < end && catalog->table.size() < SyntheticCatalog::TableSize)
+			catalog->table.push_back(w.first);
+	}
+	while (catalog->table.size() < SyntheticCatalog::TableSize)
+		catalog->table.push_back(weights.back().first);
+
+	return catalog;
+}
+
+static std::shared_ptr<const SyntheticCatalog> getCatalog()
+{
+	static std::shared_ptr<const SyntheticCatalog> catalog = makeCatalog();
+	return catalog;
+}
+
+//
+// Record generation.
+//
+
+// splitmix64. Cheap, stateless and good enough for field distributions.
+static inline uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// 2023-01-01 00:00:00 UTC as 100ns ticks since 1601. 
+static constexpr uint64_t BaseTimestamp = 133170048000000000ull;
+
+// Mean interval between records, 250ms. 
+static constexpr uint64_t RecordInterval = 2500000ull;
+
+static const char *const Users[] = {
+	"SYSTEM", "LOCAL SERVICE", "NETWORK SERVICE", "Administrator", "svc_backup", 
+	"svc_sql", "jsmith", "adoe", "mlee", "kpatel", "DWM-1", "UMFD-0"
+};
+
+static const char *const Domains[] = {
+	"NT AUTHORITY", "NT AUTHORITY", "NT AUTHORITY", "CORP", "CORP", 
+	"CORP", "CORP", "CORP", "CORP", "CORP", "Window Manager", "Font Driver Host"
+};
+
+static const char *const Sids[] = {
+	"S-1-5-18", "S-1-5-19", "S-1-5-20", "S-1-5-21-3623811015-3361044348-30300820-500",
+	"S-1-5-21-3623811015-3361044348-30300820-1104", "S-1-5-21-3623811015-3361044348-30300820-1105",
+	"S-1-5-21-3623811015-3361044348-30300820-1113", "S-1-5-21-3623811015-3361044348-30300820-1121",
+	"S-1-5-21-3623811015-3361044348-30300820-1137", "S-1-5-21-3623811015-3361044348-30300820-1142",
+	"S-1-5-90-0-1", "S-1-5-96-0-0"
+};
+
+static const char *const ProcessPaths[] = {
+	"C:\\Windows\\System32\\svchost.exe", "C:\\Windows\\System32\\lsass.exe", 
+	"C:\\Windows\\System32\\services.exe", "C:\\Windows\\System32\\winlogon.exe",
+	"C:\\Windows\\explorer.exe", "C:\\Windows\\System32\\cmd.exe",
+	"C:\\Windows\\System32\\WindowsPowerShell\\v1.0\\powershell.exe", 
+	"C:\\Program Files\\Microsoft SQL Server\\MSSQL15.MSSQLSERVER\\MSSQL\\Binn\\sqlservr.exe",
+	"C:\\Windows\\System32\\taskhostw.exe", "C:\\Windows\\System32\\conhost.exe"
+};
+
+static const char *const Services[] = {
+	"Windows Update", "Background Intelligent Transfer Service", "Windows Modules Installer",
+	"Print Spooler", "Windows Defender Antivirus Service", "WinHTTP Web Proxy Auto-Discovery Service",
+	"Software Protection", "Microsoft Store Install Service", "Delivery Optimization", 
+	"SQL Server (MSSQLSERVER)", "Windows Error Reporting Service", "Volume Shadow Copy"
+};
+
+static const char *const ServiceStates[] = { "running", "stopped" };
+
+static const char *const StartTypes[] = { "auto start", "demand start", "disabled" };
+
+static const char *const Hives[] = {
+	"\\??\\C:\\Windows\\System32\\config\\SOFTWARE", "\\??\\C:\\Windows\\System32\\config\\SYSTEM",
+	"\\SystemRoot\\System32\\Config\\DEFAULT", "\\??\\C:\\Users\\jsmith\\ntuser.dat"
+};
+
+static const char *const Updates[] = {
+	"Security Intelligence Update for Microsoft Defender Antivirus - KB2267602 (Version 1.381.3595.0)",
+	"2023-01 Cumulative Update for Windows Server 2019 (1809) for x64-based Systems (KB5022286)",
+	"2023-01 Cumulative Update for .NET Framework 3.5, 4.7.2 and 4.8 for Windows Server 2019 for x64 (KB5022511)",
+	"Windows Malicious Software Removal Tool x64 - v5.109 (KB890830)"
+};
+
+static const char *const Applications[] = { "sqlservr.exe", "explorer.exe", "w3wp.exe", "backup.exe", "MsMpEng.exe" };
+
+static const char *const Tasks[] = {
+	"\\Microsoft\\Windows\\UpdateOrchestrator\\Schedule Scan", "\\Microsoft\\Windows\\Defrag\\ScheduledDefrag",
+	"\\Microsoft\\Windows\\WindowsUpdate\\Scheduled Start", "\\CorpBackup\\Nightly", 
+	"\\Microsoft\\Windows\\Application Experience\\ProgramDataUpdater"
+};
+
+static const char *const Products[] = {
+	"Microsoft Visual C++ 2019 X64 Minimum Runtime - 14.29.30133", "Microsoft Edge", 
+	"CorpBackup Agent", "Microsoft ODBC Driver 17 for SQL Server"
+};
+
+static const char *const LogonTypes[] = { "2", "3", "3", "3", "5", "5", "7", "10" };
+
+static const char *const Computers[] = {
+	"DC01.corp.example.com", "SQL01.corp.example.com", "WEB01.corp.example.com", 
+	"WEB02.corp.example.com", "FS01.corp.example.com"
+};
+
+template<typename T, size_t N>
+static constexpr size_t countOf(T (&)[N]) { return N; }
+
+template<typename T, size_t N>
+static const T &pick(T (&a)[N], uint64_t h)
+{
+	return a[h % N];
+}
+
+static std::string to_hex(uint64_t value, int width)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string s(size_t(width) + 2, '0');
+	s[1] = 'x';
+	for (int i = width + 1; i >= 2; --i)
+	{
+		s[size_t(i)] = digits[value & 0xf];
+		value >>= 4;
+	}
+	return s;
+}
+
+static GUID makeGuid(uint64_t h1, uint64_t h2)
+{
+	GUID g{};
+	g.Data1 = uint32_t(h1);
+	g.Data2 = uint16_t(h1 >> 32);
+	g.Data3 = uint16_t(((h1 >> 48) & 0x0fff) | 0x4000);
+	for (int i = 0; i < 8; ++i)
+		g.Data4[i] = uint8_t(h2 >> (i * 8));
+	g.Data4[0] = uint8_t((g.Data4[0] & 0x3f) | 0x80);
+	return g;
+}
+
+static std::string makeArg(ArgKind kind, uint64_t h, uint64_t timestamp)
+{
+	switch (kind)
+	{
+	case ArgKind::User: return pick(Users, h);
+	case ArgKind::LogonType: return pick(LogonTypes, h);
+	case ArgKind::LogonId: return to_hex(h & 0xffffff, 8);
+	case ArgKind::ProcessPath: return pick(ProcessPaths, h);
+	case ArgKind::IpAddress: return "10.0." + std::to_string((h >> 8) % 16) + "." + std::to_string(h % 254 + 1);
+	case ArgKind::Service: return pick(Services, h);
+	case ArgKind::ServiceState: return pick(ServiceStates, h);
+	case ArgKind::StartType: return pick(StartTypes, h);
+	case ArgKind::Count: return std::to_string(h % 64);
+	case ArgKind::ErrorCode: return to_hex(0xc0000000u | (h & 0xffff), 8);
+	case ArgKind::Time: return Windows::to_string(Timestamp{ timestamp - (h % 10000) });
+	case ArgKind::HivePath: return pick(Hives, h);
+	case ArgKind::Update: return pick(Updates, h);
+	case ArgKind::Application: return pick(Applications, h);
+	case ArgKind::Version: return "10.0." + std::to_string(17763 + h % 4) + "." + std::to_string(h % 5000);
+	case ArgKind::Guid: return Windows::to_string(makeGuid(h, mix(h)));
+	case ArgKind::Sid: return pick(Sids, h);
+	case ArgKind::TaskName: return pick(Tasks, h);
+	case ArgKind::Product: return pick(Products, h);
+	default: return {};
+	}
+}
+
+// Property names by ArgKind.
+static const char *const ArgNames[] = {
+	"TargetUserName", "LogonType", "TargetLogonId", "ProcessName", "IpAddress", "ServiceName",
+	"State", "StartType", "Count", "Status", "Time", "HiveName", "UpdateTitle", "Application", 
+	"Version", "Guid", "Sid", "TaskName", "Product"
+};
+static_assert(countOf(ArgNames) == size_t(ArgKind::Product) + 1, "One name per ArgKind");
+
+// The argument as a payload property value, typed like the real event's.
+static EventPropertyValue argValue(ArgKind kind, uint64_t h, uint64_t timestamp)
+{
+	switch (kind)
+	{
+	case ArgKind::LogonType: return uint64_t(std::stoul(pick(LogonTypes, h)));
+	case ArgKind::LogonId: return uint64_t(h & 0xffffff);
+	case ArgKind::Count: return uint64_t(h % 64);
+	case ArgKind::ErrorCode: return uint64_t(0xc0000000u | (h & 0xffff));
+	case ArgKind::Time: return Timestamp{ timestamp - (h % 10000) };
+	case ArgKind::Guid: return makeGuid(h, mix(h));
+	default: return makeArg(kind, h, timestamp);
+	}
+}
+
+// Names the event's properties after their kind, numbering repeats.
+static std::string argName(const std::vector<ArgKind> &args, size_t index)
+{
+	std::string name = ArgNames[size_t(args[index])];
+	size_t repeat = size_t(std::count(args.begin(), args.begin() + ptrdiff_t(index), args[index]));
+	if (repeat > 0)
+		name += std::to_string(repeat + 1);
+	return name;
+}
+
+static const char *levelName(uint8_t level)
+{
+	switch (level)
+	{
+	case 1: return "Critical";
+	case 2: return "Error";
+	case 3: return "Warning";
+	case 5: return "Verbose";
+	default: return "Information";
+	}
+}
+
+// What a record's fields are derived from, drawn from its index.
+struct RecordDraw
+{
+	uint16_t provider;
+	uint16_t event;
+	uint64_t h2;
+	uint64_t timeCreated;
+};
+
+static RecordDraw drawRecord(const SyntheticCatalog &catalog, uint64_t seed, uint64_t index)
+{
+	uint64_t h = mix(seed ^ mix(index));
+	const SyntheticCatalog::Entry &entry = catalog.table[h & (SyntheticCatalog::TableSize - 1)];
+
+	RecordDraw draw{};
+	draw.provider = entry.provider;
+	draw.event = entry.event;
+	draw.h2 = mix(h);
+	draw.timeCreated = BaseTimestamp + index * RecordInterval + (mix(h) % RecordInterval);
+	return draw;
+}
+
+static uint32_t drawProcessId(const SyntheticProviderDef &provider, uint64_t h2)
+{
+	return provider.processId != 0 ? provider.processId : uint32_t(4 * (1 + (h2 >> 16) % 4096));
+}
+
+static uint32_t drawThreadId(uint64_t h2)
+{
+	return uint32_t(4 * (1 + (h2 >> 32) % 8192));
+}
+
+// "DOMAIN\user" into user.
+static void drawUser(uint64_t h2, std::string &user)
+{
+	size_t u = size_t((h2 >> 24) % countOf(Users));
+	user.assign(Domains[u]).append("\\").append(Users[u]);
+}
+
+// Renders the record at the given index of the log. Only the string fields
+// cost anything, so those are skipped if not wanted.
+static Ref<IEventRecord> renderRecord(const SyntheticCatalog &catalog, uint64_t seed, uint64_t index, EventField fields)
+{
+	const RecordDraw draw = drawRecord(catalog, seed, index);
+	const SyntheticProviderDef &provider = catalog.providers[draw.provider];
+	const SyntheticEventDef &event = provider.events[draw.event];
+	const uint64_t h2 = draw.h2;
+
+	SyntheticEventData d{};
+	if (hasAnyField(fields, EventField::ProviderName))
+		d.providerName = provider.name;
+	d.providerGuid = provider.guid;
+	d.eventId = event.id;
+	d.qualifiers = 0;
+	d.level = event.level;
+	d.task = event.task;
+	d.opcode = event.opcode;
+	// Same masking as EventRecord.
+	d.keywords = int64_t(event.keywords & 0x0000FFFFFFFFFFFFull);
+	d.timeCreated = draw.timeCreated;
+	d.recordId = index + 1;
+
+	if ((h2 % 5) == 0)
+		d.activityId = makeGuid(h2, mix(h2));
+
+	d.processId = drawProcessId(provider, h2);
+	d.threadId = drawThreadId(h2);
+	if (hasAnyField(fields, EventField::Channel))
+		d.channel = event.channel;
+	if (hasAnyField(fields, EventField::Computer))
+		d.computer = pick(Computers, h2 >> 8);
+	if (provider.hasUser && hasAnyField(fields, EventField::User))
+	{
+		d.user.emplace();
+		drawUser(h2, *d.user);
+	}
+	d.version = event.version;
+
+	if (hasAnyField(fields, EventField::Message))
+	{
+		std::vector<std::string> args;
+		args.reserve(event.args.size());
+		uint64_t ha = h2;
+		for (ArgKind kind : event.args)
+		{
+			ha = mix(ha);
+			args.push_back(makeArg(kind, ha, d.timeCreated));
+		}
+
+		d.message = catalog.messages[draw.provider][draw.event].format(args);
+	}
+
+	if (hasAnyField(fields, EventField::Properties))
+	{
+		d.properties.reserve(event.args.size());
+		uint64_t ha = h2;
+		for (size_t i = 0; i < event.args.size(); ++i)
+		{
+			ha = mix(ha);
+			d.properties.push_back({ argName(event.args, i), argValue(event.args[i], ha, d.timeCreated) });
+		}
+	}
+
+	if (hasAnyField(fields, EventField::Display))
+	{
+		d.levelDisplay = levelName(event.level);
+		d.taskDisplay = event.taskName;
+		d.opcodeDisplay = event.opcodeName;
+		d.keywordsDisplay.push_back(event.keywordName);
+		d.channelMessage = event.channel;
+		d.providerMessage = provider.name;
+	}
+
+	return SyntheticEventRecord::create(std::move(d));
+}
+
+// Appends the system fields of the record at the given index to the batch,
+// the same values renderRecord gives it. user is scratch space for the user
+// name, kept from one record to the next.
+static void appendRecord(const SyntheticCatalog &catalog, uint64_t seed, uint64_t index, EventField fields, 
+	EventBatch &batch, std::string &user)
+{
+	const RecordDraw draw = drawRecord(catalog, seed, index);
+	const SyntheticProviderDef &provider = catalog.providers[draw.provider];
+	const SyntheticEventDef &event = provider.events[draw.event];
+	const uint64_t h2 = draw.h2;
+
+	// Every record has the numbers. Unwanted strings are left out, like 
+	// renderRecord does.
+	EventBatch::Record r{};
+	r.fields = EventField::ProviderGuid | EventField::EventId | EventField::Qualifiers | EventField::Level | 
+		EventField::Task | EventField::Opcode | EventField::Keywords | EventField::TimeCreated | 
+		EventField::RecordId | EventField::ProcessId | EventField::ThreadId | EventField::Version |
+		(fields & (EventField::ProviderName | EventField::Channel | EventField::Computer));
+	r.providerName = provider.name;
+	r.providerGuid = provider.guid;
+	r.eventId = event.id;
+	r.level = event.level;
+	r.task = event.task;
+	r.opcode = event.opcode;
+	r.keywords = int64_t(event.keywords & 0x0000FFFFFFFFFFFFull);
+	r.timeCreated = draw.timeCreated;
+	r.recordId = index + 1;
+	if ((h2 % 5) == 0)
+	{
+		r.activityId = makeGuid(h2, mix(h2));
+		r.fields = r.fields | EventField::ActivityId;
+	}
+	r.processId = drawProcessId(provider, h2);
+	r.threadId = drawThreadId(h2);
+	r.channel = event.channel;
+	r.computer = pick(Computers, h2 >> 8);
+	if (provider.hasUser && hasAnyField(fields, EventField::User))
+	{
+		drawUser(h2, user);
+		r.user = user;
+		r.fields = r.fields | EventField::User;
+	}
+	r.version = event.version;
+	batch.append(r);
+}
+
+//
+// SyntheticBatch
+//
+
+class SyntheticBatch : public IQueryBatchResult
+{
+public:
+	friend class RefObject<SyntheticBatch>;
+
+	static Ref<SyntheticBatch> create(QueryNextStatus status)
+	{
+		return RefObject<SyntheticBatch>::createRef(status);
+	}
+
+	static Ref<SyntheticBatch> create(std::shared_ptr<const SyntheticCatalog> catalog, uint64_t seed, 
+		uint64_t recordCount, Direction dir, EventField fields, uint64_t first, uint32_t count)
+	{
+		return RefObject<SyntheticBatch>::createRef(std::move(catalog), seed, recordCount, dir, fields, first, count);
+	}
+
+	QueryNextStatus getStatus() const override { return mStatus; }
+
+	uint32_t getCount() const override { return mCount; }
+
+	Ref<IEventRecord> getRecord(uint32_t index) const override
+	{
+		if (index >= mCount)
+		{
+			THROW(IndexOutOfBoundsException);
+		}
+
+		uint64_t position = mFirst + index;
+		uint64_t recordIndex = mDirection == Direction::Forward ? position : mRecordCount - 1 - position;
+		return renderRecord(*mCatalog, mSeed, recordIndex, mFields);
+	}
+
+	Ref<IEventBatch> getEventBatch() const override
+	{
+		Ref<EventBatch> batch = EventBatch::create(mCount);
+		std::string user;
+		for (uint32_t i = 0; i < mCount; ++i)
+		{
+			uint64_t position = mFirst + i;
+			uint64_t recordIndex = mDirection == Direction::Forward ? position : mRecordCount - 1 - position;
+			appendRecord(*mCatalog, mSeed, recordIndex, mFields, batch.get(), user);
+		}
+		return batch;
+	}
+
+private:
+	explicit SyntheticBatch(QueryNextStatus status)
+		: mStatus(status)
+	{}
+
+	SyntheticBatch(std::shared_ptr<const SyntheticCatalog> catalog, uint64_t seed, uint64_t recordCount, 
+		Direction dir, EventField fields, uint64_t first, uint32_t count)
+		: mStatus(QueryNextStatus::Success)
+		, mCatalog(std::move(catalog))
+		, mSeed(seed)
+		, mRecordCount(recordCount)
+		, mDirection(dir)
+		, mFields(fields)
+		, mFirst(first)
+		, mCount(count)
+	{}
+
+	QueryNextStatus mStatus;
+	std::shared_ptr<const SyntheticCatalog> mCatalog{};
+	uint64_t mSeed = 0;
+	uint64_t mRecordCount = 0;
+	Direction mDirection = Direction::Forward;
+	EventField mFields = EventField::All;
+	uint64_t mFirst = 0;
+	uint32_t mCount = 0;
+};
+
+//
+// SyntheticRecordSource
+//
+
+Ref<SyntheticRecordSource> SyntheticRecordSource::create()
+{
+	return RefObject<SyntheticRecordSource>::createRef(Options{});
+}
+
+Ref<SyntheticRecordSource> SyntheticRecordSource::create(const Options &options)
+{
+	return RefObject<SyntheticRecordSource>::createRef(options);
+}
+
+SyntheticRecordSource::SyntheticRecordSource(const Options &options)
+	: mOptions(options)
+	, mCatalog(getCatalog())
+{}
+
+SyntheticRecordSource::~SyntheticRecordSource()
+{}
+
+std::vector<std::shared_ptr<const CatalogPublisher>> SyntheticRecordSource::getPublishers()
+{
+	// Adds the value unless it's already there.
+	auto add = [](std::vector<CatalogValue> &values, uint64_t value, const std::string &name)
+	{
+		auto same = [value](const CatalogValue &v) { return v.value == value; };
+		if (std::none_of(values.begin(), values.end(), same))
+			values.push_back({ value, name, name });
+	};
+
+	std::vector<std::shared_ptr<const CatalogPublisher>> publishers;
+	for (const SyntheticProviderDef &provider : getCatalog()->providers)
+	{
+		auto publisher = std::make_shared<CatalogPublisher>();
+		publisher->name = provider.name;
+		publisher->guid = provider.guid;
+		publisher->message = provider.name;
+
+		for (uint8_t level = 0; level <= 5; ++level)
+			add(publisher->levels, level, levelName(level));
+
+		for (const SyntheticEventDef &e : provider.events)
+		{
+			auto channel = [&e](const CatalogValue &v) { return v.name == e.channel; };
+			if (std::none_of(publisher->channels.begin(), publisher->channels.end(), channel))
+				publisher->channels.push_back({ publisher->channels.size(), e.channel, e.channel });
+			add(publisher->tasks, e.task, e.taskName);
+			add(publisher->opcodes, uint64_t(e.opcode) << 16, e.opcodeName);
+			add(publisher->keywords, e.keywords, e.keywordName);
+
+			CatalogEvent event{};
+			event.id = e.id;
+			event.version = e.version;
+			event.message = e.message;
+			for (size_t i = 0; i < e.args.size(); ++i)
+				event.dataNames.push_back(argName(e.args, i));
+			publisher->events.push_back(std::move(event));
+		}
+
+		std::sort(publisher->events.begin(), publisher->events.end(), [](const CatalogEvent &a, const CatalogEvent &b) {
+			return a.id != b.id ? a.id < b.id : a.version < b.version;
+		});
+		publishers.push_back(std::move(publisher));
+	}
+	return publishers;
+}
+
+void SyntheticRecordSource::open(Direction dir)
+{
+	mOpen = true;
+	mDirection = dir;
+	mCursor = 0;
+}
+
+void SyntheticRecordSource::queryChannelXPath(const std::string &, const std::string &, Direction dir)
+{
+	open(dir);
+}
+
+void SyntheticRecordSource::queryFileXPath(const std::string &, const std::string &, Direction dir)
+{
+	open(dir);
+}
+
+void SyntheticRecordSource::queryStructuredXML(const std::string &, Direction dir)
+{
+	open(dir);
+}
+
+Ref<IQueryBatchResult> SyntheticRecordSource::next(uint32_t batchSize, uint32_t)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	if (mOptions.nextLatencyMicros > 0)
+	{
+		std::unique_lock<std::mutex> lck(mCancelLock);
+		mCancelWake.wait_for(lck, std::chrono::microseconds(mOptions.nextLatencyMicros), 
+			[this] { return mCancelled.load(); });
+	}
+
+	if (mCancelled)
+	{
+		THROW_(SystemException, ERROR_CANCELLED);
+	}
+
+	if (mCursor >= mOptions.recordCount || batchSize == 0)
+	{
+		return SyntheticBatch::create(QueryNextStatus::NoMoreItems);
+	}
+
+	uint32_t count = uint32_t(std::min<uint64_t>(batchSize, mOptions.recordCount - mCursor));
+	uint64_t first = mCursor;
+	mCursor += count;
+
+	return SyntheticBatch::create(mCatalog, mOptions.seed, mOptions.recordCount, mDirection, mFields, first, count);
+}
+
+void SyntheticRecordSource::seek(int64_t position, SeekOption whence)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	// Same reference points as EvtSeek: the first record, the last record 
+	// or the last record read.
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SeekOption::RelativeToFirst:
+		base = 0;
+		break;
+	case SeekOption::RelativeToLast:
+		base = int64_t(mOptions.recordCount) - 1;
+		break;
+	case SeekOption::RelativeToCurrent:
+		base = int64_t(mCursor) - 1;
+		break;
+	}
+
+	int64_t target = base + position;
+	if (target < 0 || uint64_t(target) > mOptions.recordCount)
+	{
+		THROW_(SystemException, ERROR_INVALID_PARAMETER);
+	}
+	mCursor = uint64_t(target);
+}
+
+void SyntheticRecordSource::seek(const IBookmark &bookmark)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	// Record ids are the index plus one, so forward the record after the 
+	// bookmarked one is at its id and in reverse it's one before.
+	uint64_t recordId = getBookmarkedRecordId(bookmark);
+	if (mDirection == Direction::Forward)
+		mCursor = std::min(recordId, mOptions.recordCount);
+	else
+		mCursor = recordId > mOptions.recordCount ? 0 : mOptions.recordCount - recordId + 1;
+}
+
+void SyntheticRecordSource::setFields(EventField fields)
+{
+	mFields = fields;
+}
+
+SysErr SyntheticRecordSource::close()
+{
+	mOpen = false;
+	mCursor = 0;
+	return {};
+}
+
+void SyntheticRecordSource::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lck(mCancelLock);
+		mCancelled = true;
+	}
+	mCancelWake.notify_all();
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "RecordSource.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+struct CatalogPublisher;
+struct SyntheticCatalog;
+
+// In-memory record source that generates a log of records with field 
+// distributions modelled on a typical server: a few providers make up 
+// most of the volume, most events are informational, timestamps advance 
+// with jitter, and so on. Every record is a pure function of the seed and 
+// its index so seeking is O(1) and runs are repeatable.
+//
+// The synthetic log is a single stream: channel and file names are 
+// accepted but the query text is not evaluated.
+class SyntheticRecordSource : public IRecordSource
+{
+public:
+	friend class RefObject<SyntheticRecordSource>;
+
+	struct Options
+	{
+		// Number of records in the log.
+		uint64_t recordCount = 1000000u;
+
+		// Seed for the record generator.
+		uint64_t seed = 0x5eed;
+
+		// Simulated I/O latency of each next() call in microseconds.
+		uint32_t nextLatencyMicros = 0;
+	};
+
+	static Ref<SyntheticRecordSource> create();
+	static Ref<SyntheticRecordSource> create(const Options &options);
+
+	~SyntheticRecordSource();
+
+	// The synthetic providers as publisher metadata, e.g. for a catalog to 
+	// format an EVTX file written from this source with.
+	static std::vector<std::shared_ptr<const CatalogPublisher>> getPublishers();
+
+	void queryChannelXPath(const std::string &channel, const std::string &xpathQuery, Direction dir) override;
+	void queryFileXPath(const std::string &filePath, const std::string &xpathQuery, Direction dir) override;
+	void queryStructuredXML(const std::string &structuredXML, Direction dir) override;
+
+	Ref<IQueryBatchResult> next(uint32_t batchSize, uint32_t timeout) override;
+
+	void seek(int64_t position, SeekOption whence) override;
+	void seek(const IBookmark &bookmark) override;
+
+	void setFields(EventField fields) override;
+
+	SysErr close() override;
+
+	void cancel() override;
+
+	const Options &getOptions() const { return mOptions; }
+
+private:
+	explicit SyntheticRecordSource(const Options &options);
+
+	void open(Direction dir);
+
+	Options mOptions;
+	std::shared_ptr<const SyntheticCatalog> mCatalog;
+
+	bool mOpen = false;
+	Direction mDirection = Direction::Forward;
+	EventField mFields = EventField::All;
+
+	// Position, in query order, of the next record to return.
+	uint64_t mCursor = 0;
+
+	// Cuts the simulated latency short.
+	std::atomic<bool> mCancelled{ false };
+	std::mutex mCancelLock{};
+	std::condition_variable mCancelWake{};
+
+	SyntheticRecordSource(const SyntheticRecordSource &) = delete;
+	SyntheticRecordSource &operator=(const SyntheticRecordSource &) = delete;
+};
+
+}
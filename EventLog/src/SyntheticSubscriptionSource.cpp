@@ -0,0 +1,166 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "SyntheticSubscriptionSource.h"
+
+#include "Bookmark.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+namespace Windows::EventLog
+{
+
+// The log never runs out. Half the range, so positions still fit in an int64_t.
+static constexpr uint64_t LogSize = std::numeric_limits<uint64_t>::max() / 2;
+
+static constexpr uint64_t NanosPerSecond = 1000000000ull;
+
+Ref<SyntheticSubscriptionSource> SyntheticSubscriptionSource::create()
+{
+	return RefObject<SyntheticSubscriptionSource>::createRef(Options{});
+}
+
+Ref<SyntheticSubscriptionSource> SyntheticSubscriptionSource::create(const Options &options)
+{
+	return RefObject<SyntheticSubscriptionSource>::createRef(options);
+}
+
+SyntheticSubscriptionSource::SyntheticSubscriptionSource(const Options &options)
+	: mOptions(options)
+	, mStart(Clock::now())
+	, mLog(SyntheticRecordSource::create({ LogSize, options.seed, 0 }))
+{
+	mOptions.burstSize = std::max<uint32_t>(1, mOptions.burstSize);
+}
+
+uint64_t SyntheticSubscriptionSource::writtenBy(Clock::time_point time) const
+{
+	if (mOptions.recordsPerSecond == 0)
+		return LogSize;
+	if (time < mStart)
+		return mOptions.historyCount;
+
+	// Bursts written so far, the first one at the start. Split so the 
+	// product doesn't overflow.
+	const uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time - mStart).count());
+	const uint64_t rate = mOptions.recordsPerSecond;
+	const uint64_t records = (nanos / NanosPerSecond) * rate + (nanos % NanosPerSecond) * rate / NanosPerSecond;
+	const uint64_t bursts = records / mOptions.burstSize + 1;
+	return std::min(LogSize, mOptions.historyCount + bursts * mOptions.burstSize);
+}
+
+SyntheticSubscriptionSource::Clock::time_point SyntheticSubscriptionSource::getWriteTime(uint64_t recordId) const
+{
+	const uint64_t index = recordId - 1;
+	if (recordId == 0 || index < mOptions.historyCount || mOptions.recordsPerSecond == 0)
+		return mStart;
+
+	// Written with the first record of its burst.
+	const uint64_t records = (index - mOptions.historyCount) / mOptions.burstSize * mOptions.burstSize;
+	const uint64_t rate = mOptions.recordsPerSecond;
+	const uint64_t nanos = (records / rate) * NanosPerSecond + (records % rate) * NanosPerSecond / rate;
+	return mStart + std::chrono::nanoseconds(nanos);
+}
+
+void SyntheticSubscriptionSource::subscribe(const std::string &channel, const std::string &query, SubscriptionStart start, 
+	const std::string &bookmark)
+{
+	switch (start)
+	{
+	case SubscriptionStart::FutureEvents:
+		mCursor = writtenBy(Clock::now());
+		break;
+	case SubscriptionStart::Oldest:
+		mCursor = 0;
+		break;
+	case SubscriptionStart::AfterBookmark:
+		// Record ids are one more than their index, so the id is the index
+		// of the record after it.
+		mCursor = std::min(LogSize, getBookmarkedRecordId(Bookmark::fromXml(bookmark).get()));
+		break;
+	}
+
+	mLog->queryChannelXPath(channel, query, Direction::Forward);
+	mLog->seek(int64_t(mCursor), SeekOption::RelativeToFirst);
+	mOpen = true;
+}
+
+Ref<IQueryBatchResult> SyntheticSubscriptionSource::next(uint32_t batchSize)
+{
+	if (!mOpen)
+	{
+		THROW(InvalidStateException);
+	}
+
+	const uint64_t written = writtenBy(Clock::now());
+	const uint32_t count = uint32_t(std::min<uint64_t>(batchSize, written > mCursor ? written - mCursor : 0));
+	if (count == 0)
+		return IQueryBatchResult::createEmpty();
+
+	mCursor += count;
+	return mLog->next(count, 0);
+}
+
+void SyntheticSubscriptionSource::wait(uint32_t timeout)
+{
+	const Clock::time_point now = Clock::now();
+	if (writtenBy(now) > mCursor || timeout == 0)
+		return;
+
+	const Clock::time_point nextWrite = getWriteTime(mCursor + 1);
+	if (timeout != INFINITE)
+	{
+		const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(nextWrite - now).count();
+		if (remaining >= timeout)
+		{
+			mWake.wait(timeout);
+			return;
+		}
+	}
+
+	// Events only wait whole milliseconds. Sleep through the last one.
+	const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(nextWrite - now).count();
+	if (millis > 0 && mWake.wait(DWORD(millis)).getStatus() == WaitStatus::Object_0)
+		return;
+	std::this_thread::sleep_until(nextWrite);
+}
+
+void SyntheticSubscriptionSource::cancel()
+{
+	mWake.set();
+}
+
+void SyntheticSubscriptionSource::setFields(EventField fields)
+{
+	mLog->setFields(fields);
+}
+
+SysErr SyntheticSubscriptionSource::close()
+{
+	mOpen = false;
+	mCursor = 0;
+	return mLog->close();
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "SubscriptionSource.h"
+#include "SyntheticRecordSource.h"
+
+#include <chrono>
+
+namespace Windows::EventLog
+{
+
+// Simulated live channel over the synthetic log. The first historyCount 
+// records are already written when the source is created, the rest are 
+// written recordsPerSecond at a time, burstSize together. Write times are 
+// a function of the record id, so a consumer can tell how long each 
+// record took to reach it.
+//
+// Like SyntheticRecordSource, the channel and query are not evaluated.
+class SyntheticSubscriptionSource : public ISubscriptionSource
+{
+public:
+	friend class RefObject<SyntheticSubscriptionSource>;
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options
+	{
+		// Records written before subscribing.
+		uint64_t historyCount = 10000u;
+
+		// Records written per second from then on. Zero writes them all at 
+		// once, for measuring throughput.
+		uint64_t recordsPerSecond = 10000u;
+
+		// Records written together.
+		uint32_t burstSize = 1;
+
+		// Seed for the record generator.
+		uint64_t seed = 0x5eed;
+	};
+
+	static Ref<SyntheticSubscriptionSource> create();
+	static Ref<SyntheticSubscriptionSource> create(const Options &options);
+
+	~SyntheticSubscriptionSource() = default;
+
+	void subscribe(const std::string &channel, const std::string &query, SubscriptionStart start, 
+		const std::string &bookmark) override;
+
+	Ref<IQueryBatchResult> next(uint32_t batchSize) override;
+
+	void wait(uint32_t timeout) override;
+
+	void cancel() override;
+
+	void setFields(EventField fields) override;
+
+	SysErr close() override;
+
+	// When the record with the given id was written, or will be.
+	Clock::time_point getWriteTime(uint64_t recordId) const;
+
+	const Options &getOptions() const { return mOptions; }
+
+private:
+	explicit SyntheticSubscriptionSource(const Options &options);
+
+	// Number of records written by the given time.
+	uint64_t writtenBy(Clock::time_point time) const;
+
+	Options mOptions;
+	const Clock::time_point mStart;
+
+	// The log the records come from, read forward from mCursor.
+	Ref<SyntheticRecordSource> mLog;
+	bool mOpen = false;
+	uint64_t mCursor = 0;
+
+	AutoResetEvent mWake{ FALSE };
+
+	SyntheticSubscriptionSource(const SyntheticSubscriptionSource &) = delete;
+	SyntheticSubscriptionSource &operator=(const SyntheticSubscriptionSource &) = delete;
+};
+
+}
@@ -29,6 +29,8 @@ misrepresented as being the original software.
 #include <AclAPI.h>
 #include <strsafe.h>
 
+#include <algorithm>
+
 namespace Windows
 {
 
@@ -500,6 +502,30 @@ void CriticalSection::leave()
 	::LeaveCriticalSection(&mCS);
 }
 
+//
+// ReadWriteLock
+//
+
+void ReadWriteLock::enterShared()
+{
+	::AcquireSRWLockShared(&mLock);
+}
+
+void ReadWriteLock::leaveShared()
+{
+	::ReleaseSRWLockShared(&mLock);
+}
+
+void ReadWriteLock::enter()
+{
+	::AcquireSRWLockExclusive(&mLock);
+}
+
+void ReadWriteLock::leave()
+{
+	::ReleaseSRWLockExclusive(&mLock);
+}
+
 // 
 // Event
 // 
@@ -631,6 +657,82 @@ AutoResetEvent::AutoResetEvent(Event ev)
 	: mEvent(std::move(ev))
 {}
 
+//
+// Futex
+//
+
+void Futex::wait(const std::atomic<uint32_t> &value, uint32_t expected, DWORD timeout) noexcept
+{
+	::WaitOnAddress(const_cast<std::atomic<uint32_t> *>(&value), &expected, sizeof(expected), timeout);
+}
+
+void Futex::wakeOne(const std::atomic<uint32_t> &value) noexcept
+{
+	::WakeByAddressSingle(const_cast<std::atomic<uint32_t> *>(&value));
+}
+
+void Futex::wakeAll(const std::atomic<uint32_t> &value) noexcept
+{
+	::WakeByAddressAll(const_cast<std::atomic<uint32_t> *>(&value));
+}
+
+//
+// MappedFile
+//
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string &path)
+{
+	ObjectHandle file(::CreateFileW(to_utf16(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if (!file)
+	{
+		THROW_(SystemException, ::GetLastError());
+	}
+
+	LARGE_INTEGER size{};
+	if (!::GetFileSizeEx(file, &size))
+	{
+		THROW_(SystemException, ::GetLastError());
+	}
+
+	// Can't map an empty file.
+	if (size.QuadPart == 0)
+	{
+		return std::shared_ptr<const MappedFile>(new MappedFile(nullptr, 0));
+	}
+
+	// The view keeps the file and mapping open.
+	ObjectHandle mapping(::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (!mapping)
+	{
+		THROW_(SystemException, ::GetLastError());
+	}
+
+	void *p = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!p)
+	{
+		THROW_(SystemException, ::GetLastError());
+	}
+
+	return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const uint8_t *>(p), uint64_t(size.QuadPart)));
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData)
+		::UnmapViewOfFile(mData);
+}
+
+void MappedFile::release(uint64_t offset, uint64_t size) const noexcept
+{
+	if (offset >= mSize)
+		return;
+	size = std::min<uint64_t>(size, mSize - offset);
+
+	// Unlocking pages that aren't locked removes them from the working set.
+	::VirtualUnlock(const_cast<uint8_t *>(mData + offset), SIZE_T(size));
+}
+
 // Retrieves the account name for the given SID 
 std::string lookupAccount(PSID pSid)
 {
@@ -663,6 +765,19 @@ std::string lookupAccount(PSID pSid)
 	return user;
 }
 
+std::string sidToString(PSID pSid)
+{
+	LPWSTR sid = nullptr;
+	if (!::ConvertSidToStringSidW(pSid, &sid))
+	{
+		THROW_(SystemException, ::GetLastError());
+	}
+
+	std::string s = to_utf8(sid);
+	::LocalFree(sid);
+	return s;
+}
+
 std::string to_string(const Timestamp &ts) 
 { 
 	FILETIME ft;
@@ -27,7 +27,9 @@
 #include <Windows.h>
 #endif 
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -536,6 +538,46 @@ private:
 	CriticalSection &operator=(const CriticalSection &) = delete;
 };
 
+// Wrapper around SRWLOCK. Many readers or one writer.
+class ReadWriteLock
+{
+	SRWLOCK mLock = SRWLOCK_INIT;
+public:
+
+	// Scoped shared lock. 
+	class ReadLock
+	{
+		ReadWriteLock &rw;
+	public:
+		explicit ReadLock(ReadWriteLock &rw) noexcept : rw(rw) { rw.enterShared(); }
+		~ReadLock() noexcept { rw.leaveShared(); }
+	};
+
+	// Scoped exclusive lock. 
+	class WriteLock
+	{
+		ReadWriteLock &rw;
+	public:
+		explicit WriteLock(ReadWriteLock &rw) noexcept : rw(rw) { rw.enter(); }
+		~WriteLock() noexcept { rw.leave(); }
+	};
+
+	ReadWriteLock() = default;
+	~ReadWriteLock() = default;
+
+	// Use ReadLock instead.
+	void enterShared();
+	void leaveShared();
+
+	// Use WriteLock instead.
+	void enter();
+	void leave();
+
+private:
+	ReadWriteLock(const ReadWriteLock &) = delete;
+	ReadWriteLock &operator=(const ReadWriteLock &) = delete;
+};
+
 class Event
 {
 	ObjectHandle mhEvent;
@@ -568,6 +610,9 @@ public:
 	// object, which keep the kernel object alive as long as necessary. 
 	Event duplicate() const;
 
+	// For APIs that signal the event themselves, e.g. EvtSubscribe.
+	HANDLE handle() const noexcept { return mhEvent.handle(); }
+
 private:
 	explicit Event(HANDLE h) noexcept
 		: mhEvent(h)
@@ -617,6 +662,8 @@ public:
 
 	AutoResetEvent duplicate() const;
 
+	HANDLE handle() const noexcept { return mEvent.handle(); }
+
 	void set();
 
 	WaitResult wait(DWORD timeout = INFINITE, BOOL alertable = FALSE) noexcept;
@@ -641,6 +688,52 @@ public:
 
 std::string lookupAccount(PSID pSid);
 
+// S-1-5-... form of the SID.
+std::string sidToString(PSID pSid);
+
+// Waits on the value of a 32 bit atomic, like a Linux futex. Lets a thread 
+// sleep until another changes the value, without a kernel object.
+class Futex
+{
+public:
+	// Blocks while value == expected until woken or the timeout (milliseconds)
+	// expires. Can return early, so callers recheck the value.
+	static void wait(const std::atomic<uint32_t> &value, uint32_t expected, DWORD timeout = INFINITE) noexcept;
+
+	// Wakes one or all threads waiting on the value.
+	static void wakeOne(const std::atomic<uint32_t> &value) noexcept;
+	static void wakeAll(const std::atomic<uint32_t> &value) noexcept;
+};
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+public:
+	// Throws SystemException if the file can't be opened or mapped.
+	static std::shared_ptr<const MappedFile> open(const std::string &path);
+
+	~MappedFile();
+
+	const uint8_t *data() const { return mData; }
+	uint64_t size() const { return mSize; }
+
+	// Drops the pages of the range from the working set. The data stays 
+	// valid, it's read from the file again if touched. 
+	void release(uint64_t offset, uint64_t size) const noexcept;
+
+private:
+	MappedFile(const uint8_t *data, uint64_t size) noexcept
+		: mData(data)
+		, mSize(size)
+	{}
+
+	const uint8_t *mData;
+	uint64_t mSize;
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+};
+
 // Retrieves the system provided message for the given error code.
 // The error code can be a system defined HRESULT or system error code from
 // GetLastError. 
@@ -0,0 +1,810 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "XPath.h"
+
+#include "EvtxParser.h"
+#include "SysPlatform.h"
+
+#include <cstring>
+
+namespace Windows::EventLog::XPath
+{
+
+struct Attribute
+{
+	const char *name;
+	EventField field;
+};
+
+// Element of Event/System, with the field its text is and the fields its 
+// attributes are.
+struct Element
+{
+	const char *name;
+	EventField value;
+	Attribute attributes[2];
+};
+
+static const Element SystemElements[] =
+{
+	{ "Provider", EventField::None, { { "Name", EventField::ProviderName }, { "Guid", EventField::ProviderGuid } } },
+	{ "EventID", EventField::EventId, { { "Qualifiers", EventField::Qualifiers } } },
+	{ "Version", EventField::Version, {} },
+	{ "Level", EventField::Level, {} },
+	{ "Task", EventField::Task, {} },
+	{ "Opcode", EventField::Opcode, {} },
+	{ "Keywords", EventField::Keywords, {} },
+	{ "TimeCreated", EventField::None, { { "SystemTime", EventField::TimeCreated } } },
+	{ "EventRecordID", EventField::RecordId, {} },
+	{ "Correlation", EventField::None, { { "ActivityID", EventField::ActivityId } } },
+	{ "Execution", EventField::None, { { "ProcessID", EventField::ProcessId }, { "ThreadID", EventField::ThreadId } } },
+	{ "Channel", EventField::Channel, {} },
+	{ "Computer", EventField::Computer, {} },
+	{ "Security", EventField::None, { { "UserID", EventField::User } } },
+};
+
+// Where in the event a predicate is evaluated.
+enum class Context
+{
+	Event,
+	System,
+	Element,
+	Data
+};
+
+struct Literal
+{
+	bool quoted;
+	std::string text;
+};
+
+static bool isNameChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+[[noreturn]] static void fail()
+{
+	THROW_(SystemException, ERROR_EVT_INVALID_QUERY);
+}
+
+static Node makeNode(NodeKind kind, std::vector<Node> children = {})
+{
+	Node n;
+	n.kind = kind;
+	n.children = std::move(children);
+	return n;
+}
+
+// And or Or of the nodes, or the node itself if there's one.
+static Node combine(NodeKind kind, std::vector<Node> nodes)
+{
+	if (nodes.size() == 1)
+		return std::move(nodes.front());
+	return makeNode(kind, std::move(nodes));
+}
+
+// Recursive descent over the text. Each method skips leading white space.
+class Parser
+{
+public:
+	explicit Parser(const std::string &text)
+		: mText(text)
+	{}
+
+	Node parse();
+
+private:
+	Node expression(Context ctx, const Element *element);
+	Node conjunction(Context ctx, const Element *element);
+	Node unary(Context ctx, const Element *element);
+	Node step(Context ctx);
+	Node systemElement();
+	Node elementPredicate(const Element &element);
+	Node data();
+
+	Node compare(EventField field, Op op, const Literal &literal);
+	Node exists(EventField field);
+
+	void skipSpace()
+	{
+		while (mPos < mText.size() && (mText[mPos] == ' ' || mText[mPos] == '\t' || mText[mPos] == '\r' || mText[mPos] == '\n'))
+			++mPos;
+	}
+
+	bool atEnd()
+	{
+		skipSpace();
+		return mPos == mText.size();
+	}
+
+	bool accept(char c)
+	{
+		skipSpace();
+		if (mPos < mText.size() && mText[mPos] == c)
+		{
+			++mPos;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char c)
+	{
+		if (!accept(c))
+			fail();
+	}
+
+	// Consumes the name if it's next as a whole word.
+	bool acceptName(const char *name)
+	{
+		skipSpace();
+		size_t length = std::strlen(name);
+		if (mText.compare(mPos, length, name) != 0 || (mPos + length < mText.size() && isNameChar(mText[mPos + length])))
+			return false;
+		mPos += length;
+		return true;
+	}
+
+	std::string name()
+	{
+		skipSpace();
+		size_t start = mPos;
+		while (mPos < mText.size() && isNameChar(mText[mPos]))
+			++mPos;
+		if (mPos == start)
+			fail();
+		return mText.substr(start, mPos - start);
+	}
+
+	bool atOp()
+	{
+		skipSpace();
+		return mPos < mText.size() && std::strchr("=!<>", mText[mPos]) != nullptr;
+	}
+
+	Op op()
+	{
+		skipSpace();
+		if (accept('='))
+			return Op::Eq;
+		if (accept('!'))
+		{
+			if (mPos < mText.size() && mText[mPos] == '=')
+			{
+				++mPos;
+				return Op::Ne;
+			}
+			fail();
+		}
+		if (accept('<'))
+			return accept('=') ? Op::Le : Op::Lt;
+		if (accept('>'))
+			return accept('=') ? Op::Ge : Op::Gt;
+		fail();
+	}
+
+	Literal literal()
+	{
+		skipSpace();
+		if (mPos < mText.size() && (mText[mPos] == '\'' || mText[mPos] == '"'))
+		{
+			size_t end = mText.find(mText[mPos], mPos + 1);
+			if (end == std::string::npos)
+				fail();
+			Literal l{ true, mText.substr(mPos + 1, end - mPos - 1) };
+			mPos = end + 1;
+			return l;
+		}
+
+		size_t start = mPos;
+		while (mPos < mText.size() && isNameChar(mText[mPos]))
+			++mPos;
+		if (mPos == start || mText[start] < '0' || mText[start] > '9')
+			fail();
+		return { false, mText.substr(start, mPos - start) };
+	}
+
+	uint64_t number()
+	{
+		Literal l = literal();
+		std::optional<uint64_t> n = Evtx::parseUInt(l.text);
+		if (l.quoted || !n)
+			fail();
+		return *n;
+	}
+
+	const std::string &mText;
+	size_t mPos = 0;
+};
+
+Node Parser::parse()
+{
+	if (atEnd())
+		return makeNode(NodeKind::True);
+
+	accept('/');
+	if (!accept('*') && !acceptName("Event"))
+		fail();
+
+	std::vector<Node> predicates;
+	while (accept('['))
+	{
+		predicates.push_back(expression(Context::Event, nullptr));
+		expect(']');
+	}
+	if (!atEnd())
+		fail();
+
+	if (predicates.empty())
+		return makeNode(NodeKind::True);
+	return combine(NodeKind::And, std::move(predicates));
+}
+
+Node Parser::expression(Context ctx, const Element *element)
+{
+	std::vector<Node> nodes;
+	nodes.push_back(conjunction(ctx, element));
+	while (acceptName("or"))
+		nodes.push_back(conjunction(ctx, element));
+	return combine(NodeKind::Or, std::move(nodes));
+}
+
+Node Parser::conjunction(Context ctx, const Element *element)
+{
+	std::vector<Node> nodes;
+	nodes.push_back(unary(ctx, element));
+	while (acceptName("and"))
+		nodes.push_back(unary(ctx, element));
+	return combine(NodeKind::And, std::move(nodes));
+}
+
+Node Parser::unary(Context ctx, const Element *element)
+{
+	if (acceptName("not"))
+	{
+		expect('(');
+		std::vector<Node> operand;
+		operand.push_back(expression(ctx, element));
+		expect(')');
+		return makeNode(NodeKind::Not, std::move(operand));
+	}
+
+	if (accept('('))
+	{
+		Node n = expression(ctx, element);
+		expect(')');
+		return n;
+	}
+
+	switch (ctx)
+	{
+	case Context::Event:
+		if (acceptName("System"))
+			return step(Context::System);
+		if (acceptName("EventData"))
+			return step(Context::Data);
+		fail();
+	case Context::System:
+		return systemElement();
+	case Context::Element:
+		return elementPredicate(*element);
+	case Context::Data:
+		return data();
+	}
+	fail();
+}
+
+// System or EventData, followed by predicates on what's in it or a path 
+// to one of its elements.
+Node Parser::step(Context ctx)
+{
+	if (accept('/'))
+		return ctx == Context::System ? systemElement() : data();
+
+	std::vector<Node> predicates;
+	while (accept('['))
+	{
+		predicates.push_back(expression(ctx, nullptr));
+		expect(']');
+	}
+
+	if (predicates.empty())
+	{
+		// Every event has System, EventData might be missing.
+		return ctx == Context::System ? makeNode(NodeKind::True) : exists(EventField::None);
+	}
+	return combine(NodeKind::And, std::move(predicates));
+}
+
+Node Parser::systemElement()
+{
+	if (acceptName("band"))
+	{
+		expect('(');
+		if (!acceptName("Keywords"))
+			fail();
+		expect(',');
+		Node n = makeNode(NodeKind::Band);
+		n.field = EventField::Keywords;
+		n.mask = number();
+		expect(')');
+		n.op = Op::Ne;
+		if (atOp())
+		{
+			n.op = op();
+			n.value.number = number();
+		}
+		return n;
+	}
+
+	std::string elementName = name();
+	const Element *element = nullptr;
+	for (const Element &e : SystemElements)
+	{
+		if (elementName == e.name)
+			element = &e;
+	}
+	if (!element)
+		fail();
+
+	if (accept('/'))
+	{
+		// TimeCreated/@SystemTime>='...'
+		return elementPredicate(*element);
+	}
+
+	std::vector<Node> nodes;
+	while (accept('['))
+	{
+		nodes.push_back(expression(Context::Element, element));
+		expect(']');
+	}
+
+	if (atOp())
+	{
+		if (element->value == EventField::None)
+			fail();
+		Op o = op();
+		nodes.push_back(compare(element->value, o, literal()));
+	}
+
+	if (nodes.empty())
+	{
+		EventField fields = element->value;
+		for (const Attribute &a : element->attributes)
+			fields = fields | a.field;
+		return exists(fields);
+	}
+	return combine(NodeKind::And, std::move(nodes));
+}
+
+// An attribute, the text or timediff in the predicate of a System element.
+Node Parser::elementPredicate(const Element &element)
+{
+	EventField field = EventField::None;
+	if (accept('@'))
+	{
+		std::string attributeName = name();
+		for (const Attribute &a : element.attributes)
+		{
+			if (a.name && attributeName == a.name)
+				field = a.field;
+		}
+	}
+	else if (acceptName("timediff"))
+	{
+		expect('(');
+		expect('@');
+		if (element.attributes[0].field != EventField::TimeCreated || !acceptName("SystemTime"))
+			fail();
+		expect(')');
+		Node n = makeNode(NodeKind::TimeDiff);
+		n.field = EventField::TimeCreated;
+		n.op = op();
+		n.value.number = number();
+		return n;
+	}
+	else if (accept('.'))
+	{
+		field = element.value;
+	}
+
+	if (field == EventField::None)
+		fail();
+
+	if (!atOp())
+		return exists(field);
+	Op o = op();
+	return compare(field, o, literal());
+}
+
+// Data, Data[@Name='x'], either compared with a value or on its own.
+Node Parser::data()
+{
+	if (!acceptName("Data"))
+		fail();
+
+	std::string dataName;
+	if (accept('['))
+	{
+		expect('@');
+		if (!acceptName("Name"))
+			fail();
+		if (op() != Op::Eq)
+			fail();
+		Literal l = literal();
+		if (!l.quoted)
+			fail();
+		dataName = l.text;
+		expect(']');
+	}
+
+	if (!atOp())
+	{
+		Node n = exists(EventField::None);
+		n.dataName = dataName;
+		return n;
+	}
+
+	Node n = makeNode(NodeKind::Compare);
+	n.dataName = dataName;
+	n.op = op();
+	Literal l = literal();
+	n.value.text = l.text;
+	if (std::optional<uint64_t> number = Evtx::parseUInt(l.text))
+	{
+		n.value.type = Value::Type::Number;
+		n.value.number = *number;
+	}
+	else if (n.op != Op::Eq && n.op != Op::Ne)
+	{
+		fail();
+	}
+	else
+	{
+		n.value.type = Value::Type::String;
+	}
+	return n;
+}
+
+Node Parser::compare(EventField field, Op op, const Literal &literal)
+{
+	Node n = makeNode(NodeKind::Compare);
+	n.field = field;
+	n.op = op;
+	n.value.text = literal.text;
+
+	const bool equality = op == Op::Eq || op == Op::Ne;
+	switch (field)
+	{
+	case EventField::ProviderName:
+	case EventField::Channel:
+	case EventField::Computer:
+	case EventField::User:
+		if (!equality)
+			fail();
+		n.value.type = Value::Type::String;
+		break;
+	case EventField::ProviderGuid:
+	case EventField::ActivityId:
+	{
+		std::optional<GUID> guid = Evtx::parseGuid(literal.text.size() && literal.text[0] == '{' 
+			? literal.text : "{" + literal.text + "}");
+		if (!equality || !guid)
+			fail();
+		n.value.type = Value::Type::Guid;
+		n.value.guid = *guid;
+		break;
+	}
+	case EventField::TimeCreated:
+	{
+		std::optional<uint64_t> time = literal.quoted ? Evtx::parseFileTime(literal.text) : Evtx::parseUInt(literal.text);
+		if (!time)
+			fail();
+		n.value.number = *time;
+		break;
+	}
+	default:
+	{
+		std::optional<uint64_t> number = Evtx::parseUInt(literal.text);
+		if (!number)
+			fail();
+		n.value.number = *number;
+		break;
+	}
+	}
+	return n;
+}
+
+Node Parser::exists(EventField field)
+{
+	Node n = makeNode(NodeKind::Exists);
+	n.field = field;
+	return n;
+}
+
+Node parse(const std::string &xpath)
+{
+	return Parser(xpath).parse();
+}
+
+//
+// format
+//
+
+static const char *opText(Op op)
+{
+	switch (op)
+	{
+	case Op::Eq: return "=";
+	case Op::Ne: return "!=";
+	case Op::Lt: return "<";
+	case Op::Le: return "<=";
+	case Op::Gt: return ">";
+	case Op::Ge: return ">=";
+	}
+	return "=";
+}
+
+static void quote(std::string &out, const std::string &s)
+{
+	const char q = s.find('\'') == std::string::npos ? '\'' : '"';
+	out += q;
+	out += s;
+	out += q;
+}
+
+static void formatValue(std::string &out, EventField field, const Value &value)
+{
+	switch (value.type)
+	{
+	case Value::Type::String:
+		quote(out, value.text);
+		break;
+	case Value::Type::Guid:
+		quote(out, Windows::to_string(value.guid));
+		break;
+	case Value::Type::Number:
+		if (field == EventField::TimeCreated)
+			quote(out, Evtx::formatFileTime(value.number));
+		else // Decimal like the Event Viewer writes them, keywords too.
+			out += std::to_string(value.number);
+		break;
+	}
+}
+
+// Whether every test under the node is on a System field, or on EventData.
+static bool testsOnly(const Node &node, bool system)
+{
+	switch (node.kind)
+	{
+	case NodeKind::True:
+		return false;
+	case NodeKind::And:
+	case NodeKind::Or:
+	case NodeKind::Not:
+		for (const Node &child : node.children)
+		{
+			if (!testsOnly(child, system))
+				return false;
+		}
+		return true;
+	default:
+		return (node.field != EventField::None) == system;
+	}
+}
+
+// The System element with the field as its text or as an attribute.
+static const Element &elementOf(EventField field, const Attribute *&attribute)
+{
+	for (const Element &e : SystemElements)
+	{
+		attribute = nullptr;
+		if (e.value == field)
+			return e;
+		for (const Attribute &a : e.attributes)
+		{
+			if (a.name && a.field == field)
+			{
+				attribute = &a;
+				return e;
+			}
+		}
+	}
+	fail();
+}
+
+// A single field, compared with value when op isn't null.
+static void formatField(std::string &out, EventField field, const Op *op, const Value &value)
+{
+	const Attribute *attribute = nullptr;
+	const Element &element = elementOf(field, attribute);
+	out += element.name;
+	if (attribute)
+	{
+		out += "[@";
+		out += attribute->name;
+	}
+	if (op)
+	{
+		out += opText(*op);
+		formatValue(out, field, value);
+	}
+	if (attribute)
+		out += ']';
+}
+
+static void formatCompound(std::string &out, const Node &node, void (*formatChild)(std::string &, const Node &))
+{
+	if (node.kind == NodeKind::Not)
+	{
+		out += "not(";
+		formatChild(out, node.children.front());
+		out += ')';
+		return;
+	}
+
+	const char *separator = node.kind == NodeKind::And ? " and " : " or ";
+	for (size_t i = 0; i < node.children.size(); ++i)
+	{
+		const Node &child = node.children[i];
+		const bool group = child.kind == NodeKind::And || child.kind == NodeKind::Or;
+		if (i > 0)
+			out += separator;
+		if (group)
+			out += '(';
+		formatChild(out, child);
+		if (group)
+			out += ')';
+	}
+}
+
+static void formatSystem(std::string &out, const Node &node)
+{
+	switch (node.kind)
+	{
+	case NodeKind::And:
+	case NodeKind::Or:
+	case NodeKind::Not:
+		formatCompound(out, node, formatSystem);
+		break;
+	case NodeKind::Compare:
+		formatField(out, node.field, &node.op, node.value);
+		break;
+	case NodeKind::Exists:
+	{
+		// An element, or the fields one by one.
+		for (const Element &e : SystemElements)
+		{
+			EventField fields = e.value;
+			for (const Attribute &a : e.attributes)
+				fields = fields | a.field;
+			if (fields == node.field)
+			{
+				out += e.name;
+				return;
+			}
+		}
+		const char *separator = "";
+		for (uint32_t bit = 1; bit <= uint32_t(node.field); bit <<= 1)
+		{
+			if (hasAnyField(node.field, EventField(bit)))
+			{
+				out += separator;
+				formatField(out, EventField(bit), nullptr, node.value);
+				separator = " or ";
+			}
+		}
+		break;
+	}
+	case NodeKind::Band:
+		out += "band(Keywords,";
+		out += std::to_string(node.mask);
+		out += ')';
+		if (node.op != Op::Ne || node.value.number != 0)
+		{
+			out += opText(node.op);
+			out += std::to_string(node.value.number);
+		}
+		break;
+	case NodeKind::TimeDiff:
+		out += "TimeCreated[timediff(@SystemTime)";
+		out += opText(node.op);
+		out += std::to_string(node.value.number);
+		out += ']';
+		break;
+	case NodeKind::True:
+		fail();
+	}
+}
+
+static void formatData(std::string &out, const Node &node)
+{
+	switch (node.kind)
+	{
+	case NodeKind::And:
+	case NodeKind::Or:
+	case NodeKind::Not:
+		formatCompound(out, node, formatData);
+		break;
+	case NodeKind::Compare:
+	case NodeKind::Exists:
+		out += "Data";
+		if (!node.dataName.empty())
+		{
+			out += "[@Name=";
+			quote(out, node.dataName);
+			out += ']';
+		}
+		if (node.kind == NodeKind::Compare)
+		{
+			out += opText(node.op);
+			if (node.value.type == Value::Type::String)
+				quote(out, node.value.text);
+			else
+				out += node.value.text;
+		}
+		break;
+	default:
+		fail();
+	}
+}
+
+static void formatEvent(std::string &out, const Node &node)
+{
+	if (node.kind == NodeKind::True)
+	{
+		// Every event has System.
+		out += "System";
+	}
+	else if (testsOnly(node, true))
+	{
+		out += "System[";
+		formatSystem(out, node);
+		out += ']';
+	}
+	else if (testsOnly(node, false))
+	{
+		out += "EventData[";
+		formatData(out, node);
+		out += ']';
+	}
+	else
+	{
+		formatCompound(out, node, formatEvent);
+	}
+}
+
+std::string format(const Node &node)
+{
+	if (node.kind == NodeKind::True)
+		return "*";
+
+	std::string out = "*[";
+	formatEvent(out, node);
+	out += ']';
+	return out;
+}
+
+}
@@ -0,0 +1,116 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "CommonTypes.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parser for the subset of XPath 1.0 the Event Log service accepts in 
+// queries, e.g.
+//
+//   *[System[Provider[@Name='Foo'] and (Level=2 or Level=3) and 
+//     TimeCreated[timediff(@SystemTime) <= 86400000]]]
+//   *[EventData[Data[@Name='TargetUserName']='bob']]
+//
+// The expression is parsed to a tree of conditions on record fields, for
+// XPathFilter to compile, rather than to general XPath.
+namespace Windows::EventLog::XPath
+{
+
+enum class Op : uint8_t
+{
+	Eq,
+	Ne,
+	Lt,
+	Le,
+	Gt,
+	Ge
+};
+
+enum class NodeKind : uint8_t
+{
+	// Matches everything, e.g. "*".
+	True,
+	And,
+	Or,
+	Not,
+	// field op value.
+	Compare,
+	// The record has the field.
+	Exists,
+	// band(Keywords, mask) op value.
+	Band,
+	// Milliseconds from TimeCreated to now op value.
+	TimeDiff
+};
+
+// Literal a field is compared with, converted to the field's type.
+struct Value
+{
+	enum class Type : uint8_t
+	{
+		// Integers and times, which are 100 nanos since 1601.
+		Number,
+		String,
+		Guid
+	};
+
+	Type type = Type::Number;
+	uint64_t number = 0;
+	std::string text{};
+	GUID guid{};
+};
+
+struct Node
+{
+	NodeKind kind = NodeKind::True;
+
+	// A system field, or None for an EventData/UserData property.
+	EventField field = EventField::None;
+
+	// Name of the property when field is None. Empty for any property.
+	std::string dataName{};
+
+	Op op = Op::Eq;
+	Value value{};
+
+	// Band's mask.
+	uint64_t mask = 0;
+
+	// Operands of And, Or and Not.
+	std::vector<Node> children{};
+};
+
+// Parses the expression. Empty text is "*". Throws SystemException with 
+// ERROR_EVT_INVALID_QUERY if it isn't in the subset.
+Node parse(const std::string &xpath);
+
+// Writes the node as a query, with System[...] and EventData[...] around 
+// the largest parts that only test one or the other. Parses back to an 
+// equivalent node.
+std::string format(const Node &node);
+
+}
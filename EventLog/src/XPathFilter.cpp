@@ -0,0 +1,652 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "XPathFilter.h"
+
+#include "EvtxParser.h"
+#include "SysPlatform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Windows::EventLog
+{
+
+// Reserved keyword bits, which records leave out of getKeywords.
+static constexpr uint64_t KeywordsMask = 0x0000FFFFFFFFFFFFull;
+
+static uint64_t fileTimeNow()
+{
+	// 100 nanos between 1601-01-01 and 1970-01-01.
+	static constexpr uint64_t EpochDelta = 116444736000000000ull;
+	using Ticks = std::chrono::duration<int64_t, std::ratio<1, 10000000>>;
+	return uint64_t(std::chrono::duration_cast<Ticks>(std::chrono::system_clock::now().time_since_epoch()).count()) + EpochDelta;
+}
+
+static bool test(XPath::Op op, int order)
+{
+	switch (op)
+	{
+	case XPath::Op::Eq: return order == 0;
+	case XPath::Op::Ne: return order != 0;
+	case XPath::Op::Lt: return order < 0;
+	case XPath::Op::Le: return order <= 0;
+	case XPath::Op::Gt: return order > 0;
+	case XPath::Op::Ge: return order >= 0;
+	}
+	return false;
+}
+
+template<typename T>
+static int order(T a, T b)
+{
+	return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// Orders a property value against a number, nothing if it isn't one.
+static std::optional<int> orderNumber(const EventPropertyValue &value, uint64_t number)
+{
+	if (const uint64_t *u = std::get_if<uint64_t>(&value))
+		return order(*u, number);
+	if (const int64_t *i = std::get_if<int64_t>(&value))
+		return *i < 0 ? -1 : order(uint64_t(*i), number);
+	if (const double *d = std::get_if<double>(&value))
+		return order(*d, double(number));
+	if (const bool *b = std::get_if<bool>(&value))
+		return order(uint64_t(*b), number);
+	if (const std::string *s = std::get_if<std::string>(&value))
+	{
+		if (std::optional<uint64_t> parsed = Evtx::parseUInt(*s))
+			return order(*parsed, number);
+	}
+	return std::nullopt;
+}
+
+// Text of a property value, as the XML rendering has it.
+static std::string propertyText(const EventPropertyValue &value)
+{
+	struct Visitor
+	{
+		std::string operator()(std::monostate) const { return {}; }
+		std::string operator()(const std::string &s) const { return s; }
+		std::string operator()(int64_t v) const { return std::to_string(v); }
+		std::string operator()(uint64_t v) const { return std::to_string(v); }
+		std::string operator()(double v) const { return std::to_string(v); }
+		std::string operator()(bool v) const { return v ? "true" : "false"; }
+		std::string operator()(const GUID &g) const { return Windows::to_string(g); }
+		std::string operator()(const Timestamp &t) const { return Windows::to_string(t); }
+		std::string operator()(const std::vector<uint8_t> &bytes) const
+		{
+			static const char Digits[] = "0123456789ABCDEF";
+			std::string s;
+			for (uint8_t b : bytes)
+			{
+				s += Digits[b >> 4];
+				s += Digits[b & 15];
+			}
+			return s;
+		}
+	};
+	return std::visit(Visitor{}, value);
+}
+
+static bool testProperty(const EventPropertyValue &property, XPath::Op op, const XPath::Value &value)
+{
+	if (value.type == XPath::Value::Type::Number)
+	{
+		if (std::optional<int> o = orderNumber(property, value.number))
+			return test(op, *o);
+		if (op != XPath::Op::Eq && op != XPath::Op::Ne)
+			return false;
+	}
+	return test(op, propertyText(property) == value.text ? 0 : 1);
+}
+
+//
+// Rows the program runs over. Each gives the program the fields of one 
+// record. A field the record doesn't have fails the comparison.
+//
+
+// A record, through its getters.
+class RecordRow
+{
+public:
+	explicit RecordRow(const IEventRecord &record)
+		: mRecord(record)
+	{}
+
+	std::optional<uint64_t> number(EventField field) const
+	{
+		switch (field)
+		{
+		case EventField::EventId: return widen(mRecord.getEventId());
+		case EventField::Qualifiers: return widen(mRecord.getQualifers());
+		case EventField::Level: return widen(mRecord.getLevel());
+		case EventField::Task: return widen(mRecord.getTask());
+		case EventField::Opcode: return widen(mRecord.getOpcode());
+		case EventField::Keywords: return widen(mRecord.getKeywords());
+		case EventField::RecordId: return mRecord.getRecordId();
+		case EventField::ProcessId: return widen(mRecord.getProcessId());
+		case EventField::ThreadId: return widen(mRecord.getThreadId());
+		case EventField::Version: return widen(mRecord.getVersion());
+		case EventField::TimeCreated:
+		{
+			std::optional<Timestamp> t = mRecord.getTimeCreated();
+			return t ? std::optional<uint64_t>(t->timestamp) : std::nullopt;
+		}
+		default: return std::nullopt;
+		}
+	}
+
+	// 1 if the field is one of the count strings, 0 if not, -1 if the 
+	// record doesn't have it.
+	int inStrings(EventField field, const std::string *strings, uint32_t, uint32_t count) const
+	{
+		std::optional<std::string> value = string(field);
+		if (!value)
+			return -1;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (*value == strings[i])
+				return 1;
+		}
+		return 0;
+	}
+
+	std::optional<GUID> guid(EventField field) const
+	{
+		return field == EventField::ProviderGuid ? mRecord.getProviderGuid() : mRecord.getActivityId();
+	}
+
+	bool has(EventField fields) const
+	{
+		for (uint32_t bit = 1; bit <= uint32_t(fields); bit <<= 1)
+		{
+			EventField field = EventField(bit);
+			if (!hasAnyField(fields, field))
+				continue;
+			switch (field)
+			{
+			case EventField::ProviderGuid:
+			case EventField::ActivityId:
+				if (guid(field))
+					return true;
+				break;
+			case EventField::ProviderName:
+			case EventField::Channel:
+			case EventField::Computer:
+			case EventField::User:
+				if (string(field))
+					return true;
+				break;
+			default:
+				if (number(field))
+					return true;
+				break;
+			}
+		}
+		return false;
+	}
+
+	bool data(const std::string &name, XPath::Op op, const XPath::Value &value) const
+	{
+		if (!name.empty())
+		{
+			std::optional<EventPropertyValue> property = mRecord.getProperty(name);
+			return property && testProperty(*property, op, value);
+		}
+		for (const EventProperty &property : mRecord.getProperties())
+		{
+			if (testProperty(property.value, op, value))
+				return true;
+		}
+		return false;
+	}
+
+	bool hasData(const std::string &name) const
+	{
+		return name.empty() ? !mRecord.getProperties().empty() : mRecord.getProperty(name).has_value();
+	}
+
+private:
+	template<typename T>
+	static std::optional<uint64_t> widen(const std::optional<T> &v)
+	{
+		return v ? std::optional<uint64_t>(uint64_t(*v)) : std::nullopt;
+	}
+
+	std::optional<std::string> string(EventField field) const
+	{
+		switch (field)
+		{
+		case EventField::ProviderName: return mRecord.getProviderName();
+		case EventField::Channel: return mRecord.getChannel();
+		case EventField::Computer: return mRecord.getComputer();
+		case EventField::User: return mRecord.getUser();
+		default: return std::nullopt;
+		}
+	}
+
+	const IEventRecord &mRecord;
+};
+
+// The columns of a batch, fetched once per select.
+struct BatchColumns
+{
+	explicit BatchColumns(const IEventBatch &batch)
+		: fields(batch.getFields())
+		, providerNames(batch.getProviderNames())
+		, providerGuids(batch.getProviderGuids())
+		, eventIds(batch.getEventIds())
+		, qualifiers(batch.getQualifiers())
+		, levels(batch.getLevels())
+		, tasks(batch.getTasks())
+		, opcodes(batch.getOpcodes())
+		, keywords(batch.getKeywords())
+		, timeCreated(batch.getTimeCreated())
+		, recordIds(batch.getRecordIds())
+		, activityIds(batch.getActivityIds())
+		, processIds(batch.getProcessIds())
+		, threadIds(batch.getThreadIds())
+		, channels(batch.getChannels())
+		, computers(batch.getComputers())
+		, users(batch.getUsers())
+		, versions(batch.getVersions())
+	{}
+
+	const EventField *fields;
+	const uint32_t *providerNames;
+	const GUID *providerGuids;
+	const uint16_t *eventIds;
+	const uint16_t *qualifiers;
+	const uint8_t *levels;
+	const uint16_t *tasks;
+	const uint8_t *opcodes;
+	const int64_t *keywords;
+	const uint64_t *timeCreated;
+	const uint64_t *recordIds;
+	const GUID *activityIds;
+	const uint32_t *processIds;
+	const uint32_t *threadIds;
+	const uint32_t *channels;
+	const uint32_t *computers;
+	const uint32_t *users;
+	const uint8_t *versions;
+};
+
+// Record i of a batch. String comparisons are between ids: stringIds holds
+// the batch's id of each string in the program.
+class BatchRow
+{
+public:
+	BatchRow(const BatchColumns &columns, const uint32_t *stringIds, uint32_t index)
+		: mColumns(columns)
+		, mStringIds(stringIds)
+		, mIndex(index)
+	{}
+
+	std::optional<uint64_t> number(EventField field) const
+	{
+		if (!has(field))
+			return std::nullopt;
+
+		const BatchColumns &c = mColumns;
+		const uint32_t i = mIndex;
+		switch (field)
+		{
+		case EventField::EventId: return c.eventIds[i];
+		case EventField::Qualifiers: return c.qualifiers[i];
+		case EventField::Level: return c.levels[i];
+		case EventField::Task: return c.tasks[i];
+		case EventField::Opcode: return c.opcodes[i];
+		case EventField::Keywords: return uint64_t(c.keywords[i]);
+		case EventField::TimeCreated: return c.timeCreated[i];
+		case EventField::RecordId: return c.recordIds[i];
+		case EventField::ProcessId: return c.processIds[i];
+		case EventField::ThreadId: return c.threadIds[i];
+		case EventField::Version: return c.versions[i];
+		default: return std::nullopt;
+		}
+	}
+
+	int inStrings(EventField field, const std::string *, uint32_t index, uint32_t count) const
+	{
+		if (!has(field))
+			return -1;
+
+		const uint32_t *ids = nullptr;
+		switch (field)
+		{
+		case EventField::ProviderName: ids = mColumns.providerNames; break;
+		case EventField::Channel: ids = mColumns.channels; break;
+		case EventField::Computer: ids = mColumns.computers; break;
+		case EventField::User: ids = mColumns.users; break;
+		default: return -1;
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (ids[mIndex] == mStringIds[index + i])
+				return 1;
+		}
+		return 0;
+	}
+
+	std::optional<GUID> guid(EventField field) const
+	{
+		if (!has(field))
+			return std::nullopt;
+		return field == EventField::ProviderGuid ? mColumns.providerGuids[mIndex] : mColumns.activityIds[mIndex];
+	}
+
+	bool has(EventField fields) const
+	{
+		return hasAnyField(mColumns.fields[mIndex], fields);
+	}
+
+	// select doesn't run programs that test EventData.
+	bool data(const std::string &, XPath::Op, const XPath::Value &) const { return false; }
+	bool hasData(const std::string &) const { return false; }
+
+private:
+	const BatchColumns &mColumns;
+	const uint32_t *mStringIds;
+	const uint32_t mIndex;
+};
+
+//
+// IXPathFilter
+//
+
+Ref<IXPathFilter> IXPathFilter::compile(const std::string &xpath)
+{
+	return XPathFilter::create(XPath::parse(xpath));
+}
+
+//
+// XPathFilter
+//
+
+Ref<XPathFilter> XPathFilter::create(const XPath::Node &root)
+{
+	return RefObject<XPathFilter>::createRef(root);
+}
+
+XPathFilter::XPathFilter(const XPath::Node &root)
+{
+	compile(root);
+}
+
+XPathFilter::Instruction &XPathFilter::emit(OpCode code, EventField field, uint32_t operand)
+{
+	mProgram.push_back({ code, XPath::Op::Eq, field, operand, 0, 0 });
+	mFields = mFields | field;
+	return mProgram.back();
+}
+
+void XPathFilter::compile(const XPath::Node &node)
+{
+	using XPath::NodeKind;
+
+	switch (node.kind)
+	{
+	case NodeKind::True:
+		emit(OpCode::Const, EventField::None, 1);
+		break;
+
+	case NodeKind::And:
+	case NodeKind::Or:
+	{
+		if (compileSet(node))
+			break;
+
+		// Every operand but the last jumps to the end once it decides.
+		const OpCode jump = node.kind == NodeKind::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue;
+		std::vector<size_t> jumps;
+		for (size_t i = 0; i < node.children.size(); ++i)
+		{
+			compile(node.children[i]);
+			if (i + 1 < node.children.size())
+			{
+				jumps.push_back(mProgram.size());
+				emit(jump);
+			}
+		}
+		for (size_t j : jumps)
+			mProgram[j].operand = uint32_t(mProgram.size());
+		break;
+	}
+
+	case NodeKind::Not:
+		compile(node.children.front());
+		emit(OpCode::Not);
+		break;
+
+	case NodeKind::Compare:
+		if (node.field == EventField::None)
+		{
+			mData.push_back({ node.dataName, node.op, node.value });
+			emit(OpCode::CompareData, EventField::Properties, uint32_t(mData.size() - 1)).op = node.op;
+		}
+		else if (node.value.type == XPath::Value::Type::String)
+		{
+			mStrings.push_back(node.value.text);
+			emit(OpCode::CompareString, node.field, uint32_t(mStrings.size() - 1)).op = node.op;
+		}
+		else if (node.value.type == XPath::Value::Type::Guid)
+		{
+			mGuids.push_back(node.value.guid);
+			emit(OpCode::CompareGuid, node.field, uint32_t(mGuids.size() - 1)).op = node.op;
+		}
+		else
+		{
+			Instruction &in = emit(OpCode::CompareNumber, node.field);
+			in.op = node.op;
+			in.number = node.field == EventField::Keywords ? node.value.number & KeywordsMask : node.value.number;
+		}
+		break;
+
+	case NodeKind::Exists:
+		if (node.field == EventField::None)
+		{
+			mData.push_back({ node.dataName, XPath::Op::Eq, {} });
+			emit(OpCode::ExistsData, EventField::Properties, uint32_t(mData.size() - 1));
+		}
+		else
+		{
+			emit(OpCode::Exists, node.field);
+		}
+		break;
+
+	case NodeKind::Band:
+	{
+		Instruction &in = emit(OpCode::Band, EventField::Keywords);
+		in.op = node.op;
+		in.number = node.value.number;
+		in.mask = node.mask & KeywordsMask;
+		break;
+	}
+
+	case NodeKind::TimeDiff:
+	{
+		Instruction &in = emit(OpCode::TimeDiff, EventField::TimeCreated);
+		in.op = node.op;
+		in.number = node.value.number;
+		mUsesTime = true;
+		break;
+	}
+	}
+}
+
+// An or of equalities between one field and literals, e.g. EventID=1 or 
+// EventID=2, is a single set test, so the field is only read once.
+bool XPathFilter::compileSet(const XPath::Node &node)
+{
+	using XPath::NodeKind;
+
+	if (node.kind != NodeKind::Or)
+		return false;
+
+	const XPath::Node &front = node.children.front();
+	for (const XPath::Node &child : node.children)
+	{
+		if (child.kind != NodeKind::Compare || child.op != XPath::Op::Eq || child.field == EventField::None ||
+			child.field != front.field || child.value.type == XPath::Value::Type::Guid)
+			return false;
+	}
+
+	if (front.value.type == XPath::Value::Type::String)
+	{
+		Instruction &in = emit(OpCode::InStrings, front.field, uint32_t(mStrings.size()));
+		in.mask = node.children.size();
+		for (const XPath::Node &child : node.children)
+			mStrings.push_back(child.value.text);
+		return true;
+	}
+
+	std::vector<uint64_t> set;
+	for (const XPath::Node &child : node.children)
+		set.push_back(front.field == EventField::Keywords ? child.value.number & KeywordsMask : child.value.number);
+	std::sort(set.begin(), set.end());
+	mSets.push_back(std::move(set));
+	emit(OpCode::InSet, front.field, uint32_t(mSets.size() - 1));
+	return true;
+}
+
+template<typename Row>
+bool XPathFilter::run(const Row &row, uint64_t now) const
+{
+	const Instruction *program = mProgram.data();
+	const size_t size = mProgram.size();
+	bool result = true;
+	for (size_t pc = 0; pc < size; ++pc)
+	{
+		const Instruction &in = program[pc];
+		switch (in.code)
+		{
+		case OpCode::CompareNumber:
+		{
+			std::optional<uint64_t> v = row.number(in.field);
+			result = v && test(in.op, order(*v, in.number));
+			break;
+		}
+		case OpCode::CompareString:
+		{
+			int equal = row.inStrings(in.field, &mStrings[in.operand], in.operand, 1);
+			result = equal >= 0 && test(in.op, equal ? 0 : 1);
+			break;
+		}
+		case OpCode::CompareGuid:
+		{
+			std::optional<GUID> g = row.guid(in.field);
+			result = g && test(in.op, std::memcmp(&*g, &mGuids[in.operand], sizeof(GUID)) == 0 ? 0 : 1);
+			break;
+		}
+		case OpCode::InSet:
+		{
+			std::optional<uint64_t> v = row.number(in.field);
+			const std::vector<uint64_t> &set = mSets[in.operand];
+			result = v && std::binary_search(set.begin(), set.end(), *v);
+			break;
+		}
+		case OpCode::InStrings:
+			result = row.inStrings(in.field, &mStrings[in.operand], in.operand, uint32_t(in.mask)) > 0;
+			break;
+		case OpCode::Exists:
+			result = row.has(in.field);
+			break;
+		case OpCode::Band:
+		{
+			std::optional<uint64_t> v = row.number(EventField::Keywords);
+			result = v && test(in.op, order(*v & in.mask, in.number));
+			break;
+		}
+		case OpCode::TimeDiff:
+		{
+			// Whole milliseconds, negative for records from the future.
+			std::optional<uint64_t> v = row.number(EventField::TimeCreated);
+			result = v && test(in.op, order(int64_t(now - *v) / 10000, int64_t(in.number)));
+			break;
+		}
+		case OpCode::CompareData:
+		{
+			const DataTest &t = mData[in.operand];
+			result = row.data(t.name, t.op, t.value);
+			break;
+		}
+		case OpCode::ExistsData:
+			result = row.hasData(mData[in.operand].name);
+			break;
+		case OpCode::Const:
+			result = in.operand != 0;
+			break;
+		case OpCode::Not:
+			result = !result;
+			break;
+		case OpCode::JumpIfFalse:
+			if (!result)
+				pc = in.operand - 1;
+			break;
+		case OpCode::JumpIfTrue:
+			if (result)
+				pc = in.operand - 1;
+			break;
+		}
+	}
+	return result;
+}
+
+bool XPathFilter::matches(const IEventRecord &record) const
+{
+	return run(RecordRow(record), mUsesTime ? fileTimeNow() : 0);
+}
+
+uint32_t XPathFilter::select(const IEventBatch &batch, std::vector<uint64_t> &selection) const
+{
+	if (hasAnyField(mFields, EventField::Properties))
+	{
+		THROW(InvalidStateException);
+	}
+
+	std::vector<uint32_t> stringIds;
+	stringIds.reserve(mStrings.size());
+	for (const std::string &s : mStrings)
+		stringIds.push_back(batch.findString(s));
+
+	const uint32_t count = batch.getCount();
+	const BatchColumns columns(batch);
+	const uint64_t now = mUsesTime ? fileTimeNow() : 0;
+
+	selection.assign((size_t(count) + 63) / 64, 0);
+	uint32_t selected = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (run(BatchRow(columns, stringIds.data(), i), now))
+		{
+			selection[i / 64] |= uint64_t(1) << (i % 64);
+			++selected;
+		}
+	}
+	return selected;
+}
+
+}
@@ -0,0 +1,124 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "IXPathFilter.h"
+#include "XPath.h"
+
+#include <string>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Compiles the parsed expression to a flat program for a small stack-less
+// machine. Each test sets a single result flag; and/or become jumps over 
+// the rest of their operands once the flag decides them, so a record only
+// pays for the tests it needs. Literals are converted to the field's type 
+// once, at compile time.
+class XPathFilter : public IXPathFilter
+{
+public:
+	friend class RefObject<XPathFilter>;
+
+	static Ref<XPathFilter> create(const XPath::Node &root);
+
+	~XPathFilter() = default;
+
+	EventField getFields() const override { return mFields; }
+
+	bool matches(const IEventRecord &record) const override;
+
+	uint32_t select(const IEventBatch &batch, std::vector<uint64_t> &selection) const override;
+
+private:
+	explicit XPathFilter(const XPath::Node &root);
+
+	enum class OpCode : uint8_t
+	{
+		// System field op number.
+		CompareNumber,
+		// System field op strings[operand].
+		CompareString,
+		// System field op guids[operand].
+		CompareGuid,
+		// System field is one of sets[operand], or of the strings from 
+		// strings[operand] on, mask of them. From an or of equalities.
+		InSet,
+		InStrings,
+		// Any of the fields present.
+		Exists,
+		// (Keywords & mask) op number.
+		Band,
+		// Milliseconds since TimeCreated op number.
+		TimeDiff,
+		// data[operand] holds, the name empty for any property.
+		CompareData,
+		ExistsData,
+		// Result = operand.
+		Const,
+		Not,
+		// Go to operand if the result is false/true.
+		JumpIfFalse,
+		JumpIfTrue
+	};
+
+	struct Instruction
+	{
+		OpCode code;
+		XPath::Op op;
+		EventField field;
+		uint32_t operand;
+		uint64_t number;
+		uint64_t mask;
+	};
+
+	struct DataTest
+	{
+		std::string name;
+		XPath::Op op;
+		XPath::Value value;
+	};
+
+	void compile(const XPath::Node &node);
+	bool compileSet(const XPath::Node &node);
+	Instruction &emit(OpCode code, EventField field = EventField::None, uint32_t operand = 0);
+
+	// Runs the program over a record or a batch row, see XPathFilter.cpp.
+	template<typename Row>
+	bool run(const Row &row, uint64_t now) const;
+
+	std::vector<Instruction> mProgram{};
+	std::vector<std::string> mStrings{};
+	std::vector<GUID> mGuids{};
+	std::vector<std::vector<uint64_t>> mSets{};
+	std::vector<DataTest> mData{};
+
+	EventField mFields = EventField::None;
+	bool mUsesTime = false;
+
+	XPathFilter(const XPathFilter &) = delete;
+	XPathFilter &operator=(const XPathFilter &) = delete;
+};
+
+}
@@ -0,0 +1,276 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "XmlReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace Windows::EventLog
+{
+
+static void appendUtf8(std::string &out, uint32_t c)
+{
+	if (c < 0x80)
+	{
+		out += char(c);
+	}
+	else if (c < 0x800)
+	{
+		out += char(0xC0 | (c >> 6));
+		out += char(0x80 | (c & 0x3F));
+	}
+	else if (c < 0x10000)
+	{
+		out += char(0xE0 | (c >> 12));
+		out += char(0x80 | ((c >> 6) & 0x3F));
+		out += char(0x80 | (c & 0x3F));
+	}
+	else
+	{
+		out += char(0xF0 | (c >> 18));
+		out += char(0x80 | ((c >> 12) & 0x3F));
+		out += char(0x80 | ((c >> 6) & 0x3F));
+		out += char(0x80 | (c & 0x3F));
+	}
+}
+
+void appendEscaped(std::string &out, const std::string &s, char quote)
+{
+	for (char c : s)
+	{
+		switch (c)
+		{
+		case '&': out += "&amp;"; break;
+		case '<': out += "&lt;"; break;
+		case '>': out += "&gt;"; break;
+		default: 
+			if (c == quote)
+				out += quote == '"' ? "&quot;" : "&apos;";
+			else
+				out += c;
+			break;
+		}
+	}
+}
+
+//
+// XmlReader
+//
+
+void XmlReader::skipMisc()
+{
+	for (;;)
+	{
+		while (mPos < mText.size() && std::strchr(" \t\r\n", mText[mPos]) && mText[mPos] != '\0')
+			++mPos;
+		if (startsWith("<?"))
+			skipPast("?>");
+		else if (startsWith("<!--"))
+			skipPast("-->");
+		else
+			break;
+	}
+}
+
+bool XmlReader::atEnd()
+{
+	skipMisc();
+	return mPos == mText.size();
+}
+
+bool XmlReader::startElement(Element &element)
+{
+	skipMisc();
+	if (!startsWith("<") || startsWith("</"))
+		return false;
+
+	++mPos;
+	element = Element{};
+	element.name = name();
+	for (;;)
+	{
+		skipSpace();
+		if (startsWith("/>"))
+		{
+			mPos += 2;
+			element.empty = true;
+			return true;
+		}
+		if (startsWith(">"))
+		{
+			++mPos;
+			return true;
+		}
+
+		std::string attributeName = name();
+		skipSpace();
+		expect('=');
+		skipSpace();
+		if (mPos >= mText.size() || (mText[mPos] != '"' && mText[mPos] != '\''))
+			fail();
+		const char q = mText[mPos++];
+		size_t end = mText.find(q, mPos);
+		if (end == std::string::npos)
+			fail();
+		element.attributes.emplace_back(std::move(attributeName), decode(mPos, end));
+		mPos = end + 1;
+	}
+}
+
+void XmlReader::endElement(const std::string &elementName)
+{
+	skipMisc();
+	if (!startsWith("</"))
+		fail();
+	mPos += 2;
+	if (name() != elementName)
+		fail();
+	skipSpace();
+	expect('>');
+}
+
+bool XmlReader::atEndElement()
+{
+	skipMisc();
+	return startsWith("</");
+}
+
+std::string XmlReader::text()
+{
+	std::string out;
+	while (mPos < mText.size())
+	{
+		if (startsWith("<![CDATA["))
+		{
+			size_t end = mText.find("]]>", mPos);
+			if (end == std::string::npos)
+				fail();
+			out.append(mText, mPos + 9, end - mPos - 9);
+			mPos = end + 3;
+		}
+		else if (startsWith("<!--"))
+		{
+			skipPast("-->");
+		}
+		else if (startsWith("<"))
+		{
+			break;
+		}
+		else
+		{
+			size_t end = std::min(mText.find('<', mPos), mText.size());
+			out += decode(mPos, end);
+			mPos = end;
+		}
+	}
+	return out;
+}
+
+bool XmlReader::startsWith(const char *s) const
+{
+	return mText.compare(mPos, std::strlen(s), s) == 0;
+}
+
+void XmlReader::skipPast(const char *s)
+{
+	size_t end = mText.find(s, mPos);
+	if (end == std::string::npos)
+		fail();
+	mPos = end + std::strlen(s);
+}
+
+void XmlReader::skipSpace()
+{
+	while (mPos < mText.size() && (mText[mPos] == ' ' || mText[mPos] == '\t' || mText[mPos] == '\r' || mText[mPos] == '\n'))
+		++mPos;
+}
+
+void XmlReader::expect(char c)
+{
+	if (mPos >= mText.size() || mText[mPos] != c)
+		fail();
+	++mPos;
+}
+
+std::string XmlReader::name()
+{
+	size_t start = mPos;
+	while (mPos < mText.size() && (std::isalnum(static_cast<unsigned char>(mText[mPos])) || std::strchr("_-.:", mText[mPos])) 
+		&& mText[mPos] != '\0')
+		++mPos;
+	if (mPos == start)
+		fail();
+	return mText.substr(start, mPos - start);
+}
+
+std::string XmlReader::decode(size_t begin, size_t end) const
+{
+	std::string out;
+	for (size_t i = begin; i < end; ++i)
+	{
+		if (mText[i] != '&')
+		{
+			out += mText[i];
+			continue;
+		}
+
+		size_t semicolon = mText.find(';', i);
+		if (semicolon == std::string::npos || semicolon >= end)
+			fail();
+		std::string ref = mText.substr(i + 1, semicolon - i - 1);
+		if (ref == "lt")
+			out += '<';
+		else if (ref == "gt")
+			out += '>';
+		else if (ref == "amp")
+			out += '&';
+		else if (ref == "quot")
+			out += '"';
+		else if (ref == "apos")
+			out += '\'';
+		else if (ref.size() > 1 && ref[0] == '#')
+		{
+			const bool hex = ref[1] == 'x' || ref[1] == 'X';
+			char *last = nullptr;
+			unsigned long c = std::strtoul(ref.c_str() + (hex ? 2 : 1), &last, hex ? 16 : 10);
+			if (*last != '\0' || c == 0 || c > 0x10FFFF)
+				fail();
+			appendUtf8(out, uint32_t(c));
+		}
+		else
+		{
+			fail();
+		}
+		i = semicolon;
+	}
+	return out;
+}
+
+void XmlReader::fail() const
+{
+	THROW_(SystemException, mError);
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+	Copyright (C) 2022-2023 Patrick Griffiths
+
+	This software is provided 'as-is', without any express or implied
+	warranty.  In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	1. The origin of this software must not be misrepresented; you must not
+	claim that you wrote the original software. If you use this software
+	in a product, an acknowledgment in the product documentation would be
+	appreciated but is not required.
+
+	2. Altered source versions must be plainly marked as such, and must not be
+	misrepresented as being the original software.
+
+	3. This notice may not be removed or altered from any source distribution.
+*/
+
+#pragma once
+
+#include "SysPlatform.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Windows::EventLog
+{
+
+// Just enough XML for QueryLists and bookmarks: elements, attributes, text,
+// CDATA, comments, processing instructions and the character references.
+// Malformed text throws SystemException with the error code it was given.
+class XmlReader
+{
+public:
+	XmlReader(const std::string &text, DWORD error)
+		: mText(text)
+		, mError(error)
+	{}
+
+	struct Element
+	{
+		std::string name;
+		std::vector<std::pair<std::string, std::string>> attributes;
+		// <Name/>
+		bool empty = false;
+
+		const std::string *attribute(const char *attributeName) const
+		{
+			for (const auto &a : attributes)
+			{
+				if (a.first == attributeName)
+					return &a.second;
+			}
+			return nullptr;
+		}
+	};
+
+	// Skips white space, comments and processing instructions.
+	void skipMisc();
+
+	bool atEnd();
+
+	// The start tag next, if that's what's next.
+	bool startElement(Element &element);
+
+	void endElement(const std::string &elementName);
+
+	bool atEndElement();
+
+	// Text up to the next tag, with CDATA sections and comments in it.
+	std::string text();
+
+	[[noreturn]] void fail() const;
+
+private:
+	bool startsWith(const char *s) const;
+	void skipPast(const char *s);
+	void skipSpace();
+	void expect(char c);
+	std::string name();
+
+	// Text between begin and end with the references replaced.
+	std::string decode(size_t begin, size_t end) const;
+
+	const std::string &mText;
+	const DWORD mError;
+	size_t mPos = 0;
+};
+
+// Appends s with &, < and > escaped, and the quote character for an 
+// attribute value.
+void appendEscaped(std::string &out, const std::string &s, char quote = '"');
+
+}
@@ -0,0 +1,2334 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "IBookmark.h"
+#include "ICancellationToken.h"
+#include "IEventReader.h"
+#include "IEventSubscription.h"
+#include "AccountCache.h"
+#include "CallPool.h"
+#include "EventBatch.h"
+#include "EventFilter.h"
+#include "EventGenerator.h"
+#include "EventLogQuery.h"
+#include "EventReader.h"
+#include "EventSubscription.h"
+#include "EvtxRecordSource.h"
+#include "EvtxWriter.h"
+#include "FilterKernels.h"
+#include "IXPathFilter.h"
+#include "MessageTemplate.h"
+#include "MetadataCatalog.h"
+#include "QueryExecutor.h"
+#include "QueryPlan.h"
+#include "Queues.h"
+#include "RecordSource.h"
+#include "ShardedCache.h"
+#include "SyntheticRecordSource.h"
+#include "SyntheticSubscriptionSource.h"
+#include "XPathFilter.h"
+
+using Windows::EventLog::AccountCache;
+using Windows::EventLog::AccountCacheStats;
+using Windows::EventLog::CatalogPublisher;
+using Windows::EventLog::Direction;
+using Windows::EventLog::EventField;
+using Windows::EventLog::EventFilter;
+using Windows::EventLog::EventLogQuery;
+using Windows::EventLog::EventReader;
+using Windows::EventLog::EventSubscription;
+using Windows::EventLog::EvtxRecordSource;
+using Windows::EventLog::FilterKernels;
+using Windows::EventLog::IBookmark;
+using Windows::EventLog::ICancellationToken;
+using Windows::EventLog::IRecordSource;
+using Windows::EventLog::IXPathFilter;
+using Windows::EventLog::IEventBatch;
+using Windows::EventLog::IEventLogQuery;
+using Windows::EventLog::IEventReader;
+using Windows::EventLog::IEventRecord;
+using Windows::EventLog::IEventSubscription;
+using Windows::EventLog::IQueryBatchResult;
+using Windows::EventLog::MessageTemplate;
+using Windows::EventLog::MetadataCatalog;
+using Windows::EventLog::MetadataCacheStats;
+using Windows::EventLog::OverflowPolicy;
+using Windows::EventLog::QueryNextStatus;
+using Windows::EventLog::QueryExecutor;
+using Windows::EventLog::QueryPlan;
+using Windows::EventLog::ShardedCache;
+using Windows::EventLog::SubscriptionStart;
+using Windows::EventLog::SubscriptionStats;
+using Windows::EventLog::SyntheticRecordSource;
+using Windows::EventLog::SyntheticSubscriptionSource;
+using Windows::EventLog::XPathFilter;
+using Windows::AutoResetEvent;
+using Windows::BoundedSynchQueue;
+using Windows::CallPool;
+using Windows::Completion;
+using Windows::CriticalSection;
+using Windows::MpmcRingQueue;
+using Windows::Ref;
+using Windows::RefPtr;
+using Windows::SystemException;
+using Windows::SpscRingQueue;
+
+#if defined(__cpp_impl_coroutine)
+using Windows::EventLog::AsyncGenerator;
+using Windows::EventLog::EventView;
+using Windows::EventLog::generateEvents;
+using Windows::EventLog::generateEventsAsync;
+using Windows::EventLog::Resumer;
+#endif
+
+static constexpr char nl = '\n';
+
+// -name value pairs following the command.
+class Options
+{
+	std::map<std::string, std::string> mValues{};
+public:
+	Options(int argc, char *argv[], int index)
+	{
+		while (index + 1 < argc)
+		{
+			if (argv[index][0] == '-')
+				mValues[argv[index] + 1] = argv[index + 1];
+			index += 2;
+		}
+	}
+
+	uint64_t get(const std::string &name, uint64_t defaultValue) const
+	{
+		auto it = mValues.find(name);
+		return it != mValues.end() ? std::stoull(it->second) : defaultValue;
+	}
+
+	std::string get(const std::string &name, const std::string &defaultValue) const
+	{
+		auto it = mValues.find(name);
+		return it != mValues.end() ? it->second : defaultValue;
+	}
+};
+
+class Stopwatch
+{
+	std::chrono::steady_clock::time_point mStart{std::chrono::steady_clock::now()};
+public:
+	double seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+	}
+};
+
+static void report(const char *name, uint64_t records, double seconds)
+{
+	char buf[160] = {};
+	snprintf(buf, sizeof(buf), "%-32s %12llu records %9.3f s %12.0f records/s",
+		name, static_cast<unsigned long long>(records), seconds, seconds > 0 ? double(records) / seconds : 0.0);
+	std::cout << buf << nl;
+}
+
+// Peak resident memory of the process in MiB.
+static double peakResidentMiB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc{};
+	if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0.0;
+	return double(pmc.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+	struct rusage usage{};
+	if (::getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	return double(usage.ru_maxrss) / 1024.0;
+#endif
+}
+
+static SyntheticRecordSource::Options syntheticOptions(const Options &opts)
+{
+	SyntheticRecordSource::Options options{};
+	options.recordCount = opts.get("count", uint64_t(1000000));
+	options.seed = opts.get("seed", options.seed);
+	options.nextLatencyMicros = uint32_t(opts.get("latency", uint64_t(0)));
+	return options;
+}
+
+// Applies -batch, -adaptive, -prefetch and -render to the reader.
+static void batchOptions(IEventReader &reader, const Options &opts)
+{
+	if (uint64_t maxBatch = opts.get("adaptive", uint64_t(0)))
+		reader.setAdaptiveBatchSize(1, uint32_t(maxBatch));
+	else if (uint64_t batch = opts.get("batch", uint64_t(0)))
+		reader.setBatchSize(uint32_t(batch));
+	reader.setPrefetchDepth(uint32_t(opts.get("prefetch", uint64_t(reader.getPrefetchDepth()))));
+	reader.setRenderThreads(uint32_t(opts.get("render", uint64_t(reader.getRenderThreads()))));
+}
+
+// Reads every record, touching the fields a typical consumer would.
+static uint64_t drain(IEventReader &reader)
+{
+	uint64_t records = 0;
+	uint64_t checksum = 0;
+	while (reader.next())
+	{
+		Ref<IEventRecord> rec = reader.getRecord();
+		checksum += rec->getEventId().value_or(0);
+		checksum += rec->getMessage().size();
+		++records;
+	}
+	// Keep the optimizer honest.
+	if (checksum == 1)
+		std::cout << nl;
+	return records;
+}
+
+// Counts records by event id, a consumer that needs only the id and time.
+static uint64_t drainEventIds(IEventReader &reader)
+{
+	std::map<uint16_t, uint64_t> counts;
+	uint64_t records = 0;
+	uint64_t checksum = 0;
+	while (reader.next())
+	{
+		Ref<IEventRecord> rec = reader.getRecord();
+		++counts[rec->getEventId().value_or(0)];
+		checksum += uint64_t(rec->getTimeCreated().value_or(Windows::Timestamp{}).timestamp);
+		++records;
+	}
+	if (checksum == 1 || counts.empty())
+		std::cout << nl;
+	return records;
+}
+
+// Round trips through a pair of queues, like a call into the query thread
+// and its completion.
+template<typename Queue>
+static void benchQueueRoundTrip(const char *name, uint64_t count)
+{
+	Queue requests;
+	Queue replies;
+
+	std::thread server([&] {
+		for (;;)
+		{
+			uint64_t value = requests.dequeue().value_or(0);
+			replies.enqueue(value);
+			if (value == 0)
+				break;
+		}
+	});
+
+	Stopwatch sw;
+	for (uint64_t i = 1; i <= count; ++i)
+	{
+		requests.enqueue(i);
+		replies.dequeue();
+	}
+	double seconds = sw.seconds();
+
+	requests.enqueue(0);
+	replies.dequeue();
+	server.join();
+	report(name, count, seconds);
+}
+
+// One thread enqueuing as fast as it can and another dequeuing.
+template<typename Queue>
+static void benchQueueStream(const char *name, uint64_t count)
+{
+	Queue queue;
+
+	Stopwatch sw;
+	std::thread consumer([&] {
+		uint64_t checksum = 0;
+		for (uint64_t i = 0; i < count; ++i)
+			checksum += queue.dequeue().value_or(0);
+		if (checksum == 1)
+			std::cout << nl;
+	});
+
+	for (uint64_t i = 1; i <= count; ++i)
+		queue.enqueue(i);
+	consumer.join();
+	report(name, count, sw.seconds());
+}
+
+class EventLogBench
+{
+public:
+	EventLogBench() {}
+	~EventLogBench() {}
+
+	void run(int argc, char *argv[]);
+
+private:
+	void benchReader(const Options &opts);
+	void benchBatchSize(const Options &opts);
+	void benchPrefetch(const Options &opts);
+	void benchRender(const Options &opts);
+	void benchQueues(const Options &opts);
+	void benchProjection(const Options &opts);
+	void benchAccounts(const Options &opts);
+	void benchMessages(const Options &opts);
+	void benchMetadataCache(const Options &opts);
+	void benchCatalog(const Options &opts);
+	void benchEvtx(const Options &opts);
+	void benchColumns(const Options &opts);
+	void benchFilter(const Options &opts);
+	void benchXPath(const Options &opts);
+	void benchQueryList(const Options &opts);
+	void benchSubscribe(const Options &opts);
+	void benchBookmark(const Options &opts);
+	void benchExecutor(const Options &opts);
+	void benchCalls(const Options &opts);
+	void benchAsync(const Options &opts);
+#if defined(__cpp_impl_coroutine)
+	void benchCoroutine(const Options &opts);
+#endif
+	void benchCancel(const Options &opts);
+	void generateEvtx(const Options &opts);
+
+	void usage();
+
+	EventLogBench &operator=(const EventLogBench &) = delete;
+	EventLogBench(const EventLogBench &) = delete;
+};
+
+void EventLogBench::usage()
+{
+	static const char *usageMsg =
+		"eventlogbench COMMAND [-option value ...]\n\n"
+		"Benchmarks the query pipeline against the synthetic record source.\n"
+		"\nCommands:\n"
+		"  reader          EventReader throughput\n"
+		"  batch           EventReader throughput by batch size\n"
+		"  prefetch        EventReader throughput by prefetch depth\n"
+		"  render          EventReader throughput by render thread count\n"
+		"  queue           Query thread queue round trips and streaming\n"
+		"  projection      Counting by event id with all fields and just the needed ones\n"
+		"  accounts        User SID resolution with and without the account cache\n"
+		"  message         Checks message templates, then compares parsing per record with compiled\n"
+		"  metacache       Publisher metadata lookups from several threads, one lock and sharded\n"
+		"  catalog         Writes the synthetic publishers to a metadata catalog (-catalog) and reads it back\n"
+		"  evtx            EVTX file parsing throughput (-file, -catalog to format messages)\n"
+		"  evtxgen         Writes the synthetic log to an EVTX file (-file)\n"
+		"  columns         Filters batches record by record and by their columns (-file for an EVTX file)\n"
+		"  filter          Filter kernels, scalar and SIMD, against testing records through their getters\n"
+		"  xpath           Checks compiled XPath queries against IEventFilter, then times them (-file, -query for EVTX)\n"
+		"  querylist       Optimizes a synthetic QueryList, checks it selects the same and times both (-print to see it)\n"
+		"  subscribe       Latency and throughput of a simulated live channel: polled, subscribed pull and push\n"
+		"  bookmark        Checks reading resumes from a bookmark, then times checkpointing by records and by time\n"
+		"  executor        1, 100 and 1000 queries read at once, with a thread each and on a shared executor\n"
+		"  calls           Cost of a call to the query: allocated with an event against pooled with a futex\n"
+		"  async           One thread reading many slow queries, a blocking call at a time and all async\n"
+#if defined(__cpp_impl_coroutine)
+		"  coroutine       Counting by event id with the reader loop, a generator and an async generator\n"
+#endif
+		"  cancel          How long readers stuck in a slow fetch take to stop: cancelled, then destroyed\n"
+		"\nOptions:\n"
+		"  -count N        Records in the synthetic log (default 1000000)\n"
+		"  -seed N         Generator seed\n"
+		"  -latency US     Simulated latency of each batch fetch in microseconds\n"
+		"  -batch N        Records fetched per batch (default 16)\n"
+		"  -adaptive MAX   Adaptive batch size, up to MAX\n"
+		"  -prefetch N     Batches read ahead of the reader (default 0)\n"
+		"  -render N       Threads rendering records (default 0)\n"
+		"  -users N        Distinct user SIDs for accounts (default 50)\n"
+		"  -resolve US     Simulated SID resolution time in microseconds (default 100)\n"
+		"  -file PATH      EVTX file to read or write\n"
+		"  -query XPATH    XPath query for xpath -file\n"
+		"  -queries N      Queries in the synthetic QueryList (default 200), queries read by async (100), cancel (16)\n"
+		"  -rate N         Records written per second for subscribe, 0 for all at once (default 20000)\n"
+		"  -seconds N      How long each subscribe mode runs (default 2)\n"
+		"  -buffer N       Subscription buffer in records (default 4096)\n"
+		"  -overflow P     Subscription overflow policy: block, oldest or newest (default block)\n"
+		"  -work US        Simulated time spent on each delivered batch in microseconds (default 0)\n"
+		"  -interval MS    Polling interval for subscribe, checkpoint interval for bookmark (default 100)\n"
+		"  -every N        Records between bookmark checkpoints (default 1000)\n"
+		"  -persist US     Simulated time to persist a bookmark in microseconds (default 100)\n"
+		"  -catalog PATH   Publisher metadata catalog to read or write\n"
+		"  -threads N      EVTX parser threads (default: hardware threads), metacache threads (4), executor threads\n"
+		"  -publishers N   Distinct publishers for metacache (default 200)\n"
+		"  -load US        Simulated publisher metadata load time in microseconds (default 1000)\n"
+		"  -capacity N     Publisher metadata cache capacity (default 2048)\n"
+		"  -readahead N    EVTX chunks parsed ahead of the reader\n";
+
+	std::cout << usageMsg;
+}
+
+void EventLogBench::benchReader(const Options &opts)
+{
+	Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+	Stopwatch sw;
+	Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+	batchOptions(reader, opts);
+	uint64_t records = drain(reader);
+	report("reader", records, sw.seconds());
+}
+
+void EventLogBench::benchBatchSize(const Options &opts)
+{
+	static const uint32_t sizes[] = { 1, 4, 16, 64, 256, 1024 };
+
+	for (uint32_t size : sizes)
+	{
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+		Stopwatch sw;
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		reader->setBatchSize(size);
+		uint64_t records = drain(reader);
+		report(("batch " + std::to_string(size)).c_str(), records, sw.seconds());
+	}
+
+	Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+	Stopwatch sw;
+	Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+	reader->setAdaptiveBatchSize(1, 1024);
+	uint64_t records = drain(reader);
+	report("adaptive 1..1024", records, sw.seconds());
+}
+
+void EventLogBench::benchPrefetch(const Options &opts)
+{
+	static const uint32_t depths[] = { 0, 1, 2, 4, 8 };
+
+	for (uint32_t depth : depths)
+	{
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+		Stopwatch sw;
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		batchOptions(reader, opts);
+		reader->setPrefetchDepth(depth);
+		uint64_t records = drain(reader);
+		report(("prefetch " + std::to_string(depth)).c_str(), records, sw.seconds());
+	}
+}
+
+void EventLogBench::benchRender(const Options &opts)
+{
+	static const uint32_t threadCounts[] = { 0, 1, 2, 4, 8, 16 };
+
+	for (uint32_t threads : threadCounts)
+	{
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+		Stopwatch sw;
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		reader->setBatchSize(64);
+		reader->setPrefetchDepth(2);
+		batchOptions(reader, opts);
+		reader->setRenderThreads(threads);
+		uint64_t records = drain(reader);
+		report(("render " + std::to_string(threads)).c_str(), records, sw.seconds());
+	}
+}
+
+void EventLogBench::benchQueues(const Options &opts)
+{
+	uint64_t count = opts.get("count", uint64_t(1000000));
+
+	benchQueueRoundTrip<BoundedSynchQueue<uint64_t>>("round trip BoundedSynchQueue", count / 10);
+	benchQueueRoundTrip<SpscRingQueue<uint64_t>>("round trip SpscRingQueue", count / 10);
+	benchQueueRoundTrip<MpmcRingQueue<uint64_t>>("round trip MpmcRingQueue", count / 10);
+
+	benchQueueStream<BoundedSynchQueue<uint64_t>>("stream BoundedSynchQueue", count);
+	benchQueueStream<SpscRingQueue<uint64_t>>("stream SpscRingQueue", count);
+	benchQueueStream<MpmcRingQueue<uint64_t>>("stream MpmcRingQueue", count);
+}
+
+void EventLogBench::benchProjection(const Options &opts)
+{
+	struct Projection
+	{
+		const char *name;
+		EventField fields;
+	};
+	static const Projection projections[] = 
+	{
+		{ "fields all", EventField::All },
+		{ "fields system", EventField::System },
+		{ "fields EventId|TimeCreated", EventField::EventId | EventField::TimeCreated },
+	};
+
+	for (const Projection &projection : projections)
+	{
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+
+		Stopwatch sw;
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		batchOptions(reader, opts);
+		reader->setFields(projection.fields);
+		uint64_t records = drainEventIds(reader);
+		report(projection.name, records, sw.seconds());
+	}
+}
+
+void EventLogBench::benchAccounts(const Options &opts)
+{
+	uint64_t count = opts.get("count", uint64_t(20000));
+	uint64_t users = std::max<uint64_t>(1, opts.get("users", uint64_t(50)));
+	auto resolveTime = std::chrono::microseconds(opts.get("resolve", uint64_t(100)));
+
+	// A few accounts (SYSTEM, services) account for most records. Every 
+	// tenth SID doesn't resolve, like deleted accounts.
+	std::vector<std::string> sids;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t h = (i * 0x9E3779B97F4A7C15ull) >> 32;
+		uint64_t user = (h % 4 == 0) ? h % users : h % std::min<uint64_t>(users, 4);
+		sids.push_back("S-1-5-21-3623811015-3361044348-30300820-" + std::to_string(1000 + user));
+	}
+	auto resolve = [&](const std::string &sid) -> std::optional<std::string> {
+		std::this_thread::sleep_for(resolveTime);
+		if (sid.back() == '0')
+			return std::nullopt;
+		return "CORP\\user" + sid.substr(sid.size() - 4);
+	};
+
+	uint64_t checksum = 0;
+	Stopwatch sw;
+	for (const std::string &sid : sids)
+		checksum += resolve(sid).value_or(sid).size();
+	report("accounts uncached", count, sw.seconds());
+
+	AccountCache cache;
+	sw = Stopwatch();
+	for (const std::string &sid : sids)
+		checksum += cache.lookup(sid, [&] { return resolve(sid); }).value_or(sid).size();
+	report("accounts cached", count, sw.seconds());
+
+	AccountCacheStats stats = cache.getStats();
+	std::cout << "  hits " << stats.hits << " (negative " << stats.negativeHits << ") misses " << stats.misses 
+		<< " evictions " << stats.evictions << " size " << stats.size << nl;
+	if (checksum == 1)
+		std::cout << nl;
+}
+
+// The publisher metadata cache as it was: one lock, held while loading.
+class SingleLockCache
+{
+public:
+	template<typename Load>
+	std::shared_ptr<std::string> lookup(const std::string &key, Load &&load)
+	{
+		CriticalSection::Lock lck(mLock);
+		auto it = mCache.find(key);
+		if (it != mCache.end())
+			return it->second;
+		return mCache.emplace(key, load()).first->second;
+	}
+
+private:
+	CriticalSection mLock{};
+	std::unordered_map<std::string, std::shared_ptr<std::string>> mCache{};
+};
+
+void EventLogBench::benchMetadataCache(const Options &opts)
+{
+	using PublisherCache = ShardedCache<std::string, std::shared_ptr<std::string>>;
+
+	uint64_t count = opts.get("count", uint64_t(1000000));
+	uint64_t threadCount = std::max<uint64_t>(1, opts.get("threads", uint64_t(4)));
+	uint64_t publishers = std::max<uint64_t>(1, opts.get("publishers", uint64_t(200)));
+	auto loadTime = std::chrono::microseconds(opts.get("load", uint64_t(1000)));
+
+	PublisherCache::Options cacheOptions;
+	cacheOptions.capacity = size_t(opts.get("capacity", uint64_t(cacheOptions.capacity)));
+
+	// Like a real log, a few publishers write most of the records.
+	std::vector<std::string> keys;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t h = (i * 0x9E3779B97F4A7C15ull) >> 32;
+		uint64_t publisher = (h % 8 == 0) ? (h >> 8) % publishers : h % std::min<uint64_t>(publishers, 8);
+		keys.push_back("Microsoft-Windows-Publisher-" + std::to_string(publisher));
+	}
+	auto load = [&](const std::string &key) {
+		std::this_thread::sleep_for(loadTime);
+		return std::make_shared<std::string>(key);
+	};
+
+	// Each thread looks up a share of the keys.
+	auto run = [&](const char *name, auto &&lookup)
+	{
+		std::vector<uint64_t> checksums(threadCount);
+		std::vector<std::thread> threads;
+		Stopwatch sw;
+		for (uint64_t t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&, t] {
+				for (uint64_t i = t; i < count; i += threadCount)
+					checksums[t] += lookup(keys[i])->size();
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		report(name, count, sw.seconds());
+		if (checksums[0] == 1)
+			std::cout << nl;
+	};
+
+	SingleLockCache single;
+	run("metacache single lock", [&](const std::string &key) { return single.lookup(key, [&] { return load(key); }); });
+
+	PublisherCache sharded(cacheOptions);
+	run("metacache sharded", [&](const std::string &key) { return sharded.lookup(key, [&] { return load(key); }); });
+
+	MetadataCacheStats stats = sharded.getStats();
+	std::cout << "  hits " << stats.hits << " waits " << stats.waits << " misses " << stats.misses 
+		<< " evictions " << stats.evictions << " size " << stats.size 
+		<< " load " << (stats.misses ? stats.loadNanoseconds / stats.misses / 1000 : 0) << " us/miss" << nl;
+}
+
+// Message template cases: message, insertion strings, expected output or 
+// null if it shouldn't parse.
+struct MessageCase
+{
+	const char *message;
+	std::vector<std::string> insertions;
+	const char *expected;
+};
+
+static const MessageCase messageCases[] = 
+{
+	{ "The %1 service entered the %2 state.", { "Print Spooler", "running" }, "The Print Spooler service entered the running state." },
+	{ "%2 then %1", { "a", "b" }, "b then a" },
+	{ "Ten %10 and one %1", { "1", "2", "3", "4", "5", "6", "7", "8", "9", "10" }, "Ten 10 and one 1" },
+	{ "Format %1!s! done", { "x" }, "Format x done" },
+	{ "Line%nTab%tSpace%bPercent %% dot%.", {}, "Line\r\nTab\tSpace Percent % dot." },
+	{ "Stops here%0 not here", {}, "Stops here" },
+	{ "Missing %3", { "a" }, "Missing %3" },
+	{ "Trailing %", {}, "Trailing %" },
+	{ "Parameter %%1833", {}, nullptr },
+	{ "Hex %1!x!", { "1" }, nullptr },
+};
+
+static const char *const benchMessageTemplates[] = 
+{
+	"An account was successfully logged on.%n%nSubject:%n%tAccount Name:%t%t%1%n%nLogon Information:%n%tLogon Type:%t%t%2%n%tNew Logon ID:%t%t%3%n%nProcess Information:%n%tProcess Name:%t%t%4%n%nNetwork Information:%n%tSource Network Address:%t%5",
+	"The %1 service entered the %2 state.",
+	"The start type of the %1 service was changed from %2 to %3.",
+	"Installation Successful: Windows successfully installed the following update: %1",
+};
+
+void EventLogBench::benchMessages(const Options &opts)
+{
+	uint64_t count = opts.get("count", uint64_t(1000000));
+
+	size_t failed = 0;
+	for (const MessageCase &c : messageCases)
+	{
+		std::optional<MessageTemplate> t = MessageTemplate::parse(c.message);
+		bool ok = c.expected ? (t && t->format(c.insertions) == c.expected) : !t;
+		if (!ok)
+		{
+			std::cout << "MISMATCH: " << c.message << nl;
+			++failed;
+		}
+	}
+	std::cout << "message cases: " << (std::size(messageCases) - failed) << "/" << std::size(messageCases) << " ok" << nl;
+
+	const std::vector<std::string> insertions = { "jsmith", "3", "0x3e7", "C:\\Windows\\System32\\svchost.exe", "10.0.4.17" };
+	constexpr size_t templateCount = std::size(benchMessageTemplates);
+
+	uint64_t checksum = 0;
+	Stopwatch sw;
+	for (uint64_t i = 0; i < count; ++i)
+		checksum += MessageTemplate::parse(benchMessageTemplates[i % templateCount])->format(insertions).size();
+	report("message parse every record", count, sw.seconds());
+
+	std::vector<MessageTemplate> compiled;
+	for (const char *message : benchMessageTemplates)
+		compiled.push_back(MessageTemplate::parse(message).value());
+
+	sw = Stopwatch();
+	for (uint64_t i = 0; i < count; ++i)
+		checksum += compiled[i % templateCount].format(insertions).size();
+	report("message compiled", count, sw.seconds());
+
+	if (checksum == 1)
+		std::cout << nl;
+}
+
+void EventLogBench::benchCatalog(const Options &opts)
+{
+	uint64_t count = opts.get("count", uint64_t(1000000));
+	std::string path = opts.get("catalog", std::string("synthetic.catalog"));
+
+	std::vector<std::shared_ptr<const CatalogPublisher>> publishers = SyntheticRecordSource::getPublishers();
+	Stopwatch sw;
+	MetadataCatalog::write(path, publishers);
+	report("catalog write", publishers.size(), sw.seconds());
+
+	sw = Stopwatch();
+	std::shared_ptr<const MetadataCatalog> catalog = MetadataCatalog::open(path);
+	report("catalog open", catalog->getPublisherCount(), sw.seconds());
+
+	// Everything written should read back the same.
+	size_t mismatches = 0;
+	for (const std::shared_ptr<const CatalogPublisher> &expected : publishers)
+	{
+		std::shared_ptr<const CatalogPublisher> actual = catalog->find(expected->name);
+		bool same = actual && Windows::to_string(actual->guid.value_or(GUID{})) == Windows::to_string(expected->guid.value_or(GUID{})) && actual->message == expected->message &&
+			actual->levels.size() == expected->levels.size() && actual->tasks.size() == expected->tasks.size() &&
+			actual->opcodes.size() == expected->opcodes.size() && actual->keywords.size() == expected->keywords.size() &&
+			actual->channels.size() == expected->channels.size() && actual->events.size() == expected->events.size();
+		for (size_t i = 0; same && i < expected->events.size(); ++i)
+		{
+			same = actual->events[i].message == expected->events[i].message && 
+				actual->events[i].dataNames == expected->events[i].dataNames &&
+				actual->events[i].mapsData == expected->events[i].mapsData &&
+				actual->events[i].messageTemplate.has_value();
+		}
+		if (!same)
+		{
+			std::cout << "MISMATCH: " << expected->name << nl;
+			++mismatches;
+		}
+	}
+	std::cout << "catalog publishers: " << (publishers.size() - mismatches) << "/" << publishers.size() << " ok" << nl;
+
+	// What formatting a record costs on top of decoding it.
+	uint64_t checksum = 0;
+	sw = Stopwatch();
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		const CatalogPublisher &expected = *publishers[i % publishers.size()];
+		std::shared_ptr<const CatalogPublisher> publisher = catalog->find(expected.name);
+		const Windows::EventLog::CatalogEvent &event = expected.events[i % expected.events.size()];
+		checksum += publisher->findEvent(event.id, event.version) != nullptr;
+		checksum += publisher->getLevelDisplay(uint8_t(i % 5)).size();
+	}
+	report("catalog lookup", count, sw.seconds());
+	if (checksum == 1)
+		std::cout << nl;
+}
+
+void EventLogBench::benchEvtx(const Options &opts)
+{
+	EvtxRecordSource::Options options{};
+	options.workerCount = uint32_t(opts.get("threads", uint64_t(0)));
+	options.readAhead = uint32_t(opts.get("readahead", uint64_t(0)));
+	std::string catalog = opts.get("catalog", std::string());
+	if (!catalog.empty())
+		options.catalog = MetadataCatalog::open(catalog);
+	Ref<EvtxRecordSource> source = EvtxRecordSource::create(options);
+
+	Stopwatch sw;
+	Ref<IEventReader> reader = EventReader::openFile(source, opts.get("file", std::string("synthetic.evtx")), "*", Direction::Forward);
+	batchOptions(reader, opts);
+	uint64_t records = drain(reader);
+	report("evtx", records, sw.seconds());
+
+	char buf[64] = {};
+	snprintf(buf, sizeof(buf), "%-32s %12.1f MiB", "peak resident", peakResidentMiB());
+	std::cout << buf << nl;
+}
+
+// The synthetic log, or the EVTX file with -file, queried for the fields.
+static Ref<IRecordSource> columnsSource(const Options &opts, EventField fields)
+{
+	std::string file = opts.get("file", std::string());
+	Ref<IRecordSource> source = file.empty() ?
+		Ref<IRecordSource>(SyntheticRecordSource::create(syntheticOptions(opts))) :
+		Ref<IRecordSource>(EvtxRecordSource::create());
+	if (file.empty())
+		source->queryChannelXPath("Synthetic", "*", Direction::Forward);
+	else
+		source->queryFileXPath(file, "*", Direction::Forward);
+	source->setFields(fields);
+	return source;
+}
+
+// Checks the batch's columns hold the values of its records.
+static bool sameColumns(const IQueryBatchResult &batch, const IEventBatch &columns)
+{
+	if (columns.getCount() != batch.getCount())
+		return false;
+
+	for (uint32_t i = 0; i < batch.getCount(); ++i)
+	{
+		Ref<IEventRecord> rec = batch.getRecord(i);
+		auto string = [&columns](uint32_t id) { return std::string(columns.getString(id)); };
+		bool same = 
+			rec->getProviderName().value_or("") == string(columns.getProviderNames()[i]) &&
+			rec->getEventId().value_or(0) == columns.getEventIds()[i] &&
+			rec->getLevel().value_or(0) == columns.getLevels()[i] &&
+			rec->getTask().value_or(0) == columns.getTasks()[i] &&
+			rec->getOpcode().value_or(0) == columns.getOpcodes()[i] &&
+			rec->getKeywords().value_or(0) == columns.getKeywords()[i] &&
+			rec->getTimeCreated().value_or(Windows::Timestamp{}).timestamp == columns.getTimeCreated()[i] &&
+			rec->getRecordId().value_or(0) == columns.getRecordIds()[i] &&
+			rec->getProcessId().value_or(0) == columns.getProcessIds()[i] &&
+			rec->getThreadId().value_or(0) == columns.getThreadIds()[i] &&
+			rec->getChannel().value_or("") == string(columns.getChannels()[i]) &&
+			rec->getComputer().value_or("") == string(columns.getComputers()[i]) &&
+			rec->getUser().value_or("") == string(columns.getUsers()[i]) &&
+			rec->getVersion().value_or(0) == columns.getVersions()[i] &&
+			rec->getActivityId().has_value() == hasAnyField(columns.getFields()[i], EventField::ActivityId);
+		if (!same)
+			return false;
+	}
+	return true;
+}
+
+void EventLogBench::benchColumns(const Options &opts)
+{
+	const uint32_t batchSize = uint32_t(opts.get("batch", uint64_t(256)));
+
+	// Warnings and worse from one provider.
+	const std::string provider = opts.get("provider", std::string("Service Control Manager"));
+	const uint8_t maxLevel = 3;
+	const EventField fields = EventField::ProviderName | EventField::Level;
+
+	// Checks the columns against the records of the first few batches.
+	{
+		Ref<IRecordSource> source = columnsSource(opts, EventField::System);
+		uint32_t checked = 0;
+		uint32_t ok = 0;
+		for (int i = 0; i < 8; ++i)
+		{
+			Ref<IQueryBatchResult> batch = source->next(batchSize, 0);
+			if (batch->getStatus() != QueryNextStatus::Success)
+				break;
+			++checked;
+			if (sameColumns(batch, batch->getEventBatch()))
+				++ok;
+		}
+		std::cout << "columns match records: " << ok << "/" << checked << " batches" << nl;
+	}
+
+	uint64_t matchesRecords = 0;
+	{
+		Ref<IRecordSource> source = columnsSource(opts, fields);
+		Stopwatch sw;
+		uint64_t records = 0;
+		for (;;)
+		{
+			Ref<IQueryBatchResult> batch = source->next(batchSize, 0);
+			if (batch->getStatus() != QueryNextStatus::Success)
+				break;
+
+			for (uint32_t i = 0; i < batch->getCount(); ++i)
+			{
+				Ref<IEventRecord> rec = batch->getRecord(i);
+				std::optional<uint8_t> level = rec->getLevel();
+				if (level && *level <= maxLevel && rec->getProviderName() == provider)
+					++matchesRecords;
+			}
+			records += batch->getCount();
+		}
+		report("filter records", records, sw.seconds());
+	}
+
+	uint64_t matchesColumns = 0;
+	{
+		Ref<IRecordSource> source = columnsSource(opts, fields);
+		Stopwatch sw;
+		uint64_t records = 0;
+		for (;;)
+		{
+			Ref<IQueryBatchResult> batch = source->next(batchSize, 0);
+			if (batch->getStatus() != QueryNextStatus::Success)
+				break;
+
+			// The provider is looked up once per batch, then it's comparing ids.
+			Ref<IEventBatch> columns = batch->getEventBatch();
+			uint32_t providerId = columns->findString(provider);
+			if (providerId != IEventBatch::NoString)
+			{
+				const uint32_t count = columns->getCount();
+				const EventField *fields = columns->getFields();
+				const uint8_t *levels = columns->getLevels();
+				const uint32_t *providers = columns->getProviderNames();
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					matchesColumns += hasAnyField(fields[i], EventField::Level) && levels[i] <= maxLevel && 
+						providers[i] == providerId;
+				}
+			}
+			records += columns->getCount();
+		}
+		report("filter columns", records, sw.seconds());
+	}
+
+	if (matchesRecords != matchesColumns)
+		std::cout << "MISMATCH: records " << matchesRecords << ", columns " << matchesColumns << nl;
+	else
+		std::cout << "matches: " << matchesColumns << nl;
+}
+
+// Reads the synthetic log (-count, default 200000) into memory in batches of
+// -batch records, as records and as columns, so only filtering is timed.
+// Returns the number of records.
+static uint64_t holdBatches(const Options &opts, EventField fields, 
+	std::vector<std::vector<Ref<IEventRecord>>> &records, std::vector<Ref<IEventBatch>> &columns)
+{
+	const uint32_t batchSize = uint32_t(opts.get("batch", uint64_t(1024)));
+	SyntheticRecordSource::Options options = syntheticOptions(opts);
+	options.recordCount = opts.get("count", uint64_t(200000));
+	Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(options);
+	source->queryChannelXPath("Synthetic", "*", Direction::Forward);
+	source->setFields(fields);
+
+	uint64_t recordCount = 0;
+	for (;;)
+	{
+		Ref<IQueryBatchResult> batch = source->next(batchSize, 0);
+		if (batch->getStatus() != QueryNextStatus::Success)
+			break;
+
+		std::vector<Ref<IEventRecord>> batchRecords;
+		for (uint32_t i = 0; i < batch->getCount(); ++i)
+			batchRecords.push_back(batch->getRecord(i));
+		records.push_back(std::move(batchRecords));
+		columns.push_back(batch->getEventBatch());
+		recordCount += batch->getCount();
+	}
+	return recordCount;
+}
+
+void EventLogBench::benchFilter(const Options &opts)
+{
+	const uint64_t passes = std::max<uint64_t>(1, opts.get("passes", uint64_t(10)));
+
+	std::vector<std::vector<Ref<IEventRecord>>> records;
+	std::vector<Ref<IEventBatch>> columns;
+	const uint64_t recordCount = holdBatches(opts, EventField::System, records, columns);
+	if (columns.empty())
+		return;
+
+	// The middle 80% of the log.
+	const uint64_t first = columns.front()->getTimeCreated()[0];
+	const uint64_t last = columns.back()->getTimeCreated()[columns.back()->getCount() - 1];
+	const Windows::Timestamp from{ first + (last - first) / 10 };
+	const Windows::Timestamp to{ last - (last - first) / 10 };
+
+	struct Case
+	{
+		const char *name;
+		Ref<EventFilter> filter;
+	};
+	std::vector<Case> cases;
+	auto addCase = [&cases](const char *name) -> EventFilter &
+	{
+		cases.push_back({ name, EventFilter::create() });
+		return cases.back().filter;
+	};
+	addCase("level <= 3").addLevelRange(0, 3);
+	addCase("event id in 6").addEventIds({ 7000, 7031, 4625, 10016, 20, 1000 });
+	addCase("event id in 40").addEventIds([] {
+		std::vector<uint16_t> ids;
+		for (uint16_t id = 0; id < 40; ++id)
+			ids.push_back(uint16_t(7000 + id));
+		return ids;
+	}());
+	addCase("time range").addTimeRange(from, to);
+	addCase("provider").addProviderNames({ "Service Control Manager", "Application Error" });
+	EventFilter &combined = addCase("level, ids, time");
+	combined.addLevelRange(0, 3);
+	combined.addEventIds({ 7000, 7031, 4625, 10016, 20, 1000 });
+	combined.addTimeRange(from, to);
+
+	std::vector<const FilterKernels *> kernelSets = { &FilterKernels::scalar(), FilterKernels::sse2(), FilterKernels::avx2() };
+	kernelSets.erase(std::remove(kernelSets.begin(), kernelSets.end(), nullptr), kernelSets.end());
+
+	char line[160] = {};
+	snprintf(line, sizeof(line), "%-28s %-8s %10s %10s %14s", "case", "kernels", "selected", "ns/record", "records/s");
+	std::cout << line << nl;
+
+	std::vector<uint64_t> selection;
+	for (const Case &c : cases)
+	{
+		const EventFilter &filter = c.filter;
+
+		// Through the getters, what consumers do now.
+		uint64_t expected = 0;
+		Stopwatch sw;
+		for (uint64_t pass = 0; pass < passes; ++pass)
+		{
+			expected = 0;
+			for (const auto &batch : records)
+			{
+				for (const Ref<IEventRecord> &rec : batch)
+					expected += filter.matches(rec);
+			}
+		}
+		double seconds = sw.seconds();
+		double total = double(recordCount * passes);
+		snprintf(line, sizeof(line), "%-28s %-8s %10llu %10.2f %14.0f", c.name, "getters", 
+			static_cast<unsigned long long>(expected), seconds * 1e9 / total, total / seconds);
+		std::cout << line << nl;
+
+		for (const FilterKernels *kernels : kernelSets)
+		{
+			uint64_t selected = 0;
+			Stopwatch ksw;
+			for (uint64_t pass = 0; pass < passes; ++pass)
+			{
+				selected = 0;
+				for (const Ref<IEventBatch> &batch : columns)
+					selected += filter.select(batch, selection, *kernels);
+			}
+			seconds = ksw.seconds();
+			snprintf(line, sizeof(line), "%-28s %-8s %10llu %10.2f %14.0f%s", c.name, kernels->name, 
+				static_cast<unsigned long long>(selected), seconds * 1e9 / total, total / seconds,
+				selected == expected ? "" : "  MISMATCH");
+			std::cout << line << nl;
+		}
+	}
+
+	// Same records selected, not just the same number.
+	uint64_t wrong = 0;
+	for (size_t b = 0; b < columns.size(); ++b)
+	{
+		for (const FilterKernels *kernels : kernelSets)
+		{
+			combined.select(columns[b], selection, *kernels);
+			for (size_t i = 0; i < records[b].size(); ++i)
+				wrong += ((selection[i / 64] >> (i % 64)) & 1) != uint64_t(combined.matches(records[b][i]));
+		}
+	}
+	std::cout << "selection bits differing from matches: " << wrong << nl;
+}
+
+// Event Log XPath text of the time, to the millisecond.
+static std::string xpathTime(Windows::Timestamp t)
+{
+	std::string s = Windows::to_string(t);
+	std::replace(s.begin(), s.end(), ' ', 'T');
+	return s + "Z";
+}
+
+void EventLogBench::benchXPath(const Options &opts)
+{
+	const uint64_t passes = std::max<uint64_t>(1, opts.get("passes", uint64_t(5)));
+
+	std::vector<std::vector<Ref<IEventRecord>>> records;
+	std::vector<Ref<IEventBatch>> columns;
+	const uint64_t recordCount = holdBatches(opts, EventField::System | EventField::Properties, records, columns);
+	if (columns.empty())
+		return;
+
+	// The middle 80% of the log, to the millisecond so the text is exact.
+	const uint64_t first = columns.front()->getTimeCreated()[0];
+	const uint64_t last = columns.back()->getTimeCreated()[columns.back()->getCount() - 1];
+	const Windows::Timestamp from{ (first + (last - first) / 10) / 10000 * 10000 };
+	const Windows::Timestamp to{ (last - (last - first) / 10) / 10000 * 10000 };
+
+	// Expressions with an IEventFilter that selects the same records.
+	struct Case
+	{
+		std::string xpath;
+		Ref<EventFilter> filter;
+	};
+	std::vector<Case> cases;
+	auto addCase = [&cases](std::string xpath) -> EventFilter &
+	{
+		cases.push_back({ std::move(xpath), EventFilter::create() });
+		return cases.back().filter;
+	};
+	addCase("*[System[Level<=3]]").addLevelRange(0, 3);
+	addCase("*[System[EventID=7000 or EventID=7031 or EventID=4625 or EventID=10016]]").addEventIds({ 7000, 7031, 4625, 10016 });
+	addCase("*[System[TimeCreated[@SystemTime>='" + xpathTime(from) + "' and @SystemTime<'" + xpathTime(to) + "']]]")
+		.addTimeRange(from, to);
+	addCase("*[System[Provider[@Name='Service Control Manager' or @Name='Application Error']]]")
+		.addProviderNames({ "Service Control Manager", "Application Error" });
+	EventFilter &combined = addCase("*[System[(Level=1 or Level=2 or Level=3) and Channel='System' and "
+		"(EventID=7000 or EventID=7031 or EventID=4625 or EventID=10016)]]");
+	combined.addLevelRange(1, 3);
+	combined.addChannels({ "System" });
+	combined.addEventIds({ 7000, 7031, 4625, 10016 });
+
+	// Checked against the filters and against themselves, record by record 
+	// and on the columns.
+	uint64_t wrong = 0;
+	std::vector<uint64_t> selection;
+	for (const Case &c : cases)
+	{
+		Ref<IXPathFilter> xpath = IXPathFilter::compile(c.xpath);
+		for (size_t b = 0; b < columns.size(); ++b)
+		{
+			xpath->select(columns[b], selection);
+			for (size_t i = 0; i < records[b].size(); ++i)
+			{
+				bool match = xpath->matches(records[b][i]);
+				wrong += match != c.filter->matches(records[b][i]);
+				wrong += match != bool((selection[i / 64] >> (i % 64)) & 1);
+			}
+		}
+	}
+	std::cout << "records differing from IEventFilter or select: " << wrong << nl << nl;
+
+	// And some the filters can't do.
+	std::vector<std::string> expressions;
+	for (const Case &c : cases)
+		expressions.push_back(c.xpath);
+	expressions.push_back("*[System[not(Level=4) and Execution[@ProcessID>1000] and band(Keywords,0xFFFF)=0]]");
+	expressions.push_back("*[System[TimeCreated[timediff(@SystemTime) <= 86400000]]]");
+	expressions.push_back("*[EventData[Data[@Name='LogonType']=3]]");
+	expressions.push_back("*[System[Level=4] and EventData[Data[@Name='ServiceName']='Windows Update']]");
+
+	char line[200] = {};
+	snprintf(line, sizeof(line), "%-8s %10s %10s %14s  %s", "method", "selected", "ns/record", "records/s", "xpath");
+	std::cout << line << nl;
+
+	for (const std::string &expression : expressions)
+	{
+		Ref<IXPathFilter> xpath = IXPathFilter::compile(expression);
+
+		uint64_t matched = 0;
+		Stopwatch sw;
+		for (uint64_t pass = 0; pass < passes; ++pass)
+		{
+			matched = 0;
+			for (const auto &batch : records)
+			{
+				for (const Ref<IEventRecord> &rec : batch)
+					matched += xpath->matches(rec);
+			}
+		}
+		double seconds = sw.seconds();
+		const double total = double(recordCount * passes);
+		snprintf(line, sizeof(line), "%-8s %10llu %10.2f %14.0f  %s", "matches", 
+			static_cast<unsigned long long>(matched), seconds * 1e9 / total, total / seconds, expression.c_str());
+		std::cout << line << nl;
+
+		if (hasAnyField(xpath->getFields(), EventField::Properties))
+			continue;
+
+		uint64_t selected = 0;
+		Stopwatch ssw;
+		for (uint64_t pass = 0; pass < passes; ++pass)
+		{
+			selected = 0;
+			for (const Ref<IEventBatch> &batch : columns)
+				selected += xpath->select(batch, selection);
+		}
+		seconds = ssw.seconds();
+		snprintf(line, sizeof(line), "%-8s %10llu %10.2f %14.0f", "select", 
+			static_cast<unsigned long long>(selected), seconds * 1e9 / total, total / seconds);
+		std::cout << line << nl;
+	}
+
+	// Filtering an EVTX file on its parser threads against reading it all 
+	// and testing each record.
+	std::string file = opts.get("file", std::string());
+	if (file.empty())
+		return;
+
+	const std::string query = opts.get("query", cases.back().xpath);
+	Ref<IXPathFilter> xpath = IXPathFilter::compile(query);
+	uint64_t afterwards = 0;
+	Stopwatch sw;
+	{
+		Ref<EvtxRecordSource> source = EvtxRecordSource::create();
+		source->queryFileXPath(file, "*", Direction::Forward);
+		for (;;)
+		{
+			Ref<IQueryBatchResult> batch = source->next(1024, 0);
+			if (batch->getStatus() != QueryNextStatus::Success)
+				break;
+			for (uint32_t i = 0; i < batch->getCount(); ++i)
+				afterwards += xpath->matches(batch->getRecord(i));
+		}
+	}
+	report("evtx, filtered after", afterwards, sw.seconds());
+
+	uint64_t parsing = 0;
+	Stopwatch psw;
+	{
+		Ref<EvtxRecordSource> source = EvtxRecordSource::create();
+		source->queryFileXPath(file, query, Direction::Forward);
+		for (;;)
+		{
+			Ref<IQueryBatchResult> batch = source->next(1024, 0);
+			if (batch->getStatus() != QueryNextStatus::Success)
+				break;
+			parsing += batch->getCount();
+		}
+	}
+	report("evtx, filtered while parsing", parsing, psw.seconds());
+	if (parsing != afterwards)
+		std::cout << "MISMATCH" << nl;
+}
+
+// A QueryList of Queries over the synthetic channels, shaped like the ones
+// management tools write: selects per provider by level and event id, the
+// same select repeated in other Queries and some "*" with suppressions.
+static std::string syntheticQueryList(uint64_t queries, uint64_t seed)
+{
+	struct Channel
+	{
+		const char *path;
+		std::vector<const char *> providers;
+		std::vector<uint16_t> ids;
+	};
+	static const Channel channels[] = {
+		{ "System", { "Service Control Manager", "Microsoft-Windows-DistributedCOM", "Microsoft-Windows-Kernel-General", 
+			"Microsoft-Windows-GroupPolicy", "Microsoft-Windows-Winlogon" }, { 7000, 7001, 7031, 7036, 7040, 10016, 1, 16, 1500 } },
+		{ "Security", { "Microsoft-Windows-Security-Auditing" }, { 4624, 4625, 4634, 4672, 4688 } },
+		{ "Application", { "Application Error", "MsiInstaller" }, { 1000, 11707, 11708 } },
+		{ "Microsoft-Windows-TaskScheduler/Operational", { "Microsoft-Windows-TaskScheduler" }, { 100, 102, 107, 201 } },
+	};
+
+	std::mt19937_64 rng(seed);
+	auto pick = [&rng](size_t n) { return size_t(rng() % n); };
+
+	std::vector<std::string> selects;
+	std::string xml = "<QueryList>\n";
+	for (uint64_t q = 0; q < queries; ++q)
+	{
+		const Channel &channel = channels[pick(std::size(channels))];
+		xml += "  <Query Id=\"" + std::to_string(q) + "\" Path=\"" + channel.path + "\">\n";
+
+		const bool suppress = pick(4) == 0;
+		const size_t selectCount = 1 + pick(4);
+		for (size_t s = 0; s < selectCount; ++s)
+		{
+			std::string xpath;
+			if (suppress && pick(3) == 0)
+			{
+				xpath = "*";
+			}
+			else if (!selects.empty() && pick(4) == 0)
+			{
+				// Repeated from another Query, maybe of another channel.
+				xpath = selects[pick(selects.size())];
+			}
+			else
+			{
+				const char *provider = channel.providers[pick(channel.providers.size())];
+				xpath = std::string("*[System[Provider[@Name='") + provider + "'] and ";
+				xpath += pick(2) == 0 ? "(Level=1 or Level=2 or Level=3)" : "Level&lt;=2";
+				xpath += " and (";
+				const size_t idCount = 1 + pick(3);
+				for (size_t i = 0; i < idCount; ++i)
+					xpath += (i ? " or EventID=" : "EventID=") + std::to_string(channel.ids[pick(channel.ids.size())]);
+				xpath += ")]]";
+				selects.push_back(xpath);
+			}
+			xml += std::string("    <Select Path=\"") + channel.path + "\">" + xpath + "</Select>\n";
+		}
+
+		if (suppress)
+		{
+			xml += std::string("    <Suppress Path=\"") + channel.path + "\">*[System[EventID=" 
+				+ std::to_string(channel.ids[pick(channel.ids.size())]) + "]]</Suppress>\n";
+		}
+		xml += "  </Query>\n";
+	}
+	xml += "</QueryList>\n";
+	return xml;
+}
+
+static size_t countSelects(const QueryPlan &plan)
+{
+	size_t count = 0;
+	for (const QueryPlan::Path &path : plan.getPaths())
+	{
+		for (const QueryPlan::Clause &clause : path.clauses)
+			count += clause.selects.size() + clause.suppresses.size();
+	}
+	return count;
+}
+
+void EventLogBench::benchQueryList(const Options &opts)
+{
+	const uint64_t passes = std::max<uint64_t>(1, opts.get("passes", uint64_t(5)));
+	const std::string xml = syntheticQueryList(opts.get("queries", uint64_t(200)), opts.get("seed", uint64_t(1)));
+
+	Stopwatch sw;
+	QueryPlan written = QueryPlan::parse(xml);
+	const double parseSeconds = sw.seconds();
+
+	QueryPlan optimized = written;
+	Stopwatch osw;
+	optimized.optimize();
+	const double optimizeSeconds = osw.seconds();
+
+	const std::string optimizedXml = optimized.toXml();
+	QueryPlan reread = QueryPlan::parse(optimizedXml);
+
+	char line[200] = {};
+	snprintf(line, sizeof(line), "written:   %6zu selects/suppresses %8zu bytes, parsed in %.3f ms", 
+		countSelects(written), xml.size(), parseSeconds * 1e3);
+	std::cout << line << nl;
+	snprintf(line, sizeof(line), "optimized: %6zu selects/suppresses %8zu bytes, in %.3f ms", 
+		countSelects(optimized), optimizedXml.size(), optimizeSeconds * 1e3);
+	std::cout << line << nl;
+	if (opts.get("print", uint64_t(0)))
+		std::cout << optimizedXml;
+
+	// The records of each path, with the plan as written, optimized and 
+	// read back from the optimized XML compiled for it.
+	struct PathRecords
+	{
+		std::string path;
+		std::vector<Ref<IEventRecord>> records;
+		std::vector<Ref<IXPathFilter>> filters;
+	};
+	std::vector<PathRecords> paths;
+	for (const QueryPlan::Path &path : written.getPaths())
+	{
+		PathRecords p{ path.path, {}, {} };
+		for (const QueryPlan *plan : { &written, &optimized, &reread })
+			p.filters.push_back(XPathFilter::create(*plan->getFilter(path.path)));
+		paths.push_back(std::move(p));
+	}
+
+	std::vector<std::vector<Ref<IEventRecord>>> records;
+	std::vector<Ref<IEventBatch>> columns;
+	uint64_t recordCount = holdBatches(opts, EventField::System, records, columns);
+	for (const auto &batch : records)
+	{
+		for (const Ref<IEventRecord> &rec : batch)
+		{
+			std::string channel = rec->getChannel().value_or("");
+			for (PathRecords &p : paths)
+			{
+				if (p.path == channel)
+					p.records.push_back(rec);
+			}
+		}
+	}
+
+	uint64_t wrong = 0;
+	for (const PathRecords &p : paths)
+	{
+		for (const Ref<IEventRecord> &rec : p.records)
+		{
+			bool match = p.filters[0]->matches(rec);
+			wrong += match != p.filters[1]->matches(rec);
+			wrong += match != p.filters[2]->matches(rec);
+		}
+	}
+	std::cout << "records selected differently once optimized: " << wrong << nl;
+
+	const char *names[] = { "written", "optimized" };
+	for (size_t f = 0; f < std::size(names); ++f)
+	{
+		uint64_t selected = 0;
+		Stopwatch esw;
+		for (uint64_t pass = 0; pass < passes; ++pass)
+		{
+			selected = 0;
+			for (const PathRecords &p : paths)
+			{
+				for (const Ref<IEventRecord> &rec : p.records)
+					selected += p.filters[f]->matches(rec);
+			}
+		}
+		const double seconds = esw.seconds();
+		const double total = double(recordCount * passes);
+		snprintf(line, sizeof(line), "%-10s %10llu selected %10.2f ns/record %14.0f records/s", names[f], 
+			static_cast<unsigned long long>(selected), seconds * 1e9 / total, total / seconds);
+		std::cout << line << nl;
+	}
+}
+
+// Time from the simulated channel writing each record to the consumer 
+// getting it.
+class LatencyRecorder
+{
+	const SyntheticSubscriptionSource &mSource;
+	std::vector<double> mMicros{};
+	uint64_t mRecords = 0;
+public:
+	explicit LatencyRecorder(const SyntheticSubscriptionSource &source)
+		: mSource(source)
+	{}
+
+	void add(const IQueryBatchResult &batch)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < batch.getCount(); ++i)
+		{
+			if (std::optional<uint64_t> recordId = batch.getRecord(i)->getRecordId())
+				mMicros.push_back(std::chrono::duration<double, std::micro>(now - mSource.getWriteTime(*recordId)).count());
+		}
+		mRecords += batch.getCount();
+	}
+
+	void report(const char *name, double seconds, const SubscriptionStats *stats)
+	{
+		std::sort(mMicros.begin(), mMicros.end());
+		auto percentile = [this](double p) { return mMicros.empty() ? 0.0 : mMicros[size_t(p * double(mMicros.size() - 1))]; };
+
+		char line[240] = {};
+		snprintf(line, sizeof(line), "%-6s %10llu records %10.0f records/s  latency p50 %9.1f us  p99 %9.1f us  max %9.1f us",
+			name, static_cast<unsigned long long>(mRecords), double(mRecords) / seconds, percentile(0.5), percentile(0.99), 
+			percentile(1.0));
+		std::cout << line;
+		if (stats)
+		{
+			snprintf(line, sizeof(line), "  dropped %llu  peak buffered %llu  blocked %llu", static_cast<unsigned long long>(stats->dropped), 
+				static_cast<unsigned long long>(stats->peakBuffered), static_cast<unsigned long long>(stats->blocked));
+			std::cout << line;
+		}
+		std::cout << nl;
+	}
+};
+
+// Stands in for whatever the consumer does with a batch.
+static void simulateWork(uint64_t micros)
+{
+	if (micros > 0)
+		std::this_thread::sleep_for(std::chrono::microseconds(micros));
+}
+
+void EventLogBench::benchSubscribe(const Options &opts)
+{
+	SyntheticSubscriptionSource::Options sourceOptions{};
+	sourceOptions.recordsPerSecond = opts.get("rate", uint64_t(20000));
+	sourceOptions.seed = opts.get("seed", sourceOptions.seed);
+
+	// Everything is written up front at rate 0, so there are no future events.
+	IEventSubscription::Options options{};
+	options.start = sourceOptions.recordsPerSecond == 0 ? SubscriptionStart::Oldest : SubscriptionStart::FutureEvents;
+	options.batchSize = uint32_t(opts.get("batch", uint64_t(options.batchSize)));
+	options.bufferSize = uint32_t(opts.get("buffer", uint64_t(options.bufferSize)));
+	options.fields = EventField::RecordId;
+	const std::string overflow = opts.get("overflow", std::string("block"));
+	options.overflow = overflow == "oldest" ? OverflowPolicy::DropOldest : 
+		overflow == "newest" ? OverflowPolicy::DropNewest : OverflowPolicy::Block;
+
+	const auto duration = std::chrono::seconds(opts.get("seconds", uint64_t(2)));
+	const uint64_t work = opts.get("work", uint64_t(0));
+	const auto interval = std::chrono::milliseconds(opts.get("interval", uint64_t(100)));
+
+	// Polling the channel, the way it's done without a subscription.
+	{
+		Ref<SyntheticSubscriptionSource> source = SyntheticSubscriptionSource::create(sourceOptions);
+		source->setFields(options.fields);
+		source->subscribe("System", "*", options.start, "");
+		LatencyRecorder latency(source.get());
+		Stopwatch sw;
+		const auto end = std::chrono::steady_clock::now() + duration;
+		while (std::chrono::steady_clock::now() < end)
+		{
+			Ref<IQueryBatchResult> batch = source->next(options.batchSize);
+			if (batch->getCount() == 0)
+			{
+				std::this_thread::sleep_for(interval);
+				continue;
+			}
+			latency.add(batch.get());
+			simulateWork(work);
+		}
+		latency.report("poll", sw.seconds(), nullptr);
+	}
+
+	// Pull mode, waiting on the subscription.
+	{
+		Ref<SyntheticSubscriptionSource> source = SyntheticSubscriptionSource::create(sourceOptions);
+		LatencyRecorder latency(source.get());
+		Ref<EventSubscription> subscription = EventSubscription::create(source, "System", "*", options, nullptr);
+		Stopwatch sw;
+		const auto end = std::chrono::steady_clock::now() + duration;
+		for (auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now())
+		{
+			const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count();
+			Ref<IQueryBatchResult> batch = subscription->getNextBatch(uint32_t(remaining + 1));
+			if (batch->getCount() == 0)
+				continue;
+			latency.add(batch.get());
+			simulateWork(work);
+		}
+		const double seconds = sw.seconds();
+		SubscriptionStats stats = subscription->getStats();
+		subscription->close();
+		latency.report("pull", seconds, &stats);
+	}
+
+	// Push mode, the handler on the subscription's thread.
+	{
+		Ref<SyntheticSubscriptionSource> source = SyntheticSubscriptionSource::create(sourceOptions);
+		LatencyRecorder latency(source.get());
+		Ref<EventSubscription> subscription = EventSubscription::create(source, "System", "*", options, 
+			[&latency, work](Ref<IQueryBatchResult> batch) {
+				latency.add(batch.get());
+				simulateWork(work);
+			});
+		Stopwatch sw;
+		std::this_thread::sleep_for(duration);
+		const double seconds = sw.seconds();
+		SubscriptionStats stats = subscription->getStats();
+		subscription->close();
+		latency.report("push", seconds, &stats);
+	}
+}
+
+// Made up but stable SID for the synthetic user name.
+static std::string userSid(const std::string &user)
+{
+	return "S-1-5-21-3623811015-3361044348-30300820-" + std::to_string(1000 + std::hash<std::string>{}(user) % 1000);
+}
+
+// Text of a payload property, the writer only does strings.
+static std::string propertyText(const Windows::EventLog::EventPropertyValue &value)
+{
+	return std::visit([](const auto &v) -> std::string {
+		using T = std::decay_t<decltype(v)>;
+		if constexpr (std::is_same_v<T, std::string>)
+			return v;
+		else if constexpr (std::is_same_v<T, GUID> || std::is_same_v<T, Windows::Timestamp>)
+			return Windows::to_string(v);
+		else if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t> || std::is_same_v<T, double>)
+			return std::to_string(v);
+		else if constexpr (std::is_same_v<T, bool>)
+			return v ? "true" : "false";
+		else
+			return {};
+	}, value);
+}
+
+// Converts a synthetic record for the EVTX writer.
+static EvtxWriterRecord toWriterRecord(const IEventRecord &rec)
+{
+	EvtxWriterRecord w{};
+	w.providerName = rec.getProviderName().value_or("");
+	w.providerGuid = rec.getProviderGuid().value_or(GUID{});
+	w.eventId = rec.getEventId().value_or(0);
+	w.qualifiers = rec.getQualifers().value_or(0);
+	w.version = rec.getVersion().value_or(0);
+	w.level = rec.getLevel().value_or(0);
+	w.task = rec.getTask().value_or(0);
+	w.opcode = rec.getOpcode().value_or(0);
+	w.keywords = uint64_t(rec.getKeywords().value_or(0));
+	w.timeCreated = rec.getTimeCreated().value_or(Windows::Timestamp{}).timestamp;
+	w.recordId = rec.getRecordId().value_or(0);
+	w.activityId = rec.getActivityId();
+	w.processId = rec.getProcessId().value_or(0);
+	w.threadId = rec.getThreadId().value_or(0);
+	w.channel = rec.getChannel().value_or("");
+	w.computer = rec.getComputer().value_or("");
+	if (auto user = rec.getUser())
+		w.userSid = userSid(*user);
+	for (const Windows::EventLog::EventProperty &property : rec.getProperties())
+		w.data.push_back({ property.name, propertyText(property.value) });
+	w.data.push_back({ "Message", rec.getMessage() });
+	return w;
+}
+
+// Where a reader started from a bookmark picks up. Returns the id of its 
+// first record, zero if there is none.
+static uint64_t resumeAt(const Options &opts, const std::string &bookmarkXml, Direction dir)
+{
+	Ref<IEventReader> reader = EventReader::openChannel(SyntheticRecordSource::create(syntheticOptions(opts)), 
+		"Synthetic", "*", dir);
+	reader->seek(IBookmark::fromXml(bookmarkXml).get());
+	return reader->next() ? reader->getRecord()->getRecordId().value_or(0) : 0;
+}
+
+void EventLogBench::benchBookmark(const Options &opts)
+{
+	const uint64_t count = opts.get("count", uint64_t(1000000));
+	const uint32_t every = uint32_t(opts.get("every", uint64_t(1000)));
+	const uint32_t interval = uint32_t(opts.get("interval", uint64_t(100)));
+	const uint64_t persist = opts.get("persist", uint64_t(100));
+	const EventField fields = EventField::EventId | EventField::TimeCreated;
+
+	// Resuming. Stop halfway, as if the process died, and start again from 
+	// the last checkpoint: records after it are read again, none are 
+	// skipped. Then the same with a checkpoint on the way out, which picks 
+	// up right after the last record.
+	for (Direction dir : { Direction::Forward, Direction::Reverse })
+	{
+		const char *name = dir == Direction::Forward ? "forward" : "reverse";
+		Ref<IEventReader> reader = EventReader::openChannel(SyntheticRecordSource::create(syntheticOptions(opts)), 
+			"Synthetic", "*", dir);
+		reader->setFields(fields);
+		std::string saved;
+		reader->setCheckpoint(IBookmark::create(), every, 0, [&saved](const IBookmark &bookmark) { saved = bookmark.toXml(); });
+
+		uint64_t lastId = 0;
+		for (uint64_t i = 0; i < count / 2 && reader->next(); ++i)
+			lastId = reader->getRecord()->getRecordId().value_or(0);
+
+		uint64_t resumedId = resumeAt(opts, saved, dir);
+		uint64_t reread = dir == Direction::Forward ? lastId - resumedId + 1 : resumedId - lastId + 1;
+		std::cout << name << " stopped at RecordId " << lastId << ", resumed at " << resumedId << 
+			" reading " << reread << " records again" << nl;
+
+		reader->checkpoint();
+		uint64_t expected = dir == Direction::Forward ? lastId + 1 : lastId - 1;
+		resumedId = resumeAt(opts, saved, dir);
+		std::cout << name << " after checkpoint() resumed at RecordId " << resumedId << 
+			(resumedId == expected ? " ok" : " WRONG") << nl;
+	}
+
+	// Cost. Persisting is simulated by serializing the bookmark and sleeping 
+	// -persist microseconds, like a write to disk.
+	struct Checkpoint
+	{
+		std::string name;
+		bool enabled;
+		uint32_t records;
+		uint32_t millis;
+	};
+	const Checkpoint checkpoints[] =
+	{
+		{ "no bookmark", false, 0, 0 },
+		{ "bookmark, no checkpoints", true, 0, 0 },
+		{ "checkpoint every record", true, 1, 0 },
+		{ "checkpoint every " + std::to_string(every), true, every, 0 },
+		{ "checkpoint every " + std::to_string(interval) + " ms", true, 0, interval },
+	};
+
+	for (const Checkpoint &checkpoint : checkpoints)
+	{
+		// Persisting every record is slow, a hundredth of the records will do.
+		SyntheticRecordSource::Options options = syntheticOptions(opts);
+		if (checkpoint.records == 1)
+			options.recordCount = std::max<uint64_t>(1, count / 100);
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(options);
+
+		uint64_t persisted = 0;
+		Stopwatch sw;
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		batchOptions(reader, opts);
+		reader->setFields(fields);
+		if (checkpoint.enabled)
+		{
+			reader->setCheckpoint(IBookmark::create(), checkpoint.records, checkpoint.millis, 
+				[&persisted, persist](const IBookmark &bookmark)
+				{
+					std::string xml = bookmark.toXml();
+					persisted += xml.size() > 0;
+					simulateWork(persist);
+				});
+		}
+		uint64_t records = drainEventIds(reader);
+		report(checkpoint.name.c_str(), records, sw.seconds());
+		if (checkpoint.enabled)
+			std::cout << "  " << persisted << " checkpoints" << nl;
+	}
+}
+
+void EventLogBench::benchExecutor(const Options &opts)
+{
+	static const uint32_t queryCounts[] = { 1, 100, 1000 };
+	const uint64_t count = opts.get("count", uint64_t(1000000));
+	const uint32_t batchSize = uint32_t(opts.get("batch", uint64_t(64)));
+	const uint32_t prefetch = uint32_t(opts.get("prefetch", uint64_t(2)));
+	const uint32_t threads = uint32_t(opts.get("threads", uint64_t(std::max(1u, std::thread::hardware_concurrency()))));
+
+	for (uint32_t queries : queryCounts)
+	{
+		for (bool shared : { false, true })
+		{
+			// A thread per query is the same as an executor of one each.
+			std::shared_ptr<QueryExecutor> sharedExecutor = shared ? std::make_shared<QueryExecutor>(threads) : nullptr;
+			uint32_t executorThreads = shared ? sharedExecutor->getThreadCount() : queries;
+
+			// The log is split between the queries.
+			SyntheticRecordSource::Options options = syntheticOptions(opts);
+			options.recordCount = std::max<uint64_t>(1, count / queries);
+
+			Stopwatch openTime;
+			std::vector<Ref<IEventLogQuery>> all;
+			all.reserve(queries);
+			for (uint32_t i = 0; i < queries; ++i)
+			{
+				std::shared_ptr<QueryExecutor> executor = shared ? sharedExecutor : std::make_shared<QueryExecutor>(1);
+				Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(options), executor);
+				query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+				query->setFields(EventField::System);
+				query->setPrefetchDepth(prefetch);
+				all.push_back(std::move(query));
+			}
+			double openSeconds = openTime.seconds();
+
+			// A consumer per hardware thread takes a batch from each of its 
+			// queries in turn, like a collector multiplexing channels.
+			const uint32_t consumerCount = std::min<uint32_t>(queries, threads);
+			std::atomic<uint64_t> records{ 0 };
+			Stopwatch readTime;
+			std::vector<std::thread> consumers;
+			for (uint32_t c = 0; c < consumerCount; ++c)
+			{
+				consumers.emplace_back([&, c] {
+					std::vector<IEventLogQuery *> open;
+					for (uint32_t i = c; i < queries; i += consumerCount)
+						open.push_back(&all[i].get());
+
+					uint64_t read = 0;
+					while (!open.empty())
+					{
+						for (size_t i = 0; i < open.size();)
+						{
+							Ref<IQueryBatchResult> batch = open[i]->getNextBatch(batchSize, Windows::INFINITE);
+							read += batch->getStatus() == QueryNextStatus::Success ? batch->getCount() : 0;
+							if (batch->getStatus() == QueryNextStatus::Success)
+							{
+								++i;
+							}
+							else
+							{
+								open[i] = open.back();
+								open.pop_back();
+							}
+						}
+					}
+					records += read;
+				});
+			}
+			for (std::thread &consumer : consumers)
+				consumer.join();
+			double readSeconds = readTime.seconds();
+
+			Stopwatch closeTime;
+			all.clear();
+			sharedExecutor.reset();
+			double closeSeconds = closeTime.seconds();
+
+			std::string name = std::to_string(queries) + (shared ? " queries shared" : " queries thread each");
+			report(name.c_str(), records, readSeconds);
+
+			char buf[160] = {};
+			snprintf(buf, sizeof(buf), "  %u query threads, open %.3f s, close %.3f s", executorThreads, openSeconds, closeSeconds);
+			std::cout << buf << nl;
+		}
+	}
+}
+
+// A call made the way EventLogQuery made them before CallPool: allocated 
+// with an event of its own.
+class EventCall : public Windows::IRefObject
+{
+public:
+	AutoResetEvent done{ Windows::FALSE };
+};
+
+// The same call, recycled and completed through a futex.
+class PooledCall : public Windows::IRefObject
+{
+public:
+	Completion done{};
+};
+
+static void reportCalls(const char *name, uint64_t calls, double seconds)
+{
+	char buf[160] = {};
+	snprintf(buf, sizeof(buf), "%-32s %12llu calls   %9.3f s %12.1f ns/call",
+		name, static_cast<unsigned long long>(calls), seconds, calls > 0 ? seconds * 1e9 / double(calls) : 0.0);
+	std::cout << buf << nl;
+}
+
+// Calls handed to another thread that completes them, like the query's 
+// strand does.
+template<typename Call, typename MakeCall>
+static void benchCallRoundTrip(const char *name, uint64_t count, MakeCall &&makeCall)
+{
+	MpmcRingQueue<RefPtr<Call>> requests;
+	std::thread server([&] {
+		for (;;)
+		{
+			RefPtr<Call> call = requests.dequeue().value_or(nullptr);
+			if (!call)
+				break;
+			call->done.set();
+		}
+	});
+
+	Stopwatch sw;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		RefPtr<Call> call = makeCall();
+		requests.enqueue(call);
+		call->done.wait(Windows::INFINITE);
+	}
+	double seconds = sw.seconds();
+
+	requests.enqueue(nullptr);
+	server.join();
+	reportCalls(name, count, seconds);
+}
+
+void EventLogBench::benchCalls(const Options &opts)
+{
+	const uint64_t count = opts.get("count", uint64_t(1000000));
+	CallPool<PooledCall> pool;
+	auto makeEventCall = [] { return Windows::RefObject<EventCall>::create(); };
+	auto makePooledCall = [&pool] { return pool.acquire(); };
+
+	// Making, completing and dropping a call, without handing it over.
+	{
+		Stopwatch sw;
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			RefPtr<EventCall> call = makeEventCall();
+			call->done.set();
+			call->done.wait(Windows::INFINITE);
+		}
+		reportCalls("call object, event", count, sw.seconds());
+	}
+	{
+		Stopwatch sw;
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			RefPtr<PooledCall> call = makePooledCall();
+			call->done.set();
+			call->done.wait(Windows::INFINITE);
+		}
+		reportCalls("call object, pooled", count, sw.seconds());
+	}
+
+	// Through another thread. The hand over costs the most when both sides 
+	// can't run at once.
+	benchCallRoundTrip<EventCall>("round trip, event", count / 10, makeEventCall);
+	benchCallRoundTrip<PooledCall>("round trip, pooled", count / 10, makePooledCall);
+
+	// All the way through EventLogQuery, a void call and a batch of one.
+	SyntheticRecordSource::Options options = syntheticOptions(opts);
+	options.recordCount = std::numeric_limits<uint32_t>::max();
+	Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(options));
+	query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+	{
+		Stopwatch sw;
+		for (uint64_t i = 0; i < count / 10; ++i)
+			query->setFields(EventField::All);
+		reportCalls("EventLogQuery::setFields", count / 10, sw.seconds());
+	}
+	{
+		Stopwatch sw;
+		for (uint64_t i = 0; i < count / 10; ++i)
+			query->getNextBatch(1, Windows::INFINITE);
+		reportCalls("EventLogQuery::getNextBatch", count / 10, sw.seconds());
+	}
+}
+
+void EventLogBench::benchAsync(const Options &opts)
+{
+	const uint32_t queries = uint32_t(std::max<uint64_t>(1, opts.get("queries", uint64_t(100))));
+	const uint64_t count = opts.get("count", uint64_t(100000));
+	const uint32_t batchSize = uint32_t(opts.get("batch", uint64_t(16)));
+	const uint32_t threads = uint32_t(opts.get("threads", uint64_t(8)));
+
+	// Slow sources, so there's I/O to overlap. The log is split between 
+	// the queries.
+	SyntheticRecordSource::Options options = syntheticOptions(opts);
+	options.recordCount = std::max<uint64_t>(1, count / queries);
+	options.nextLatencyMicros = uint32_t(opts.get("latency", uint64_t(500)));
+
+	for (bool async : { false, true })
+	{
+		std::shared_ptr<QueryExecutor> executor = std::make_shared<QueryExecutor>(threads);
+		std::vector<Ref<IEventLogQuery>> all;
+		all.reserve(queries);
+		for (uint32_t i = 0; i < queries; ++i)
+		{
+			Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(options), executor);
+			query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+			query->setFields(EventField::System);
+			all.push_back(std::move(query));
+		}
+
+		uint64_t records = 0;
+		Stopwatch sw;
+		if (!async)
+		{
+			// A batch from each query in turn, waiting on each.
+			std::vector<IEventLogQuery *> open;
+			for (Ref<IEventLogQuery> &query : all)
+				open.push_back(&query.get());
+
+			while (!open.empty())
+			{
+				for (size_t i = 0; i < open.size();)
+				{
+					Ref<IQueryBatchResult> batch = open[i]->getNextBatch(batchSize, Windows::INFINITE);
+					if (batch->getStatus() == QueryNextStatus::Success)
+					{
+						records += batch->getCount();
+						++i;
+					}
+					else
+					{
+						open[i] = open.back();
+						open.pop_back();
+					}
+				}
+			}
+		}
+		else
+		{
+			// A call outstanding on every query. The callbacks hand the 
+			// batches back and this thread asks for the next.
+			struct Completed
+			{
+				uint32_t query = 0;
+				uint32_t records = 0;
+				bool more = false;
+			};
+			auto completed = std::make_unique<MpmcRingQueue<Completed, 1024>>();
+
+			auto request = [&](uint32_t i) {
+				all[i]->getNextBatchAsync(batchSize, Windows::INFINITE,
+					[&completed, i](Ref<IQueryBatchResult> batch, std::exception_ptr error)
+					{
+						bool more = !error && batch->getStatus() == QueryNextStatus::Success;
+						completed->enqueue(Completed{ i, more ? batch->getCount() : 0, more });
+					});
+			};
+
+			for (uint32_t i = 0; i < queries; ++i)
+				request(i);
+
+			uint32_t open = queries;
+			while (open > 0)
+			{
+				Completed c = completed->dequeue().value();
+				records += c.records;
+				if (c.more)
+					request(c.query);
+				else
+					--open;
+			}
+		}
+		double seconds = sw.seconds();
+
+		all.clear();
+		std::string name = std::to_string(queries) + (async ? " queries async" : " queries blocking");
+		report(name.c_str(), records, seconds);
+	}
+
+	// A callback starting the next call while the query's queue is full 
+	// mustn't wait on the strand that's running it.
+	{
+		const uint32_t queued = 16;
+		SyntheticRecordSource::Options slow = syntheticOptions(opts);
+		slow.nextLatencyMicros = 50000;
+		Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(slow));
+		query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+
+		std::atomic<uint32_t> callbacks{ 0 };
+		Completion done{};
+		auto counted = [&](Ref<IQueryBatchResult>, std::exception_ptr)
+		{
+			if (++callbacks == queued + 2)
+				done.set();
+		};
+
+		query->getNextBatchAsync(1, Windows::INFINITE,
+			[&](Ref<IQueryBatchResult> batch, std::exception_ptr error)
+			{
+				query->getNextBatchAsync(1, Windows::INFINITE, counted);
+				counted(std::move(batch), error);
+			});
+		// Let the strand take the first call, then fill the queue behind it.
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		for (uint32_t i = 0; i < queued; ++i)
+			query->getNextBatchAsync(1, Windows::INFINITE, counted);
+
+		bool ok = done.wait(30000);
+		std::cout << "callback with queue full: " << (ok ? "ok" : "FAILED") << nl;
+		// The strand is stuck, so the query can't be destroyed.
+		if (!ok)
+			std::exit(1);
+	}
+
+	// The last reference to a query dropped in its callback. The query goes
+	// once the callback returns, cancelling the call it started.
+	{
+		Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(syntheticOptions(opts)));
+		query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+
+		std::atomic<bool> cancelled{ false };
+		Completion done{};
+		IEventLogQuery &q = query.get();
+		q.getNextBatchAsync(1, Windows::INFINITE,
+			[&, query = std::move(query)](Ref<IQueryBatchResult>, std::exception_ptr) mutable
+			{
+				Ref<IEventLogQuery> last = std::move(query);
+				last->getNextBatchAsync(1, Windows::INFINITE, 
+					[&](Ref<IQueryBatchResult>, std::exception_ptr error)
+					{
+						cancelled = error != nullptr;
+						done.set();
+					});
+			});
+
+		bool ok = done.wait(30000) && cancelled;
+		std::cout << "query released in its callback: " << (ok ? "ok" : "FAILED") << nl;
+		if (!ok)
+			std::exit(1);
+	}
+}
+
+#if defined(__cpp_impl_coroutine)
+
+// Starts when called and runs to the end, with nothing to await it. Enough
+// to drive an AsyncGenerator.
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+static DetachedTask sumEventIdsAsync(IEventLogQuery &query, uint32_t batchSize, uint64_t &records, 
+	uint64_t &checksum, Completion &done, Resumer resume)
+{
+	{
+		AsyncGenerator<EventView> events = generateEventsAsync(query, batchSize, Windows::INFINITE, std::move(resume));
+		while (const EventView *event = co_await events.next())
+		{
+			checksum += event->getEventId();
+			++records;
+		}
+	}
+	done.set();
+}
+
+void EventLogBench::benchCoroutine(const Options &opts)
+{
+	const uint32_t batchSize = uint32_t(opts.get("batch", uint64_t(64)));
+	const uint32_t prefetch = uint32_t(opts.get("prefetch", uint64_t(0)));
+
+	// The same fields all round, so it's only the loop that differs.
+	{
+		Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+		Ref<IEventReader> reader = EventReader::openChannel(source, "Synthetic", "*", Direction::Forward);
+		reader->setBatchSize(batchSize);
+		reader->setPrefetchDepth(prefetch);
+		reader->setFields(EventField::System);
+
+		Stopwatch sw;
+		uint64_t records = 0;
+		uint64_t checksum = 0;
+		while (reader->next())
+		{
+			Ref<IEventRecord> rec = reader->getRecord();
+			checksum += rec->getEventId().value_or(0);
+			++records;
+		}
+		report("reader loop", records, sw.seconds());
+		if (checksum == 1)
+			std::cout << nl;
+	}
+
+	auto openQuery = [&] {
+		Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(syntheticOptions(opts)));
+		query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+		query->setFields(EventField::System);
+		query->setPrefetchDepth(prefetch);
+		return query;
+	};
+
+	{
+		Ref<IEventLogQuery> query = openQuery();
+
+		Stopwatch sw;
+		uint64_t records = 0;
+		uint64_t checksum = 0;
+		for (const EventView &event : generateEvents(query.get(), batchSize, Windows::INFINITE))
+		{
+			checksum += event.getEventId();
+			++records;
+		}
+		report("generator", records, sw.seconds());
+		if (checksum == 1)
+			std::cout << nl;
+	}
+
+	{
+		Ref<IEventLogQuery> query = openQuery();
+
+		Stopwatch sw;
+		uint64_t records = 0;
+		uint64_t checksum = 0;
+		Completion done;
+		sumEventIdsAsync(query.get(), batchSize, records, checksum, done, nullptr);
+		done.wait(Windows::INFINITE);
+		report("async generator", records, sw.seconds());
+		if (checksum == 1)
+			std::cout << nl;
+	}
+
+	// Resumed on this thread rather than the query's worker, which is left
+	// free to read ahead.
+	{
+		Ref<IEventLogQuery> query = openQuery();
+
+		Stopwatch sw;
+		uint64_t records = 0;
+		uint64_t checksum = 0;
+		Completion done;
+		MpmcRingQueue<std::coroutine_handle<>> resumes;
+		sumEventIdsAsync(query.get(), batchSize, records, checksum, done, 
+			[&resumes](std::coroutine_handle<> handle) { resumes.enqueue(handle); });
+		while (!done.wait(0))
+			resumes.dequeue().value().resume();
+		report("async generator, loop", records, sw.seconds());
+		if (checksum == 1)
+			std::cout << nl;
+	}
+}
+
+#endif
+
+void EventLogBench::benchCancel(const Options &opts)
+{
+	const uint32_t queries = uint32_t(std::max<uint64_t>(1, opts.get("queries", uint64_t(16))));
+
+	// Fetches that take far longer than anyone wants to wait at shutdown, 
+	// like EvtNext on a quiet channel with a long timeout.
+	SyntheticRecordSource::Options options = syntheticOptions(opts);
+	options.nextLatencyMicros = uint32_t(opts.get("latency", uint64_t(10000000)));
+
+	// Readers blocked in next(), each on a thread of its own, all sharing 
+	// one token.
+	{
+		Ref<ICancellationToken> token = ICancellationToken::create();
+		std::vector<Ref<IEventReader>> readers;
+		for (uint32_t i = 0; i < queries; ++i)
+		{
+			Ref<IEventReader> reader = EventReader::openChannel(SyntheticRecordSource::create(options), 
+				"Synthetic", "*", Direction::Forward);
+			reader->setCancellationToken(token);
+			readers.push_back(std::move(reader));
+		}
+
+		std::atomic<uint32_t> cancelled{ 0 };
+		std::vector<std::thread> threads;
+		for (Ref<IEventReader> &reader : readers)
+		{
+			threads.emplace_back([&reader, &cancelled] {
+				try
+				{
+					while (reader->next())
+						;
+				}
+				catch (const SystemException &e)
+				{
+					cancelled += e.getErrorCode() == Windows::ERROR_CANCELLED;
+				}
+			});
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		Stopwatch cancelTime;
+		token->cancel();
+		for (std::thread &thread : threads)
+			thread.join();
+		double cancelSeconds = cancelTime.seconds();
+
+		Stopwatch closeTime;
+		readers.clear();
+		double closeSeconds = closeTime.seconds();
+
+		char buf[160] = {};
+		snprintf(buf, sizeof(buf), "cancelled %u of %u readers: woken in %.3f ms, destroyed in %.3f ms", 
+			cancelled.load(), queries, cancelSeconds * 1000.0, closeSeconds * 1000.0);
+		std::cout << buf << nl;
+	}
+
+	// No token, queries destroyed with a fetch in progress. They stop the 
+	// fetch rather than wait it out. A worker each, so every fetch is.
+	{
+		std::shared_ptr<QueryExecutor> executor = std::make_shared<QueryExecutor>(queries);
+		std::vector<Ref<IEventLogQuery>> all;
+		for (uint32_t i = 0; i < queries; ++i)
+		{
+			Ref<IEventLogQuery> query = EventLogQuery::create(SyntheticRecordSource::create(options), executor);
+			query->queryChannelXPath("Synthetic", "*", Direction::Forward);
+			query->getNextBatchAsync(16, Windows::INFINITE, [](Ref<IQueryBatchResult>, std::exception_ptr) {});
+			all.push_back(std::move(query));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		Stopwatch closeTime;
+		all.clear();
+		double closeSeconds = closeTime.seconds();
+
+		char buf[160] = {};
+		snprintf(buf, sizeof(buf), "destroyed %u queries mid fetch in %.3f ms", queries, closeSeconds * 1000.0);
+		std::cout << buf << nl;
+	}
+}
+
+void EventLogBench::generateEvtx(const Options &opts)
+{
+	// Straight from the source, the output shouldn't depend on the reader.
+	Ref<SyntheticRecordSource> source = SyntheticRecordSource::create(syntheticOptions(opts));
+	source->queryChannelXPath("Synthetic", "*", Direction::Forward);
+	EvtxWriter writer(opts.get("file", std::string("synthetic.evtx")));
+
+	Stopwatch sw;
+	uint64_t records = 0;
+	for (;;)
+	{
+		Ref<IQueryBatchResult> batch = source->next(256, 0);
+		if (batch->getStatus() != QueryNextStatus::Success)
+			break;
+
+		for (uint32_t i = 0; i < batch->getCount(); ++i)
+		{
+			writer.write(toWriterRecord(batch->getRecord(i)));
+			++records;
+		}
+	}
+	writer.close();
+	report("evtxgen", records, sw.seconds());
+}
+
+void EventLogBench::run(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		usage();
+		return;
+	}
+
+	Options opts(argc, argv, 2);
+	if (strcmp("reader", argv[1]) == 0)
+	{
+		benchReader(opts);
+	}
+	else if (strcmp("batch", argv[1]) == 0)
+	{
+		benchBatchSize(opts);
+	}
+	else if (strcmp("prefetch", argv[1]) == 0)
+	{
+		benchPrefetch(opts);
+	}
+	else if (strcmp("render", argv[1]) == 0)
+	{
+		benchRender(opts);
+	}
+	else if (strcmp("queue", argv[1]) == 0)
+	{
+		benchQueues(opts);
+	}
+	else if (strcmp("projection", argv[1]) == 0)
+	{
+		benchProjection(opts);
+	}
+	else if (strcmp("accounts", argv[1]) == 0)
+	{
+		benchAccounts(opts);
+	}
+	else if (strcmp("message", argv[1]) == 0)
+	{
+		benchMessages(opts);
+	}
+	else if (strcmp("metacache", argv[1]) == 0)
+	{
+		benchMetadataCache(opts);
+	}
+	else if (strcmp("catalog", argv[1]) == 0)
+	{
+		benchCatalog(opts);
+	}
+	else if (strcmp("evtx", argv[1]) == 0)
+	{
+		benchEvtx(opts);
+	}
+	else if (strcmp("evtxgen", argv[1]) == 0)
+	{
+		generateEvtx(opts);
+	}
+	else if (strcmp("columns", argv[1]) == 0)
+	{
+		benchColumns(opts);
+	}
+	else if (strcmp("filter", argv[1]) == 0)
+	{
+		benchFilter(opts);
+	}
+	else if (strcmp("xpath", argv[1]) == 0)
+	{
+		benchXPath(opts);
+	}
+	else if (strcmp("querylist", argv[1]) == 0)
+	{
+		benchQueryList(opts);
+	}
+	else if (strcmp("subscribe", argv[1]) == 0)
+	{
+		benchSubscribe(opts);
+	}
+	else if (strcmp("bookmark", argv[1]) == 0)
+	{
+		benchBookmark(opts);
+	}
+	else if (strcmp("executor", argv[1]) == 0)
+	{
+		benchExecutor(opts);
+	}
+	else if (strcmp("calls", argv[1]) == 0)
+	{
+		benchCalls(opts);
+	}
+	else if (strcmp("async", argv[1]) == 0)
+	{
+		benchAsync(opts);
+	}
+#if defined(__cpp_impl_coroutine)
+	else if (strcmp("coroutine", argv[1]) == 0)
+	{
+		benchCoroutine(opts);
+	}
+#endif
+	else if (strcmp("cancel", argv[1]) == 0)
+	{
+		benchCancel(opts);
+	}
+	else
+	{
+		usage();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	try
+	{
+		EventLogBench bench;
+		bench.run(argc, argv);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Error: " << e.what() << nl;
+		return 1;
+	}
+
+	return 0;
+}
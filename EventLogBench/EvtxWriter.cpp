@@ -0,0 +1,570 @@
+#include "EvtxWriter.h"
+
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+#include "EvtxParser.h"
+#include "Exceptions.h"
+#include "SysPlatform.h"
+
+namespace Evtx = Windows::EventLog::Evtx;
+using Evtx::ValueType;
+
+// Substitution value of a record being written.
+struct EvtxWriterValue
+{
+	ValueType type;
+	std::vector<uint8_t> bytes;
+};
+
+static void put16(std::vector<uint8_t> &v, uint16_t x)
+{
+	v.push_back(uint8_t(x));
+	v.push_back(uint8_t(x >> 8));
+}
+
+static void put32(std::vector<uint8_t> &v, uint32_t x)
+{
+	put16(v, uint16_t(x));
+	put16(v, uint16_t(x >> 16));
+}
+
+static void put64(std::vector<uint8_t> &v, uint64_t x)
+{
+	put32(v, uint32_t(x));
+	put32(v, uint32_t(x >> 32));
+}
+
+// ASCII/Latin-1 only, which is all the generator produces.
+static std::vector<uint16_t> toUtf16(const std::string &s)
+{
+	std::vector<uint16_t> out;
+	out.reserve(s.size());
+	for (unsigned char c : s)
+		out.push_back(c);
+	return out;
+}
+
+static EvtxWriterValue stringValue(const std::string &s)
+{
+	EvtxWriterValue v{ ValueType::String, {} };
+	for (uint16_t c : toUtf16(s))
+		put16(v.bytes, c);
+	return v;
+}
+
+static EvtxWriterValue guidValue(const GUID &g)
+{
+	EvtxWriterValue v{ ValueType::Guid, {} };
+	put32(v.bytes, g.Data1);
+	put16(v.bytes, g.Data2);
+	put16(v.bytes, g.Data3);
+	v.bytes.insert(v.bytes.end(), g.Data4, g.Data4 + 8);
+	return v;
+}
+
+static EvtxWriterValue sidValue(const std::string &sid)
+{
+	EvtxWriterValue v{ ValueType::Sid, {} };
+
+	// S-R-A-S1-S2...
+	std::vector<uint64_t> parts;
+	size_t pos = 2;
+	while (pos < sid.size())
+	{
+		size_t end = sid.find('-', pos);
+		if (end == std::string::npos)
+			end = sid.size();
+		parts.push_back(std::stoull(sid.substr(pos, end - pos)));
+		pos = end + 1;
+	}
+	if (parts.size() < 2)
+		return EvtxWriterValue{ ValueType::Null, {} };
+
+	v.bytes.push_back(uint8_t(parts[0]));
+	v.bytes.push_back(uint8_t(parts.size() - 2));
+	for (int i = 5; i >= 0; --i)
+		v.bytes.push_back(uint8_t(parts[1] >> (i * 8)));
+	for (size_t i = 2; i < parts.size(); ++i)
+		put32(v.bytes, uint32_t(parts[i]));
+	return v;
+}
+
+template<typename T>
+static EvtxWriterValue intValue(ValueType type, T x)
+{
+	EvtxWriterValue v{ type, {} };
+	for (size_t i = 0; i < sizeof(T); ++i)
+		v.bytes.push_back(uint8_t(uint64_t(x) >> (i * 8)));
+	return v;
+}
+
+//
+// EvtxWriter::Chunk
+//
+
+// Builds one 64 KiB chunk in memory. 
+class EvtxWriter::Chunk
+{
+public:
+	Chunk()
+		: mData(Evtx::ChunkSize, 0)
+	{}
+
+	// Appends the record. Returns false, leaving the chunk unchanged, if 
+	// it doesn't fit.
+	bool append(const EvtxWriterRecord &rec);
+
+	bool empty() const { return mRecordCount == 0; }
+
+	// Fills in the header and checksums. 
+	const std::vector<uint8_t> &finish();
+
+private:
+	// Position independent output buffer. Offsets are chunk relative.
+	void u8(uint8_t x) { mOut.push_back(x); }
+	void u16(uint16_t x) { put16(mOut, x); }
+	void u32(uint32_t x) { put32(mOut, x); }
+	void u64(uint64_t x) { put64(mOut, x); }
+	uint32_t pos() const { return uint32_t(mBase + mOut.size()); }
+	void patch32(size_t at, uint32_t x)
+	{
+		for (int i = 0; i < 4; ++i)
+			mOut[at - mBase + size_t(i)] = uint8_t(x >> (i * 8));
+	}
+
+	void name(const std::string &s);
+	void openElement(const std::string &name, bool hasAttributes);
+	void attribute(const std::string &name);
+	void closeStart();
+	void closeEmpty();
+	void endElement();
+	void text(const std::string &s);
+	void substitution(uint16_t index, ValueType type, bool optional);
+
+	void simpleElement(const std::string &name, uint16_t index, ValueType type);
+	void templateBody(const EvtxWriterRecord &rec);
+
+	std::vector<uint8_t> mData;
+	size_t mPos = Evtx::ChunkHeaderSize;
+	size_t mLastRecord = 0;
+	uint64_t mFirstRecordId = 0;
+	uint64_t mLastRecordId = 0;
+	uint64_t mRecordCount = 0;
+
+	std::unordered_map<std::string, uint32_t> mNames{};
+	std::unordered_map<std::string, uint32_t> mTemplates{};
+
+	// Record being built and the names and templates it added.
+	std::vector<uint8_t> mOut{};
+	size_t mBase = 0;
+	std::vector<std::string> mNewNames{};
+
+	// Open element header positions: data size and attribute list size.
+	std::vector<std::pair<size_t, size_t>> mOpen{};
+};
+
+void EvtxWriter::Chunk::name(const std::string &s)
+{
+	auto it = mNames.find(s);
+	if (it != mNames.end())
+	{
+		u32(it->second);
+		return;
+	}
+
+	// Defined inline, right after the offset.
+	uint32_t offset = pos() + 4;
+	u32(offset);
+	mNames.emplace(s, offset);
+	mNewNames.push_back(s);
+
+	std::vector<uint16_t> chars = toUtf16(s);
+	uint16_t hash = 0;
+	for (uint16_t c : chars)
+		hash = uint16_t(hash * 65599u + c);
+
+	u32(0);
+	u16(hash);
+	u16(uint16_t(chars.size()));
+	for (uint16_t c : chars)
+		u16(c);
+	u16(0);
+}
+
+// token, dependency id, data size, name, [attribute list size]
+void EvtxWriter::Chunk::openElement(const std::string &elementName, bool hasAttributes)
+{
+	u8(hasAttributes ? 0x41 : 0x01);
+	u16(0xffff);
+	size_t dataSize = pos();
+	u32(0);
+	name(elementName);
+	size_t attrSize = 0;
+	if (hasAttributes)
+	{
+		attrSize = pos();
+		u32(0);
+	}
+	mOpen.push_back({ dataSize, attrSize });
+}
+
+void EvtxWriter::Chunk::attribute(const std::string &attrName)
+{
+	u8(0x06);
+	name(attrName);
+}
+
+void EvtxWriter::Chunk::closeStart()
+{
+	if (mOpen.back().second != 0)
+		patch32(mOpen.back().second, pos() - uint32_t(mOpen.back().second) - 4);
+	u8(0x02);
+}
+
+void EvtxWriter::Chunk::closeEmpty()
+{
+	if (mOpen.back().second != 0)
+		patch32(mOpen.back().second, pos() - uint32_t(mOpen.back().second) - 4);
+	u8(0x03);
+	patch32(mOpen.back().first, pos() - uint32_t(mOpen.back().first) - 4);
+	mOpen.pop_back();
+}
+
+void EvtxWriter::Chunk::endElement()
+{
+	u8(0x04);
+	patch32(mOpen.back().first, pos() - uint32_t(mOpen.back().first) - 4);
+	mOpen.pop_back();
+}
+
+void EvtxWriter::Chunk::text(const std::string &s)
+{
+	std::vector<uint16_t> chars = toUtf16(s);
+	u8(0x05);
+	u8(uint8_t(ValueType::String));
+	u16(uint16_t(chars.size()));
+	for (uint16_t c : chars)
+		u16(c);
+}
+
+void EvtxWriter::Chunk::substitution(uint16_t index, ValueType type, bool optional)
+{
+	u8(optional ? 0x0e : 0x0d);
+	u16(index);
+	u8(uint8_t(type));
+}
+
+void EvtxWriter::Chunk::simpleElement(const std::string &elementName, uint16_t index, ValueType type)
+{
+	openElement(elementName, false);
+	closeStart();
+	substitution(index, type, false);
+	endElement();
+}
+
+// Substitution indexes. EventData values follow.
+enum : uint16_t
+{
+	SubProviderName, SubProviderGuid, SubQualifiers, SubEventId, SubVersion, SubLevel, SubTask, 
+	SubOpcode, SubKeywords, SubTimeCreated, SubRecordId, SubActivityId, SubProcessId, SubThreadId, 
+	SubChannel, SubComputer, SubUserId, SubData
+};
+
+void EvtxWriter::Chunk::templateBody(const EvtxWriterRecord &rec)
+{
+	// Fragment header
+	u8(0x0f);
+	u8(1);
+	u8(1);
+	u8(0);
+
+	openElement("Event", true);
+	attribute("xmlns");
+	text("http://schemas.microsoft.com/win/2004/08/events/event");
+	closeStart();
+
+	openElement("System", false);
+	closeStart();
+
+	openElement("Provider", true);
+	attribute("Name");
+	substitution(SubProviderName, ValueType::String, true);
+	attribute("Guid");
+	substitution(SubProviderGuid, ValueType::Guid, true);
+	closeEmpty();
+
+	openElement("EventID", true);
+	attribute("Qualifiers");
+	substitution(SubQualifiers, ValueType::UInt16, true);
+	closeStart();
+	substitution(SubEventId, ValueType::UInt16, false);
+	endElement();
+
+	simpleElement("Version", SubVersion, ValueType::UInt8);
+	simpleElement("Level", SubLevel, ValueType::UInt8);
+	simpleElement("Task", SubTask, ValueType::UInt16);
+	simpleElement("Opcode", SubOpcode, ValueType::UInt8);
+	simpleElement("Keywords", SubKeywords, ValueType::HexInt64);
+
+	openElement("TimeCreated", true);
+	attribute("SystemTime");
+	substitution(SubTimeCreated, ValueType::FileTime, true);
+	closeEmpty();
+
+	simpleElement("EventRecordID", SubRecordId, ValueType::UInt64);
+
+	openElement("Correlation", true);
+	attribute("ActivityID");
+	substitution(SubActivityId, ValueType::Guid, true);
+	closeEmpty();
+
+	openElement("Execution", true);
+	attribute("ProcessID");
+	substitution(SubProcessId, ValueType::UInt32, true);
+	attribute("ThreadID");
+	substitution(SubThreadId, ValueType::UInt32, true);
+	closeEmpty();
+
+	simpleElement("Channel", SubChannel, ValueType::String);
+	simpleElement("Computer", SubComputer, ValueType::String);
+
+	openElement("Security", true);
+	attribute("UserID");
+	substitution(SubUserId, ValueType::Sid, true);
+	closeEmpty();
+
+	endElement(); // System
+
+	if (!rec.data.empty())
+	{
+		openElement("EventData", false);
+		closeStart();
+		for (size_t i = 0; i < rec.data.size(); ++i)
+		{
+			openElement("Data", true);
+			attribute("Name");
+			text(rec.data[i].first);
+			closeStart();
+			substitution(uint16_t(SubData + i), ValueType::String, true);
+			endElement();
+		}
+		endElement();
+	}
+
+	endElement(); // Event
+
+	u8(0x00); // End of stream
+}
+
+bool EvtxWriter::Chunk::append(const EvtxWriterRecord &rec)
+{
+	mOut.clear();
+	mNewNames.clear();
+	mBase = mPos;
+
+	std::vector<EvtxWriterValue> values;
+	values.push_back(stringValue(rec.providerName));
+	values.push_back(guidValue(rec.providerGuid));
+	values.push_back(intValue(ValueType::UInt16, rec.qualifiers));
+	values.push_back(intValue(ValueType::UInt16, rec.eventId));
+	values.push_back(intValue(ValueType::UInt8, rec.version));
+	values.push_back(intValue(ValueType::UInt8, rec.level));
+	values.push_back(intValue(ValueType::UInt16, rec.task));
+	values.push_back(intValue(ValueType::UInt8, rec.opcode));
+	values.push_back(intValue(ValueType::HexInt64, rec.keywords));
+	values.push_back(intValue(ValueType::FileTime, rec.timeCreated));
+	values.push_back(intValue(ValueType::UInt64, rec.recordId));
+	values.push_back(rec.activityId ? guidValue(*rec.activityId) : EvtxWriterValue{ ValueType::Null, {} });
+	values.push_back(intValue(ValueType::UInt32, rec.processId));
+	values.push_back(intValue(ValueType::UInt32, rec.threadId));
+	values.push_back(stringValue(rec.channel));
+	values.push_back(stringValue(rec.computer));
+	values.push_back(rec.userSid ? sidValue(*rec.userSid) : EvtxWriterValue{ ValueType::Null, {} });
+	for (const auto &data : rec.data)
+		values.push_back(stringValue(data.second));
+
+	// Header: signature, size, record id, written time.
+	u32(0x00002a2a);
+	u32(0);
+	u64(rec.recordId);
+	u64(rec.timeCreated);
+
+	// Fragment header and template instance.
+	u8(0x0f);
+	u8(1);
+	u8(1);
+	u8(0);
+
+	std::string key = rec.providerName + '/' + std::to_string(rec.eventId) + '/' + std::to_string(rec.version)
+		+ '/' + std::to_string(rec.data.size());
+	for (const auto &data : rec.data)
+		key.append("/").append(data.first);
+
+	u8(0x0c);
+	u8(0x01);
+	u32(uint32_t(std::hash<std::string>{}(key)));
+
+	bool newTemplate = false;
+	auto it = mTemplates.find(key);
+	if (it != mTemplates.end())
+	{
+		u32(it->second);
+	}
+	else
+	{
+		// Defined inline: next template, GUID, size, body.
+		newTemplate = true;
+		uint32_t offset = pos() + 4;
+		u32(offset);
+		u32(0);
+		uint64_t h = std::hash<std::string>{}(key);
+		u64(h);
+		u64(~h);
+		size_t dataSize = pos();
+		u32(0);
+		templateBody(rec);
+		patch32(dataSize, pos() - uint32_t(dataSize) - 4);
+		mTemplates.emplace(key, offset);
+	}
+
+	u32(uint32_t(values.size()));
+	for (const EvtxWriterValue &v : values)
+	{
+		u16(uint16_t(v.bytes.size()));
+		u8(uint8_t(v.type));
+		u8(0);
+	}
+	for (const EvtxWriterValue &v : values)
+		mOut.insert(mOut.end(), v.bytes.begin(), v.bytes.end());
+
+	u8(0x00); // End of stream
+
+	uint32_t size = uint32_t(mOut.size() + 4);
+	u32(size);
+	patch32(mBase + 4, size);
+
+	if (mPos + mOut.size() > Evtx::ChunkSize)
+	{
+		for (const std::string &s : mNewNames)
+			mNames.erase(s);
+		if (newTemplate)
+			mTemplates.erase(key);
+		return false;
+	}
+
+	std::memcpy(mData.data() + mPos, mOut.data(), mOut.size());
+	mLastRecord = mPos;
+	mPos += mOut.size();
+
+	if (mRecordCount == 0)
+		mFirstRecordId = rec.recordId;
+	mLastRecordId = rec.recordId;
+	++mRecordCount;
+	return true;
+}
+
+const std::vector<uint8_t> &EvtxWriter::Chunk::finish()
+{
+	uint8_t *p = mData.data();
+	std::vector<uint8_t> h;
+	h.insert(h.end(), { 'E', 'l', 'f', 'C', 'h', 'n', 'k', 0 });
+	put64(h, mFirstRecordId);
+	put64(h, mLastRecordId);
+	put64(h, mFirstRecordId);
+	put64(h, mLastRecordId);
+	put32(h, 128);
+	put32(h, uint32_t(mLastRecord));
+	put32(h, uint32_t(mPos));
+	put32(h, Evtx::crc32(p + Evtx::ChunkHeaderSize, mPos - Evtx::ChunkHeaderSize));
+	std::memcpy(p, h.data(), h.size());
+
+	// Header checksum covers the first 120 bytes and the string and 
+	// template tables.
+	uint32_t crc = Evtx::crc32(p, 120);
+	crc = Evtx::crc32(p + 128, Evtx::ChunkHeaderSize - 128, crc);
+	h.clear();
+	put32(h, crc);
+	std::memcpy(p + 124, h.data(), 4);
+
+	return mData;
+}
+
+//
+// EvtxWriter
+//
+
+EvtxWriter::EvtxWriter(const std::string &filePath)
+	: mFile(filePath, std::ios::binary | std::ios::trunc)
+	, mChunk(std::make_unique<Chunk>())
+{
+	if (!mFile)
+	{
+		THROW_(Windows::SystemException, Windows::ERROR_FILE_NOT_FOUND);
+	}
+
+	// Placeholder until close().
+	std::vector<uint8_t> header(Evtx::FileHeaderSize, 0);
+	mFile.write(reinterpret_cast<const char *>(header.data()), std::streamsize(header.size()));
+}
+
+EvtxWriter::~EvtxWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (...)
+	{
+	}
+}
+
+void EvtxWriter::write(const EvtxWriterRecord &rec)
+{
+	if (!mChunk->append(rec))
+	{
+		flushChunk();
+		if (!mChunk->append(rec))
+		{
+			THROW_(Windows::SystemException, Windows::ERROR_INSUFFICIENT_BUFFER);
+		}
+	}
+	mNextRecordId = rec.recordId + 1;
+}
+
+void EvtxWriter::flushChunk()
+{
+	const std::vector<uint8_t> &data = mChunk->finish();
+	mFile.write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+	++mChunkCount;
+	mChunk = std::make_unique<Chunk>();
+}
+
+void EvtxWriter::close()
+{
+	if (mClosed)
+		return;
+	mClosed = true;
+
+	if (!mChunk->empty())
+		flushChunk();
+
+	std::vector<uint8_t> h;
+	h.insert(h.end(), { 'E', 'l', 'f', 'F', 'i', 'l', 'e', 0 });
+	put64(h, 0);
+	put64(h, mChunkCount > 0 ? mChunkCount - 1 : 0);
+	put64(h, mNextRecordId);
+	put32(h, 128);
+	put16(h, 1);
+	put16(h, 3);
+	put16(h, uint16_t(Evtx::FileHeaderSize));
+	put16(h, uint16_t(mChunkCount));
+	h.resize(120, 0);
+	put32(h, 0); // flags
+	put32(h, Evtx::crc32(h.data(), 120));
+
+	mFile.seekp(0);
+	mFile.write(reinterpret_cast<const char *>(h.data()), std::streamsize(h.size()));
+	mFile.close();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CommonTypes.h"
+
+// Values of a record to write. 
+struct EvtxWriterRecord
+{
+	std::string providerName{};
+	GUID providerGuid{};
+	uint16_t eventId = 0;
+	uint16_t qualifiers = 0;
+	uint8_t version = 0;
+	uint8_t level = 0;
+	uint16_t task = 0;
+	uint8_t opcode = 0;
+	uint64_t keywords = 0;
+	uint64_t timeCreated = 0;
+	uint64_t recordId = 0;
+	std::optional<GUID> activityId{};
+	uint32_t processId = 0;
+	uint32_t threadId = 0;
+	std::string channel{};
+	std::string computer{};
+	std::optional<std::string> userSid{};
+
+	// EventData/Data elements, as name/value.
+	std::vector<std::pair<std::string, std::string>> data{};
+};
+
+// Writes records to an EVTX file laid out the way the Event Log service 
+// does: one template per event shape, defined inline on first use in each 
+// chunk, System and EventData values as substitutions. Gives the benchmarks 
+// real files to parse without needing a Windows machine to export them.
+class EvtxWriter
+{
+public:
+	explicit EvtxWriter(const std::string &filePath);
+	~EvtxWriter();
+
+	void write(const EvtxWriterRecord &rec);
+
+	// Flushes the last chunk and writes the file header.
+	void close();
+
+private:
+	class Chunk;
+
+	void flushChunk();
+
+	std::ofstream mFile;
+	std::unique_ptr<Chunk> mChunk;
+	uint64_t mChunkCount = 0;
+	uint64_t mNextRecordId = 1;
+	bool mClosed = false;
+
+	EvtxWriter(const EvtxWriter &) = delete;
+	EvtxWriter &operator=(const EvtxWriter &) = delete;
+};
@@ -4,6 +4,8 @@
 #include <string>
 #include <cstdio>
 #include <iostream>
+#include <type_traits>
+#include <variant>
 
 #include "IChannelPathEnumerator.h"
 #include "IChannelConfig.h"
@@ -62,6 +64,22 @@ static std::string to_string(const std::vector<std::string> &v)
 	return result;
 }
 
+static std::string to_string(const Windows::EventLog::EventPropertyValue &value)
+{
+	return std::visit([](const auto &v) -> std::string {
+		using T = std::decay_t<decltype(v)>;
+		using std::to_string;
+		using Windows::to_string;
+		if constexpr (std::is_same_v<T, std::string>)
+			return v;
+		else if constexpr (std::is_same_v<T, bool>)
+			return v ? "true" : "false";
+		else if constexpr (std::is_same_v<T, std::vector<uint8_t>> || std::is_same_v<T, std::monostate>)
+			return {};
+		else
+			return to_string(v);
+	}, value);
+}
 
 static 
 std::string to_hex_string(uint16_t n)
@@ -189,6 +207,12 @@ static void printEventRecord(const IEventRecord &rec)
 		<< "Publisher Message: " << to_string(rec.getProviderMessage()) << nl
 		<< "Message: " << nl << rec.getMessage() << nl;
 		;
+
+	std::cout << "Properties: " << nl;
+	for (const Windows::EventLog::EventProperty &property : rec.getProperties())
+	{
+		std::cout << tab << property.name << ": " << to_string(property.value) << nl;
+	}
 }
 
 static void print(IEventReader &reader)